@@ -0,0 +1,578 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tsp_io.h"
+
+#include "try_macros.h"
+#include "vtsp.h"
+#include "vtsp_bindings.h"
+
+#define DEFAULT_DIR "problems"
+#define DEFAULT_OUTPUT "bench_output.csv"
+#define DEFAULT_TRIALS 5
+#define MAX_PROBLEMS 1024
+#define MAX_FILENAME 4096
+
+enum {
+	PHASE_SOLVE,
+	PHASE_VALIDATE,
+	PHASE_ORDER,
+	PHASE_ENVELOPE,
+	PHASE_MESH,
+	PHASE_HEAT,
+	PHASE_INSERT,
+	PHASE_IMPROVE,
+	N_PHASES
+};
+
+static const char *PHASE_NAMES[N_PHASES] = {
+	"solve", "validate", "order", "envelope", "mesh", "heat", "insert",
+	"improve"
+};
+
+typedef struct {
+	const char *dir;
+	const char *output;      /* CSV, or JSON if it ends with .json */
+	uint32_t n_trials;
+	uint32_t n_threads;
+	bool improve;            /* Run the local search after insertion */
+	bool cache;              /* Edge-cost cache in front of the walk */
+	uint32_t cache_entries;
+	bool order;              /* Renumber points along a Hilbert curve */
+	bool delaunay;           /* Built-in mesher instead of dms */
+	float accuracy;          /* Refinement of the dms mesh, 0 for none */
+	bool incremental;        /* Heat follows the path during insertion */
+} bench_args_t;
+
+/* Tracer binding collecting the span durations of every trial */
+typedef struct {
+	uint32_t trial;
+	double begin_ms[N_PHASES];
+	double *time_ms[N_PHASES];
+} bench_tracer_t;
+
+typedef struct {
+	char name[256];
+	int status;
+	uint32_t num;
+	uint32_t n_trials;
+	size_t opmem;            /* op_mem vtsp_solve_sizeof_opmem asks for,
+				    not the peak the solve touched */
+	double median_ms[N_PHASES];
+	double p95_ms[N_PHASES];
+	double pts_per_s;
+	double length;
+	double optimal;          /* Zero without .opt.tour */
+	double gap;
+	double hit_rate;         /* Cache hits over lookups, -c only */
+	uint32_t n_solves;       /* Global heat solves of the last trial */
+} bench_result_t;
+
+static int parse_args(int argc, const char *argv[], bench_args_t *args);
+static int list_problems(const char *dir, char **names, uint32_t *n_names);
+static int compare_names(const void *a, const void *b);
+static int run_problem(const bench_args_t *args, const char *name,
+		       vtsp_logger_t *logger, bench_result_t *result);
+static int run_trials(const bench_args_t *args, const vtsp_points_t *input,
+		      vtsp_logger_t *logger, vtsp_perm_t *output,
+		      bench_tracer_t *tracer, bench_result_t *result);
+static int score_tour(const char *dir, const char *name,
+		      const vtsp_points_t *input, const vtsp_perm_t *output,
+		      bench_result_t *result);
+static int load_optimal(const char *filename, const vtsp_points_t *input,
+			const vtsp_perm_t *output, bench_result_t *result,
+			void *validate_mem);
+static void compute_stats(bench_tracer_t *tracer, bench_result_t *result);
+static double percentile(const double *sorted, uint32_t n, double p);
+static int compare_doubles(const void *a, const void *b);
+static int trace_begin(void *ctx, const char *span);
+static int trace_end(void *ctx, const char *span, uint32_t n_items);
+static int find_phase(const char *span);
+static double now_ms(void);
+static int write_csv(FILE *fp, const bench_result_t *results, uint32_t num);
+static int write_json(FILE *fp, const bench_result_t *results, uint32_t num);
+static bool ends_with(const char *str, const char *suffix);
+
+/*
+ * Usage: vtsp_bench [-t trials] [-j threads] [-o out.csv|out.json] [-n]
+ *                   [-c entries] [-s] [-m] [-r accuracy] [-i] [dir]
+ * Solves every dir/NAME.tsp (default problems/) and compares the
+ * tour against dir/NAME.opt.tour when it exists. Results go to
+ * bench_output.csv unless -o is given, -n skips the tour improver,
+ * -c caches edge costs (0 entries sizes the cache by the mesh) and
+ * -s sorts the points along a Hilbert curve before solving, -m
+ * meshes with the built-in Delaunay mesher, -r refines the dms mesh
+ * and -i updates the heat field incrementally during insertion.
+ */
+int main(int argc, const char* argv[])
+{
+	bench_args_t args;
+	TRY( parse_args(argc, argv, &args) );
+
+	char *names[MAX_PROBLEMS];
+	uint32_t n_problems;
+	TRY( list_problems(args.dir, names, &n_problems) );
+
+	bench_result_t *results;
+	TRY_PTR( malloc(n_problems * sizeof(*results) + 1), results,
+		 ERROR_MALLOC );
+
+	vtsp_logger_t logger;
+	TRY_GOTO( vtsp_logger_init(&logger, STDERR_FILENO, 0), ERROR_LOGGER );
+
+	uint32_t i;
+	for (i = 0; i < n_problems; i++) {
+		bench_result_t *r = &(results[i]);
+		run_problem(&args, names[i], &logger, r);
+		fprintf(stderr, "%-16s %8u pts %10.2f ms %12.0f pts/s "
+			"gap %6.2f%% solves %4u ", r->name, r->num,
+			r->median_ms[PHASE_SOLVE], r->pts_per_s, r->gap,
+			r->n_solves);
+		if (args.cache) {
+			fprintf(stderr, "hits %5.1f%% ", 100.0 * r->hit_rate);
+		}
+		fprintf(stderr, "%s\n", r->status == SUCCESS ? "" : "FAILED");
+	}
+	vtsp_logger_finish(&logger);
+
+	FILE *fp;
+	TRY_PTR( fopen(args.output, "w"), fp, ERROR_OUTPUT );
+	int status;
+	if (ends_with(args.output, ".json")) {
+		status = write_json(fp, results, n_problems);
+	} else {
+		status = write_csv(fp, results, n_problems);
+	}
+	fclose(fp);
+
+	for (i = 0; i < n_problems; i++) {
+		free(names[i]);
+	}
+	free(results);
+	return status;
+ERROR_OUTPUT:
+ERROR_LOGGER:
+	free(results);
+ERROR_MALLOC:
+	for (i = 0; i < n_problems; i++) {
+		free(names[i]);
+	}
+	fprintf(stderr, "Error running benchmark\n");
+	return ERROR;
+}
+
+static int parse_args(int argc, const char *argv[], bench_args_t *args)
+{
+	args->dir = DEFAULT_DIR;
+	args->output = DEFAULT_OUTPUT;
+	args->n_trials = DEFAULT_TRIALS;
+	args->n_threads = 0; /* All cores */
+	args->improve = true;
+	args->cache = false;
+	args->cache_entries = 0;
+	args->order = false;
+	args->delaunay = false;
+	args->accuracy = 0;
+	args->incremental = false;
+
+	int i;
+	for (i = 1; i < argc; i++) {
+		bool has_value = (i + 1 < argc);
+		if (strcmp(argv[i], "-t") == 0 && has_value) {
+			args->n_trials = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-j") == 0 && has_value) {
+			args->n_threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-o") == 0 && has_value) {
+			args->output = argv[++i];
+		} else if (strcmp(argv[i], "-n") == 0) {
+			args->improve = false;
+		} else if (strcmp(argv[i], "-c") == 0 && has_value) {
+			args->cache = true;
+			args->cache_entries = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-s") == 0) {
+			args->order = true;
+		} else if (strcmp(argv[i], "-m") == 0) {
+			args->delaunay = true;
+		} else if (strcmp(argv[i], "-r") == 0 && has_value) {
+			args->accuracy = atof(argv[++i]);
+		} else if (strcmp(argv[i], "-i") == 0) {
+			args->incremental = true;
+		} else if (argv[i][0] != '-') {
+			args->dir = argv[i];
+		} else {
+			fprintf(stderr, "Usage: %s [-t trials] [-j threads] "
+				"[-o out.csv|out.json] [-n] [-c entries] [-s] "
+				"[-m] [-r accuracy] [-i] [dir]\n",
+				argv[0]);
+			return ERROR;
+		}
+	}
+	THROW( args->n_trials == 0, ERROR );
+	return SUCCESS;
+}
+
+static int list_problems(const char *dir, char **names, uint32_t *n_names)
+{
+	DIR *dp;
+	TRY_PTR( opendir(dir), dp, ERROR_OPEN );
+
+	*n_names = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dp)) != NULL && *n_names < MAX_PROBLEMS) {
+		size_t len = strlen(entry->d_name);
+		if (len > 4 && ends_with(entry->d_name, ".tsp")) {
+			char *name;
+			TRY_PTR( malloc(len - 3), name, ERROR_MALLOC );
+			memcpy(name, entry->d_name, len - 4);
+			name[len - 4] = 0;
+			names[(*n_names)++] = name;
+		}
+	}
+	closedir(dp);
+
+	qsort(names, *n_names, sizeof(*names), compare_names);
+	return SUCCESS;
+ERROR_MALLOC:
+	closedir(dp);
+	while (*n_names > 0) {
+		free(names[--(*n_names)]);
+	}
+	return ERROR;
+ERROR_OPEN:
+	fprintf(stderr, "Error opening %s\n", dir);
+	return ERROR;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+	return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+static int run_problem(const bench_args_t *args, const char *name,
+		       vtsp_logger_t *logger, bench_result_t *result)
+{
+	memset(result, 0, sizeof(*result));
+	snprintf(result->name, sizeof(result->name), "%s", name);
+	result->status = ERROR;
+
+	char filename[MAX_FILENAME];
+	snprintf(filename, MAX_FILENAME, "%s/%s.tsp", args->dir, name);
+	vtsp_points_t input;
+	TRY( vtsp_load_problem(filename, &input) );
+	result->num = input.num;
+
+	vtsp_perm_t output;
+	output.num = 0;
+	output.n_alloc = input.num;
+	TRY_PTR( malloc(input.num * sizeof(*(output.index))), output.index,
+		 ERROR_OUTPUT );
+
+	bench_tracer_t tracer;
+	uint32_t i;
+	for (i = 0; i < N_PHASES; i++) {
+		tracer.time_ms[i] = NULL;
+	}
+	for (i = 0; i < N_PHASES; i++) {
+		TRY_PTR( calloc(args->n_trials, sizeof(double)),
+			 tracer.time_ms[i], ERROR_TRACER );
+	}
+
+	TRY_GOTO( run_trials(args, &input, logger, &output, &tracer, result),
+		  ERROR_TRACER );
+	compute_stats(&tracer, result);
+
+	TRY_GOTO( score_tour(args->dir, name, &input, &output, result),
+		  ERROR_TRACER );
+	result->status = SUCCESS;
+
+ERROR_TRACER:
+	for (i = 0; i < N_PHASES; i++) {
+		free(tracer.time_ms[i]);
+	}
+	free(output.index);
+ERROR_OUTPUT:
+	free(input.pts);
+	return result->status;
+}
+
+static int run_trials(const bench_args_t *args, const vtsp_points_t *input,
+		      vtsp_logger_t *logger, vtsp_perm_t *output,
+		      bench_tracer_t *tracer, bench_result_t *result)
+{
+	vtsp_envelope_ctx_t envelope;
+	envelope.n_threads = args->n_threads;
+	vtsp_heat_ctx_t heat;
+	memset(&heat, 0, sizeof(heat));
+	vtsp_integral_ctx_t integral;
+	integral.n_threads = args->n_threads;
+	vtsp_binding_integral_t walk;
+	vtsp_cache_ctx_t cache;
+	cache.integral = &walk;
+	cache.n_entries = args->cache_entries;
+	heat.n_threads = args->n_threads;
+	heat.precond = VTSP_HEAT_IC0;
+	vtsp_improve_ctx_t improve;
+	improve.max_moves = 0;
+	improve.max_millis = 0;
+	vtsp_hilbert_ctx_t hilbert;
+	hilbert.n_threads = args->n_threads;
+	vtsp_delaunay_ctx_t delaunay;
+	delaunay.n_threads = args->n_threads;
+	vtsp_dms_ctx_t dms;
+	dms.accuracy = args->accuracy;
+
+	vtsp_depend_t depend;
+	memset(&depend, 0, sizeof(depend));
+	TRY( vtsp_bind_logger(&(depend.logger), logger, VTSP_LOG_ERROR) );
+	if (args->order) {
+		TRY( vtsp_bind_hilbert(&(depend.orderer), &hilbert) );
+	}
+	TRY( vtsp_bind_envelope(&(depend.envelope), &envelope) );
+	if (args->delaunay) {
+		TRY( vtsp_bind_delaunay(&(depend.mesher), &delaunay) );
+	} else {
+		TRY( vtsp_bind_dms_mesher(&(depend.mesher), &dms) );
+	}
+	heat.mesher = &(depend.mesher);
+	if (args->incremental) {
+		TRY( vtsp_bind_heat_incremental(&(depend.heat), &heat) );
+	} else {
+		TRY( vtsp_bind_heat(&(depend.heat), &heat) );
+	}
+	if (args->cache) {
+		TRY( vtsp_bind_integral(&walk, &integral) );
+		TRY( vtsp_bind_cache(&(depend.integral), &cache) );
+	} else {
+		TRY( vtsp_bind_integral(&(depend.integral), &integral) );
+	}
+	if (args->improve) {
+		TRY( vtsp_bind_improver(&(depend.improver), &improve) );
+	}
+	depend.tracer.ctx = tracer;
+	depend.tracer.begin = trace_begin;
+	depend.tracer.end = trace_end;
+
+	TRY( vtsp_solve_sizeof_opmem(input, &depend, &(result->opmem)) );
+	void *opmem;
+	TRY_PTR( malloc(result->opmem), opmem, ERROR_MALLOC );
+
+	for (tracer->trial = 0; tracer->trial < args->n_trials;
+	     tracer->trial++) {
+		TRY_GOTO( vtsp_solve(input, output, &depend, opmem), ERROR );
+	}
+	result->n_trials = args->n_trials;
+	result->n_solves = heat.n_solves;
+	if (args->cache && cache.n_hits + cache.n_misses > 0) {
+		result->hit_rate = (double) cache.n_hits /
+			(double) (cache.n_hits + cache.n_misses);
+	}
+	free(opmem);
+	return SUCCESS;
+ERROR:
+	free(opmem);
+ERROR_MALLOC:
+	return ERROR;
+}
+
+static int score_tour(const char *dir, const char *name,
+		      const vtsp_points_t *input, const vtsp_perm_t *output,
+		      bench_result_t *result)
+{
+	size_t size;
+	TRY( vtsp_tour_validate_sizeof_opmem(input->num, &size) );
+	void *validate_mem;
+	TRY_PTR( malloc(size), validate_mem, ERROR_MALLOC );
+
+	TRY_GOTO( vtsp_tour_validate(output, input->num, validate_mem), ERROR );
+	TRY_GOTO( vtsp_tour_length(input, output, &(result->length)), ERROR );
+
+	char filename[MAX_FILENAME];
+	snprintf(filename, MAX_FILENAME, "%s/%s.opt.tour", dir, name);
+	if (access(filename, R_OK) == 0) {
+		TRY_GOTO( load_optimal(filename, input, output, result,
+				       validate_mem), ERROR );
+	}
+	free(validate_mem);
+	return SUCCESS;
+ERROR:
+	free(validate_mem);
+ERROR_MALLOC:
+	return ERROR;
+}
+
+static int load_optimal(const char *filename, const vtsp_points_t *input,
+			const vtsp_perm_t *output, bench_result_t *result,
+			void *validate_mem)
+{
+	vtsp_perm_t tour;
+	tour.n_alloc = input->num;
+	TRY_PTR( malloc(input->num * sizeof(*(tour.index))), tour.index,
+		 ERROR_MALLOC );
+	TRY_GOTO( vtsp_read_tour(filename, &tour), ERROR );
+	TRY_GOTO( vtsp_tour_validate(&tour, input->num, validate_mem), ERROR );
+	TRY_GOTO( vtsp_tour_length(input, &tour, &(result->optimal)), ERROR );
+	TRY_GOTO( vtsp_tour_gap(input, output, &tour, &(result->gap)), ERROR );
+	free(tour.index);
+	return SUCCESS;
+ERROR:
+	free(tour.index);
+ERROR_MALLOC:
+	return ERROR;
+}
+
+static void compute_stats(bench_tracer_t *tracer, bench_result_t *result)
+{
+	uint32_t n = result->n_trials;
+	uint32_t i;
+	for (i = 0; i < N_PHASES; i++) {
+		qsort(tracer->time_ms[i], n, sizeof(double), compare_doubles);
+		result->median_ms[i] = percentile(tracer->time_ms[i], n, 0.5);
+		result->p95_ms[i] = percentile(tracer->time_ms[i], n, 0.95);
+	}
+	double solve_s = result->median_ms[PHASE_SOLVE] * 1e-3;
+	result->pts_per_s = solve_s > 0 ? result->num / solve_s : 0;
+}
+
+static double percentile(const double *sorted, uint32_t n, double p)
+{
+	/* Nearest rank */
+	uint32_t rank = (uint32_t) ceil(p * n);
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+static int trace_begin(void *ctx, const char *span)
+{
+	bench_tracer_t *tracer = ctx;
+	int phase = find_phase(span);
+	if (phase >= 0) {
+		tracer->begin_ms[phase] = now_ms();
+	}
+	return SUCCESS;
+}
+
+static int trace_end(void *ctx, const char *span, uint32_t n_items)
+{
+	bench_tracer_t *tracer = ctx;
+	int phase = find_phase(span);
+	if (phase >= 0) {
+		tracer->time_ms[phase][tracer->trial] =
+			now_ms() - tracer->begin_ms[phase];
+	}
+	return SUCCESS;
+}
+
+static int find_phase(const char *span)
+{
+	int i;
+	for (i = 0; i < N_PHASES; i++) {
+		if (strcmp(span, PHASE_NAMES[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+static int write_csv(FILE *fp, const bench_result_t *results, uint32_t num)
+{
+	TRY_NONEG( fprintf(fp, "problem,points,status,trials,"
+			   "opmem_requested_bytes,heat_solves,points_per_s,"
+			   "length,optimal,gap_pct"), ERROR );
+	uint32_t i, j;
+	for (j = 0; j < N_PHASES; j++) {
+		TRY_NONEG( fprintf(fp, ",%s_median_ms,%s_p95_ms",
+				   PHASE_NAMES[j], PHASE_NAMES[j]), ERROR );
+	}
+	TRY_NONEG( fprintf(fp, "\n"), ERROR );
+
+	for (i = 0; i < num; i++) {
+		const bench_result_t *r = &(results[i]);
+		TRY_NONEG( fprintf(fp, "%s,%u,%s,%u,%zu,%u,%.1f,%.0f,", r->name,
+				   r->num, r->status == SUCCESS ? "ok" : "failed",
+				   r->n_trials, r->opmem, r->n_solves,
+				   r->pts_per_s, r->length), ERROR );
+		if (r->optimal > 0) {
+			TRY_NONEG( fprintf(fp, "%.0f,%.4f", r->optimal, r->gap),
+				   ERROR );
+		} else {
+			TRY_NONEG( fprintf(fp, ","), ERROR );
+		}
+		for (j = 0; j < N_PHASES; j++) {
+			TRY_NONEG( fprintf(fp, ",%.4f,%.4f", r->median_ms[j],
+					   r->p95_ms[j]), ERROR );
+		}
+		TRY_NONEG( fprintf(fp, "\n"), ERROR );
+	}
+	return SUCCESS;
+ERROR:
+	return ERROR;
+}
+
+static int write_json(FILE *fp, const bench_result_t *results, uint32_t num)
+{
+	TRY_NONEG( fprintf(fp, "[\n"), ERROR );
+	uint32_t i, j;
+	for (i = 0; i < num; i++) {
+		const bench_result_t *r = &(results[i]);
+		TRY_NONEG( fprintf(fp, "  {\"problem\": \"%s\", \"points\": %u, "
+				   "\"status\": \"%s\", \"trials\": %u, "
+				   "\"opmem_requested_bytes\": %zu, "
+				   "\"heat_solves\": %u, "
+				   "\"points_per_s\": %.1f, \"length\": %.0f, ",
+				   r->name, r->num,
+				   r->status == SUCCESS ? "ok" : "failed",
+				   r->n_trials, r->opmem, r->n_solves,
+				   r->pts_per_s, r->length), ERROR );
+		if (r->optimal > 0) {
+			TRY_NONEG( fprintf(fp, "\"optimal\": %.0f, "
+					   "\"gap_pct\": %.4f, ",
+					   r->optimal, r->gap), ERROR );
+		} else {
+			TRY_NONEG( fprintf(fp, "\"optimal\": null, "
+					   "\"gap_pct\": null, "), ERROR );
+		}
+		TRY_NONEG( fprintf(fp, "\"phases\": {"), ERROR );
+		for (j = 0; j < N_PHASES; j++) {
+			TRY_NONEG( fprintf(fp, "%s\"%s\": {\"median_ms\": %.4f, "
+					   "\"p95_ms\": %.4f}",
+					   j > 0 ? ", " : "", PHASE_NAMES[j],
+					   r->median_ms[j], r->p95_ms[j]), ERROR );
+		}
+		TRY_NONEG( fprintf(fp, "}}%s\n", i + 1 < num ? "," : ""),
+			   ERROR );
+	}
+	TRY_NONEG( fprintf(fp, "]\n"), ERROR );
+	return SUCCESS;
+ERROR:
+	return ERROR;
+}
+
+static bool ends_with(const char *str, const char *suffix)
+{
+	size_t len = strlen(str);
+	size_t suffix_len = strlen(suffix);
+	return len >= suffix_len &&
+		strcmp(str + len - suffix_len, suffix) == 0;
+}
@@ -5,9 +5,27 @@
 
 #include "vtsp_types.h"
 #include "vtsp_depend.h"
+#include "vtsp_cache.h"
+#include "vtsp_delaunay.h"
+#include "vtsp_envelope.h"
+#include "vtsp_heat.h"
+#include "vtsp_hilbert.h"
+#include "vtsp_improve.h"
+#include "vtsp_integral.h"
+#include "vtsp_locate.h"
+#include "vtsp_logger.h"
+#include "vtsp_points.h"
+#include "vtsp_topology.h"
+#include "vtsp_tour.h"
+#include "vtsp_tracer.h"
 
 
-int vtsp_solve_sizeof_opmem(const vtsp_points_t *input, uint32_t *output);
+/*
+ * Exact op_mem needed by vtsp_solve for this input and bindings,
+ * including the scratch requested by the bindings.
+ */
+int vtsp_solve_sizeof_opmem(const vtsp_points_t *input,
+			    const vtsp_depend_t *depend, size_t *output);
 
 int vtsp_solve(const vtsp_points_t *input, vtsp_perm_t *output,
 	       vtsp_depend_t *depend, void *op_mem);
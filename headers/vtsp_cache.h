@@ -0,0 +1,41 @@
+#ifndef __VTSP_CACHE_H__
+#define __VTSP_CACHE_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_depend.h"
+
+/*
+ * Built-in edge-cost cache, an integral binding in front of another one.
+ * Results are kept by pair of points, (p1, p2) and (p2, p1) share an
+ * entry. The table is open addressed in the op_mem of prepare and
+ * bounded: a pair probes a short window of entries, and a full window
+ * evicts by clock, entries hit since the hand last passed are spared.
+ * Lookups and stores are lock-free, so one ctx can serve many threads.
+ * invalidate drops every entry at once, insertion calls it whenever
+ * the incremental heat binding changes the field.
+ */
+typedef struct {
+	const vtsp_binding_integral_t *integral;   /* Cached binding */
+	uint32_t n_entries;   /* Rounded to a power of two, 0 sizes it by
+				 the mesh nodes, up to 2^20 entries */
+	uint64_t n_hits;      /* Output, pairs served by the table */
+	uint64_t n_misses;    /* Output, pairs passed to the integral */
+	void *table;          /* Set by prepare, lives in its op_mem */
+} vtsp_cache_ctx_t;
+
+int vtsp_bind_cache(vtsp_binding_integral_t *integral, vtsp_cache_ctx_t *ctx);
+
+int vtsp_cache_prepare_sizeof_opmem(void *ctx, const vtsp_mesh_t *mesh,
+				    size_t *output);
+int vtsp_cache_prepare(void *ctx, const vtsp_mesh_t *mesh, void *op_mem);
+int vtsp_cache_integrate_path(void *ctx, const vtsp_field_t *field,
+			      const vtsp_mesh_t *mesh, uint32_t p1,
+			      uint32_t p2, double *output);
+int vtsp_cache_integrate_paths(void *ctx, const vtsp_field_t *field,
+			       const vtsp_mesh_t *mesh, const uint32_t *p1,
+			       const uint32_t *p2, uint32_t n, double *output);
+int vtsp_cache_invalidate(void *ctx);
+
+#endif
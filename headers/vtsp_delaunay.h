@@ -0,0 +1,43 @@
+#ifndef __VTSP_DELAUNAY_H__
+#define __VTSP_DELAUNAY_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_depend.h"
+
+/*
+ * Built-in mesher.
+ * Points go through a parallel radix sort by x then y, equal points
+ * become one node. Every thread triangulates a strip of the sorted
+ * nodes by Guibas-Stolfi divide and conquer, then neighboring strips
+ * are merged pairwise, the pairs of a level in parallel.
+ * The mesh is the Delaunay triangulation of the convex hull, no node is
+ * added. The envelope must lie on that hull, as any convex envelope of
+ * the points does, its segments are checked rather than inserted.
+ * Orientation and in-circle tests are exact for any float input, a
+ * double filter under Shewchuk's error bounds falls back to exact
+ * expansion arithmetic when it cannot decide the sign.
+ * Triangles are CCW and nbr is filled when it has room. With the
+ * zero-copy handoff the mesh stays at the head of op_mem.
+ */
+typedef struct {
+	uint32_t n_threads;  /* 0 uses every online core */
+} vtsp_delaunay_ctx_t;
+
+int vtsp_bind_delaunay(vtsp_binding_mesher_t *mesher,
+		       vtsp_delaunay_ctx_t *ctx);
+
+int vtsp_delaunay_mesh_sizeof_opmem(void *ctx, const vtsp_points_t *input_pts,
+				    const vtsp_perm_t *input_envelope,
+				    const vtsp_mesh_t *output_ref,
+				    size_t *output);
+int vtsp_delaunay_mesh_sizeof_output(void *ctx, const vtsp_points_t *input_pts,
+				     const vtsp_perm_t *input_envelope,
+				     const vtsp_mesh_t *output_ref,
+				     size_t *output);
+int vtsp_delaunay_mesh(void *ctx, const vtsp_points_t *input_pts,
+		       const vtsp_perm_t *input_envelope,
+		       vtsp_mesh_t *output_ref, void *op_mem);
+
+#endif
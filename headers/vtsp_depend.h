@@ -5,9 +5,23 @@
 
 #include "vtsp_types.h"
 
+enum {
+	VTSP_LOG_ERROR = 0,
+	VTSP_LOG_INFO,
+	VTSP_LOG_DEBUG
+};
+
+/*
+ * Messages above level are dropped before they are formatted.
+ * log_array is optional, it receives whole index arrays (e.g. the
+ * convex envelope) that are otherwise logged one index per message.
+ */
 typedef struct {
 	void *ctx;
+	int level;
 	int (*log)(void *ctx, const char *msg);
+	int (*log_array)(void *ctx, const char *prefix,
+			 const uint32_t *array, uint32_t num);
 } vtsp_binding_logger_t;
 
 
@@ -24,42 +38,144 @@ typedef struct {
 	int (*report_progress)(void *ctx, float percent);
 } vtsp_binding_reporter_t;
 
+/*
+ * Optional, NULL begin and end disable tracing, vtsp_solve rejects
+ * a tracer with only one of them.
+ * Every solve phase is a span, end reports how many items the
+ * phase produced (points, hull size, triangles, insertions).
+ */
+typedef struct {
+	void *ctx;
+	int (*begin)(void *ctx, const char *span);
+	int (*end)(void *ctx, const char *span, uint32_t n_items);
+} vtsp_binding_tracer_t;
+
+/*
+ * Bindings doing heavy work receive their scratch as op_mem, carved from
+ * the op_mem given to vtsp_solve. The *_sizeof_opmem callbacks are called
+ * before the operation is known in full: 'num' fields hold upper bounds
+ * and data pointers of inputs not yet computed are NULL.
+ * A NULL *_sizeof_opmem callback means the binding needs no op_mem.
+ */
+
+/*
+ * Optional, a NULL order_points keeps the input order.
+ * output lists the points in the order the solve should store them.
+ * vtsp_solve orders the input first and the mesh nodes once meshed,
+ * every other binding sees both in that order, and the tour is given
+ * back in input indices.
+ */
 typedef struct {
 	void *ctx;
+	int (*order_points_sizeof_opmem)(void *ctx, const vtsp_points_t *input,
+					 size_t *output);
+	int (*order_points)(void *ctx, const vtsp_points_t *input,
+			    vtsp_perm_t *output, void *op_mem);
+} vtsp_binding_orderer_t;
+
+typedef struct {
+	void *ctx;
+	int (*get_convex_envelope_sizeof_opmem)(void *ctx,
+						const vtsp_points_t *input,
+						size_t *output);
 	int (*get_convex_envelope)(void* ctx, const vtsp_points_t *input,
-				   vtsp_perm_t *output);
+				   vtsp_perm_t *output, void *op_mem);
 } vtsp_binding_envelope_t;
 
+/*
+ * Meshers that know the neighbors of their triangles may fill
+ * output_ref->nbr when nbr.n_alloc has room (see vtsp_topology.h),
+ * vtsp_solve then skips their search.
+ *
+ * Optional zero-copy handoff, get_mesh_sizeof_output set. vtsp_solve
+ * then gives get_mesh an output_ref whose nodes, adj and map_vtx have
+ * NULL data and upper bounds as n_alloc. The mesher builds the mesh in
+ * the first get_mesh_sizeof_output bytes of op_mem, which stay alive
+ * along the solve, and points those arrays there instead of copying.
+ * Callers that pass their own arrays (multigrid levels) get a copy.
+ */
 typedef struct {
 	void *ctx;
+	int (*get_mesh_sizeof_opmem)(void *ctx, const vtsp_points_t *input_pts,
+				     const vtsp_perm_t *input_envelope,
+				     const vtsp_mesh_t *output_ref,
+				     size_t *output);
+	int (*get_mesh_sizeof_output)(void *ctx,
+				      const vtsp_points_t *input_pts,
+				      const vtsp_perm_t *input_envelope,
+				      const vtsp_mesh_t *output_ref,
+				      size_t *output);
 	int (*get_mesh)(void *ctx, const vtsp_points_t *input_pts,
 			const vtsp_perm_t *input_envelope,
-			vtsp_mesh_t *output_ref);
+			vtsp_mesh_t *output_ref, void *op_mem);
 } vtsp_binding_mesher_t;
 
 typedef struct {
 	void *ctx;
+	int (*solve_heat_sizeof_opmem)(void *ctx, const vtsp_mesh_t *input,
+				       size_t *output);
 	int (*solve_heat)(void* ctx, const vtsp_mesh_t *input,
 			  float input_temperature_vtx,
-			  vtsp_field_t *output);
+			  vtsp_field_t *output, void *op_mem);
+	/*
+	 * Optional incremental mode. solve_heat then only fixes the nodes
+	 * of the envelope, and update_heat fixes one more node each time
+	 * insertion adds a point. op_mem of solve_heat stays alive.
+	 * output_changed lists the nodes whose value moved, every node
+	 * when the whole field did, its n_alloc covers the nodes.
+	 */
+	int (*update_heat)(void *ctx, const vtsp_mesh_t *input, uint32_t node,
+			   vtsp_field_t *output, vtsp_perm_t *output_changed,
+			   void *op_mem);
 } vtsp_binding_heat_t;
 
+/*
+ * prepare is optional, it runs once the mesh is built and its op_mem
+ * stays alive while insertion integrates paths. integrate_paths is
+ * optional too, output[i] integrates from p1[i] to p2[i]. So is
+ * invalidate, called whenever the field changes after prepare.
+ */
 typedef struct {
 	void *ctx;
-	int (*integrate_path)(const vtsp_field_t *field,
+	int (*prepare_sizeof_opmem)(void *ctx, const vtsp_mesh_t *mesh,
+				    size_t *output);
+	int (*prepare)(void *ctx, const vtsp_mesh_t *mesh, void *op_mem);
+	int (*integrate_path)(void *ctx, const vtsp_field_t *field,
 			      const vtsp_mesh_t *mesh,
 			      uint32_t p1, uint32_t p2,
 			      double* output);
+	int (*integrate_paths)(void *ctx, const vtsp_field_t *field,
+			       const vtsp_mesh_t *mesh, const uint32_t *p1,
+			       const uint32_t *p2, uint32_t n,
+			       double *output);
+	int (*invalidate)(void *ctx);
 } vtsp_binding_integral_t;
 
+/*
+ * Optional, a NULL improve_tour keeps the tour built by insertion.
+ * It runs last, the mesh is still alive and tour holds every point.
+ */
+typedef struct {
+	void *ctx;
+	int (*improve_tour_sizeof_opmem)(void *ctx, const vtsp_points_t *points,
+					 const vtsp_mesh_t *mesh,
+					 size_t *output);
+	int (*improve_tour)(void *ctx, const vtsp_points_t *points,
+			    const vtsp_mesh_t *mesh, vtsp_perm_t *tour,
+			    void *op_mem);
+} vtsp_binding_improver_t;
+
 typedef struct {
 	vtsp_binding_logger_t logger;
 	vtsp_binding_drawer_t drawer;
 	vtsp_binding_reporter_t reporter;
+	vtsp_binding_tracer_t tracer;
+	vtsp_binding_orderer_t orderer;
 	vtsp_binding_envelope_t envelope;
 	vtsp_binding_mesher_t mesher;
 	vtsp_binding_heat_t heat;
 	vtsp_binding_integral_t integral;
+	vtsp_binding_improver_t improver;
 } vtsp_depend_t;
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef __VTSP_ENVELOPE_H__
+#define __VTSP_ENVELOPE_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_depend.h"
+
+/*
+ * Built-in convex envelope engine.
+ * An Akl-Toussaint pass discards the points inside the octagon of
+ * extreme points, every thread builds the monotone chain hull of its
+ * survivors and the partial hulls are merged into a CCW envelope.
+ */
+typedef struct {
+	uint32_t n_threads;  /* 0 uses every online core */
+} vtsp_envelope_ctx_t;
+
+int vtsp_bind_envelope(vtsp_binding_envelope_t *envelope,
+		       vtsp_envelope_ctx_t *ctx);
+
+int vtsp_get_convex_envelope_sizeof_opmem(void *ctx,
+					  const vtsp_points_t *input,
+					  size_t *output);
+int vtsp_get_convex_envelope(void *ctx, const vtsp_points_t *input,
+			     vtsp_perm_t *output, void *op_mem);
+
+/*
+ * Same envelope from coordinate arrays, the passes over every point
+ * read x and y as they are, eight points per AVX2 step.
+ */
+int vtsp_get_convex_envelope_soa_sizeof_opmem(void *ctx,
+					      const vtsp_points_soa_t *input,
+					      size_t *output);
+int vtsp_get_convex_envelope_soa(void *ctx, const vtsp_points_soa_t *input,
+				 vtsp_perm_t *output, void *op_mem);
+
+#endif
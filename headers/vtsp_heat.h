@@ -0,0 +1,71 @@
+#ifndef __VTSP_HEAT_H__
+#define __VTSP_HEAT_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_depend.h"
+
+enum {
+	VTSP_HEAT_JACOBI = 0,
+	VTSP_HEAT_IC0,
+	VTSP_HEAT_MULTIGRID
+};
+
+enum {
+	VTSP_HEAT_CG = 0,
+	VTSP_HEAT_VCYCLES
+};
+
+/*
+ * Built-in heat engine.
+ * Steady heat with a unit source over the mesh, the nodes in map_vtx
+ * are fixed at the vertex temperature. The P1 stiffness matrix is
+ * assembled in CSR and solved by preconditioned conjugate gradient.
+ * IC(0) is factored per thread block, so every thread keeps working
+ * on its own rows (block Jacobi between threads).
+ * Multigrid coarsens the mesh by keeping an independent set of nodes
+ * and triangulating it again with the mesher binding, one V-cycle is
+ * either the preconditioner of CG or the whole iteration. Fixed nodes
+ * stay on every level. Plain V-cycles hand over to CG once a cycle
+ * cuts the residual by less than half.
+ * The incremental binding relaxes the rings of rows around each new
+ * fixed node, up to the first ring its residual barely reaches, and
+ * solves again from the current field each time the fixed nodes grew
+ * by update_growth. It is opt-in: points not fixed yet stay hot and
+ * pull insertion toward the path, so tours come out much longer than
+ * with vtsp_bind_heat.
+ */
+typedef struct {
+	uint32_t n_threads;   /* 0 uses every online core */
+	int method;           /* VTSP_HEAT_CG or VTSP_HEAT_VCYCLES */
+	int precond;          /* VTSP_HEAT_JACOBI, IC0 or MULTIGRID */
+	/* Coarse levels of multigrid, unused otherwise */
+	const vtsp_binding_mesher_t *mesher;
+	float tolerance;      /* Relative residual, 0 uses 1e-6 */
+	uint32_t max_iters;   /* 0 means the number of nodes */
+	uint32_t update_rings;    /* Incremental, 0 relaxes up to 8 rings */
+	float update_tolerance;   /* Incremental, residual past the rings over
+				     the first one, 0 uses 1e-2 */
+	float update_growth;      /* Incremental, solves again once the fixed
+				     nodes grew by it, 1 or less uses 1.5 */
+	uint32_t n_iters;     /* Output, iterations of the last solve */
+	float residual;       /* Output, relative residual reached */
+	uint32_t n_solves;    /* Output, global solves */
+} vtsp_heat_ctx_t;
+
+int vtsp_bind_heat(vtsp_binding_heat_t *heat, vtsp_heat_ctx_t *ctx);
+int vtsp_bind_heat_incremental(vtsp_binding_heat_t *heat,
+			       vtsp_heat_ctx_t *ctx);
+
+int vtsp_solve_heat_sizeof_opmem(void *ctx, const vtsp_mesh_t *input,
+				 size_t *output);
+int vtsp_solve_heat(void *ctx, const vtsp_mesh_t *input,
+		    float input_temperature_vtx,
+		    vtsp_field_t *output, void *op_mem);
+/* op_mem must be the one of the last vtsp_solve_heat */
+int vtsp_update_heat(void *ctx, const vtsp_mesh_t *input, uint32_t node,
+		     vtsp_field_t *output, vtsp_perm_t *output_changed,
+		     void *op_mem);
+
+#endif
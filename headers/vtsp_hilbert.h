@@ -0,0 +1,28 @@
+#ifndef __VTSP_HILBERT_H__
+#define __VTSP_HILBERT_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_depend.h"
+
+/*
+ * Built-in point orderer.
+ * Points are snapped to a 2^16 x 2^16 grid over their bounding box and
+ * sorted by their index along a Hilbert curve, so points close in the
+ * plane end up close in memory. The 32 bit keys go through a parallel
+ * LSD radix sort, stable, ties keep the input order.
+ */
+typedef struct {
+	uint32_t n_threads;  /* 0 uses every online core */
+} vtsp_hilbert_ctx_t;
+
+int vtsp_bind_hilbert(vtsp_binding_orderer_t *orderer,
+		      vtsp_hilbert_ctx_t *ctx);
+
+int vtsp_hilbert_order_sizeof_opmem(void *ctx, const vtsp_points_t *input,
+				    size_t *output);
+int vtsp_hilbert_order(void *ctx, const vtsp_points_t *input,
+		       vtsp_perm_t *output, void *op_mem);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __VTSP_IMPROVE_H__
+#define __VTSP_IMPROVE_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_depend.h"
+
+/*
+ * Built-in tour improver.
+ * Lin-Kernighan style moves up to depth 3 (2-opt and sequential 3-opt)
+ * plus Or-opt of segments of up to 3 points, with don't-look bits.
+ * The candidate neighbors of a point are the points next to it in the
+ * mesh, Steiner nodes in between are crossed. The tour is kept in a
+ * two-level list, so moves cost O(sqrt(n)) instead of O(n).
+ */
+typedef struct {
+	uint32_t max_moves;   /* 0 means no limit */
+	uint32_t max_millis;  /* 0 means no limit */
+	uint32_t n_moves;     /* Output, moves applied by the last run */
+} vtsp_improve_ctx_t;
+
+int vtsp_bind_improver(vtsp_binding_improver_t *improver,
+		       vtsp_improve_ctx_t *ctx);
+
+int vtsp_improve_tour_sizeof_opmem(void *ctx, const vtsp_points_t *points,
+				   const vtsp_mesh_t *mesh, size_t *output);
+int vtsp_improve_tour(void *ctx, const vtsp_points_t *points,
+		      const vtsp_mesh_t *mesh, vtsp_perm_t *tour,
+		      void *op_mem);
+
+#endif
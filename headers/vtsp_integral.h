@@ -0,0 +1,43 @@
+#ifndef __VTSP_INTEGRAL_H__
+#define __VTSP_INTEGRAL_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_depend.h"
+
+/*
+ * Built-in integral.
+ * Exact integral of the P1 field along the segment between two points,
+ * walking the triangles it crosses: a query costs the triangles it
+ * crosses. Its adjacency comes with the locator of the mesh, prepare
+ * builds a locator for meshes without one. Batches are shared among
+ * threads.
+ */
+typedef struct {
+	uint32_t n_threads;   /* 0 uses every online core */
+	void *walk;           /* Set by prepare, lives in its op_mem */
+} vtsp_integral_ctx_t;
+
+int vtsp_bind_integral(vtsp_binding_integral_t *integral,
+		       vtsp_integral_ctx_t *ctx);
+
+int vtsp_integral_prepare_sizeof_opmem(void *ctx, const vtsp_mesh_t *mesh,
+				       size_t *output);
+int vtsp_integral_prepare(void *ctx, const vtsp_mesh_t *mesh, void *op_mem);
+int vtsp_integrate_path(void *ctx, const vtsp_field_t *field,
+			const vtsp_mesh_t *mesh, uint32_t p1, uint32_t p2,
+			double *output);
+int vtsp_integrate_paths(void *ctx, const vtsp_field_t *field,
+			 const vtsp_mesh_t *mesh, const uint32_t *p1,
+			 const uint32_t *p2, uint32_t n, double *output);
+
+/*
+ * From a to b anywhere on the mesh, boundary included. MALFORMED_INPUT
+ * if a is off it, ERROR if the segment leaves it before b.
+ */
+int vtsp_integrate_segment(void *ctx, const vtsp_field_t *field,
+			   const vtsp_mesh_t *mesh, const vtsp_point_t *a,
+			   const vtsp_point_t *b, double *output);
+
+#endif
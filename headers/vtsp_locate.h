@@ -0,0 +1,44 @@
+#ifndef __VTSP_LOCATE_H__
+#define __VTSP_LOCATE_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_topology.h"
+
+/*
+ * Point location over a mesh.
+ * A uniform grid with about one cell per node keeps a seed triangle per
+ * cell, and a visibility walk goes from the seed to the triangle that
+ * contains the point, O(1) expected steps on meshes of even density.
+ * vtsp_solve builds one for its mesh, bindings find it in mesh->locator.
+ * The walk follows mesh->nbr, the topology of the mesh must be built.
+ */
+struct vtsp_locator {
+	const vtsp_mesh_t *mesh;
+	uint32_t *seed;         /* Triangle per cell, row major */
+	uint32_t nx, ny;
+	double x0, y0;          /* Lower corner of the grid */
+	double inv_cw, inv_ch;  /* Cells per unit of length */
+};
+
+#define VTSP_LOCATE_NONE VTSP_NO_TRG
+
+int vtsp_locator_sizeof_opmem(const vtsp_mesh_t *mesh, size_t *output);
+
+/* op_mem must outlive the locator */
+int vtsp_locator_build(vtsp_locator_t *locator, const vtsp_mesh_t *mesh,
+		       void *op_mem);
+
+/*
+ * Triangle containing p and its barycentric weights at n1, n2 and n3.
+ * trg is VTSP_LOCATE_NONE when p is off the mesh.
+ */
+int vtsp_locate_point(const vtsp_locator_t *locator, const vtsp_point_t *p,
+		      uint32_t *trg, double *weight);
+
+/* Linear interpolation of the field, MALFORMED_INPUT off the mesh */
+int vtsp_field_at(const vtsp_locator_t *locator, const vtsp_field_t *field,
+		  const vtsp_point_t *p, double *output);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef __VTSP_LOGGER_H__
+#define __VTSP_LOGGER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_depend.h"
+
+/*
+ * Built-in asynchronous logger.
+ * Messages are copied into a ring buffer and a background thread
+ * drains it to a file descriptor, so the solver never waits on I/O
+ * unless the ring is full. Each message or array goes in whole, lines
+ * of concurrent callers do not interleave.
+ */
+typedef struct vtsp_logger_sync vtsp_logger_sync_t;
+
+typedef struct {
+	int fd;
+	char *ring;
+	uint32_t capacity;
+	uint64_t head;           /* Bytes ever written */
+	uint64_t tail;           /* Bytes ever drained */
+	bool stop;
+	bool busy;               /* A record is being pushed */
+	int status;              /* First write error of the drainer */
+	vtsp_logger_sync_t *sync;  /* Lock, conditions and drainer thread */
+} vtsp_logger_t;
+
+/* The caller keeps ownership of fd, capacity 0 uses a default */
+int vtsp_logger_init(vtsp_logger_t *logger, int fd, uint32_t capacity);
+/* Drain what is left, stop the thread and free the ring */
+int vtsp_logger_finish(vtsp_logger_t *logger);
+
+int vtsp_bind_logger(vtsp_binding_logger_t *binding, vtsp_logger_t *logger,
+		     int level);
+
+int vtsp_logger_log(void *ctx, const char *msg);
+int vtsp_logger_log_array(void *ctx, const char *prefix,
+			  const uint32_t *array, uint32_t num);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __VTSP_POINTS_H__
+#define __VTSP_POINTS_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+
+/* Bytes of memory holding n_alloc points as coordinate arrays */
+int vtsp_points_soa_sizeof(uint32_t n_alloc, size_t *output);
+
+/*
+ * Carve x and y from mem, vtsp_points_soa_sizeof bytes. Both arrays
+ * are 64-byte aligned and padded to a multiple of 64 bytes.
+ */
+int vtsp_points_soa_init(vtsp_points_soa_t *points, uint32_t n_alloc,
+			 void *mem);
+
+int vtsp_points_to_soa(const vtsp_points_t *input, vtsp_points_soa_t *output);
+int vtsp_points_from_soa(const vtsp_points_soa_t *input,
+			 vtsp_points_t *output);
+
+#endif
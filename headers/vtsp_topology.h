@@ -0,0 +1,34 @@
+#ifndef __VTSP_TOPOLOGY_H__
+#define __VTSP_TOPOLOGY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vtsp_types.h"
+
+/*
+ * Topology of a mesh, kept next to its triangles.
+ * vtsp_solve builds it once meshed, so the locator, the integral walk,
+ * insertion, local search and heat share one copy instead of each
+ * rebuilding theirs. A mesher that knows the neighbors of its triangles
+ * fills mesh->nbr when nbr.n_alloc has room, only the node tables are
+ * built then.
+ */
+#define VTSP_NO_TRG UINT32_MAX
+
+/* True when nbr, node_trgs and node_nodes cover the triangles */
+bool vtsp_topology_ready(const vtsp_mesh_t *mesh);
+
+/* No topology and no room for nbr, for meshes built outside vtsp_solve */
+void vtsp_topology_clear(vtsp_mesh_t *mesh);
+
+int vtsp_topology_sizeof_opmem(const vtsp_mesh_t *mesh, size_t *output);
+
+/*
+ * Builds the tables the mesh lacks, nbr goes to op_mem when
+ * mesh->nbr has no room. op_mem must outlive the mesh,
+ * n_threads 0 uses every online core.
+ */
+int vtsp_topology_build(vtsp_mesh_t *mesh, uint32_t n_threads, void *op_mem);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef __VTSP_TOUR_H__
+#define __VTSP_TOUR_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+
+/*
+ * Closed tour length with TSPLIB EUC_2D distances, every edge is
+ * rounded to the nearest integer. The tour must index valid points,
+ * see vtsp_tour_validate().
+ */
+int vtsp_tour_length(const vtsp_points_t *points, const vtsp_perm_t *tour,
+		     double *output);
+
+/*
+ * Same from coordinate arrays, eight edges per AVX2 step. Faster when
+ * the tour follows memory, e.g. points in Hilbert order, a tour in
+ * random order reads two cache lines per point instead of one.
+ */
+int vtsp_tour_length_soa(const vtsp_points_soa_t *points,
+			 const vtsp_perm_t *tour, double *output);
+
+/* SUCCESS if tour visits each of the n_points exactly once */
+int vtsp_tour_validate_sizeof_opmem(uint32_t n_points, size_t *output);
+int vtsp_tour_validate(const vtsp_perm_t *tour, uint32_t n_points,
+		       void *op_mem);
+
+/* Percent excess of tour length over the reference tour length */
+int vtsp_tour_gap(const vtsp_points_t *points, const vtsp_perm_t *tour,
+		  const vtsp_perm_t *reference, double *output);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __VTSP_TRACER_H__
+#define __VTSP_TRACER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vtsp_types.h"
+#include "vtsp_depend.h"
+
+/*
+ * Built-in tracer writing Chrome trace-event JSON, the file opens
+ * in chrome://tracing or Perfetto. Timestamps are microseconds
+ * since vtsp_tracer_init().
+ */
+typedef struct {
+	FILE *fp;
+	double origin_us;
+	bool first;
+} vtsp_tracer_t;
+
+/* The caller keeps ownership of fp */
+int vtsp_tracer_init(vtsp_tracer_t *tracer, FILE *fp);
+/* Close the event array, fp is flushed but not closed */
+int vtsp_tracer_finish(vtsp_tracer_t *tracer);
+
+int vtsp_bind_tracer(vtsp_binding_tracer_t *binding, vtsp_tracer_t *tracer);
+
+int vtsp_tracer_begin(void *ctx, const char *span);
+int vtsp_tracer_end(void *ctx, const char *span, uint32_t n_items);
+
+#endif
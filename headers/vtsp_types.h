@@ -1,6 +1,7 @@
 #ifndef __VTSP_TYPES_H__
 #define __VTSP_TYPES_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 enum {
@@ -20,6 +21,18 @@ typedef struct {
 	vtsp_point_t *pts;
 } vtsp_points_t;
 
+/*
+ * Same points as coordinate arrays, x and y start 64-byte aligned so
+ * vector kernels load consecutive points without deinterleaving.
+ * See vtsp_points.h to allocate and convert them.
+ */
+typedef struct {
+	uint32_t num;
+	uint32_t n_alloc;
+	float *x;
+	float *y;
+} vtsp_points_soa_t;
+
 typedef struct {
 	uint32_t num;
 	uint32_t n_alloc;
@@ -43,10 +56,30 @@ typedef struct {
 	vtsp_trg_t* trgs;
 } vtsp_trgs_t;
 
+/* Compressed rows, row i lists index[offset[i]] to index[offset[i + 1] - 1] */
+typedef struct {
+	uint32_t num;      /* Rows */
+	uint32_t n_alloc;
+	uint32_t *offset;  /* num + 1 entries */
+	uint32_t *index;
+} vtsp_graph_t;
+
+typedef struct vtsp_locator vtsp_locator_t;
+
 typedef struct {
 	vtsp_points_t nodes;
 	vtsp_trgs_t adj;
 	vtsp_perm_t map_vtx;
+	/*
+	 * Topology, num 0 until built, see vtsp_topology.h. A mesher may
+	 * fill nbr when it has room, vtsp_solve fills the rest.
+	 */
+	vtsp_perm_t nbr;          /* 3 per triangle, across the edge opposite
+				     each corner, VTSP_NO_TRG on the boundary */
+	vtsp_graph_t node_trgs;   /* Triangles around each node */
+	vtsp_graph_t node_nodes;  /* Nodes around each node, sorted rows */
+	/* Set by vtsp_solve once meshed, NULL for meshes it did not build */
+	const vtsp_locator_t *locator;
 } vtsp_mesh_t;
 
 #endif
@@ -1,45 +1,315 @@
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "vtsp.h"
 #include "try_macros.h"
+#include "vtsp_insert.h"
+#include "vtsp_opmem.h"
+#include "vtsp_renumber.h"
 
 #define MIN_POINTS 3
 #define MAX_POINTS 20000000
+#define MESH_NODES_FACTOR 2     /* Room for nodes added by refinement */
+#define VERTEX_TEMPERATURE 1.0f
 
 
 enum {
 	ERROR_INTERNAL = ERROR,
 	ERROR_SPRINTF,
-	ERROR_WRITE_LOG
+	ERROR_WRITE_LOG,
+	ERROR_OPMEM_SIZE,
+	ERROR_TRACE
 };
 
-static int validate_input(const vtsp_points_t *input,
+typedef struct {
+	size_t orderer;
+	size_t envelope;
+	size_t mesher;
+	size_t mesh_output;     /* Head of the mesher op_mem kept, handoff */
+	size_t heat;
+	size_t integral;
+	size_t improver;
+} binding_opmem_t;
+
+typedef struct {
+	/* Live along the whole solve */
+	vtsp_perm_t order;      /* Ordered point to input point */
+	vtsp_points_t points;   /* Input in that order, what phases see */
+	vtsp_mesh_t mesh;
+	uint32_t max_nodes;     /* Bounds the phases are sized for */
+	uint32_t max_trgs;
+	vtsp_field_t field;
+	vtsp_mesh_t heat_mesh;  /* Only the envelope fixed, incremental heat */
+	void *topology_mem;
+	vtsp_locator_t locator;
+	void *locator_mem;
+	/* Phase scratch, each phase reuses the memory of the previous one */
+	binding_opmem_t binding;
+	size_t phase;
+	vtsp_renumber_mem_t renumber;
+	vtsp_insert_mem_t insert;
+} solve_mem_t;
+
+static int take_solve_mem(const vtsp_points_t *input, bool ordered,
+			  bool handoff, solve_mem_t *smem, vtsp_opmem_t *mem);
+static int sizeof_binding_opmem(const vtsp_points_t *input,
+				const vtsp_depend_t *depend,
+				solve_mem_t *smem);
+static void *take_phase_mem(vtsp_opmem_t *mem, const solve_mem_t *smem,
+			    size_t size);
+static int validate_input(const vtsp_points_t *input, const vtsp_perm_t *output,
 			  const vtsp_depend_t *depend);
-static int write_log(const vtsp_depend_t *depend, const char *msg);
+static bool log_enabled(const vtsp_depend_t *depend, int level);
+static int write_log(const vtsp_depend_t *depend, int level, const char *msg);
+static int trace_begin(const vtsp_depend_t *depend, const char *span);
+static int trace_end(const vtsp_depend_t *depend, const char *span,
+		     uint32_t n_items);
 static int solve(const vtsp_points_t *input, vtsp_perm_t *output,
 		 vtsp_depend_t *depend, void *op_mem);
+static int order_points(const vtsp_points_t *input, vtsp_perm_t *output,
+			vtsp_depend_t *depend, void *op_mem);
 static int get_convex_envelope(const vtsp_points_t *input, vtsp_perm_t *output,
 			       vtsp_depend_t *depend, void *op_mem);
+static int get_mesh(const vtsp_points_t *input, const vtsp_perm_t *envelope,
+		    vtsp_mesh_t *mesh, const solve_mem_t *smem,
+		    vtsp_depend_t *depend, void *op_mem);
+static void keep_mesh_output(vtsp_opmem_t *mem, solve_mem_t *smem);
+static int renumber_mesh(vtsp_mesh_t *mesh, vtsp_depend_t *depend,
+			 vtsp_renumber_mem_t *mem, void *op_mem);
+static void fix_envelope(const vtsp_mesh_t *mesh, const vtsp_perm_t *envelope,
+			 vtsp_mesh_t *heat_mesh);
+static int solve_heat(const vtsp_mesh_t *mesh, vtsp_field_t *field,
+		      vtsp_depend_t *depend, void *op_mem);
+static int prepare_integral(const vtsp_mesh_t *mesh, vtsp_depend_t *depend,
+			    void *op_mem);
+static int add_points(const vtsp_points_t *input, const vtsp_mesh_t *mesh,
+		      vtsp_field_t *field, vtsp_perm_t *output,
+		      vtsp_depend_t *depend, vtsp_insert_mem_t *mem);
+static int improve_tour(const vtsp_points_t *input, const vtsp_mesh_t *mesh,
+			vtsp_perm_t *output, vtsp_depend_t *depend,
+			void *op_mem);
 static int log_perm(vtsp_depend_t *depend,  vtsp_perm_t *output,
 		    const char *prefix);
 
-int vtsp_solve_sizeof_opmem(const vtsp_points_t *input, uint32_t *output)
+int vtsp_solve_sizeof_opmem(const vtsp_points_t *input,
+			    const vtsp_depend_t *depend, size_t *output)
 {
-	*output = 1;
+	/* Replay the takes of solve() without memory */
+	solve_mem_t smem;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, NULL);
+	bool ordered = depend->orderer.order_points != NULL;
+	bool handoff = depend->mesher.get_mesh_sizeof_output != NULL;
+	TRY( take_solve_mem(input, ordered, handoff, &smem, &mem) );
+	TRY( sizeof_binding_opmem(input, depend, &smem) );
+	smem.phase = vtsp_opmem_mark(&mem);
+
+	if (ordered) {
+		take_phase_mem(&mem, &smem, smem.binding.orderer);
+	}
+	take_phase_mem(&mem, &smem, smem.binding.envelope);
+	take_phase_mem(&mem, &smem, smem.binding.mesher);
+	if (handoff) {
+		keep_mesh_output(&mem, &smem);
+	}
+	if (ordered) {
+		take_phase_mem(&mem, &smem, smem.binding.orderer);
+		vtsp_renumber_take(&(smem.renumber), smem.max_nodes,
+				   smem.max_trgs, &mem);
+	}
+	take_phase_mem(&mem, &smem, smem.binding.heat);
+	if (depend->heat.update_heat == NULL) {
+		take_phase_mem(&mem, &smem, 0);
+	}
+	vtsp_insert_take(&(smem.insert), input->num, smem.max_nodes, &mem);
+	vtsp_opmem_take(&mem, smem.binding.integral);
+	take_phase_mem(&mem, &smem, smem.binding.improver);
+
+	*output = vtsp_opmem_sizeof(&mem);
 	return SUCCESS;
 }
 
 int vtsp_solve(const vtsp_points_t *input, vtsp_perm_t *output,
 			 vtsp_depend_t *depend, void *op_mem)
 {
-	TRY( validate_input(input, depend) );
+	/* A half-bound tracer would call a NULL end */
+	THROW( (depend->tracer.begin == NULL) != (depend->tracer.end == NULL),
+	       ERROR_TRACE );
+	TRY( trace_begin(depend, "solve") );
+	TRY( trace_begin(depend, "validate") );
+	TRY( validate_input(input, output, depend) );
+	TRY( trace_end(depend, "validate", input->num) );
         TRY( solve(input, output, depend, op_mem) );
+	TRY( trace_end(depend, "solve", output->num) );
+	return SUCCESS;
+}
+
+static int take_solve_mem(const vtsp_points_t *input, bool ordered,
+			  bool handoff, solve_mem_t *smem, vtsp_opmem_t *mem)
+{
+	/* Keeps the 32-bit node and triangle counts below far from overflow */
+	THROW( input->num > MAX_POINTS, ERROR_OPMEM_SIZE );
+	uint32_t n_nodes = MESH_NODES_FACTOR * input->num;
+	uint32_t n_trgs = 2 * n_nodes;
+	smem->max_nodes = n_nodes;
+	smem->max_trgs = n_trgs;
+
+	/* Without an orderer the phases see the input itself */
+	smem->points = *input;
+	if (ordered) {
+		smem->order.num = 0;
+		smem->order.n_alloc = input->num;
+		smem->order.index = vtsp_opmem_take(mem, input->num *
+						    sizeof(*(smem->order.index)));
+		smem->points.n_alloc = input->num;
+		smem->points.pts = vtsp_opmem_take(mem, input->num *
+						   sizeof(*(smem->points.pts)));
+	}
+
+	/* With the handoff the mesher points these into its own output */
+	vtsp_mesh_t *mesh = &(smem->mesh);
+	mesh->nodes.num = 0;
+	mesh->nodes.n_alloc = n_nodes;
+	mesh->nodes.pts = NULL;
+	mesh->adj.num = 0;
+	mesh->adj.n_alloc = n_trgs;
+	mesh->adj.trgs = NULL;
+	mesh->map_vtx.num = 0;
+	mesh->map_vtx.n_alloc = input->num;
+	mesh->map_vtx.index = NULL;
+	if (!handoff) {
+		mesh->nodes.pts = vtsp_opmem_take(mem, n_nodes *
+						  sizeof(*(mesh->nodes.pts)));
+		mesh->adj.trgs = vtsp_opmem_take(mem, n_trgs *
+						 sizeof(*(mesh->adj.trgs)));
+		mesh->map_vtx.index = vtsp_opmem_take(mem, input->num *
+						      sizeof(*(mesh->map_vtx.index)));
+	}
+	/* Room for the neighbors, meshers that know them fill them */
+	vtsp_topology_clear(mesh);
+	mesh->nbr.n_alloc = 3 * n_trgs;
+	mesh->nbr.index = vtsp_opmem_take(mem, 3 * (size_t) n_trgs *
+					  sizeof(*(mesh->nbr.index)));
+	mesh->locator = NULL;
+
+	vtsp_field_t *field = &(smem->field);
+	field->num = 0;
+	field->n_alloc = n_nodes;
+	field->values = vtsp_opmem_take(mem, n_nodes * sizeof(*(field->values)));
+
+	vtsp_perm_t *fixed = &(smem->heat_mesh.map_vtx);
+	fixed->num = 0;
+	fixed->n_alloc = input->num;
+	fixed->index = vtsp_opmem_take(mem, input->num * sizeof(*(fixed->index)));
+	vtsp_topology_clear(&(smem->heat_mesh));
+	smem->heat_mesh.locator = NULL;
+
+	/* Sized for the bounds, topology and locator follow the mesh */
+	vtsp_mesh_t bound = *mesh;
+	bound.nodes.num = n_nodes;
+	bound.adj.num = n_trgs;
+	size_t topology_size;
+	TRY( vtsp_topology_sizeof_opmem(&bound, &topology_size) );
+	smem->topology_mem = vtsp_opmem_take(mem, topology_size);
+	size_t locator_size;
+	TRY( vtsp_locator_sizeof_opmem(&bound, &locator_size) );
+	smem->locator_mem = vtsp_opmem_take(mem, locator_size);
+	return SUCCESS;
+}
+
+static int sizeof_binding_opmem(const vtsp_points_t *input,
+				const vtsp_depend_t *depend,
+				solve_mem_t *smem)
+{
+	binding_opmem_t *size = &(smem->binding);
+	size->orderer = 0;
+	size->envelope = 0;
+	size->mesher = 0;
+	size->mesh_output = 0;
+	size->heat = 0;
+	size->integral = 0;
+	size->improver = 0;
+
+	/* Upper bounds of the inputs each binding will receive */
+	vtsp_perm_t envelope;
+	envelope.num = input->num;
+	envelope.n_alloc = input->num;
+	envelope.index = NULL;
+
+	vtsp_mesh_t mesh = smem->mesh;
+	mesh.nodes.num = mesh.nodes.n_alloc;
+	mesh.nodes.pts = NULL;
+	mesh.adj.num = mesh.adj.n_alloc;
+	mesh.adj.trgs = NULL;
+	mesh.map_vtx.num = mesh.map_vtx.n_alloc;
+	mesh.map_vtx.index = NULL;
+	mesh.nbr.num = 3 * mesh.adj.num;
+	mesh.node_trgs.num = mesh.nodes.num;
+	mesh.node_nodes.num = mesh.nodes.num;
+	mesh.locator = &(smem->locator);
+
+	/* The orderer sorts the input, then the mesh nodes */
+	const vtsp_binding_orderer_t *orderer = &(depend->orderer);
+	if (orderer->order_points != NULL &&
+	    orderer->order_points_sizeof_opmem != NULL) {
+		TRY( orderer->order_points_sizeof_opmem(orderer->ctx, input,
+							&(size->orderer)) );
+		size_t nodes_size;
+		TRY( orderer->order_points_sizeof_opmem(orderer->ctx,
+							&(mesh.nodes),
+							&nodes_size) );
+		if (nodes_size > size->orderer) {
+			size->orderer = nodes_size;
+		}
+	}
+	const vtsp_binding_envelope_t *env = &(depend->envelope);
+	if (env->get_convex_envelope_sizeof_opmem != NULL) {
+		TRY( env->get_convex_envelope_sizeof_opmem(env->ctx, input,
+							   &(size->envelope)) );
+	}
+	const vtsp_binding_mesher_t *mesher = &(depend->mesher);
+	if (mesher->get_mesh_sizeof_opmem != NULL) {
+		TRY( mesher->get_mesh_sizeof_opmem(mesher->ctx, input, &envelope,
+						   &(smem->mesh),
+						   &(size->mesher)) );
+	}
+	if (mesher->get_mesh_sizeof_output != NULL) {
+		TRY( mesher->get_mesh_sizeof_output(mesher->ctx, input,
+						    &envelope, &(smem->mesh),
+						    &(size->mesh_output)) );
+		THROW( size->mesh_output > size->mesher, ERROR_OPMEM_SIZE );
+	}
+	const vtsp_binding_heat_t *heat = &(depend->heat);
+	if (heat->solve_heat_sizeof_opmem != NULL) {
+		TRY( heat->solve_heat_sizeof_opmem(heat->ctx, &mesh,
+						   &(size->heat)) );
+	}
+	const vtsp_binding_integral_t *integral = &(depend->integral);
+	if (integral->prepare != NULL &&
+	    integral->prepare_sizeof_opmem != NULL) {
+		TRY( integral->prepare_sizeof_opmem(integral->ctx, &mesh,
+						    &(size->integral)) );
+	}
+	const vtsp_binding_improver_t *improver = &(depend->improver);
+	if (improver->improve_tour != NULL &&
+	    improver->improve_tour_sizeof_opmem != NULL) {
+		TRY( improver->improve_tour_sizeof_opmem(improver->ctx, input,
+							 &mesh,
+							 &(size->improver)) );
+	}
 	return SUCCESS;
 }
 
-static int validate_input(const vtsp_points_t *input,
+static void *take_phase_mem(vtsp_opmem_t *mem, const solve_mem_t *smem,
+			    size_t size)
+{
+	vtsp_opmem_release(mem, smem->phase);
+	return vtsp_opmem_take(mem, size);
+}
+
+static int validate_input(const vtsp_points_t *input, const vtsp_perm_t *output,
 			  const vtsp_depend_t *depend)
 {
 	char msg[100];
@@ -50,10 +320,13 @@ static int validate_input(const vtsp_points_t *input,
 	} else if (input->num > MAX_POINTS) {
 		TRY_NONEG( sprintf(msg, "Num of points is bigger than max %i", MAX_POINTS),
 			   ERROR_SPRINTF );
+	} else if (output->n_alloc < input->num) {
+		TRY_NONEG( sprintf(msg, "Output must allocate at least %u indices",
+				   input->num), ERROR_SPRINTF );
 	}
 	
 	if (strlen(msg) > 0) {
-		TRY( write_log(depend, msg) );
+		TRY( write_log(depend, VTSP_LOG_ERROR, msg) );
 		return MALFORMED_INPUT;
 	}
 	return SUCCESS;
@@ -61,8 +334,16 @@ ERROR_SPRINTF:
 	return ERROR_SPRINTF;
 }
 
-static int write_log(const vtsp_depend_t *depend, const char *msg)
+static bool log_enabled(const vtsp_depend_t *depend, int level)
 {
+	return level <= depend->logger.level;
+}
+
+static int write_log(const vtsp_depend_t *depend, int level, const char *msg)
+{
+	if (!log_enabled(depend, level)) {
+		return SUCCESS;
+	}
 	TRY_GOTO( depend->logger.log(depend->logger.ctx, msg),
 		  ERROR_WRITE_LOG );
 	return SUCCESS;
@@ -70,35 +351,309 @@ ERROR_WRITE_LOG:
 	return ERROR_WRITE_LOG;
 }
 
+static int trace_begin(const vtsp_depend_t *depend, const char *span)
+{
+	if (depend->tracer.begin == NULL) {
+		return SUCCESS;
+	}
+	THROW( depend->tracer.begin(depend->tracer.ctx, span), ERROR_TRACE );
+	return SUCCESS;
+}
+
+static int trace_end(const vtsp_depend_t *depend, const char *span,
+		     uint32_t n_items)
+{
+	if (depend->tracer.begin == NULL) {
+		return SUCCESS;
+	}
+	THROW( depend->tracer.end(depend->tracer.ctx, span, n_items),
+	       ERROR_TRACE );
+	return SUCCESS;
+}
+
 static int solve(const vtsp_points_t *input, vtsp_perm_t *output,
 		 vtsp_depend_t *depend, void *op_mem)
 {
-	TRY( get_convex_envelope(input, output, depend, op_mem) );
-	//mesh = get_mesh();
-	//set_conditions(input, mesh);
-	//field = solve_heat();
-	//while (more_points()) {
-	//	add_point(path, mesh);
-	//}
+	solve_mem_t smem;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, op_mem);
+	bool ordered = depend->orderer.order_points != NULL;
+	bool handoff = depend->mesher.get_mesh_sizeof_output != NULL;
+	TRY( take_solve_mem(input, ordered, handoff, &smem, &mem) );
+	TRY( sizeof_binding_opmem(input, depend, &smem) );
+	smem.phase = vtsp_opmem_mark(&mem);
+
+	/* From here on every phase works on the ordered points */
+	void *phase_mem;
+	const vtsp_points_t *points = &(smem.points);
+	if (ordered) {
+		TRY( trace_begin(depend, "order") );
+		phase_mem = take_phase_mem(&mem, &smem, smem.binding.orderer);
+		TRY( order_points(input, &(smem.order), depend, phase_mem) );
+		vtsp_renumber_points(input, &(smem.order), &(smem.points));
+		TRY( trace_end(depend, "order", smem.points.num) );
+	}
+
+	TRY( trace_begin(depend, "envelope") );
+	phase_mem = take_phase_mem(&mem, &smem, smem.binding.envelope);
+	TRY( get_convex_envelope(points, output, depend, phase_mem) );
+	uint32_t n_envelope = output->num;
+	TRY( trace_end(depend, "envelope", n_envelope) );
+
+	TRY( trace_begin(depend, "mesh") );
+	phase_mem = take_phase_mem(&mem, &smem, smem.binding.mesher);
+	TRY( get_mesh(points, output, &(smem.mesh), &smem, depend,
+		      phase_mem) );
+	if (handoff) {
+		keep_mesh_output(&mem, &smem);
+	}
+	if (ordered) {
+		phase_mem = take_phase_mem(&mem, &smem, smem.binding.orderer);
+		vtsp_renumber_take(&(smem.renumber), smem.max_nodes,
+				   smem.max_trgs, &mem);
+		TRY( renumber_mesh(&(smem.mesh), depend, &(smem.renumber),
+				   phase_mem) );
+	}
+	TRY( vtsp_topology_build(&(smem.mesh), 0, smem.topology_mem) );
+	TRY( vtsp_locator_build(&(smem.locator), &(smem.mesh),
+				smem.locator_mem) );
+	smem.mesh.locator = &(smem.locator);
+	TRY( trace_end(depend, "mesh", smem.mesh.adj.num) );
+
+	/* Incremental heat fixes path nodes as insertion adds them */
+	bool incremental = depend->heat.update_heat != NULL;
+	const vtsp_mesh_t *heat_mesh = &(smem.mesh);
+	if (incremental) {
+		fix_envelope(&(smem.mesh), output, &(smem.heat_mesh));
+		heat_mesh = &(smem.heat_mesh);
+	}
+	TRY( trace_begin(depend, "heat") );
+	phase_mem = take_phase_mem(&mem, &smem, smem.binding.heat);
+	TRY( solve_heat(heat_mesh, &(smem.field), depend, phase_mem) );
+	TRY( trace_end(depend, "heat", smem.field.num) );
+
+	TRY( trace_begin(depend, "insert") );
+	if (!incremental) {
+		take_phase_mem(&mem, &smem, 0);
+	}
+	vtsp_insert_take(&(smem.insert), points->num, smem.max_nodes, &mem);
+	smem.insert.heat_mem = incremental ? phase_mem : NULL;
+	TRY( prepare_integral(&(smem.mesh), depend,
+			      vtsp_opmem_take(&mem, smem.binding.integral)) );
+	TRY( add_points(points, &(smem.mesh), &(smem.field), output, depend,
+			&(smem.insert)) );
+	TRY( trace_end(depend, "insert", output->num - n_envelope) );
+
+	if (depend->improver.improve_tour != NULL) {
+		TRY( trace_begin(depend, "improve") );
+		phase_mem = take_phase_mem(&mem, &smem, smem.binding.improver);
+		TRY( improve_tour(points, &(smem.mesh), output, depend,
+				  phase_mem) );
+		TRY( trace_end(depend, "improve", output->num) );
+	}
+	if (ordered) {
+		vtsp_renumber_tour(output, &(smem.order));
+	}
+	return SUCCESS;
+}
+
+static int order_points(const vtsp_points_t *input, vtsp_perm_t *output,
+			vtsp_depend_t *depend, void *op_mem)
+{
+	int status = depend->orderer.order_points(depend->orderer.ctx, input,
+						  output, op_mem);
+	char msg[100];
+	if (0 != status) {
+		TRY_NONEG( sprintf(msg, "Error ordering points (code %i).", status),
+			   ERROR_SPRINTF );
+		TRY( write_log(depend, VTSP_LOG_ERROR, msg) );
+		return ERROR;
+	}
+	if (output->num != input->num) {
+		TRY( write_log(depend, VTSP_LOG_ERROR,
+			       "Order does not list every point.") );
+		return ERROR;
+	}
 	return SUCCESS;
+ERROR_SPRINTF:
+	return ERROR_SPRINTF;
 }
 
 static int get_convex_envelope(const vtsp_points_t *input, vtsp_perm_t *output,
 			       vtsp_depend_t *depend, void *op_mem)
 {
 	int status = depend->envelope.get_convex_envelope(depend->envelope.ctx,
-							  input, output);
+							  input, output, op_mem);
 	char msg[100];
 	if (0 != status) {
 		TRY_NONEG( sprintf(msg, "Error computing convex envelope (code %i).", status),
 			   ERROR_SPRINTF );
-		TRY( write_log(depend, msg) );
+		TRY( write_log(depend, VTSP_LOG_ERROR, msg) );
 		return ERROR;
 	}
-	TRY_NONEG( sprintf(msg, "Convex envelope has %i points.", output->num),
-		   ERROR_SPRINTF );
 	TRY( log_perm(depend, output, "Indices forming convex envelope") );
-	TRY( write_log(depend, msg) );
+	if (log_enabled(depend, VTSP_LOG_INFO)) {
+		TRY_NONEG( sprintf(msg, "Convex envelope has %i points.",
+				   output->num), ERROR_SPRINTF );
+		TRY( write_log(depend, VTSP_LOG_INFO, msg) );
+	}
+	return SUCCESS;
+ERROR_SPRINTF:
+	return ERROR_SPRINTF;
+}
+
+static int get_mesh(const vtsp_points_t *input, const vtsp_perm_t *envelope,
+		    vtsp_mesh_t *mesh, const solve_mem_t *smem,
+		    vtsp_depend_t *depend, void *op_mem)
+{
+	int status = depend->mesher.get_mesh(depend->mesher.ctx, input,
+					     envelope, mesh, op_mem);
+	char msg[100];
+	if (0 != status) {
+		TRY_NONEG( sprintf(msg, "Error computing mesh (code %i).", status),
+			   ERROR_SPRINTF );
+		TRY( write_log(depend, VTSP_LOG_ERROR, msg) );
+		return ERROR;
+	}
+	if (mesh->map_vtx.num != input->num) {
+		TRY( write_log(depend, VTSP_LOG_ERROR,
+			       "Mesh does not map every input point.") );
+		return ERROR;
+	}
+	if (mesh->nodes.num > smem->max_nodes || mesh->adj.num > smem->max_trgs ||
+	    mesh->nodes.pts == NULL || mesh->adj.trgs == NULL ||
+	    mesh->map_vtx.index == NULL) {
+		TRY( write_log(depend, VTSP_LOG_ERROR,
+			       "Mesh is out of the bounds of the solve.") );
+		return ERROR;
+	}
+	if (log_enabled(depend, VTSP_LOG_INFO)) {
+		TRY_NONEG( sprintf(msg, "Mesh has %u nodes and %u triangles.",
+				   mesh->nodes.num, mesh->adj.num), ERROR_SPRINTF );
+		TRY( write_log(depend, VTSP_LOG_INFO, msg) );
+	}
+	return SUCCESS;
+ERROR_SPRINTF:
+	return ERROR_SPRINTF;
+}
+
+static void keep_mesh_output(vtsp_opmem_t *mem, solve_mem_t *smem)
+{
+	/* The mesh lives at the head of the mesher op_mem, phases follow */
+	vtsp_opmem_release(mem, smem->phase);
+	vtsp_opmem_take(mem, smem->binding.mesh_output);
+	smem->phase = vtsp_opmem_mark(mem);
+}
+
+static int renumber_mesh(vtsp_mesh_t *mesh, vtsp_depend_t *depend,
+			 vtsp_renumber_mem_t *mem, void *op_mem)
+{
+	/* Same orderer as the points, Steiner nodes fall among them */
+	TRY( order_points(&(mesh->nodes), &(mem->order), depend, op_mem) );
+	int status = vtsp_renumber_mesh(mesh, mem);
+	if (0 != status) {
+		TRY( write_log(depend, VTSP_LOG_ERROR,
+			       "Error renumbering mesh.") );
+		return ERROR;
+	}
+	return SUCCESS;
+}
+
+static void fix_envelope(const vtsp_mesh_t *mesh, const vtsp_perm_t *envelope,
+			 vtsp_mesh_t *heat_mesh)
+{
+	/* Same mesh, map_vtx only lists the nodes of the envelope */
+	heat_mesh->nodes = mesh->nodes;
+	heat_mesh->adj = mesh->adj;
+	heat_mesh->nbr = mesh->nbr;
+	heat_mesh->node_trgs = mesh->node_trgs;
+	heat_mesh->node_nodes = mesh->node_nodes;
+	heat_mesh->locator = mesh->locator;
+	uint32_t i;
+	for (i = 0; i < envelope->num; i++) {
+		heat_mesh->map_vtx.index[i] =
+			mesh->map_vtx.index[envelope->index[i]];
+	}
+	heat_mesh->map_vtx.num = envelope->num;
+}
+
+static int solve_heat(const vtsp_mesh_t *mesh, vtsp_field_t *field,
+		      vtsp_depend_t *depend, void *op_mem)
+{
+	field->num = mesh->nodes.num;
+	int status = depend->heat.solve_heat(depend->heat.ctx, mesh,
+					     VERTEX_TEMPERATURE, field, op_mem);
+	char msg[100];
+	if (0 != status) {
+		TRY_NONEG( sprintf(msg, "Error solving heat (code %i).", status),
+			   ERROR_SPRINTF );
+		TRY( write_log(depend, VTSP_LOG_ERROR, msg) );
+		return ERROR;
+	}
+	return SUCCESS;
+ERROR_SPRINTF:
+	return ERROR_SPRINTF;
+}
+
+static int prepare_integral(const vtsp_mesh_t *mesh, vtsp_depend_t *depend,
+			    void *op_mem)
+{
+	if (depend->integral.prepare == NULL) {
+		return SUCCESS;
+	}
+	int status = depend->integral.prepare(depend->integral.ctx, mesh,
+					      op_mem);
+	char msg[100];
+	if (0 != status) {
+		TRY_NONEG( sprintf(msg, "Error preparing integral (code %i).",
+				   status), ERROR_SPRINTF );
+		TRY( write_log(depend, VTSP_LOG_ERROR, msg) );
+		return ERROR;
+	}
+	return SUCCESS;
+ERROR_SPRINTF:
+	return ERROR_SPRINTF;
+}
+
+static int add_points(const vtsp_points_t *input, const vtsp_mesh_t *mesh,
+		      vtsp_field_t *field, vtsp_perm_t *output,
+		      vtsp_depend_t *depend, vtsp_insert_mem_t *mem)
+{
+	int status = vtsp_insert_points(input, mesh, field, depend, mem, output);
+	char msg[100];
+	if (0 != status) {
+		TRY_NONEG( sprintf(msg, "Error inserting points (code %i).", status),
+			   ERROR_SPRINTF );
+		TRY( write_log(depend, VTSP_LOG_ERROR, msg) );
+		return ERROR;
+	}
+	if (log_enabled(depend, VTSP_LOG_INFO)) {
+		TRY_NONEG( sprintf(msg, "Path visits %u points.", output->num),
+			   ERROR_SPRINTF );
+		TRY( write_log(depend, VTSP_LOG_INFO, msg) );
+	}
+	if (depend->drawer.draw_state != NULL) {
+		TRY( depend->drawer.draw_state(depend->drawer.ctx, input, mesh,
+					       field, output) );
+	}
+	return SUCCESS;
+ERROR_SPRINTF:
+	return ERROR_SPRINTF;
+}
+
+static int improve_tour(const vtsp_points_t *input, const vtsp_mesh_t *mesh,
+			vtsp_perm_t *output, vtsp_depend_t *depend,
+			void *op_mem)
+{
+	int status = depend->improver.improve_tour(depend->improver.ctx, input,
+						   mesh, output, op_mem);
+	char msg[100];
+	if (0 != status) {
+		TRY_NONEG( sprintf(msg, "Error improving tour (code %i).", status),
+			   ERROR_SPRINTF );
+		TRY( write_log(depend, VTSP_LOG_ERROR, msg) );
+		return ERROR;
+	}
 	return SUCCESS;
 ERROR_SPRINTF:
 	return ERROR_SPRINTF;
@@ -107,15 +662,27 @@ ERROR_SPRINTF:
 static int log_perm(vtsp_depend_t *depend,  vtsp_perm_t *perm,
 		    const char *prefix)
 {
+	if (!log_enabled(depend, VTSP_LOG_DEBUG)) {
+		return SUCCESS;
+	}
+	if (depend->logger.log_array != NULL) {
+		TRY_GOTO( depend->logger.log_array(depend->logger.ctx, prefix,
+						   perm->index, perm->num),
+			  ERROR_WRITE_LOG );
+		return SUCCESS;
+	}
+
 	char msg[100];
 	uint32_t i;
 	TRY_NONEG( sprintf(msg, "%s:", prefix), ERROR_SPRINTF );
-	TRY( write_log(depend, msg) );
+	TRY( write_log(depend, VTSP_LOG_DEBUG, msg) );
 	for (i = 0; i < perm->num; i++) {
 		TRY_NONEG( sprintf(msg, "  %u", perm->index[i]), ERROR_SPRINTF );
-		TRY( write_log(depend, msg) );
+		TRY( write_log(depend, VTSP_LOG_DEBUG, msg) );
 	}
 	return SUCCESS;
+ERROR_WRITE_LOG:
+	return ERROR_WRITE_LOG;
 ERROR_SPRINTF:
 	return ERROR_SPRINTF;
 }
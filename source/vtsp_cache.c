@@ -0,0 +1,434 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vtsp_cache.h"
+#include "try_macros.h"
+#include "vtsp_opmem.h"
+
+#define PROBE_ENTRIES 8             /* Window a pair may live in */
+#define ENTRIES_PER_NODE 4
+#define DEFAULT_MAX_ENTRIES (1u << 20)
+#define CHUNK_PAIRS 256             /* Pairs of a batch looked up at once */
+#define EMPTY (((uint64_t) UINT32_MAX << 32) | (UINT32_MAX - 1))
+#define BUSY UINT64_MAX             /* Entry being written */
+#define HIT UINT32_MAX
+#define READ_RETRIES 4              /* Reads of an entry being written */
+
+/*
+ * Keys hold the smaller point high, so neither EMPTY nor BUSY is a pair.
+ * Writers take an entry by swapping its key with BUSY, then write it
+ * between two bumps of seq, odd while the entry changes. Readers retry
+ * while seq is odd or moved, so key, value and epoch come from the
+ * same write, even when the key is rewritten for a new epoch.
+ */
+typedef struct {
+	uint64_t key;
+	uint64_t value;     /* Bits of the double */
+	uint32_t epoch;     /* Field the value was integrated on */
+	uint32_t ref;       /* Clock bit, set by hits */
+	uint32_t seq;       /* Writes started and ended */
+} entry_t;
+
+/* Lives at the start of the op_mem of prepare */
+typedef struct {
+	const vtsp_mesh_t *mesh;
+	entry_t *entries;
+	uint64_t mask;
+	uint32_t shift;
+	uint32_t epoch;     /* Entries of older epochs are free */
+	uint32_t hand;      /* Clock, start of the next eviction scan */
+} table_t;
+
+static uint64_t table_entries(const vtsp_cache_ctx_t *cctx,
+			      const vtsp_mesh_t *mesh);
+static void take_table(table_t *table, uint64_t n_entries,
+		       vtsp_opmem_t *mem);
+static int sizeof_inner(const vtsp_binding_integral_t *inner,
+			const vtsp_mesh_t *mesh, size_t *output);
+static int integrate(const vtsp_binding_integral_t *inner,
+		     const vtsp_field_t *field, const vtsp_mesh_t *mesh,
+		     const uint32_t *p1, const uint32_t *p2, uint32_t n,
+		     double *output);
+static int integrate_chunk(vtsp_cache_ctx_t *cctx, table_t *table,
+			   uint32_t epoch, const vtsp_field_t *field,
+			   const vtsp_mesh_t *mesh, const uint32_t *p1,
+			   const uint32_t *p2, uint32_t n, double *output);
+static uint64_t pair_key(uint32_t p1, uint32_t p2);
+static uint64_t hash(const table_t *table, uint64_t key);
+static bool lookup(table_t *table, uint64_t key, uint32_t epoch,
+		   double *output);
+static bool read_entry(entry_t *e, uint64_t *key, uint64_t *bits,
+		       uint32_t *epoch);
+static void store(table_t *table, uint64_t key, uint32_t epoch,
+		  double value);
+static entry_t *pick_victim(table_t *table, uint64_t key, uint32_t epoch,
+			    uint64_t *victim_key);
+
+int vtsp_bind_cache(vtsp_binding_integral_t *integral, vtsp_cache_ctx_t *ctx)
+{
+	THROW( ctx->integral == NULL || ctx->integral->integrate_path == NULL,
+	       ERROR );
+	ctx->table = NULL;
+	ctx->n_hits = 0;
+	ctx->n_misses = 0;
+	integral->ctx = ctx;
+	integral->prepare_sizeof_opmem = &vtsp_cache_prepare_sizeof_opmem;
+	integral->prepare = &vtsp_cache_prepare;
+	integral->integrate_path = &vtsp_cache_integrate_path;
+	integral->integrate_paths = &vtsp_cache_integrate_paths;
+	integral->invalidate = &vtsp_cache_invalidate;
+	return SUCCESS;
+}
+
+int vtsp_cache_prepare_sizeof_opmem(void *ctx, const vtsp_mesh_t *mesh,
+				    size_t *output)
+{
+	const vtsp_cache_ctx_t *cctx = (const vtsp_cache_ctx_t*) ctx;
+	size_t inner_size;
+	TRY( sizeof_inner(cctx->integral, mesh, &inner_size) );
+
+	table_t table;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, NULL);
+	vtsp_opmem_take(&mem, sizeof(table));
+	take_table(&table, table_entries(cctx, mesh), &mem);
+	vtsp_opmem_take(&mem, inner_size);
+
+	*output = vtsp_opmem_sizeof(&mem);
+	return SUCCESS;
+}
+
+int vtsp_cache_prepare(void *ctx, const vtsp_mesh_t *mesh, void *op_mem)
+{
+	vtsp_cache_ctx_t *cctx = (vtsp_cache_ctx_t*) ctx;
+	const vtsp_binding_integral_t *inner = cctx->integral;
+	size_t inner_size;
+	TRY( sizeof_inner(inner, mesh, &inner_size) );
+
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, op_mem);
+	table_t *table = vtsp_opmem_take(&mem, sizeof(*table));
+	take_table(table, table_entries(cctx, mesh), &mem);
+	void *inner_mem = vtsp_opmem_take(&mem, inner_size);
+	if (inner->prepare != NULL) {
+		TRY( inner->prepare(inner->ctx, mesh, inner_mem) );
+	}
+
+	uint64_t i;
+	for (i = 0; i <= table->mask; i++) {
+		table->entries[i].key = EMPTY;
+		table->entries[i].value = 0;
+		table->entries[i].epoch = 0;
+		table->entries[i].ref = 0;
+		table->entries[i].seq = 0;
+	}
+	table->mesh = mesh;
+	table->epoch = 1;
+	table->hand = 0;
+	cctx->n_hits = 0;
+	cctx->n_misses = 0;
+	cctx->table = table;
+	return SUCCESS;
+}
+
+int vtsp_cache_integrate_path(void *ctx, const vtsp_field_t *field,
+			      const vtsp_mesh_t *mesh, uint32_t p1,
+			      uint32_t p2, double *output)
+{
+	vtsp_cache_ctx_t *cctx = (vtsp_cache_ctx_t*) ctx;
+	table_t *table = cctx->table;
+	THROW( table == NULL || table->mesh != mesh, ERROR );
+	uint32_t epoch = __atomic_load_n(&(table->epoch), __ATOMIC_ACQUIRE);
+	uint64_t key = pair_key(p1, p2);
+	if (lookup(table, key, epoch, output)) {
+		__atomic_fetch_add(&(cctx->n_hits), 1, __ATOMIC_RELAXED);
+		return SUCCESS;
+	}
+	const vtsp_binding_integral_t *inner = cctx->integral;
+	TRY( inner->integrate_path(inner->ctx, field, mesh, p1, p2, output) );
+	store(table, key, epoch, *output);
+	__atomic_fetch_add(&(cctx->n_misses), 1, __ATOMIC_RELAXED);
+	return SUCCESS;
+}
+
+int vtsp_cache_integrate_paths(void *ctx, const vtsp_field_t *field,
+			       const vtsp_mesh_t *mesh, const uint32_t *p1,
+			       const uint32_t *p2, uint32_t n, double *output)
+{
+	vtsp_cache_ctx_t *cctx = (vtsp_cache_ctx_t*) ctx;
+	table_t *table = cctx->table;
+	THROW( table == NULL || table->mesh != mesh, ERROR );
+	uint32_t epoch = __atomic_load_n(&(table->epoch), __ATOMIC_ACQUIRE);
+	uint32_t i;
+	for (i = 0; i < n; i += CHUNK_PAIRS) {
+		uint32_t n_chunk = n - i < CHUNK_PAIRS ? n - i : CHUNK_PAIRS;
+		TRY( integrate_chunk(cctx, table, epoch, field, mesh, p1 + i,
+				     p2 + i, n_chunk, output + i) );
+	}
+	return SUCCESS;
+}
+
+int vtsp_cache_invalidate(void *ctx)
+{
+	/* Epochs do not wrap, a solve invalidates once per point at most */
+	vtsp_cache_ctx_t *cctx = (vtsp_cache_ctx_t*) ctx;
+	table_t *table = cctx->table;
+	if (table != NULL) {
+		__atomic_add_fetch(&(table->epoch), 1, __ATOMIC_RELEASE);
+	}
+	return SUCCESS;
+}
+
+static uint64_t table_entries(const vtsp_cache_ctx_t *cctx,
+			      const vtsp_mesh_t *mesh)
+{
+	uint64_t wanted = cctx->n_entries;
+	if (wanted == 0) {
+		wanted = ENTRIES_PER_NODE * (uint64_t) mesh->nodes.num;
+		if (wanted > DEFAULT_MAX_ENTRIES) {
+			wanted = DEFAULT_MAX_ENTRIES;
+		}
+	}
+	uint64_t n = PROBE_ENTRIES;
+	while (n < wanted) {
+		n <<= 1;
+	}
+	return n;
+}
+
+static void take_table(table_t *table, uint64_t n_entries,
+		       vtsp_opmem_t *mem)
+{
+	table->entries = vtsp_opmem_take(mem, n_entries *
+					 sizeof(*(table->entries)));
+	table->mask = n_entries - 1;
+	table->shift = 64;
+	while (n_entries > 1) {
+		n_entries >>= 1;
+		table->shift --;
+	}
+}
+
+static int sizeof_inner(const vtsp_binding_integral_t *inner,
+			const vtsp_mesh_t *mesh, size_t *output)
+{
+	*output = 0;
+	if (inner->prepare != NULL && inner->prepare_sizeof_opmem != NULL) {
+		TRY( inner->prepare_sizeof_opmem(inner->ctx, mesh, output) );
+	}
+	return SUCCESS;
+}
+
+static int integrate(const vtsp_binding_integral_t *inner,
+		     const vtsp_field_t *field, const vtsp_mesh_t *mesh,
+		     const uint32_t *p1, const uint32_t *p2, uint32_t n,
+		     double *output)
+{
+	if (inner->integrate_paths != NULL) {
+		TRY( inner->integrate_paths(inner->ctx, field, mesh, p1, p2, n,
+					    output) );
+		return SUCCESS;
+	}
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		TRY( inner->integrate_path(inner->ctx, field, mesh, p1[i],
+					   p2[i], &(output[i])) );
+	}
+	return SUCCESS;
+}
+
+static int integrate_chunk(vtsp_cache_ctx_t *cctx, table_t *table,
+			   uint32_t epoch, const vtsp_field_t *field,
+			   const vtsp_mesh_t *mesh, const uint32_t *p1,
+			   const uint32_t *p2, uint32_t n, double *output)
+{
+	/*
+	 * Misses go to the integral in one batch, each pair once: a
+	 * batch often holds both directions of an edge. The scratch is
+	 * on the stack, so concurrent callers share nothing but the table.
+	 */
+	uint64_t miss_key[CHUNK_PAIRS];
+	uint32_t miss_p1[CHUNK_PAIRS], miss_p2[CHUNK_PAIRS];
+	double miss_value[CHUNK_PAIRS];
+	uint32_t from[CHUNK_PAIRS];           /* Miss serving each pair */
+	uint16_t seen[2 * CHUNK_PAIRS];       /* Misses by key, 1 based */
+	uint32_t n_miss = 0;
+	uint64_t n_hits = 0;
+	memset(seen, 0, sizeof(seen));
+
+	uint32_t k;
+	for (k = 0; k < n; k++) {
+		uint64_t key = pair_key(p1[k], p2[k]);
+		if (lookup(table, key, epoch, &(output[k]))) {
+			from[k] = HIT;
+			n_hits ++;
+			continue;
+		}
+		uint32_t s = (uint32_t) (hash(table, key) &
+					 (2 * CHUNK_PAIRS - 1));
+		while (seen[s] != 0 && miss_key[seen[s] - 1] != key) {
+			s = (s + 1) & (2 * CHUNK_PAIRS - 1);
+		}
+		if (seen[s] != 0) {
+			from[k] = seen[s] - 1;
+			n_hits ++;
+			continue;
+		}
+		miss_key[n_miss] = key;
+		miss_p1[n_miss] = p1[k];
+		miss_p2[n_miss] = p2[k];
+		from[k] = n_miss;
+		seen[s] = (uint16_t) ++n_miss;
+	}
+
+	if (n_miss > 0) {
+		TRY( integrate(cctx->integral, field, mesh, miss_p1, miss_p2,
+			       n_miss, miss_value) );
+	}
+	uint32_t m;
+	for (m = 0; m < n_miss; m++) {
+		store(table, miss_key[m], epoch, miss_value[m]);
+	}
+	for (k = 0; k < n; k++) {
+		if (from[k] != HIT) {
+			output[k] = miss_value[from[k]];
+		}
+	}
+	__atomic_fetch_add(&(cctx->n_hits), n_hits, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&(cctx->n_misses), n_miss, __ATOMIC_RELAXED);
+	return SUCCESS;
+}
+
+static uint64_t pair_key(uint32_t p1, uint32_t p2)
+{
+	/* The integral does not depend on the direction */
+	if (p1 > p2) {
+		uint32_t swap = p1;
+		p1 = p2;
+		p2 = swap;
+	}
+	return ((uint64_t) p1 << 32) | p2;
+}
+
+static uint64_t hash(const table_t *table, uint64_t key)
+{
+	/* Fibonacci hashing, the high bits mix every bit of the key */
+	return (key * UINT64_C(0x9E3779B97F4A7C15)) >> table->shift;
+}
+
+static bool lookup(table_t *table, uint64_t key, uint32_t epoch,
+		   double *output)
+{
+	uint64_t h = hash(table, key);
+	uint32_t k;
+	for (k = 0; k < PROBE_ENTRIES; k++) {
+		entry_t *e = &(table->entries[(h + k) & table->mask]);
+		if (__atomic_load_n(&(e->key), __ATOMIC_RELAXED) != key) {
+			continue;
+		}
+		uint64_t e_key, bits;
+		uint32_t e_epoch;
+		if (!read_entry(e, &e_key, &bits, &e_epoch) || e_key != key ||
+		    e_epoch != epoch) {
+			continue; /* Still being written, rewritten, or stale */
+		}
+		if (__atomic_load_n(&(e->ref), __ATOMIC_RELAXED) == 0) {
+			__atomic_store_n(&(e->ref), 1, __ATOMIC_RELAXED);
+		}
+		memcpy(output, &bits, sizeof(*output));
+		return true;
+	}
+	return false;
+}
+
+static bool read_entry(entry_t *e, uint64_t *key, uint64_t *bits,
+		       uint32_t *epoch)
+{
+	uint32_t r;
+	for (r = 0; r < READ_RETRIES; r++) {
+		uint32_t seq = __atomic_load_n(&(e->seq), __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			continue;
+		}
+		*key = __atomic_load_n(&(e->key), __ATOMIC_RELAXED);
+		*bits = __atomic_load_n(&(e->value), __ATOMIC_RELAXED);
+		*epoch = __atomic_load_n(&(e->epoch), __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&(e->seq), __ATOMIC_RELAXED) == seq) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void store(table_t *table, uint64_t key, uint32_t epoch,
+		  double value)
+{
+	/* A lost race drops the store, the cache stays best effort */
+	uint64_t victim_key;
+	entry_t *e = pick_victim(table, key, epoch, &victim_key);
+	if (e == NULL || !__atomic_compare_exchange_n(&(e->key), &victim_key,
+						      BUSY, false,
+						      __ATOMIC_ACQUIRE,
+						      __ATOMIC_RELAXED)) {
+		return;
+	}
+	/* The entry is ours while its key is BUSY */
+	uint32_t seq = __atomic_load_n(&(e->seq), __ATOMIC_RELAXED);
+	__atomic_store_n(&(e->seq), seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	__atomic_store_n(&(e->value), bits, __ATOMIC_RELAXED);
+	__atomic_store_n(&(e->epoch), epoch, __ATOMIC_RELAXED);
+	__atomic_store_n(&(e->ref), 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&(e->key), key, __ATOMIC_RELAXED);
+	__atomic_store_n(&(e->seq), seq + 2, __ATOMIC_RELEASE);
+}
+
+static entry_t *pick_victim(table_t *table, uint64_t key, uint32_t epoch,
+			    uint64_t *victim_key)
+{
+	/*
+	 * The entry of the pair itself, else a free or stale one, else
+	 * the clock hand goes around the window clearing reference bits
+	 * and takes the first entry not hit since its last pass.
+	 */
+	uint64_t h = hash(table, key);
+	entry_t *victim = NULL;
+	uint32_t k;
+	for (k = 0; k < PROBE_ENTRIES; k++) {
+		entry_t *e = &(table->entries[(h + k) & table->mask]);
+		uint64_t old = __atomic_load_n(&(e->key), __ATOMIC_RELAXED);
+		if (old == key) {
+			*victim_key = old;
+			return e;
+		}
+		if (victim == NULL && old != BUSY && (old == EMPTY ||
+		    __atomic_load_n(&(e->epoch), __ATOMIC_RELAXED) != epoch)) {
+			victim = e;
+			*victim_key = old;
+		}
+	}
+	if (victim != NULL) {
+		return victim;
+	}
+
+	uint32_t hand = __atomic_fetch_add(&(table->hand), 1, __ATOMIC_RELAXED);
+	for (k = 0; k < 2 * PROBE_ENTRIES; k++) {
+		entry_t *e = &(table->entries[(h + (hand + k) % PROBE_ENTRIES) &
+					      table->mask]);
+		uint64_t old = __atomic_load_n(&(e->key), __ATOMIC_RELAXED);
+		if (old == BUSY) {
+			continue;
+		}
+		if (__atomic_load_n(&(e->ref), __ATOMIC_RELAXED) != 0) {
+			__atomic_store_n(&(e->ref), 0, __ATOMIC_RELAXED);
+			continue;
+		}
+		*victim_key = old;
+		return e;
+	}
+	return NULL;
+}
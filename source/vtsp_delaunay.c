@@ -0,0 +1,1170 @@
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vtsp_delaunay.h"
+#include "try_macros.h"
+#include "vtsp_opmem.h"
+#include "vtsp_parallel.h"
+#include "vtsp_sort.h"
+#include "vtsp_topology.h"
+
+#define MIN_NODES_PER_THREAD 65536
+#define STRIP_ROOT_DIV 4  /* sqrt(n) / 4 strips of 4 sqrt(n) nodes */
+#define RADIX_BITS 8
+#define RADIX (1u << RADIX_BITS)
+#define KEY_BITS 64
+#define QUADS_PER_NODE 3  /* Planar graphs have less than 3n edges */
+#define NO_NODE UINT32_MAX
+#define NO_EDGE UINT32_MAX
+/* Predicates, Shewchuk's filter bounds, eps is half an ulp of 1 */
+#define PRED_EPS (DBL_EPSILON / 2)
+#define ORIENT_BOUND ((3.0 + 16.0 * PRED_EPS) * PRED_EPS)
+#define IN_CIRCLE_BOUND ((10.0 + 96.0 * PRED_EPS) * PRED_EPS)
+#define SPLITTER 134217729.0  /* 2^27 + 1, halves a double mantissa */
+#define MINOR_TERMS 6         /* Float products in a 3x3 orient minor */
+#define IN_CIRCLE_TERMS (4 * 2 * 2 * MINOR_TERMS)
+
+/*
+ * Quad-edge structure over indices, edge e = 4 * quad + rotation.
+ * Rotations 0 and 2 are the two directions of the edge, 1 and 3 its
+ * dual. next[e] is onext(e), org[e >> 1] the origin of an even e,
+ * NO_NODE for a quad not in use.
+ */
+typedef struct {
+	const vtsp_point_t *pts;
+	uint32_t *next;
+	uint32_t *org;
+} quads_t;
+
+/* Quads of a part, bumped from its range then recycled */
+typedef struct {
+	uint32_t cur, end;
+	uint32_t free, tail;  /* Free list linked through next[4 * quad] */
+} pool_t;
+
+/* Hull edges of a triangulation, as Guibas and Stolfi return them */
+typedef struct {
+	uint32_t le;  /* CCW hull edge out of the leftmost node */
+	uint32_t re;  /* CW hull edge out of the rightmost node */
+} hull_t;
+
+typedef struct {
+	const vtsp_point_t *pts;
+	uint32_t n;
+	vtsp_mesh_t *mesh;
+	/* Sort, released once the nodes are written */
+	uint64_t *keys[2];
+	uint32_t *index[2];
+	uint32_t *count;      /* RADIX per thread, then their offsets */
+	uint32_t src;         /* Buffer holding the current order */
+	uint32_t shift;       /* Digit sorted by the current pass */
+	uint32_t n_new[PARALLEL_MAX_THREADS];
+	/* Triangulation, one pool and hull per part, a run of strips */
+	quads_t q;
+	uint32_t n_quads;
+	uint32_t n_strips;
+	vtsp_point_t *turned; /* Nodes turned, for the cuts inside strips */
+	uint32_t *order;      /* Nodes of each strip in the turned order */
+	uint32_t *scratch;
+	pool_t pool[PARALLEL_MAX_THREADS];
+	hull_t hull[PARALLEL_MAX_THREADS];
+	uint32_t n_parts;
+	uint32_t stride;      /* Parts apart at the current merge level */
+	/* Extraction */
+	uint32_t *trg_of;     /* Left triangle of each directed edge, e >> 1 */
+	uint8_t *is_first;    /* Directed edge starting a triangle, e >> 1 */
+	uint32_t *trg_edge;   /* First edge of each triangle */
+	uint32_t outer;       /* First edge of the outer face if a triangle */
+	uint32_t n_trgs[PARALLEL_MAX_THREADS];
+} delaunay_job_t;
+
+static void take_output(vtsp_mesh_t *mesh, uint32_t n, vtsp_opmem_t *mem);
+static void take_sort(delaunay_job_t *job, uint32_t n, vtsp_opmem_t *mem);
+static void take_quads(delaunay_job_t *job, uint32_t n_nodes,
+		       vtsp_opmem_t *mem);
+static void take_strips(delaunay_job_t *job, uint32_t n_nodes,
+			vtsp_opmem_t *mem);
+static void take_extract(delaunay_job_t *job, uint32_t n_nodes,
+			 vtsp_opmem_t *mem);
+static int check_output(const vtsp_mesh_t *mesh, uint32_t n);
+static int sort_points(delaunay_job_t *job, uint32_t n_threads);
+static int make_keys(void *ctx, uint32_t id, uint32_t n_threads);
+static int count_digits(void *ctx, uint32_t id, uint32_t n_threads);
+static bool prefix_counts(delaunay_job_t *job, uint32_t n_threads);
+static int scatter(void *ctx, uint32_t id, uint32_t n_threads);
+static int count_nodes(void *ctx, uint32_t id, uint32_t n_threads);
+static int write_nodes(void *ctx, uint32_t id, uint32_t n_threads);
+static int triangulate(delaunay_job_t *job, uint32_t n_threads);
+static int triangulate_part(void *ctx, uint32_t id, uint32_t n_threads);
+static int triangulate_strip(delaunay_job_t *job, pool_t *pool,
+			     uint32_t strip, hull_t *output);
+static int find_hull_ends(const quads_t *q, uint32_t e0, uint32_t left,
+			  uint32_t right, hull_t *output);
+static int merge_parts(void *ctx, uint32_t id, uint32_t n_threads);
+static int divide(quads_t *q, pool_t *pool, const uint32_t *order,
+		  uint32_t begin, uint32_t end, hull_t *output);
+static int merge(quads_t *q, pool_t *pool, const hull_t *l, const hull_t *r,
+		 hull_t *output);
+static void join_pools(quads_t *q, pool_t *a, const pool_t *b);
+static int extract(delaunay_job_t *job, uint32_t n_threads);
+static int count_trgs(void *ctx, uint32_t id, uint32_t n_threads);
+static int write_trgs(void *ctx, uint32_t id, uint32_t n_threads);
+static int write_nbrs(void *ctx, uint32_t id, uint32_t n_threads);
+static bool is_first_of_trg(const quads_t *q, uint32_t e, uint32_t outer);
+static int check_envelope(delaunay_job_t *job, const vtsp_perm_t *envelope);
+static bool hull_covers(const quads_t *q, const uint32_t *hull, uint32_t h,
+			const uint32_t *nodes, uint32_t n, int dir);
+
+static uint32_t make_edge(quads_t *q, pool_t *pool, uint32_t a, uint32_t b);
+static uint32_t connect(quads_t *q, pool_t *pool, uint32_t a, uint32_t b);
+static void delete_edge(quads_t *q, pool_t *pool, uint32_t e);
+static void splice(quads_t *q, uint32_t a, uint32_t b);
+static bool is_right_of(const quads_t *q, uint32_t p, uint32_t e);
+static bool is_left_of(const quads_t *q, uint32_t p, uint32_t e);
+static double orient(const vtsp_point_t *pts, uint32_t a, uint32_t b,
+		     uint32_t c);
+static bool in_circle(const vtsp_point_t *pts, uint32_t a, uint32_t b,
+		      uint32_t c, uint32_t d);
+static double orient_exact(const vtsp_point_t *a, const vtsp_point_t *b,
+			   const vtsp_point_t *c);
+static bool in_circle_exact(const vtsp_point_t *pts, uint32_t a, uint32_t b,
+			    uint32_t c, uint32_t d);
+static uint32_t minor_exact(const vtsp_point_t *a, const vtsp_point_t *b,
+			    const vtsp_point_t *c, double *h);
+static uint32_t add_scaled(uint32_t n, double *e, uint32_t n_f,
+			   const double *f, double b);
+static uint32_t grow_expansion(uint32_t n, double *e, double b);
+static void two_sum(double a, double b, double *x, double *y);
+static void two_product(double a, double b, double *x, double *y);
+static void split(double a, double *hi, double *lo);
+static uint64_t point_key(const vtsp_point_t *p);
+static uint32_t float_key(float v);
+
+static inline uint32_t rot(uint32_t e)
+{
+	return (e & ~3u) | ((e + 1) & 3u);
+}
+
+static inline uint32_t rot_inv(uint32_t e)
+{
+	return (e & ~3u) | ((e + 3) & 3u);
+}
+
+static inline uint32_t sym(uint32_t e)
+{
+	return e ^ 2u;
+}
+
+static inline uint32_t onext(const quads_t *q, uint32_t e)
+{
+	return q->next[e];
+}
+
+static inline uint32_t oprev(const quads_t *q, uint32_t e)
+{
+	return rot(q->next[rot(e)]);
+}
+
+static inline uint32_t lnext(const quads_t *q, uint32_t e)
+{
+	return rot(q->next[rot_inv(e)]);
+}
+
+static inline uint32_t rprev(const quads_t *q, uint32_t e)
+{
+	return q->next[sym(e)];
+}
+
+static inline uint32_t org(const quads_t *q, uint32_t e)
+{
+	return q->org[e >> 1];
+}
+
+static inline uint32_t dest(const quads_t *q, uint32_t e)
+{
+	return q->org[sym(e) >> 1];
+}
+
+int vtsp_bind_delaunay(vtsp_binding_mesher_t *mesher,
+		       vtsp_delaunay_ctx_t *ctx)
+{
+	mesher->ctx = ctx;
+	mesher->get_mesh_sizeof_opmem = &vtsp_delaunay_mesh_sizeof_opmem;
+	mesher->get_mesh_sizeof_output = &vtsp_delaunay_mesh_sizeof_output;
+	mesher->get_mesh = &vtsp_delaunay_mesh;
+	return SUCCESS;
+}
+
+int vtsp_delaunay_mesh_sizeof_opmem(void *ctx, const vtsp_points_t *input_pts,
+				    const vtsp_perm_t *input_envelope,
+				    const vtsp_mesh_t *output_ref,
+				    size_t *output)
+{
+	/* Layout: output of the handoff | sort, then quads | strips, then
+	 * extraction */
+	delaunay_job_t job;
+	vtsp_mesh_t mesh = *output_ref;
+	uint32_t n = input_pts->num;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, NULL);
+	take_output(&mesh, n, &mem);
+	size_t mark = vtsp_opmem_mark(&mem);
+	take_sort(&job, n, &mem);
+	vtsp_opmem_release(&mem, mark);
+	take_quads(&job, n, &mem);
+	mark = vtsp_opmem_mark(&mem);
+	take_strips(&job, n, &mem);
+	vtsp_opmem_release(&mem, mark);
+	take_extract(&job, n, &mem);
+
+	*output = vtsp_opmem_sizeof(&mem);
+	return SUCCESS;
+}
+
+int vtsp_delaunay_mesh_sizeof_output(void *ctx, const vtsp_points_t *input_pts,
+				     const vtsp_perm_t *input_envelope,
+				     const vtsp_mesh_t *output_ref,
+				     size_t *output)
+{
+	vtsp_mesh_t mesh = *output_ref;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, NULL);
+	take_output(&mesh, input_pts->num, &mem);
+
+	/* The head of op_mem, without the alignment slack */
+	*output = vtsp_opmem_mark(&mem);
+	return SUCCESS;
+}
+
+int vtsp_delaunay_mesh(void *ctx, const vtsp_points_t *input_pts,
+		       const vtsp_perm_t *input_envelope,
+		       vtsp_mesh_t *output_ref, void *op_mem)
+{
+	const vtsp_delaunay_ctx_t *dctx = (const vtsp_delaunay_ctx_t*) ctx;
+	uint32_t n = input_pts->num;
+	THROW( n < 3, MALFORMED_INPUT );
+
+	/* The head of op_mem is the output when no arrays are given */
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, op_mem);
+	vtsp_mesh_t head = *output_ref;
+	take_output(&head, n, &mem);
+	if (output_ref->nodes.pts == NULL) {
+		output_ref->nodes = head.nodes;
+		output_ref->adj = head.adj;
+		output_ref->map_vtx = head.map_vtx;
+	}
+	TRY( check_output(output_ref, n) );
+
+	delaunay_job_t job;
+	job.pts = input_pts->pts;
+	job.n = n;
+	job.mesh = output_ref;
+	uint32_t requested = dctx ? dctx->n_threads : 0;
+	size_t mark = vtsp_opmem_mark(&mem);
+	take_sort(&job, n, &mem);
+	TRY( sort_points(&job, vtsp_parallel_threads(requested, n,
+						     MIN_NODES_PER_THREAD)) );
+	vtsp_opmem_release(&mem, mark);
+
+	uint32_t n_nodes = output_ref->nodes.num;
+	THROW( n_nodes < 3, MALFORMED_INPUT );
+	take_quads(&job, n_nodes, &mem);
+	mark = vtsp_opmem_mark(&mem);
+	take_strips(&job, n_nodes, &mem);
+	uint32_t n_threads = vtsp_parallel_threads(requested, n_nodes,
+						   MIN_NODES_PER_THREAD);
+	TRY( triangulate(&job, n_threads) );
+	vtsp_opmem_release(&mem, mark);
+	take_extract(&job, n_nodes, &mem);
+	TRY( extract(&job, n_threads) );
+	THROW( output_ref->adj.num == 0, MALFORMED_INPUT ); /* Collinear */
+	TRY( check_envelope(&job, input_envelope) );
+	return SUCCESS;
+}
+
+static void take_output(vtsp_mesh_t *mesh, uint32_t n, vtsp_opmem_t *mem)
+{
+	/* Sized for the points, duplicates only make it smaller */
+	mesh->nodes.num = 0;
+	mesh->nodes.n_alloc = n;
+	mesh->nodes.pts = vtsp_opmem_take(mem, n * sizeof(*(mesh->nodes.pts)));
+	mesh->adj.num = 0;
+	mesh->adj.n_alloc = 2 * n;
+	mesh->adj.trgs = vtsp_opmem_take(mem, 2 * (size_t) n *
+					 sizeof(*(mesh->adj.trgs)));
+	mesh->map_vtx.num = 0;
+	mesh->map_vtx.n_alloc = n;
+	mesh->map_vtx.index = vtsp_opmem_take(mem, n *
+					      sizeof(*(mesh->map_vtx.index)));
+}
+
+static void take_sort(delaunay_job_t *job, uint32_t n, vtsp_opmem_t *mem)
+{
+	job->keys[0] = vtsp_opmem_take(mem, n * sizeof(*(job->keys[0])));
+	job->keys[1] = vtsp_opmem_take(mem, n * sizeof(*(job->keys[1])));
+	job->index[0] = vtsp_opmem_take(mem, n * sizeof(*(job->index[0])));
+	job->index[1] = vtsp_opmem_take(mem, n * sizeof(*(job->index[1])));
+	job->count = vtsp_opmem_take(mem, PARALLEL_MAX_THREADS * RADIX *
+				     sizeof(*(job->count)));
+}
+
+static void take_quads(delaunay_job_t *job, uint32_t n_nodes,
+		       vtsp_opmem_t *mem)
+{
+	size_t n_quads = QUADS_PER_NODE * (size_t) n_nodes;
+	job->n_quads = (uint32_t) n_quads;
+	job->q.next = vtsp_opmem_take(mem, 4 * n_quads * sizeof(*(job->q.next)));
+	job->q.org = vtsp_opmem_take(mem, 2 * n_quads * sizeof(*(job->q.org)));
+}
+
+static void take_strips(delaunay_job_t *job, uint32_t n_nodes,
+			vtsp_opmem_t *mem)
+{
+	job->turned = vtsp_opmem_take(mem, n_nodes * sizeof(*(job->turned)));
+	job->order = vtsp_opmem_take(mem, n_nodes * sizeof(*(job->order)));
+	job->scratch = vtsp_opmem_take(mem, n_nodes * sizeof(*(job->scratch)));
+}
+
+static void take_extract(delaunay_job_t *job, uint32_t n_nodes,
+			 vtsp_opmem_t *mem)
+{
+	job->trg_of = vtsp_opmem_take(mem, 2 * (size_t) job->n_quads *
+				      sizeof(*(job->trg_of)));
+	job->is_first = vtsp_opmem_take(mem, 2 * (size_t) job->n_quads *
+					sizeof(*(job->is_first)));
+	job->trg_edge = vtsp_opmem_take(mem, 2 * (size_t) n_nodes *
+					sizeof(*(job->trg_edge)));
+}
+
+static int check_output(const vtsp_mesh_t *mesh, uint32_t n)
+{
+	/* Triangles of n nodes are less than 2n */
+	THROW( mesh->nodes.pts == NULL || mesh->adj.trgs == NULL ||
+	       mesh->map_vtx.index == NULL, ERROR );
+	THROW( mesh->nodes.n_alloc < n || mesh->map_vtx.n_alloc < n, ERROR );
+	THROW( mesh->adj.n_alloc < 2 * (size_t) n, ERROR );
+	return SUCCESS;
+}
+
+static int sort_points(delaunay_job_t *job, uint32_t n_threads)
+{
+	job->src = 0;
+	TRY( vtsp_parallel_run(n_threads, &make_keys, job) );
+	for (job->shift = 0; job->shift < KEY_BITS; job->shift += RADIX_BITS) {
+		TRY( vtsp_parallel_run(n_threads, &count_digits, job) );
+		if (!prefix_counts(job, n_threads)) {
+			continue; /* Every key has the same digit */
+		}
+		TRY( vtsp_parallel_run(n_threads, &scatter, job) );
+		job->src = 1 - job->src;
+	}
+
+	/* Equal keys are equal points, each run becomes one node */
+	TRY( vtsp_parallel_run(n_threads, &count_nodes, job) );
+	uint32_t sum = 0;
+	uint32_t t;
+	for (t = 0; t < n_threads; t++) {
+		uint32_t c = job->n_new[t];
+		job->n_new[t] = sum;
+		sum += c;
+	}
+	TRY( vtsp_parallel_run(n_threads, &write_nodes, job) );
+	job->mesh->nodes.num = sum;
+	job->mesh->map_vtx.num = job->n;
+	return SUCCESS;
+}
+
+static int make_keys(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	delaunay_job_t *job = (delaunay_job_t*) ctx;
+	uint32_t begin, end, i;
+	vtsp_parallel_range(job->n, id, n_threads, &begin, &end);
+	for (i = begin; i < end; i++) {
+		job->keys[0][i] = point_key(&(job->pts[i]));
+		job->index[0][i] = i;
+	}
+	return SUCCESS;
+}
+
+static int count_digits(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	delaunay_job_t *job = (delaunay_job_t*) ctx;
+	uint32_t begin, end, i;
+	vtsp_parallel_range(job->n, id, n_threads, &begin, &end);
+
+	uint32_t *count = &(job->count[id * RADIX]);
+	memset(count, 0, RADIX * sizeof(*count));
+	const uint64_t *keys = job->keys[job->src];
+	for (i = begin; i < end; i++) {
+		count[(keys[i] >> job->shift) & (RADIX - 1)] ++;
+	}
+	return SUCCESS;
+}
+
+/* Counts become where each thread writes each digit, false if no-op */
+static bool prefix_counts(delaunay_job_t *job, uint32_t n_threads)
+{
+	uint32_t d, t;
+	for (d = 0; d < RADIX; d++) {
+		uint32_t total = 0;
+		for (t = 0; t < n_threads; t++) {
+			total += job->count[t * RADIX + d];
+		}
+		if (total == job->n) {
+			return false;
+		}
+	}
+
+	uint32_t sum = 0;
+	for (d = 0; d < RADIX; d++) {
+		for (t = 0; t < n_threads; t++) {
+			uint32_t c = job->count[t * RADIX + d];
+			job->count[t * RADIX + d] = sum;
+			sum += c;
+		}
+	}
+	return true;
+}
+
+static int scatter(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	delaunay_job_t *job = (delaunay_job_t*) ctx;
+	uint32_t begin, end, i;
+	vtsp_parallel_range(job->n, id, n_threads, &begin, &end);
+
+	uint32_t *offset = &(job->count[id * RADIX]);
+	const uint64_t *src_keys = job->keys[job->src];
+	const uint32_t *src_index = job->index[job->src];
+	uint64_t *dst_keys = job->keys[1 - job->src];
+	uint32_t *dst_index = job->index[1 - job->src];
+	for (i = begin; i < end; i++) {
+		uint64_t key = src_keys[i];
+		uint32_t pos = offset[(key >> job->shift) & (RADIX - 1)] ++;
+		dst_keys[pos] = key;
+		dst_index[pos] = src_index[i];
+	}
+	return SUCCESS;
+}
+
+static int count_nodes(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	delaunay_job_t *job = (delaunay_job_t*) ctx;
+	uint32_t begin, end, i;
+	vtsp_parallel_range(job->n, id, n_threads, &begin, &end);
+
+	const uint64_t *keys = job->keys[job->src];
+	uint32_t n_new = 0;
+	for (i = begin; i < end; i++) {
+		n_new += (i == 0 || keys[i] != keys[i - 1]);
+	}
+	job->n_new[id] = n_new;
+	return SUCCESS;
+}
+
+static int write_nodes(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	delaunay_job_t *job = (delaunay_job_t*) ctx;
+	uint32_t begin, end, i;
+	vtsp_parallel_range(job->n, id, n_threads, &begin, &end);
+
+	const uint64_t *keys = job->keys[job->src];
+	const uint32_t *index = job->index[job->src];
+	vtsp_mesh_t *mesh = job->mesh;
+	uint32_t node = job->n_new[id] - 1; /* Wraps until the first run */
+	for (i = begin; i < end; i++) {
+		if (i == 0 || keys[i] != keys[i - 1]) {
+			node ++;
+			mesh->nodes.pts[node] = job->pts[index[i]];
+		}
+		mesh->map_vtx.index[index[i]] = node;
+	}
+	return SUCCESS;
+}
+
+static int triangulate(delaunay_job_t *job, uint32_t n_threads)
+{
+	/* Dwyer: strips about as wide as their cells are high */
+	uint32_t n_nodes = job->mesh->nodes.num;
+	job->q.pts = job->mesh->nodes.pts;
+	job->n_strips = (uint32_t) (sqrt((double) n_nodes) / STRIP_ROOT_DIV);
+	if (job->n_strips > n_nodes / 2) {
+		job->n_strips = n_nodes / 2;
+	}
+	if (job->n_strips < n_threads) {
+		job->n_strips = n_threads;
+	}
+	job->n_parts = n_threads;
+	TRY( vtsp_parallel_run(n_threads, &triangulate_part, job) );
+
+	/* Parts i and i + stride merge into i, level by level */
+	for (job->stride = 1; job->stride < job->n_parts; job->stride *= 2) {
+		uint32_t n_pairs = (job->n_parts - job->stride +
+				    2 * job->stride - 1) / (2 * job->stride);
+		TRY( vtsp_parallel_run(n_pairs, &merge_parts, job) );
+	}
+	return SUCCESS;
+}
+
+static int triangulate_part(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	delaunay_job_t *job = (delaunay_job_t*) ctx;
+	uint32_t n_nodes = job->mesh->nodes.num;
+	uint32_t first, last, begin, end, unused, k, i;
+	vtsp_parallel_range(job->n_strips, id, n_threads, &first, &last);
+	vtsp_parallel_range(n_nodes, first, job->n_strips, &begin, &unused);
+	vtsp_parallel_range(n_nodes, last - 1, job->n_strips, &unused, &end);
+
+	pool_t *pool = &(job->pool[id]);
+	pool->cur = QUADS_PER_NODE * begin;
+	pool->end = QUADS_PER_NODE * end;
+	pool->free = NO_EDGE;
+	pool->tail = NO_EDGE;
+	for (i = 2 * pool->cur; i < 2 * pool->end; i++) {
+		job->q.org[i] = NO_NODE;
+	}
+
+	/* Each strip joins the part from the right, seams stay short */
+	hull_t *part = &(job->hull[id]);
+	for (k = first; k < last; k++) {
+		hull_t strip;
+		TRY( triangulate_strip(job, pool, k, &strip) );
+		if (k == first) {
+			*part = strip;
+		} else {
+			TRY( merge(&(job->q), pool, part, &strip, part) );
+		}
+	}
+	return SUCCESS;
+}
+
+static int triangulate_strip(delaunay_job_t *job, pool_t *pool,
+			     uint32_t strip, hull_t *output)
+{
+	uint32_t begin, end, i;
+	vtsp_parallel_range(job->mesh->nodes.num, strip, job->n_strips,
+			    &begin, &end);
+
+	/* Sorted nodes, a strip is every node between two vertical lines.
+	 * Turned a quarter clockwise, its own cuts become horizontal. */
+	const vtsp_point_t *pts = job->q.pts;
+	for (i = begin; i < end; i++) {
+		job->turned[i].x = pts[i].y;
+		job->turned[i].y = -pts[i].x;
+		job->order[i] = i;
+	}
+	uint32_t *order = &(job->order[begin]);
+	vtsp_sort_by_xy(job->turned, order, end - begin,
+			&(job->scratch[begin]));
+	hull_t turned;
+	TRY( divide(&(job->q), pool, order, 0, end - begin, &turned) );
+	return find_hull_ends(&(job->q), turned.le, begin, end - 1, output);
+}
+
+/* Hull edges out of the leftmost and rightmost nodes, for vertical seams */
+static int find_hull_ends(const quads_t *q, uint32_t e0, uint32_t left,
+			  uint32_t right, hull_t *output)
+{
+	/* CCW along the hull, the outer face on the right of every edge */
+	bool has_le = false;
+	bool has_re = false;
+	uint32_t e = e0;
+	do {
+		if (org(q, e) == left) {
+			output->le = e;
+			has_le = true;
+		}
+		if (dest(q, e) == right) {
+			output->re = sym(e);
+			has_re = true;
+		}
+		e = rprev(q, e);
+	} while (e != e0);
+	THROW( !has_le || !has_re, ERROR );
+	return SUCCESS;
+}
+
+static int merge_parts(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	delaunay_job_t *job = (delaunay_job_t*) ctx;
+	uint32_t l = 2 * job->stride * id;
+	uint32_t r = l + job->stride;
+	join_pools(&(job->q), &(job->pool[l]), &(job->pool[r]));
+	TRY( merge(&(job->q), &(job->pool[l]), &(job->hull[l]),
+		   &(job->hull[r]), &(job->hull[l])) );
+	return SUCCESS;
+}
+
+static int divide(quads_t *q, pool_t *pool, const uint32_t *order,
+		  uint32_t begin, uint32_t end, hull_t *output)
+{
+	/* order lists the nodes by x then y, in the frame of the cuts */
+	uint32_t n = end - begin;
+	const uint32_t *s = &(order[begin]);
+	THROW( n < 2, ERROR );
+	if (n == 2) {
+		uint32_t a = make_edge(q, pool, s[0], s[1]);
+		THROW( a == NO_EDGE, ERROR );
+		output->le = a;
+		output->re = sym(a);
+		return SUCCESS;
+	}
+	if (n == 3) {
+		uint32_t a = make_edge(q, pool, s[0], s[1]);
+		uint32_t b = make_edge(q, pool, s[1], s[2]);
+		THROW( a == NO_EDGE || b == NO_EDGE, ERROR );
+		splice(q, sym(a), b);
+		double o = orient(q->pts, s[0], s[1], s[2]);
+		output->le = a;
+		output->re = sym(b);
+		if (o != 0) {
+			uint32_t c = connect(q, pool, b, a);
+			THROW( c == NO_EDGE, ERROR );
+			if (o < 0) {
+				output->le = sym(c);
+				output->re = c;
+			}
+		}
+		return SUCCESS;
+	}
+
+	hull_t l, r;
+	uint32_t mid = begin + n / 2;
+	TRY( divide(q, pool, order, begin, mid, &l) );
+	TRY( divide(q, pool, order, mid, end, &r) );
+	return merge(q, pool, &l, &r, output);
+}
+
+static int merge(quads_t *q, pool_t *pool, const hull_t *l, const hull_t *r,
+		 hull_t *output)
+{
+	uint32_t ldo = l->le, ldi = l->re;
+	uint32_t rdi = r->le, rdo = r->re;
+
+	/* Lower common tangent of both hulls */
+	for (;;) {
+		if (is_left_of(q, org(q, rdi), ldi)) {
+			ldi = lnext(q, ldi);
+		} else if (is_right_of(q, org(q, ldi), rdi)) {
+			rdi = rprev(q, rdi);
+		} else {
+			break;
+		}
+	}
+
+	/* Zip upwards, candidates failing the circle test are deleted */
+	uint32_t basel = connect(q, pool, sym(rdi), ldi);
+	THROW( basel == NO_EDGE, ERROR );
+	if (org(q, ldi) == org(q, ldo)) {
+		ldo = sym(basel);
+	}
+	if (org(q, rdi) == org(q, rdo)) {
+		rdo = basel;
+	}
+	for (;;) {
+		uint32_t lcand = onext(q, sym(basel));
+		bool l_valid = is_right_of(q, dest(q, lcand), basel);
+		while (l_valid && in_circle(q->pts, dest(q, basel), org(q, basel),
+					    dest(q, lcand),
+					    dest(q, onext(q, lcand)))) {
+			uint32_t t = onext(q, lcand);
+			delete_edge(q, pool, lcand);
+			lcand = t;
+		}
+		uint32_t rcand = oprev(q, basel);
+		bool r_valid = is_right_of(q, dest(q, rcand), basel);
+		while (r_valid && in_circle(q->pts, dest(q, basel), org(q, basel),
+					    dest(q, rcand),
+					    dest(q, oprev(q, rcand)))) {
+			uint32_t t = oprev(q, rcand);
+			delete_edge(q, pool, rcand);
+			rcand = t;
+		}
+		l_valid = is_right_of(q, dest(q, lcand), basel);
+		r_valid = is_right_of(q, dest(q, rcand), basel);
+		if (!l_valid && !r_valid) {
+			break; /* basel is the upper common tangent */
+		}
+		if (!l_valid || (r_valid && in_circle(q->pts, dest(q, lcand),
+						      org(q, lcand),
+						      org(q, rcand),
+						      dest(q, rcand)))) {
+			basel = connect(q, pool, rcand, sym(basel));
+		} else {
+			basel = connect(q, pool, sym(basel), sym(lcand));
+		}
+		THROW( basel == NO_EDGE, ERROR );
+	}
+	output->le = ldo;
+	output->re = rdo;
+	return SUCCESS;
+}
+
+/* b follows a in the nodes, a takes every quad of b */
+static void join_pools(quads_t *q, pool_t *a, const pool_t *b)
+{
+	/* Few quads of a are left unbumped, a hull's worth at most */
+	while (a->cur < a->end) {
+		uint32_t quad = a->cur++;
+		q->next[4 * quad] = a->free;
+		a->free = quad;
+		if (a->tail == NO_EDGE) {
+			a->tail = quad;
+		}
+	}
+	if (b->free != NO_EDGE) {
+		if (a->free == NO_EDGE) {
+			a->free = b->free;
+		} else {
+			q->next[4 * a->tail] = b->free;
+		}
+		a->tail = b->tail;
+	}
+	a->cur = b->cur;
+	a->end = b->end;
+}
+
+static int extract(delaunay_job_t *job, uint32_t n_threads)
+{
+	/* Faces are triangles but the outer one, a triangle too when the
+	 * hull is, its edges have it on the left once turned around */
+	const quads_t *q = &(job->q);
+	uint32_t e = sym(job->hull[0].le);
+	uint32_t e1 = lnext(q, e);
+	uint32_t e2 = lnext(q, e1);
+	job->outer = NO_EDGE;
+	if (lnext(q, e2) == e) {
+		job->outer = e < e1 ? e : e1;
+		job->outer = e2 < job->outer ? e2 : job->outer;
+	}
+
+	/* The lowest directed edge around each face starts its triangle */
+	TRY( vtsp_parallel_run(n_threads, &count_trgs, job) );
+	uint32_t sum = 0;
+	uint32_t t;
+	for (t = 0; t < n_threads; t++) {
+		uint32_t c = job->n_trgs[t];
+		job->n_trgs[t] = sum;
+		sum += c;
+	}
+	vtsp_mesh_t *mesh = job->mesh;
+	THROW( sum > mesh->adj.n_alloc, ERROR );
+	TRY( vtsp_parallel_run(n_threads, &write_trgs, job) );
+	mesh->adj.num = sum;
+
+	if (mesh->nbr.index != NULL && mesh->nbr.n_alloc >= 3 * (size_t) sum) {
+		TRY( vtsp_parallel_run(n_threads, &write_nbrs, job) );
+		mesh->nbr.num = 3 * sum;
+	}
+	return SUCCESS;
+}
+
+static int count_trgs(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	delaunay_job_t *job = (delaunay_job_t*) ctx;
+	const quads_t *q = &(job->q);
+	uint32_t begin, end, i, k;
+	vtsp_parallel_range(job->n_quads, id, n_threads, &begin, &end);
+
+	uint32_t n_trgs = 0;
+	for (i = begin; i < end; i++) {
+		for (k = 0; k < 2; k++) {
+			uint32_t e = 4 * i + 2 * k;
+			bool is_first = is_first_of_trg(q, e, job->outer);
+			job->trg_of[e >> 1] = VTSP_NO_TRG;
+			job->is_first[e >> 1] = is_first;
+			n_trgs += is_first;
+		}
+	}
+	job->n_trgs[id] = n_trgs;
+	return SUCCESS;
+}
+
+static int write_trgs(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	delaunay_job_t *job = (delaunay_job_t*) ctx;
+	const quads_t *q = &(job->q);
+	uint32_t begin, end, i, k;
+	vtsp_parallel_range(job->n_quads, id, n_threads, &begin, &end);
+
+	vtsp_trg_t *trgs = job->mesh->adj.trgs;
+	uint32_t t = job->n_trgs[id];
+	for (i = begin; i < end; i++) {
+		for (k = 0; k < 2; k++) {
+			uint32_t e = 4 * i + 2 * k;
+			if (!job->is_first[e >> 1]) {
+				continue;
+			}
+			uint32_t e1 = lnext(q, e);
+			uint32_t e2 = lnext(q, e1);
+			trgs[t].n1 = org(q, e);
+			trgs[t].n2 = org(q, e1);
+			trgs[t].n3 = org(q, e2);
+			job->trg_of[e >> 1] = t;
+			job->trg_of[e1 >> 1] = t;
+			job->trg_of[e2 >> 1] = t;
+			job->trg_edge[t] = e;
+			t++;
+		}
+	}
+	return SUCCESS;
+}
+
+static int write_nbrs(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	delaunay_job_t *job = (delaunay_job_t*) ctx;
+	const quads_t *q = &(job->q);
+	uint32_t begin, end, t;
+	vtsp_parallel_range(job->mesh->adj.num, id, n_threads, &begin, &end);
+
+	/* Corner k faces the edge between the two corners after it */
+	uint32_t *nbr = job->mesh->nbr.index;
+	for (t = begin; t < end; t++) {
+		uint32_t e = job->trg_edge[t];
+		uint32_t e1 = lnext(q, e);
+		uint32_t e2 = lnext(q, e1);
+		nbr[3 * t] = job->trg_of[sym(e1) >> 1];
+		nbr[3 * t + 1] = job->trg_of[sym(e2) >> 1];
+		nbr[3 * t + 2] = job->trg_of[sym(e) >> 1];
+	}
+	return SUCCESS;
+}
+
+/* e is the lowest of the three edges around a triangle */
+static bool is_first_of_trg(const quads_t *q, uint32_t e, uint32_t outer)
+{
+	if (org(q, e) == NO_NODE || e == outer) {
+		return false;
+	}
+	uint32_t e1 = lnext(q, e);
+	if (e1 < e) {
+		return false;
+	}
+	uint32_t e2 = lnext(q, e1);
+	return e < e2 && lnext(q, e2) == e;
+}
+
+static int check_envelope(delaunay_job_t *job, const vtsp_perm_t *envelope)
+{
+	/* Hull nodes in CCW order, from the leftmost node */
+	const quads_t *q = &(job->q);
+	uint32_t *hull = job->trg_edge;
+	uint32_t h = 0;
+	uint32_t e = job->hull[0].le;
+	do {
+		THROW( h >= job->mesh->nodes.num, ERROR );
+		hull[h++] = org(q, e);
+		e = rprev(q, e);
+	} while (e != job->hull[0].le);
+
+	/* Envelope nodes, repeated ones once */
+	uint32_t *nodes = job->trg_of;
+	const uint32_t *map = job->mesh->map_vtx.index;
+	uint32_t n = 0;
+	uint32_t i;
+	for (i = 0; i < envelope->num; i++) {
+		uint32_t node = map[envelope->index[i]];
+		THROW( n >= 2 * (size_t) job->n_quads, MALFORMED_INPUT );
+		if (n == 0 || nodes[n - 1] != node) {
+			nodes[n++] = node;
+		}
+	}
+	while (n > 1 && nodes[n - 1] == nodes[0]) {
+		n--;
+	}
+	if (n < 3) {
+		return SUCCESS; /* Points are not collinear, nothing to check */
+	}
+	THROW( !hull_covers(q, hull, h, nodes, n, 1) &&
+	       !hull_covers(q, hull, h, nodes, n, -1), MALFORMED_INPUT );
+	return SUCCESS;
+}
+
+/* Each envelope segment spans hull nodes lying on it, dir 1 is CCW */
+static bool hull_covers(const quads_t *q, const uint32_t *hull, uint32_t h,
+			const uint32_t *nodes, uint32_t n, int dir)
+{
+	uint32_t pos = 0;
+	while (pos < h && hull[pos] != nodes[0]) {
+		pos++;
+	}
+	if (pos == h) {
+		return false;
+	}
+	uint32_t step = dir > 0 ? 1 : h - 1;
+	uint32_t n_steps = 0;
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		uint32_t a = nodes[i];
+		uint32_t b = nodes[(i + 1) % n];
+		pos = (pos + step) % h;
+		n_steps ++;
+		while (hull[pos] != b) {
+			if (n_steps >= h || orient(q->pts, a, b, hull[pos]) != 0) {
+				return false;
+			}
+			pos = (pos + step) % h;
+			n_steps ++;
+		}
+	}
+	return n_steps == h;
+}
+
+static uint32_t make_edge(quads_t *q, pool_t *pool, uint32_t a, uint32_t b)
+{
+	uint32_t quad;
+	if (pool->free != NO_EDGE) {
+		quad = pool->free;
+		pool->free = q->next[4 * quad];
+		if (pool->free == NO_EDGE) {
+			pool->tail = NO_EDGE;
+		}
+	} else if (pool->cur < pool->end) {
+		quad = pool->cur++;
+	} else {
+		return NO_EDGE;
+	}
+	uint32_t e = 4 * quad;
+	q->next[e] = e;
+	q->next[e + 1] = e + 3;
+	q->next[e + 2] = e + 2;
+	q->next[e + 3] = e + 1;
+	q->org[e >> 1] = a;
+	q->org[(e + 2) >> 1] = b;
+	return e;
+}
+
+/* New edge from dest(a) to org(b), left faces of a, e and b match */
+static uint32_t connect(quads_t *q, pool_t *pool, uint32_t a, uint32_t b)
+{
+	uint32_t e = make_edge(q, pool, dest(q, a), org(q, b));
+	if (e == NO_EDGE) {
+		return NO_EDGE;
+	}
+	splice(q, e, lnext(q, a));
+	splice(q, sym(e), b);
+	return e;
+}
+
+static void delete_edge(quads_t *q, pool_t *pool, uint32_t e)
+{
+	splice(q, e, oprev(q, e));
+	splice(q, sym(e), oprev(q, sym(e)));
+	uint32_t quad = e >> 2;
+	q->org[2 * quad] = NO_NODE;
+	q->org[2 * quad + 1] = NO_NODE;
+	q->next[4 * quad] = pool->free;
+	pool->free = quad;
+	if (pool->tail == NO_EDGE) {
+		pool->tail = quad;
+	}
+}
+
+static void splice(quads_t *q, uint32_t a, uint32_t b)
+{
+	uint32_t alpha = rot(q->next[a]);
+	uint32_t beta = rot(q->next[b]);
+	uint32_t t1 = q->next[b];
+	uint32_t t2 = q->next[a];
+	uint32_t t3 = q->next[beta];
+	uint32_t t4 = q->next[alpha];
+	q->next[a] = t1;
+	q->next[b] = t2;
+	q->next[alpha] = t3;
+	q->next[beta] = t4;
+}
+
+static bool is_right_of(const quads_t *q, uint32_t p, uint32_t e)
+{
+	return orient(q->pts, p, dest(q, e), org(q, e)) > 0;
+}
+
+static bool is_left_of(const quads_t *q, uint32_t p, uint32_t e)
+{
+	return orient(q->pts, p, org(q, e), dest(q, e)) > 0;
+}
+
+/*
+ * Twice the signed area of abc, positive when CCW. Its sign is exact:
+ * the double result is kept when it clears the rounding error bound,
+ * the determinant is summed exactly otherwise.
+ */
+static double orient(const vtsp_point_t *pts, uint32_t a, uint32_t b,
+		     uint32_t c)
+{
+	double acx = (double) pts[a].x - pts[c].x;
+	double acy = (double) pts[a].y - pts[c].y;
+	double bcx = (double) pts[b].x - pts[c].x;
+	double bcy = (double) pts[b].y - pts[c].y;
+	double left = acx * bcy;
+	double right = acy * bcx;
+	double det = left - right;
+	double bound = ORIENT_BOUND * (fabs(left) + fabs(right));
+	if (det >= bound || -det >= bound)
+		return det;
+	return orient_exact(&pts[a], &pts[b], &pts[c]);
+}
+
+/* d strictly inside the circle through a, b and c, abc CCW, exact */
+static bool in_circle(const vtsp_point_t *pts, uint32_t a, uint32_t b,
+		      uint32_t c, uint32_t d)
+{
+	double adx = (double) pts[a].x - pts[d].x;
+	double ady = (double) pts[a].y - pts[d].y;
+	double bdx = (double) pts[b].x - pts[d].x;
+	double bdy = (double) pts[b].y - pts[d].y;
+	double cdx = (double) pts[c].x - pts[d].x;
+	double cdy = (double) pts[c].y - pts[d].y;
+	double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+	double cdxady = cdx * ady, adxcdy = adx * cdy;
+	double adxbdy = adx * bdy, bdxady = bdx * ady;
+	double alift = adx * adx + ady * ady;
+	double blift = bdx * bdx + bdy * bdy;
+	double clift = cdx * cdx + cdy * cdy;
+	double det = alift * (bdxcdy - cdxbdy) + blift * (cdxady - adxcdy) +
+		clift * (adxbdy - bdxady);
+	double bound = IN_CIRCLE_BOUND *
+		((fabs(bdxcdy) + fabs(cdxbdy)) * alift +
+		 (fabs(cdxady) + fabs(adxcdy)) * blift +
+		 (fabs(adxbdy) + fabs(bdxady)) * clift);
+	if (det > bound || -det > bound)
+		return det > 0;
+	return in_circle_exact(pts, a, b, c, d);
+}
+
+/*
+ * Exact fallbacks. Products of two floats are exact in double, so the
+ * determinants expand to sums of doubles, kept as nonoverlapping
+ * expansions in increasing magnitude whose last term carries the sign.
+ * They rely on IEEE double without contraction, as -std=c99 gives.
+ */
+static double orient_exact(const vtsp_point_t *a, const vtsp_point_t *b,
+			   const vtsp_point_t *c)
+{
+	double h[MINOR_TERMS];
+	uint32_t n = minor_exact(a, b, c, h);
+	return h[n - 1];
+}
+
+/* The lifted 4x4 determinant, expanded along its lift column */
+static bool in_circle_exact(const vtsp_point_t *pts, uint32_t a, uint32_t b,
+			    uint32_t c, uint32_t d)
+{
+	const uint32_t rows[4] = { a, b, c, d };
+	double det[IN_CIRCLE_TERMS];
+	uint32_t n = 0;
+	uint32_t i;
+	for (i = 0; i < 4; i++) {
+		const vtsp_point_t *p[3];
+		uint32_t j, k = 0;
+		for (j = 0; j < 4; j++) {
+			if (j != i)
+				p[k++] = &pts[rows[j]];
+		}
+		double m[MINOR_TERMS];
+		uint32_t n_m = minor_exact(p[0], p[1], p[2], m);
+		double sign = (i & 1) ? -1.0 : 1.0;
+		double x = pts[rows[i]].x;
+		double y = pts[rows[i]].y;
+		n = add_scaled(n, det, n_m, m, sign * x * x);
+		n = add_scaled(n, det, n_m, m, sign * y * y);
+	}
+	return det[n - 1] > 0;
+}
+
+/* Expansion of orient(a, b, c) from its six float products */
+static uint32_t minor_exact(const vtsp_point_t *a, const vtsp_point_t *b,
+			    const vtsp_point_t *c, double *h)
+{
+	const double terms[MINOR_TERMS] = {
+		(double) a->x * b->y, -((double) a->x * c->y),
+		(double) b->x * c->y, -((double) b->x * a->y),
+		(double) c->x * a->y, -((double) c->x * b->y)
+	};
+	uint32_t n = 0;
+	uint32_t i;
+	for (i = 0; i < MINOR_TERMS; i++)
+		n = grow_expansion(n, h, terms[i]);
+	return n;
+}
+
+/* e += f * b, in place */
+static uint32_t add_scaled(uint32_t n, double *e, uint32_t n_f,
+			   const double *f, double b)
+{
+	uint32_t i;
+	for (i = 0; i < n_f; i++) {
+		double hi, lo;
+		two_product(f[i], b, &hi, &lo);
+		n = grow_expansion(n, e, lo);
+		n = grow_expansion(n, e, hi);
+	}
+	return n;
+}
+
+/* e += b in place, zero terms dropped, an exact zero is one term */
+static uint32_t grow_expansion(uint32_t n, double *e, double b)
+{
+	uint32_t m = 0;
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		double err;
+		two_sum(b, e[i], &b, &err);
+		if (err != 0)
+			e[m++] = err;
+	}
+	if (b != 0 || m == 0)
+		e[m++] = b;
+	return m;
+}
+
+/* x + y == a + b exactly, x the rounded sum */
+static void two_sum(double a, double b, double *x, double *y)
+{
+	double sum = a + b;
+	double b_virt = sum - a;
+	double a_virt = sum - b_virt;
+	*y = (a - a_virt) + (b - b_virt);
+	*x = sum;
+}
+
+/* x + y == a * b exactly, x the rounded product */
+static void two_product(double a, double b, double *x, double *y)
+{
+	double a_hi, a_lo, b_hi, b_lo;
+	double prod = a * b;
+	split(a, &a_hi, &a_lo);
+	split(b, &b_hi, &b_lo);
+	double err = prod - a_hi * b_hi;
+	err -= a_lo * b_hi;
+	err -= a_hi * b_lo;
+	*y = a_lo * b_lo - err;
+	*x = prod;
+}
+
+/* Dekker's split into two halves of at most 26 bits */
+static void split(double a, double *hi, double *lo)
+{
+	double c = SPLITTER * a;
+	double big = c - a;
+	*hi = c - big;
+	*lo = a - *hi;
+}
+
+/* Orders by x then y, equal points get equal keys */
+static uint64_t point_key(const vtsp_point_t *p)
+{
+	return (uint64_t) float_key(p->x) << 32 | float_key(p->y);
+}
+
+static uint32_t float_key(float v)
+{
+	/* Sign flipped, negatives reversed, -0 is 0 */
+	uint32_t bits;
+	v = v == 0 ? 0.0f : v;
+	memcpy(&bits, &v, sizeof(bits));
+	return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
@@ -0,0 +1,543 @@
+#include <float.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vtsp_envelope.h"
+#include "try_macros.h"
+#include "vtsp_opmem.h"
+#include "vtsp_parallel.h"
+#include "vtsp_sort.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#endif
+
+#define MIN_POINTS_PER_THREAD 65536
+#define N_DIRS 8
+
+typedef struct {
+	const vtsp_point_t *pts;  /* Coordinate arrays input: compact */
+	const float *x, *y;       /* Coordinate arrays input, else NULL */
+	vtsp_point_t *compact;    /* Extremes and survivors of x and y */
+	uint32_t n;
+	uint32_t *survivors;
+	uint32_t *scratch;
+	uint32_t *hulls;      /* n + n_threads entries, one run per thread */
+	uint32_t extreme[PARALLEL_MAX_THREADS][N_DIRS];
+	uint32_t octagon[N_DIRS];
+	uint32_t n_octagon;
+	double edge[N_DIRS][3];  /* Octagon edges as a*x + b*y + c > 0 inside */
+	uint32_t n_hull[PARALLEL_MAX_THREADS];
+} envelope_job_t;
+
+static void take_buffers(envelope_job_t *job, uint32_t n, bool soa,
+			 vtsp_opmem_t *mem);
+static int run(const vtsp_envelope_ctx_t *ctx, envelope_job_t *job,
+	       vtsp_perm_t *output);
+static int find_extremes(void *ctx, uint32_t id, uint32_t n_threads);
+static void find_extremes_soa(const envelope_job_t *job, uint32_t begin,
+			      uint32_t end, uint32_t *extreme);
+static int filter_and_hull(void *ctx, uint32_t id, uint32_t n_threads);
+static uint32_t filter_soa(const envelope_job_t *job, uint32_t begin,
+			   uint32_t end, uint32_t *survivors);
+static void compact_extremes(envelope_job_t *job, uint32_t n_threads);
+static void reduce_octagon(envelope_job_t *job, uint32_t n_threads);
+static int is_inside_octagon(const envelope_job_t *job, double x, double y);
+static double cross(const vtsp_point_t *pts, uint32_t o, uint32_t a,
+		    uint32_t b);
+static double support(const vtsp_point_t *p, uint32_t dir);
+static uint32_t monotone_chain(const vtsp_point_t *pts, const uint32_t *sorted,
+			       uint32_t n, uint32_t *hull);
+#ifdef HAVE_AVX2_KERNEL
+static uint32_t find_extremes_avx2(const envelope_job_t *job, uint32_t begin,
+				   uint32_t end, double *best,
+				   uint32_t *extreme);
+static uint32_t filter_avx2(const envelope_job_t *job, uint32_t begin,
+			    uint32_t end, uint32_t *survivors,
+			    uint32_t *n_survivors);
+#endif
+
+int vtsp_bind_envelope(vtsp_binding_envelope_t *envelope,
+		       vtsp_envelope_ctx_t *ctx)
+{
+	envelope->ctx = ctx;
+	envelope->get_convex_envelope_sizeof_opmem =
+		&vtsp_get_convex_envelope_sizeof_opmem;
+	envelope->get_convex_envelope = &vtsp_get_convex_envelope;
+	return SUCCESS;
+}
+
+int vtsp_get_convex_envelope_sizeof_opmem(void *ctx,
+					  const vtsp_points_t *input,
+					  size_t *output)
+{
+	envelope_job_t job;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, NULL);
+	take_buffers(&job, input->num, false, &mem);
+
+	*output = vtsp_opmem_sizeof(&mem);
+	return SUCCESS;
+}
+
+int vtsp_get_convex_envelope(void *ctx, const vtsp_points_t *input,
+			     vtsp_perm_t *output, void *op_mem)
+{
+	THROW( input->num < 3, ERROR );
+
+	envelope_job_t job;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, op_mem);
+	take_buffers(&job, input->num, false, &mem);
+	job.pts = input->pts;
+	job.x = NULL;
+	job.y = NULL;
+	job.n = input->num;
+	return run((const vtsp_envelope_ctx_t*) ctx, &job, output);
+}
+
+int vtsp_get_convex_envelope_soa_sizeof_opmem(void *ctx,
+					      const vtsp_points_soa_t *input,
+					      size_t *output)
+{
+	envelope_job_t job;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, NULL);
+	take_buffers(&job, input->num, true, &mem);
+
+	*output = vtsp_opmem_sizeof(&mem);
+	return SUCCESS;
+}
+
+int vtsp_get_convex_envelope_soa(void *ctx, const vtsp_points_soa_t *input,
+				 vtsp_perm_t *output, void *op_mem)
+{
+	THROW( input->num < 3, ERROR );
+
+	envelope_job_t job;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, op_mem);
+	take_buffers(&job, input->num, true, &mem);
+	job.pts = job.compact;
+	job.x = input->x;
+	job.y = input->y;
+	job.n = input->num;
+	return run((const vtsp_envelope_ctx_t*) ctx, &job, output);
+}
+
+static void take_buffers(envelope_job_t *job, uint32_t n, bool soa,
+			 vtsp_opmem_t *mem)
+{
+	job->survivors = vtsp_opmem_take(mem, n * sizeof(*(job->survivors)));
+	job->scratch = vtsp_opmem_take(mem, n * sizeof(*(job->scratch)));
+	job->hulls = vtsp_opmem_take(mem, (n + PARALLEL_MAX_THREADS) *
+				     sizeof(*(job->hulls)));
+	job->compact = soa ? vtsp_opmem_take(mem, n * sizeof(*(job->compact))) :
+		NULL;
+}
+
+static int run(const vtsp_envelope_ctx_t *ctx, envelope_job_t *job,
+	       vtsp_perm_t *output)
+{
+	uint32_t n_threads = vtsp_parallel_threads(ctx ? ctx->n_threads : 0,
+						   job->n,
+						   MIN_POINTS_PER_THREAD);
+	TRY( vtsp_parallel_run(n_threads, &find_extremes, job) );
+	if (job->x != NULL) {
+		compact_extremes(job, n_threads);
+	}
+	reduce_octagon(job, n_threads);
+	TRY( vtsp_parallel_run(n_threads, &filter_and_hull, job) );
+
+	/* Merge the partial hulls, they are few points */
+	uint32_t n_merge = 0;
+	uint32_t t;
+	for (t = 0; t < n_threads; t++) {
+		uint32_t begin, end;
+		vtsp_parallel_range(job->n, t, n_threads, &begin, &end);
+		uint32_t i;
+		for (i = 0; i < job->n_hull[t]; i++) {
+			job->survivors[n_merge++] = job->hulls[begin + t + i];
+		}
+	}
+	vtsp_sort_by_xy(job->pts, job->survivors, n_merge, job->scratch);
+	uint32_t n_hull = monotone_chain(job->pts, job->survivors, n_merge,
+					 job->hulls);
+	THROW( n_hull < 3, ERROR ); /* Collinear points */
+	THROW( n_hull > output->n_alloc, ERROR );
+
+	uint32_t i;
+	for (i = 0; i < n_hull; i++) {
+		output->index[i] = job->hulls[i];
+	}
+	output->num = n_hull;
+	return SUCCESS;
+}
+
+static int find_extremes(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	envelope_job_t *job = (envelope_job_t*) ctx;
+	uint32_t begin, end;
+	vtsp_parallel_range(job->n, id, n_threads, &begin, &end);
+
+	uint32_t *extreme = job->extreme[id];
+	if (job->x != NULL) {
+		find_extremes_soa(job, begin, end, extreme);
+		return SUCCESS;
+	}
+	double best[N_DIRS];
+	uint32_t d;
+	for (d = 0; d < N_DIRS; d++) {
+		extreme[d] = begin;
+		best[d] = support(&(job->pts[begin]), d);
+	}
+	/* Unrolled support(), this loop streams over every point */
+	uint32_t i;
+	for (i = begin + 1; i < end; i++) {
+		double x = job->pts[i].x;
+		double y = job->pts[i].y;
+		double s[N_DIRS] = {x, x + y, y, y - x, -x, -x - y, -y, x - y};
+		for (d = 0; d < N_DIRS; d++) {
+			if (s[d] > best[d]) {
+				best[d] = s[d];
+				extreme[d] = i;
+			}
+		}
+	}
+	return SUCCESS;
+}
+
+static void find_extremes_soa(const envelope_job_t *job, uint32_t begin,
+			      uint32_t end, uint32_t *extreme)
+{
+	double best[N_DIRS];
+	uint32_t i = begin;
+	uint32_t d;
+#ifdef HAVE_AVX2_KERNEL
+	if (end - begin >= 8 && __builtin_cpu_supports("avx2")) {
+		i = find_extremes_avx2(job, begin, end, best, extreme);
+	}
+#endif
+	if (i == begin) {
+		vtsp_point_t p = { job->x[begin], job->y[begin] };
+		for (d = 0; d < N_DIRS; d++) {
+			extreme[d] = begin;
+			best[d] = support(&p, d);
+		}
+		i = begin + 1;
+	}
+	for (; i < end; i++) {
+		double x = job->x[i];
+		double y = job->y[i];
+		double s[N_DIRS] = {x, x + y, y, y - x, -x, -x - y, -y, x - y};
+		for (d = 0; d < N_DIRS; d++) {
+			if (s[d] > best[d]) {
+				best[d] = s[d];
+				extreme[d] = i;
+			}
+		}
+	}
+}
+
+static int filter_and_hull(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	envelope_job_t *job = (envelope_job_t*) ctx;
+	uint32_t begin, end;
+	vtsp_parallel_range(job->n, id, n_threads, &begin, &end);
+
+	uint32_t *survivors = &(job->survivors[begin]);
+	uint32_t n_survivors = 0;
+	if (job->x != NULL) {
+		n_survivors = filter_soa(job, begin, end, survivors);
+	} else {
+		uint32_t i;
+		for (i = begin; i < end; i++) {
+			const vtsp_point_t *p = &(job->pts[i]);
+			if (!is_inside_octagon(job, p->x, p->y)) {
+				survivors[n_survivors++] = i;
+			}
+		}
+	}
+
+	vtsp_sort_by_xy(job->pts, survivors, n_survivors,
+			&(job->scratch[begin]));
+	/* Runs are shifted by id, a chain may take one entry more */
+	job->n_hull[id] = monotone_chain(job->pts, survivors, n_survivors,
+					 &(job->hulls[begin + id]));
+	return SUCCESS;
+}
+
+static uint32_t filter_soa(const envelope_job_t *job, uint32_t begin,
+			   uint32_t end, uint32_t *survivors)
+{
+	uint32_t n_survivors = 0;
+	uint32_t i = begin;
+#ifdef HAVE_AVX2_KERNEL
+	if (job->n_octagon >= 3 && __builtin_cpu_supports("avx2")) {
+		i = filter_avx2(job, begin, end, survivors, &n_survivors);
+	}
+#endif
+	for (; i < end; i++) {
+		if (!is_inside_octagon(job, job->x[i], job->y[i])) {
+			survivors[n_survivors++] = i;
+		}
+	}
+
+	/* The hull reads pairs, only survivors need theirs */
+	uint32_t k;
+	for (k = 0; k < n_survivors; k++) {
+		uint32_t p = survivors[k];
+		job->compact[p].x = job->x[p];
+		job->compact[p].y = job->y[p];
+	}
+	return n_survivors;
+}
+
+static void compact_extremes(envelope_job_t *job, uint32_t n_threads)
+{
+	/* reduce_octagon() reads the extremes as pairs */
+	uint32_t t, d;
+	for (t = 0; t < n_threads; t++) {
+		for (d = 0; d < N_DIRS; d++) {
+			uint32_t p = job->extreme[t][d];
+			job->compact[p].x = job->x[p];
+			job->compact[p].y = job->y[p];
+		}
+	}
+}
+
+static void reduce_octagon(envelope_job_t *job, uint32_t n_threads)
+{
+	uint32_t extreme[N_DIRS];
+	uint32_t d, t;
+	for (d = 0; d < N_DIRS; d++) {
+		extreme[d] = job->extreme[0][d];
+		double best = support(&(job->pts[extreme[d]]), d);
+		for (t = 1; t < n_threads; t++) {
+			uint32_t i = job->extreme[t][d];
+			double s = support(&(job->pts[i]), d);
+			if (s > best) {
+				best = s;
+				extreme[d] = i;
+			}
+		}
+	}
+
+	/* Directions are CCW, so are their extreme points */
+	job->n_octagon = 0;
+	for (d = 0; d < N_DIRS; d++) {
+		uint32_t i = extreme[d];
+		if (job->n_octagon > 0 &&
+		    job->octagon[job->n_octagon - 1] == i) {
+			continue;
+		}
+		job->octagon[job->n_octagon++] = i;
+	}
+	while (job->n_octagon > 1 &&
+	       job->octagon[job->n_octagon - 1] == job->octagon[0]) {
+		job->n_octagon --;
+	}
+
+	uint32_t k;
+	for (k = 0; k < job->n_octagon; k++) {
+		const vtsp_point_t *a = &(job->pts[job->octagon[k]]);
+		const vtsp_point_t *b = &(job->pts[job->octagon[(k + 1) %
+							       job->n_octagon]]);
+		double dx = (double) b->x - a->x;
+		double dy = (double) b->y - a->y;
+		job->edge[k][0] = -dy;
+		job->edge[k][1] = dx;
+		job->edge[k][2] = dy * a->x - dx * a->y;
+	}
+}
+
+static int is_inside_octagon(const envelope_job_t *job, double x, double y)
+{
+	if (job->n_octagon < 3) {
+		return 0;
+	}
+	uint32_t k;
+	for (k = 0; k < job->n_octagon; k++) {
+		const double *e = job->edge[k];
+		if (e[0] * x + e[1] * y + e[2] <= 0.0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static double cross(const vtsp_point_t *pts, uint32_t o, uint32_t a,
+		    uint32_t b)
+{
+	double ax = (double) pts[a].x - pts[o].x;
+	double ay = (double) pts[a].y - pts[o].y;
+	double bx = (double) pts[b].x - pts[o].x;
+	double by = (double) pts[b].y - pts[o].y;
+	return ax * by - ay * bx;
+}
+
+static double support(const vtsp_point_t *p, uint32_t dir)
+{
+	/* Directions at multiples of 45 degrees, CCW from +x */
+	double x = p->x;
+	double y = p->y;
+	switch (dir) {
+	case 0: return x;
+	case 1: return x + y;
+	case 2: return y;
+	case 3: return y - x;
+	case 4: return -x;
+	case 5: return -x - y;
+	case 6: return -y;
+	default: return x - y;
+	}
+}
+
+static uint32_t monotone_chain(const vtsp_point_t *pts, const uint32_t *sorted,
+			       uint32_t n, uint32_t *hull)
+{
+	/* CCW hull without collinear points, needs n + 1 entries */
+	uint32_t k = 0;
+	uint32_t i;
+	if (n < 3) {
+		for (i = 0; i < n; i++) {
+			hull[i] = sorted[i];
+		}
+		return n;
+	}
+	for (i = 0; i < n; i++) {
+		while (k >= 2 && cross(pts, hull[k - 2], hull[k - 1],
+				       sorted[i]) <= 0.0) {
+			k --;
+		}
+		hull[k++] = sorted[i];
+	}
+	uint32_t lower = k + 1;
+	for (i = n - 1; i > 0; i--) {
+		uint32_t p = sorted[i - 1];
+		while (k >= lower && cross(pts, hull[k - 2], hull[k - 1],
+					   p) <= 0.0) {
+			k --;
+		}
+		hull[k++] = p;
+	}
+	return k - 1; /* Last point repeats the first one */
+}
+
+#ifdef HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+static uint32_t find_extremes_avx2(const envelope_job_t *job, uint32_t begin,
+				   uint32_t end, double *best,
+				   uint32_t *extreme)
+{
+	/* Eight points per step, in double four lanes at a time like the
+	 * scalar loop. Each lane keeps its best point per direction, with
+	 * its index as a double, strict > keeps the first one. */
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	const __m256d lane = _mm256_set_pd(3, 2, 1, 0);
+	__m256d lane_best[2][N_DIRS];
+	__m256d lane_index[2][N_DIRS];
+	uint32_t d, h;
+	for (h = 0; h < 2; h++) {
+		for (d = 0; d < N_DIRS; d++) {
+			lane_best[h][d] = _mm256_set1_pd(-DBL_MAX);
+			lane_index[h][d] = _mm256_setzero_pd();
+		}
+	}
+
+	uint32_t i;
+	for (i = begin; i + 8 <= end; i += 8) {
+		__m256 x8 = _mm256_loadu_ps(&(job->x[i]));
+		__m256 y8 = _mm256_loadu_ps(&(job->y[i]));
+		for (h = 0; h < 2; h++) {
+			__m256d x = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(x8, 1) :
+						    _mm256_castps256_ps128(x8));
+			__m256d y = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(y8, 1) :
+						    _mm256_castps256_ps128(y8));
+			__m256d nx = _mm256_xor_pd(x, sign);
+			__m256d ny = _mm256_xor_pd(y, sign);
+			__m256d s[N_DIRS] = {
+				x, _mm256_add_pd(x, y), y, _mm256_sub_pd(y, x),
+				nx, _mm256_sub_pd(nx, y), ny, _mm256_sub_pd(x, y)
+			};
+			__m256d index = _mm256_add_pd(
+				_mm256_set1_pd((double) (i + 4 * h)), lane);
+			for (d = 0; d < N_DIRS; d++) {
+				__m256d gt = _mm256_cmp_pd(s[d], lane_best[h][d],
+							   _CMP_GT_OQ);
+				lane_best[h][d] = _mm256_blendv_pd(lane_best[h][d],
+								   s[d], gt);
+				lane_index[h][d] = _mm256_blendv_pd(lane_index[h][d],
+								    index, gt);
+			}
+		}
+	}
+
+	/* Lanes to one point, ties go to the lowest index */
+	for (d = 0; d < N_DIRS; d++) {
+		double value[8], index[8];
+		_mm256_storeu_pd(value, lane_best[0][d]);
+		_mm256_storeu_pd(&(value[4]), lane_best[1][d]);
+		_mm256_storeu_pd(index, lane_index[0][d]);
+		_mm256_storeu_pd(&(index[4]), lane_index[1][d]);
+		best[d] = value[0];
+		extreme[d] = (uint32_t) index[0];
+		uint32_t k;
+		for (k = 1; k < 8; k++) {
+			uint32_t p = (uint32_t) index[k];
+			if (value[k] > best[d] ||
+			    (value[k] == best[d] && p < extreme[d])) {
+				best[d] = value[k];
+				extreme[d] = p;
+			}
+		}
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static uint32_t filter_avx2(const envelope_job_t *job, uint32_t begin,
+			    uint32_t end, uint32_t *survivors,
+			    uint32_t *n_survivors)
+{
+	/* Eight points per step against every edge, same operations as
+	 * is_inside_octagon(), survivors come out in index order */
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d all = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ);
+	uint32_t n = *n_survivors;
+	uint32_t i;
+	for (i = begin; i + 8 <= end; i += 8) {
+		__m256 x8 = _mm256_loadu_ps(&(job->x[i]));
+		__m256 y8 = _mm256_loadu_ps(&(job->y[i]));
+		uint32_t inside = 0;
+		uint32_t h;
+		for (h = 0; h < 2; h++) {
+			__m256d x = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(x8, 1) :
+						    _mm256_castps256_ps128(x8));
+			__m256d y = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(y8, 1) :
+						    _mm256_castps256_ps128(y8));
+			__m256d in = all;
+			uint32_t k;
+			for (k = 0; k < job->n_octagon; k++) {
+				const double *e = job->edge[k];
+				__m256d v = _mm256_add_pd(
+					_mm256_add_pd(
+						_mm256_mul_pd(_mm256_set1_pd(e[0]), x),
+						_mm256_mul_pd(_mm256_set1_pd(e[1]), y)),
+					_mm256_set1_pd(e[2]));
+				in = _mm256_and_pd(in, _mm256_cmp_pd(v, zero,
+								     _CMP_NLE_UQ));
+			}
+			inside |= (uint32_t) _mm256_movemask_pd(in) << (4 * h);
+		}
+		uint32_t out = ~inside & 0xff;
+		while (out != 0) {
+			survivors[n++] = i + (uint32_t) __builtin_ctz(out);
+			out &= out - 1;
+		}
+	}
+	*n_survivors = n;
+	return i;
+}
+#endif
@@ -0,0 +1,95 @@
+#include <stdint.h>
+
+#include "vtsp_graph.h"
+#include "try_macros.h"
+
+static void add_edge(vtsp_graph_t *graph, uint32_t *cursor,
+		     uint32_t n1, uint32_t n2);
+static uint32_t sort_unique(uint32_t *row, uint32_t len);
+
+void vtsp_graph_take(vtsp_graph_t *graph, uint32_t n_nodes, uint32_t n_trgs,
+		     vtsp_opmem_t *mem)
+{
+	/* Every triangle adds its three edges in both directions */
+	graph->num = 0;
+	graph->n_alloc = n_nodes;
+	graph->offset = vtsp_opmem_take(mem, (n_nodes + 1) * sizeof(*(graph->offset)));
+	graph->index = vtsp_opmem_take(mem, 6 * (size_t) n_trgs * sizeof(*(graph->index)));
+}
+
+int vtsp_graph_build(const vtsp_mesh_t *mesh, vtsp_graph_t *graph,
+		     uint32_t *cursor)
+{
+	uint32_t n = mesh->nodes.num;
+	THROW( n > graph->n_alloc, ERROR );
+	graph->num = n;
+
+	uint32_t i;
+	for (i = 0; i <= n; i++) {
+		graph->offset[i] = 0;
+	}
+	for (i = 0; i < mesh->adj.num; i++) {
+		const vtsp_trg_t *trg = &(mesh->adj.trgs[i]);
+		THROW( trg->n1 >= n || trg->n2 >= n || trg->n3 >= n, ERROR );
+		graph->offset[trg->n1 + 1] += 2;
+		graph->offset[trg->n2 + 1] += 2;
+		graph->offset[trg->n3 + 1] += 2;
+	}
+	for (i = 0; i < n; i++) {
+		graph->offset[i + 1] += graph->offset[i];
+		cursor[i] = graph->offset[i];
+	}
+
+	for (i = 0; i < mesh->adj.num; i++) {
+		const vtsp_trg_t *trg = &(mesh->adj.trgs[i]);
+		add_edge(graph, cursor, trg->n1, trg->n2);
+		add_edge(graph, cursor, trg->n2, trg->n3);
+		add_edge(graph, cursor, trg->n3, trg->n1);
+	}
+
+	/* Interior edges were added twice, compact rows in place */
+	uint32_t begin = 0;
+	uint32_t end = 0;
+	for (i = 0; i < n; i++) {
+		uint32_t len = sort_unique(&(graph->index[begin]),
+					   graph->offset[i + 1] - begin);
+		uint32_t j;
+		for (j = 0; j < len; j++) {
+			graph->index[end + j] = graph->index[begin + j];
+		}
+		begin = graph->offset[i + 1];
+		graph->offset[i] = end;
+		end += len;
+	}
+	graph->offset[n] = end;
+	return SUCCESS;
+}
+
+static void add_edge(vtsp_graph_t *graph, uint32_t *cursor,
+		     uint32_t n1, uint32_t n2)
+{
+	graph->index[cursor[n1]++] = n2;
+	graph->index[cursor[n2]++] = n1;
+}
+
+static uint32_t sort_unique(uint32_t *row, uint32_t len)
+{
+	/* Rows are short (~12 entries), insertion sort is enough */
+	uint32_t i;
+	for (i = 1; i < len; i++) {
+		uint32_t val = row[i];
+		uint32_t j = i;
+		while (j > 0 && row[j - 1] > val) {
+			row[j] = row[j - 1];
+			j --;
+		}
+		row[j] = val;
+	}
+	uint32_t k = 0;
+	for (i = 0; i < len; i++) {
+		if (k == 0 || row[k - 1] != row[i]) {
+			row[k++] = row[i];
+		}
+	}
+	return k;
+}
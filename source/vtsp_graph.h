@@ -0,0 +1,16 @@
+#ifndef __VTSP_GRAPH_H__
+#define __VTSP_GRAPH_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_opmem.h"
+
+/* Node to node adjacency of a mesh in CSR form */
+void vtsp_graph_take(vtsp_graph_t *graph, uint32_t n_nodes, uint32_t n_trgs,
+		     vtsp_opmem_t *mem);
+/* cursor must hold at least mesh->nodes.num entries */
+int vtsp_graph_build(const vtsp_mesh_t *mesh, vtsp_graph_t *graph,
+		     uint32_t *cursor);
+
+#endif
@@ -0,0 +1,773 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vtsp_heat.h"
+#include "try_macros.h"
+#include "vtsp_multigrid.h"
+#include "vtsp_opmem.h"
+#include "vtsp_parallel.h"
+#include "vtsp_stiffness.h"
+#include "vtsp_topology.h"
+
+#define MIN_NODES_PER_THREAD 16384
+#define HEAT_SOURCE 1.0
+#define DEFAULT_TOLERANCE 1e-6f
+#define VCYCLE_STALL 0.5        /* Slowest residual reduction per V-cycle */
+#define DEFAULT_UPDATE_RINGS 8
+#define DEFAULT_UPDATE_TOLERANCE 1e-2f
+#define DEFAULT_UPDATE_GROWTH 1.5f
+#define MAX_RELAX_SWEEPS 4      /* Relaxations per row of a new ring */
+
+typedef struct {
+	vtsp_stiffness_t a;
+	float temperature;
+	uint32_t requested;      /* Threads asked by the ctx */
+	uint32_t n_threads;
+	int precond;
+	bool block_precond;      /* Jacobi or IC(0), applied by each thread */
+	float *l_diag;           /* IC(0) factor inside each thread block */
+	float *l_val;
+	vtsp_multigrid_t mg;
+	double *x, *r, *z, *p, *q;
+	double alpha, beta;
+	double dot[PARALLEL_MAX_THREADS][2];
+	double norm0;            /* Residual of the first guess */
+	double rr;               /* Squared residual of the last solve */
+	/* Incremental mode */
+	uint32_t n_fixed;
+	uint32_t n_fixed_solved; /* Fixed nodes at the last global solve */
+	uint32_t *region;        /* Free rows around the new fixed node, by ring */
+	uint8_t *in_region;
+	uint32_t n_region;
+	uint32_t *queue;         /* Circular, rows of the region to relax */
+	uint8_t *queued;
+	uint32_t head, n_queued;
+} heat_job_t;
+
+static bool uses_multigrid(const vtsp_heat_ctx_t *hctx);
+static int take_buffers(heat_job_t *job, const vtsp_heat_ctx_t *hctx,
+			const vtsp_mesh_t *mesh, vtsp_opmem_t *mem);
+static int assemble_rows(void *ctx, uint32_t id, uint32_t n_threads);
+static int prepare(heat_job_t *job, const vtsp_heat_ctx_t *hctx);
+static int iterate(heat_job_t *job, vtsp_heat_ctx_t *hctx);
+static void write_field(const heat_job_t *job, vtsp_field_t *output);
+static void fix_node(heat_job_t *job, uint32_t i);
+static void relax_rings(heat_job_t *job, uint32_t node, uint32_t max_rings,
+			double tolerance);
+static uint32_t add_ring(heat_job_t *job, const uint32_t *rows, uint32_t n);
+static double ring_residual(const heat_job_t *job, uint32_t begin);
+static void relax_region(heat_job_t *job, uint32_t begin, double eps);
+static void relax(heat_job_t *job, uint32_t j, double eps);
+static void queue_row(heat_job_t *job, uint32_t j, double eps);
+static uint32_t pop_queue(heat_job_t *job);
+static int solve_cg(heat_job_t *job, uint32_t n_threads, double stop,
+		    uint32_t max_iters, uint32_t *n_iters, double *rr);
+static int solve_vcycles(heat_job_t *job, uint32_t n_threads, double stop,
+			 uint32_t max_iters, uint32_t *n_iters, double *rr);
+static int factor_ic0(void *ctx, uint32_t id, uint32_t n_threads);
+static void precondition(heat_job_t *job, uint32_t begin, uint32_t end);
+static int start_cg(void *ctx, uint32_t id, uint32_t n_threads);
+static int multiply(void *ctx, uint32_t id, uint32_t n_threads);
+static int update(void *ctx, uint32_t id, uint32_t n_threads);
+static int dot_rz(void *ctx, uint32_t id, uint32_t n_threads);
+static int new_direction(void *ctx, uint32_t id, uint32_t n_threads);
+static void sum_dots(const heat_job_t *job, uint32_t n_threads,
+		     double *dot0, double *dot1);
+
+int vtsp_bind_heat(vtsp_binding_heat_t *heat, vtsp_heat_ctx_t *ctx)
+{
+	heat->ctx = ctx;
+	heat->solve_heat_sizeof_opmem = &vtsp_solve_heat_sizeof_opmem;
+	heat->solve_heat = &vtsp_solve_heat;
+	heat->update_heat = NULL;
+	return SUCCESS;
+}
+
+int vtsp_bind_heat_incremental(vtsp_binding_heat_t *heat,
+			       vtsp_heat_ctx_t *ctx)
+{
+	TRY( vtsp_bind_heat(heat, ctx) );
+	heat->update_heat = &vtsp_update_heat;
+	return SUCCESS;
+}
+
+int vtsp_solve_heat_sizeof_opmem(void *ctx, const vtsp_mesh_t *input,
+				 size_t *output)
+{
+	const vtsp_heat_ctx_t *hctx = (const vtsp_heat_ctx_t*) ctx;
+	heat_job_t job;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, NULL);
+	vtsp_opmem_take(&mem, sizeof(job));
+	TRY( take_buffers(&job, hctx, input, &mem) );
+
+	*output = vtsp_opmem_sizeof(&mem);
+	return SUCCESS;
+}
+
+int vtsp_solve_heat(void *ctx, const vtsp_mesh_t *input,
+		    float input_temperature_vtx,
+		    vtsp_field_t *output, void *op_mem)
+{
+	vtsp_heat_ctx_t *hctx = (vtsp_heat_ctx_t*) ctx;
+	uint32_t n = input->nodes.num;
+	THROW( n == 0 || input->adj.num == 0, ERROR );
+	THROW( output->n_alloc < n, ERROR );
+
+	/* The job leads op_mem, incremental updates find it there */
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, op_mem);
+	heat_job_t *job = vtsp_opmem_take(&mem, sizeof(*job));
+	TRY( take_buffers(job, hctx, input, &mem) );
+	job->temperature = input_temperature_vtx;
+
+	TRY( vtsp_stiffness_pattern(&(job->a), input) );
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		job->a.fixed[i] = 0;
+		job->in_region[i] = 0;
+		job->queued[i] = 0;
+	}
+	job->n_region = 0;
+	job->head = 0;
+	job->n_queued = 0;
+	job->n_fixed = 0;
+	for (i = 0; i < input->map_vtx.num; i++) {
+		uint32_t node = input->map_vtx.index[i];
+		THROW( node >= n, ERROR );
+		job->n_fixed += !job->a.fixed[node];
+		job->a.fixed[node] = 1;
+	}
+	job->n_fixed_solved = job->n_fixed;
+
+	job->requested = hctx ? hctx->n_threads : 0;
+	job->n_threads = vtsp_parallel_threads(job->requested, n,
+					       MIN_NODES_PER_THREAD);
+	TRY( vtsp_parallel_run(job->n_threads, &assemble_rows, job) );
+	TRY( prepare(job, hctx) );
+
+	/* Tolerances stay relative to the residual of x = temperature */
+	TRY( vtsp_parallel_run(job->n_threads, &start_cg, job) );
+	sum_dots(job, job->n_threads, &(job->rr), NULL);
+	job->norm0 = sqrt(job->rr);
+	if (hctx) {
+		hctx->n_solves = 0;
+	}
+	TRY( iterate(job, hctx) );
+	write_field(job, output);
+	return SUCCESS;
+}
+
+int vtsp_update_heat(void *ctx, const vtsp_mesh_t *input, uint32_t node,
+		     vtsp_field_t *output, vtsp_perm_t *output_changed,
+		     void *op_mem)
+{
+	vtsp_heat_ctx_t *hctx = (vtsp_heat_ctx_t*) ctx;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, op_mem);
+	heat_job_t *job = vtsp_opmem_take(&mem, sizeof(*job));
+	THROW( input->nodes.num != job->a.n || node >= job->a.n, ERROR );
+	THROW( output->n_alloc < job->a.n, ERROR );
+	THROW( output_changed->n_alloc < job->a.n, ERROR );
+	output_changed->num = 0;
+	if (job->a.fixed[node]) {
+		return SUCCESS;
+	}
+
+	uint32_t max_rings = DEFAULT_UPDATE_RINGS;
+	float tolerance = DEFAULT_UPDATE_TOLERANCE;
+	float growth = DEFAULT_UPDATE_GROWTH;
+	if (hctx && hctx->update_rings > 0) {
+		max_rings = hctx->update_rings;
+	}
+	if (hctx && hctx->update_tolerance > 0) {
+		tolerance = hctx->update_tolerance;
+	}
+	if (hctx && hctx->update_growth > 1) {
+		growth = hctx->update_growth;
+	}
+
+	fix_node(job, node);
+	output->values[node] = job->temperature;
+	relax_rings(job, node, max_rings, (double) tolerance);
+	output_changed->index[output_changed->num++] = node;
+	uint32_t i;
+	for (i = 0; i < job->n_region; i++) {
+		uint32_t j = job->region[i];
+		output->values[j] = (float) job->x[j];
+		output_changed->index[output_changed->num++] = j;
+		job->in_region[j] = 0;
+	}
+
+	/*
+	 * What the rings left behind is cleared by a global solve, once
+	 * the fixed nodes grew by a factor since the last one, so there
+	 * are only logarithmically many.
+	 */
+	if ((double) job->n_fixed < (double) growth * job->n_fixed_solved) {
+		return SUCCESS;
+	}
+	/* Warm start, preconditioners are set up for the new fixed nodes */
+	TRY( prepare(job, hctx) );
+	TRY( vtsp_parallel_run(job->n_threads, &start_cg, job) );
+	sum_dots(job, job->n_threads, &(job->rr), NULL);
+	TRY( iterate(job, hctx) );
+	write_field(job, output);
+	for (i = 0; i < job->a.n; i++) {
+		output_changed->index[i] = i;
+	}
+	output_changed->num = job->a.n;
+	job->n_fixed_solved = job->n_fixed;
+	return SUCCESS;
+}
+
+static bool uses_multigrid(const vtsp_heat_ctx_t *hctx)
+{
+	return hctx != NULL && (hctx->method == VTSP_HEAT_VCYCLES ||
+				hctx->precond == VTSP_HEAT_MULTIGRID);
+}
+
+static int take_buffers(heat_job_t *job, const vtsp_heat_ctx_t *hctx,
+			const vtsp_mesh_t *mesh, vtsp_opmem_t *mem)
+{
+	uint32_t n_nodes = mesh->nodes.num;
+	uint32_t n_trgs = mesh->adj.num;
+	THROW( hctx && hctx->method != VTSP_HEAT_CG &&
+	       hctx->method != VTSP_HEAT_VCYCLES, ERROR );
+	THROW( hctx && hctx->precond != VTSP_HEAT_JACOBI &&
+	       hctx->precond != VTSP_HEAT_IC0 &&
+	       hctx->precond != VTSP_HEAT_MULTIGRID, ERROR );
+	job->precond = hctx ? hctx->precond : VTSP_HEAT_JACOBI;
+	job->block_precond = !uses_multigrid(hctx);
+	/* The pattern is the node graph of the mesh when it comes with one */
+	vtsp_stiffness_take(&(job->a), n_nodes, n_trgs,
+			    vtsp_topology_ready(mesh), mem);
+	if (job->block_precond && job->precond == VTSP_HEAT_IC0) {
+		job->l_diag = vtsp_opmem_take(mem, n_nodes *
+					      sizeof(*(job->l_diag)));
+		job->l_val = vtsp_opmem_take(mem, 6 * (size_t) n_trgs *
+					     sizeof(*(job->l_val)));
+	} else {
+		job->l_diag = NULL;
+		job->l_val = NULL;
+	}
+	if (uses_multigrid(hctx)) {
+		THROW( hctx->mesher == NULL || hctx->mesher->get_mesh == NULL,
+		       ERROR );
+		TRY( vtsp_mg_take(&(job->mg), n_nodes, hctx->mesher, mem) );
+	}
+	job->x = vtsp_opmem_take(mem, n_nodes * sizeof(*(job->x)));
+	job->r = vtsp_opmem_take(mem, n_nodes * sizeof(*(job->r)));
+	job->z = vtsp_opmem_take(mem, n_nodes * sizeof(*(job->z)));
+	job->p = vtsp_opmem_take(mem, n_nodes * sizeof(*(job->p)));
+	job->q = vtsp_opmem_take(mem, n_nodes * sizeof(*(job->q)));
+	job->region = vtsp_opmem_take(mem, n_nodes * sizeof(*(job->region)));
+	job->in_region = vtsp_opmem_take(mem, n_nodes *
+					 sizeof(*(job->in_region)));
+	job->queue = vtsp_opmem_take(mem, n_nodes * sizeof(*(job->queue)));
+	job->queued = vtsp_opmem_take(mem, n_nodes * sizeof(*(job->queued)));
+	return SUCCESS;
+}
+
+static int assemble_rows(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	heat_job_t *job = (heat_job_t*) ctx;
+	uint32_t begin, end;
+	vtsp_parallel_range(job->a.n, id, n_threads, &begin, &end);
+	TRY( vtsp_stiffness_assemble(&(job->a), begin, end) );
+
+	/*
+	 * Starting from x = temperature everywhere, the rows of a
+	 * Laplacian sum zero, so the residual is the load.
+	 */
+	uint32_t i;
+	for (i = begin; i < end; i++) {
+		job->x[i] = job->temperature;
+		job->r[i] = job->a.fixed[i] ? 0.0 : HEAT_SOURCE * job->a.load[i];
+	}
+	return SUCCESS;
+}
+
+static int prepare(heat_job_t *job, const vtsp_heat_ctx_t *hctx)
+{
+	/* Preconditioners of the current fixed nodes */
+	if (job->block_precond && job->precond == VTSP_HEAT_IC0) {
+		TRY( vtsp_parallel_run(job->n_threads, &factor_ic0, job) );
+	}
+	if (uses_multigrid(hctx)) {
+		TRY( vtsp_mg_build(&(job->mg), &(job->a), hctx->mesher,
+				   job->requested) );
+	}
+	return SUCCESS;
+}
+
+static int iterate(heat_job_t *job, vtsp_heat_ctx_t *hctx)
+{
+	/* From the current x, r and rr, the best iterate is kept */
+	float tolerance = DEFAULT_TOLERANCE;
+	uint32_t max_iters = job->a.n;
+	if (hctx && hctx->tolerance > 0) {
+		tolerance = hctx->tolerance;
+	}
+	if (hctx && hctx->max_iters > 0) {
+		max_iters = hctx->max_iters;
+	}
+
+	double stop = (double) tolerance * job->norm0;
+	uint32_t n_iters = 0;
+	if (hctx && hctx->method == VTSP_HEAT_VCYCLES) {
+		TRY( solve_vcycles(job, job->n_threads, stop, max_iters,
+				   &n_iters, &(job->rr)) );
+	} else {
+		TRY( solve_cg(job, job->n_threads, stop, max_iters,
+			      &n_iters, &(job->rr)) );
+	}
+	if (hctx) {
+		hctx->n_iters = n_iters;
+		hctx->residual = job->norm0 > 0.0 ?
+			(float) (sqrt(job->rr) / job->norm0) : 0.0f;
+		hctx->n_solves ++;
+	}
+	return SUCCESS;
+}
+
+static void write_field(const heat_job_t *job, vtsp_field_t *output)
+{
+	uint32_t i;
+	for (i = 0; i < job->a.n; i++) {
+		output->values[i] = (float) job->x[i];
+	}
+	output->num = job->a.n;
+}
+
+static void fix_node(heat_job_t *job, uint32_t i)
+{
+	/*
+	 * Measured from the temperature fixed nodes hold zero, so the old
+	 * value of i leaves the residual of its neighbors with its column.
+	 */
+	vtsp_stiffness_t *a = &(job->a);
+	const vtsp_graph_t *graph = &(a->graph);
+	double shift = job->x[i] - job->temperature;
+	a->fixed[i] = 1;
+	a->diag[i] = 1.0;
+	job->x[i] = job->temperature;
+	job->r[i] = 0.0;
+	job->n_fixed ++;
+
+	uint32_t e;
+	for (e = graph->offset[i]; e < graph->offset[i + 1]; e++) {
+		uint32_t j = graph->index[e];
+		double a_ij = a->val[e];
+		a->val[e] = 0.0;
+		if (a->fixed[j]) {
+			continue;
+		}
+		uint32_t f;
+		for (f = graph->offset[j]; f < graph->offset[j + 1]; f++) {
+			if (graph->index[f] == i) {
+				a->val[f] = 0.0;
+				break;
+			}
+		}
+		job->r[j] += a_ij * shift;
+	}
+}
+
+static void relax_rings(heat_job_t *job, uint32_t node, uint32_t max_rings,
+			double tolerance)
+{
+	/*
+	 * The free rows around node join the region ring by ring, while
+	 * the residual reaching the next ring is above tolerance times
+	 * the one of the first ring. Fixed nodes bound the rings, so the
+	 * denser the path around node, the smaller the region.
+	 */
+	job->n_region = 0;
+	uint32_t begin = 0;
+	uint32_t end = add_ring(job, &node, 1);
+	double stop = tolerance * ring_residual(job, begin);
+	uint32_t ring = 1;
+	while (end > begin) {
+		relax_region(job, begin, stop / sqrt((double) job->n_region));
+		if (ring == max_rings) {
+			break;
+		}
+		uint32_t next = add_ring(job, job->region + begin, end - begin);
+		if (ring_residual(job, end) <= stop) {
+			/* Residual left there is below what the region keeps */
+			while (job->n_region > end) {
+				job->in_region[job->region[--job->n_region]] = 0;
+			}
+			break;
+		}
+		begin = end;
+		end = next;
+		ring ++;
+	}
+}
+
+static uint32_t add_ring(heat_job_t *job, const uint32_t *rows, uint32_t n)
+{
+	/* Free neighbors of rows not in the region yet, rows may alias it */
+	const vtsp_stiffness_t *a = &(job->a);
+	const vtsp_graph_t *graph = &(a->graph);
+	uint32_t k;
+	for (k = 0; k < n; k++) {
+		uint32_t i = rows[k];
+		uint32_t e;
+		for (e = graph->offset[i]; e < graph->offset[i + 1]; e++) {
+			uint32_t j = graph->index[e];
+			if (!a->fixed[j] && !job->in_region[j]) {
+				job->in_region[j] = 1;
+				job->region[job->n_region++] = j;
+			}
+		}
+	}
+	return job->n_region;
+}
+
+static double ring_residual(const heat_job_t *job, uint32_t begin)
+{
+	double rr = 0.0;
+	uint32_t k;
+	for (k = begin; k < job->n_region; k++) {
+		double r = job->r[job->region[k]];
+		rr += r * r;
+	}
+	return sqrt(rr);
+}
+
+static void relax_region(heat_job_t *job, uint32_t begin, double eps)
+{
+	/*
+	 * Gauss-Seidel driven by the rows above eps, starting from the
+	 * ring at begin. Inner rows come back as their residual grows.
+	 */
+	uint32_t k;
+	for (k = begin; k < job->n_region; k++) {
+		queue_row(job, job->region[k], eps);
+	}
+	uint64_t n_relaxed = 0;
+	uint64_t max_relaxed = (uint64_t) MAX_RELAX_SWEEPS *
+		(job->n_region - begin);
+	while (job->n_queued > 0 && n_relaxed < max_relaxed) {
+		relax(job, pop_queue(job), eps);
+		n_relaxed ++;
+	}
+	while (job->n_queued > 0) {
+		pop_queue(job);
+	}
+}
+
+static void relax(heat_job_t *job, uint32_t j, double eps)
+{
+	/* Gauss-Seidel on row j, the change reaches the residual around */
+	const vtsp_stiffness_t *a = &(job->a);
+	const vtsp_graph_t *graph = &(a->graph);
+	double delta = job->r[j] / a->diag[j];
+	job->x[j] += delta;
+	job->r[j] = 0.0;
+	uint32_t e;
+	for (e = graph->offset[j]; e < graph->offset[j + 1]; e++) {
+		uint32_t k = graph->index[e];
+		if (!a->fixed[k]) {
+			job->r[k] -= a->val[e] * delta;
+			queue_row(job, k, eps);
+		}
+	}
+}
+
+static void queue_row(heat_job_t *job, uint32_t j, double eps)
+{
+	/* Only rows of the region, the others keep their residual */
+	if (fabs(job->r[j]) > eps && job->in_region[j] && !job->queued[j]) {
+		uint32_t tail = job->head + job->n_queued;
+		job->queue[tail < job->a.n ? tail : tail - job->a.n] = j;
+		job->queued[j] = 1;
+		job->n_queued ++;
+	}
+}
+
+static uint32_t pop_queue(heat_job_t *job)
+{
+	uint32_t j = job->queue[job->head];
+	job->queued[j] = 0;
+	job->head = job->head + 1 < job->a.n ? job->head + 1 : 0;
+	job->n_queued --;
+	return j;
+}
+
+static int solve_cg(heat_job_t *job, uint32_t n_threads, double stop,
+		    uint32_t max_iters, uint32_t *n_iters, double *rr)
+{
+	/* Preconditioned CG, a V-cycle is one more preconditioner */
+	double rz, pq;
+	if (!job->block_precond) {
+		TRY( vtsp_mg_vcycle(&(job->mg), job->r, job->z) );
+	}
+	TRY( vtsp_parallel_run(n_threads, &dot_rz, job) );
+	sum_dots(job, n_threads, &rz, NULL);
+	job->beta = 0.0;
+	TRY( vtsp_parallel_run(n_threads, &new_direction, job) );
+
+	uint32_t iter = 0;
+	while (sqrt(*rr) > stop && iter < max_iters) {
+		TRY( vtsp_parallel_run(n_threads, &multiply, job) );
+		sum_dots(job, n_threads, &pq, NULL);
+		THROW( !(pq > 0.0), ERROR ); /* Not SPD or NaN */
+		job->alpha = rz / pq;
+		TRY( vtsp_parallel_run(n_threads, &update, job) );
+		double rz_new;
+		sum_dots(job, n_threads, rr, &rz_new);
+		iter ++;
+		if (sqrt(*rr) <= stop) {
+			break;
+		}
+		if (!job->block_precond) {
+			TRY( vtsp_mg_vcycle(&(job->mg), job->r, job->z) );
+			TRY( vtsp_parallel_run(n_threads, &dot_rz, job) );
+			sum_dots(job, n_threads, &rz_new, NULL);
+		}
+		job->beta = rz_new / rz;
+		rz = rz_new;
+		TRY( vtsp_parallel_run(n_threads, &new_direction, job) );
+	}
+	*n_iters = iter;
+	return SUCCESS;
+}
+
+static int solve_vcycles(heat_job_t *job, uint32_t n_threads, double stop,
+			 uint32_t max_iters, uint32_t *n_iters, double *rr)
+{
+	/* x += V(r), the correction goes through p so r -= A p */
+	uint32_t iter = 0;
+	while (sqrt(*rr) > stop && iter < max_iters) {
+		double rr_prev = *rr;
+		TRY( vtsp_mg_vcycle(&(job->mg), job->r, job->p) );
+		TRY( vtsp_parallel_run(n_threads, &multiply, job) );
+		job->alpha = 1.0;
+		TRY( vtsp_parallel_run(n_threads, &update, job) );
+		sum_dots(job, n_threads, rr, NULL);
+		iter ++;
+		if (*rr > VCYCLE_STALL * VCYCLE_STALL * rr_prev) {
+			/*
+			 * V-cycles alone slow down on meshes of skinny
+			 * triangles, CG over the same V-cycle still converges.
+			 */
+			uint32_t n_cg;
+			TRY( solve_cg(job, n_threads, stop, max_iters - iter,
+				      &n_cg, rr) );
+			iter += n_cg;
+			break;
+		}
+	}
+	*n_iters = iter;
+	return SUCCESS;
+}
+
+static int factor_ic0(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	/* Incomplete Cholesky of the diagonal block of this thread */
+	heat_job_t *job = (heat_job_t*) ctx;
+	const vtsp_graph_t *graph = &(job->a.graph);
+	uint32_t begin, end;
+	vtsp_parallel_range(job->a.n, id, n_threads, &begin, &end);
+
+	uint32_t i;
+	for (i = begin; i < end; i++) {
+		uint32_t row = graph->offset[i];
+		uint32_t row_end = graph->offset[i + 1];
+		double d = job->a.diag[i];
+		uint32_t e;
+		for (e = row; e < row_end; e++) {
+			uint32_t k = graph->index[e];
+			if (k < begin) {
+				continue;
+			}
+			if (k >= i) {
+				break;
+			}
+			/* Sum l_im * l_km over begin <= m < k, both rows sorted */
+			double s = job->a.val[e];
+			uint32_t a = row;
+			uint32_t b = graph->offset[k];
+			uint32_t b_end = graph->offset[k + 1];
+			while (a < e && b < b_end) {
+				uint32_t ma = graph->index[a];
+				uint32_t mb = graph->index[b];
+				if (ma < begin || ma < mb) {
+					a ++;
+				} else if (mb < begin || mb < ma) {
+					b ++;
+				} else {
+					if (mb >= k) {
+						break;
+					}
+					s -= (double) job->l_val[a] *
+						(double) job->l_val[b];
+					a ++;
+					b ++;
+				}
+			}
+			double l = s / (double) job->l_diag[k];
+			job->l_val[e] = (float) l;
+			d -= l * l;
+		}
+		/* Keep the plain diagonal if the factor breaks down */
+		job->l_diag[i] = (float) sqrt(d > 0.0 ? d : job->a.diag[i]);
+	}
+	return SUCCESS;
+}
+
+static void precondition(heat_job_t *job, uint32_t begin, uint32_t end)
+{
+	uint32_t i;
+	if (job->precond != VTSP_HEAT_IC0) {
+		for (i = begin; i < end; i++) {
+			job->z[i] = job->r[i] / job->a.diag[i];
+		}
+		return;
+	}
+
+	/* Solve L y = r and then L^T z = y, inside the block */
+	const vtsp_graph_t *graph = &(job->a.graph);
+	for (i = begin; i < end; i++) {
+		double s = job->r[i];
+		uint32_t e;
+		for (e = graph->offset[i]; e < graph->offset[i + 1]; e++) {
+			uint32_t k = graph->index[e];
+			if (k >= i) {
+				break;
+			}
+			if (k >= begin) {
+				s -= (double) job->l_val[e] * job->z[k];
+			}
+		}
+		job->z[i] = s / (double) job->l_diag[i];
+	}
+	for (i = end; i > begin; i--) {
+		uint32_t row = i - 1;
+		double zi = job->z[row] / (double) job->l_diag[row];
+		job->z[row] = zi;
+		uint32_t e;
+		for (e = graph->offset[row]; e < graph->offset[row + 1]; e++) {
+			uint32_t k = graph->index[e];
+			if (k >= row) {
+				break;
+			}
+			if (k >= begin) {
+				job->z[k] -= (double) job->l_val[e] * zi;
+			}
+		}
+	}
+}
+
+static int start_cg(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	heat_job_t *job = (heat_job_t*) ctx;
+	uint32_t begin, end;
+	vtsp_parallel_range(job->a.n, id, n_threads, &begin, &end);
+	if (job->block_precond) {
+		precondition(job, begin, end);
+	}
+
+	double rr = 0.0;
+	uint32_t i;
+	for (i = begin; i < end; i++) {
+		rr += job->r[i] * job->r[i];
+	}
+	job->dot[id][0] = rr;
+	return SUCCESS;
+}
+
+static int multiply(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	/* q = A p */
+	heat_job_t *job = (heat_job_t*) ctx;
+	uint32_t begin, end;
+	vtsp_parallel_range(job->a.n, id, n_threads, &begin, &end);
+	job->dot[id][0] = vtsp_stiffness_multiply(&(job->a), job->p, job->q,
+						  begin, end);
+	return SUCCESS;
+}
+
+static int update(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	heat_job_t *job = (heat_job_t*) ctx;
+	uint32_t begin, end;
+	vtsp_parallel_range(job->a.n, id, n_threads, &begin, &end);
+
+	double alpha = job->alpha;
+	uint32_t i;
+	for (i = begin; i < end; i++) {
+		job->x[i] += alpha * job->p[i];
+		job->r[i] -= alpha * job->q[i];
+	}
+	if (job->block_precond) {
+		precondition(job, begin, end);
+	}
+
+	double rr = 0.0;
+	double rz = 0.0;
+	for (i = begin; i < end; i++) {
+		rr += job->r[i] * job->r[i];
+		rz += job->r[i] * job->z[i];
+	}
+	job->dot[id][0] = rr;
+	job->dot[id][1] = rz;
+	return SUCCESS;
+}
+
+static int dot_rz(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	heat_job_t *job = (heat_job_t*) ctx;
+	uint32_t begin, end;
+	vtsp_parallel_range(job->a.n, id, n_threads, &begin, &end);
+
+	double rz = 0.0;
+	uint32_t i;
+	for (i = begin; i < end; i++) {
+		rz += job->r[i] * job->z[i];
+	}
+	job->dot[id][0] = rz;
+	return SUCCESS;
+}
+
+static int new_direction(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	heat_job_t *job = (heat_job_t*) ctx;
+	uint32_t begin, end;
+	vtsp_parallel_range(job->a.n, id, n_threads, &begin, &end);
+
+	double beta = job->beta;
+	uint32_t i;
+	if (beta == 0.0) {
+		for (i = begin; i < end; i++) {
+			job->p[i] = job->z[i];
+		}
+		return SUCCESS;
+	}
+	for (i = begin; i < end; i++) {
+		job->p[i] = job->z[i] + beta * job->p[i];
+	}
+	return SUCCESS;
+}
+
+static void sum_dots(const heat_job_t *job, uint32_t n_threads,
+		     double *dot0, double *dot1)
+{
+	/* Fixed order, results do not depend on thread timing */
+	*dot0 = 0.0;
+	if (dot1) {
+		*dot1 = 0.0;
+	}
+	uint32_t t;
+	for (t = 0; t < n_threads; t++) {
+		*dot0 += job->dot[t][0];
+		if (dot1) {
+			*dot1 += job->dot[t][1];
+		}
+	}
+}
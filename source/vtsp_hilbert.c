@@ -0,0 +1,266 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vtsp_hilbert.h"
+#include "try_macros.h"
+#include "vtsp_opmem.h"
+#include "vtsp_parallel.h"
+
+#define MIN_POINTS_PER_THREAD 65536
+#define GRID_BITS 16
+#define GRID_SIZE (1u << GRID_BITS)  /* Cells per axis, keys fill 32 bits */
+#define RADIX_BITS 8
+#define RADIX (1u << RADIX_BITS)
+#define KEY_BITS 32
+
+/*
+ * Curve as a state machine, a state is how the current quadrant is
+ * flipped and rotated. Quadrant index is (x bit) << 1 | (y bit).
+ */
+static const uint8_t HILBERT_DIGIT[4][4] = {
+	{ 0, 1, 3, 2 }, { 2, 3, 1, 0 }, { 0, 3, 1, 2 }, { 2, 1, 3, 0 }
+};
+static const uint8_t HILBERT_NEXT[4][4] = {
+	{ 2, 0, 3, 0 }, { 1, 2, 1, 3 }, { 0, 1, 2, 2 }, { 3, 3, 0, 1 }
+};
+
+typedef struct {
+	const vtsp_point_t *pts;
+	uint32_t n;
+	uint32_t *keys[2];
+	uint32_t *index[2];   /* index[0] is the output */
+	uint32_t *count;      /* RADIX per thread, then their offsets */
+	uint32_t src;         /* Buffer holding the current order */
+	uint32_t shift;       /* Digit sorted by the current pass */
+	float lo[PARALLEL_MAX_THREADS][2];
+	float hi[PARALLEL_MAX_THREADS][2];
+	double x0, y0;
+	double scale;         /* Grid cells per unit of length */
+} hilbert_job_t;
+
+static void take_buffers(hilbert_job_t *job, uint32_t n, vtsp_opmem_t *mem);
+static int find_bounds(void *ctx, uint32_t id, uint32_t n_threads);
+static void reduce_bounds(hilbert_job_t *job, uint32_t n_threads);
+static int make_keys(void *ctx, uint32_t id, uint32_t n_threads);
+static int count_digits(void *ctx, uint32_t id, uint32_t n_threads);
+static bool prefix_counts(hilbert_job_t *job, uint32_t n_threads);
+static int scatter(void *ctx, uint32_t id, uint32_t n_threads);
+static uint32_t snap(double v, double origin, double scale);
+static uint32_t hilbert_key(uint32_t x, uint32_t y);
+
+int vtsp_bind_hilbert(vtsp_binding_orderer_t *orderer,
+		      vtsp_hilbert_ctx_t *ctx)
+{
+	orderer->ctx = ctx;
+	orderer->order_points_sizeof_opmem = &vtsp_hilbert_order_sizeof_opmem;
+	orderer->order_points = &vtsp_hilbert_order;
+	return SUCCESS;
+}
+
+int vtsp_hilbert_order_sizeof_opmem(void *ctx, const vtsp_points_t *input,
+				    size_t *output)
+{
+	hilbert_job_t job;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, NULL);
+	take_buffers(&job, input->num, &mem);
+
+	*output = vtsp_opmem_sizeof(&mem);
+	return SUCCESS;
+}
+
+int vtsp_hilbert_order(void *ctx, const vtsp_points_t *input,
+		       vtsp_perm_t *output, void *op_mem)
+{
+	const vtsp_hilbert_ctx_t *hctx = (const vtsp_hilbert_ctx_t*) ctx;
+	THROW( output->n_alloc < input->num, ERROR );
+	output->num = input->num;
+	if (input->num == 0) {
+		return SUCCESS;
+	}
+
+	hilbert_job_t job;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, op_mem);
+	take_buffers(&job, input->num, &mem);
+	job.pts = input->pts;
+	job.n = input->num;
+	job.index[0] = output->index;
+	job.src = 0;
+
+	uint32_t n_threads = vtsp_parallel_threads(hctx ? hctx->n_threads : 0,
+						   input->num,
+						   MIN_POINTS_PER_THREAD);
+	TRY( vtsp_parallel_run(n_threads, &find_bounds, &job) );
+	reduce_bounds(&job, n_threads);
+	TRY( vtsp_parallel_run(n_threads, &make_keys, &job) );
+
+	for (job.shift = 0; job.shift < KEY_BITS; job.shift += RADIX_BITS) {
+		TRY( vtsp_parallel_run(n_threads, &count_digits, &job) );
+		if (!prefix_counts(&job, n_threads)) {
+			continue; /* Every key has the same digit */
+		}
+		TRY( vtsp_parallel_run(n_threads, &scatter, &job) );
+		job.src = 1 - job.src;
+	}
+	if (job.src != 0) {
+		memcpy(output->index, job.index[1],
+		       job.n * sizeof(*(output->index)));
+	}
+	return SUCCESS;
+}
+
+static void take_buffers(hilbert_job_t *job, uint32_t n, vtsp_opmem_t *mem)
+{
+	job->keys[0] = vtsp_opmem_take(mem, n * sizeof(*(job->keys[0])));
+	job->keys[1] = vtsp_opmem_take(mem, n * sizeof(*(job->keys[1])));
+	job->index[1] = vtsp_opmem_take(mem, n * sizeof(*(job->index[1])));
+	job->count = vtsp_opmem_take(mem, PARALLEL_MAX_THREADS * RADIX *
+				     sizeof(*(job->count)));
+}
+
+static int find_bounds(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	hilbert_job_t *job = (hilbert_job_t*) ctx;
+	uint32_t begin, end;
+	vtsp_parallel_range(job->n, id, n_threads, &begin, &end);
+
+	float *lo = job->lo[id];
+	float *hi = job->hi[id];
+	lo[0] = hi[0] = job->pts[begin].x;
+	lo[1] = hi[1] = job->pts[begin].y;
+	uint32_t i;
+	for (i = begin + 1; i < end; i++) {
+		const vtsp_point_t *p = &(job->pts[i]);
+		lo[0] = p->x < lo[0] ? p->x : lo[0];
+		hi[0] = p->x > hi[0] ? p->x : hi[0];
+		lo[1] = p->y < lo[1] ? p->y : lo[1];
+		hi[1] = p->y > hi[1] ? p->y : hi[1];
+	}
+	return SUCCESS;
+}
+
+static void reduce_bounds(hilbert_job_t *job, uint32_t n_threads)
+{
+	float lo[2] = { job->lo[0][0], job->lo[0][1] };
+	float hi[2] = { job->hi[0][0], job->hi[0][1] };
+	uint32_t t, k;
+	for (t = 1; t < n_threads; t++) {
+		for (k = 0; k < 2; k++) {
+			lo[k] = job->lo[t][k] < lo[k] ? job->lo[t][k] : lo[k];
+			hi[k] = job->hi[t][k] > hi[k] ? job->hi[t][k] : hi[k];
+		}
+	}
+
+	/* Same scale on both axes, the curve keeps the aspect ratio */
+	double w = (double) hi[0] - lo[0];
+	double h = (double) hi[1] - lo[1];
+	double side = w > h ? w : h;
+	job->x0 = lo[0];
+	job->y0 = lo[1];
+	job->scale = side > 0 ? (GRID_SIZE - 1) / side : 0;
+}
+
+static int make_keys(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	hilbert_job_t *job = (hilbert_job_t*) ctx;
+	uint32_t begin, end;
+	vtsp_parallel_range(job->n, id, n_threads, &begin, &end);
+
+	uint32_t i;
+	for (i = begin; i < end; i++) {
+		const vtsp_point_t *p = &(job->pts[i]);
+		uint32_t x = snap(p->x, job->x0, job->scale);
+		uint32_t y = snap(p->y, job->y0, job->scale);
+		job->keys[0][i] = hilbert_key(x, y);
+		job->index[0][i] = i;
+	}
+	return SUCCESS;
+}
+
+static int count_digits(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	hilbert_job_t *job = (hilbert_job_t*) ctx;
+	uint32_t begin, end;
+	vtsp_parallel_range(job->n, id, n_threads, &begin, &end);
+
+	uint32_t *count = &(job->count[id * RADIX]);
+	memset(count, 0, RADIX * sizeof(*count));
+	const uint32_t *keys = job->keys[job->src];
+	uint32_t i;
+	for (i = begin; i < end; i++) {
+		count[(keys[i] >> job->shift) & (RADIX - 1)] ++;
+	}
+	return SUCCESS;
+}
+
+/* Counts become where each thread writes each digit, false if no-op */
+static bool prefix_counts(hilbert_job_t *job, uint32_t n_threads)
+{
+	uint32_t d, t;
+	for (d = 0; d < RADIX; d++) {
+		uint32_t total = 0;
+		for (t = 0; t < n_threads; t++) {
+			total += job->count[t * RADIX + d];
+		}
+		if (total == job->n) {
+			return false;
+		}
+	}
+
+	/* Digit major, thread minor: runs of a thread stay in order */
+	uint32_t sum = 0;
+	for (d = 0; d < RADIX; d++) {
+		for (t = 0; t < n_threads; t++) {
+			uint32_t c = job->count[t * RADIX + d];
+			job->count[t * RADIX + d] = sum;
+			sum += c;
+		}
+	}
+	return true;
+}
+
+static int scatter(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	hilbert_job_t *job = (hilbert_job_t*) ctx;
+	uint32_t begin, end;
+	vtsp_parallel_range(job->n, id, n_threads, &begin, &end);
+
+	uint32_t *offset = &(job->count[id * RADIX]);
+	const uint32_t *src_keys = job->keys[job->src];
+	const uint32_t *src_index = job->index[job->src];
+	uint32_t *dst_keys = job->keys[1 - job->src];
+	uint32_t *dst_index = job->index[1 - job->src];
+	uint32_t i;
+	for (i = begin; i < end; i++) {
+		uint32_t key = src_keys[i];
+		uint32_t pos = offset[(key >> job->shift) & (RADIX - 1)] ++;
+		dst_keys[pos] = key;
+		dst_index[pos] = src_index[i];
+	}
+	return SUCCESS;
+}
+
+static uint32_t snap(double v, double origin, double scale)
+{
+	double cell = (v - origin) * scale;
+	if (!(cell > 0)) {
+		return 0;
+	}
+	return cell < GRID_SIZE - 1 ? (uint32_t) cell : GRID_SIZE - 1;
+}
+
+/* Distance along the curve filling the grid, x and y below GRID_SIZE */
+static uint32_t hilbert_key(uint32_t x, uint32_t y)
+{
+	uint32_t key = 0;
+	uint32_t state = 0;
+	int bit;
+	for (bit = GRID_BITS - 1; bit >= 0; bit--) {
+		uint32_t quadrant = ((x >> bit) & 1) << 1 | ((y >> bit) & 1);
+		key = key << 2 | HILBERT_DIGIT[state][quadrant];
+		state = HILBERT_NEXT[state][quadrant];
+	}
+	return key;
+}
@@ -0,0 +1,532 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "vtsp_improve.h"
+#include "try_macros.h"
+#include "vtsp_graph.h"
+#include "vtsp_opmem.h"
+#include "vtsp_topology.h"
+#include "vtsp_twolevel.h"
+
+#define NONE UINT32_MAX
+#define MIN_POINTS 8
+#define MAX_CANDIDATES 10
+#define MAX_GATHER 64          /* Mesh neighbors looked at per point */
+#define MAX_SEGMENT 3          /* Or-opt moves segments of 1 to 3 points */
+#define CLOCK_PERIOD 1024      /* Points processed between clock checks */
+#define MIN_GAIN 1e-7
+
+typedef struct {
+	const vtsp_point_t *pts;
+	uint32_t n;
+	vtsp_twolevel_t tour;
+	uint32_t *cand;         /* MAX_CANDIDATES per point, nearest first */
+	uint8_t *n_cand;
+	uint32_t *node_point;   /* Mesh node to input point, NONE if Steiner */
+	uint32_t *ring;         /* Queue of points with the look bit on */
+	uint8_t *queued;
+	uint32_t head, n_queued;
+	vtsp_graph_t graph;
+} improve_job_t;
+
+static void take_buffers(improve_job_t *job, uint32_t n_points,
+			 const vtsp_mesh_t *mesh, vtsp_opmem_t *mem);
+static void init_candidates(improve_job_t *job, const vtsp_mesh_t *mesh);
+static void gather(uint32_t p, uint32_t q, uint32_t *buffer,
+		   uint32_t *n_buffer);
+static double dist(const improve_job_t *job, uint32_t a, uint32_t b);
+static uint32_t next(const improve_job_t *job, uint32_t p);
+static uint32_t prev(const improve_job_t *job, uint32_t p);
+static uint32_t step(const improve_job_t *job, uint32_t p, bool forward);
+static void push(improve_job_t *job, uint32_t p);
+static uint32_t pop(improve_job_t *job);
+static bool between(const improve_job_t *job, uint32_t a, uint32_t b,
+		    uint32_t c, bool forward);
+static void move_2opt(improve_job_t *job, uint32_t x1, uint32_t x2,
+		      uint32_t y1);
+static bool try_3opt(improve_job_t *job, uint32_t t1);
+static bool try_depth3(improve_job_t *job, uint32_t t1, uint32_t t2,
+		       uint32_t t3, uint32_t t4, double gain, bool succ,
+		       bool forward);
+static bool try_oropt(improve_job_t *job, uint32_t a);
+static bool apply_oropt(improve_job_t *job, uint32_t p, uint32_t s1,
+			uint32_t s2, uint32_t nx, uint32_t u, uint32_t v,
+			double gain);
+static bool in_segment(const improve_job_t *job, uint32_t s1, uint32_t s2,
+		       uint32_t x, bool forward);
+static double elapsed_millis(const struct timespec *start);
+
+int vtsp_bind_improver(vtsp_binding_improver_t *improver,
+		       vtsp_improve_ctx_t *ctx)
+{
+	improver->ctx = ctx;
+	improver->improve_tour_sizeof_opmem = &vtsp_improve_tour_sizeof_opmem;
+	improver->improve_tour = &vtsp_improve_tour;
+	return SUCCESS;
+}
+
+int vtsp_improve_tour_sizeof_opmem(void *ctx, const vtsp_points_t *points,
+				   const vtsp_mesh_t *mesh, size_t *output)
+{
+	improve_job_t job;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, NULL);
+	take_buffers(&job, points->num, mesh, &mem);
+
+	*output = vtsp_opmem_sizeof(&mem);
+	return SUCCESS;
+}
+
+int vtsp_improve_tour(void *ctx, const vtsp_points_t *points,
+		      const vtsp_mesh_t *mesh, vtsp_perm_t *tour,
+		      void *op_mem)
+{
+	vtsp_improve_ctx_t *ictx = (vtsp_improve_ctx_t*) ctx;
+	ictx->n_moves = 0;
+	THROW( tour->num != points->num, ERROR );
+	THROW( mesh->map_vtx.num != points->num, ERROR );
+	if (points->num < MIN_POINTS) {
+		return SUCCESS;
+	}
+
+	struct timespec start;
+	THROW( clock_gettime(CLOCK_MONOTONIC, &start) != 0, ERROR );
+
+	improve_job_t job;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, op_mem);
+	take_buffers(&job, points->num, mesh, &mem);
+	job.pts = points->pts;
+	job.n = points->num;
+	if (vtsp_topology_ready(mesh)) {
+		job.graph = mesh->node_nodes;
+	} else {
+		/* The graph build uses the queue as cursor, it is filled later */
+		TRY( vtsp_graph_build(mesh, &(job.graph), job.ring) );
+	}
+	init_candidates(&job, mesh);
+
+	uint32_t i;
+	job.head = 0;
+	job.n_queued = 0;
+	for (i = 0; i < job.n; i++) {
+		job.queued[i] = 0;
+	}
+	for (i = 0; i < job.n; i++) {
+		uint32_t p = tour->index[i];
+		THROW( p >= job.n || job.queued[p], ERROR );
+		push(&job, p);
+	}
+	vtsp_tl_init(&(job.tour), tour->index);
+
+	uint32_t n_popped = 0;
+	while (job.n_queued > 0) {
+		if (ictx->max_moves > 0 && ictx->n_moves >= ictx->max_moves) {
+			break;
+		}
+		if (ictx->max_millis > 0 && ++n_popped % CLOCK_PERIOD == 0 &&
+		    elapsed_millis(&start) >= ictx->max_millis) {
+			break;
+		}
+		uint32_t a = pop(&job);
+		if (try_3opt(&job, a) || try_oropt(&job, a)) {
+			ictx->n_moves += 1;
+			push(&job, a);
+		}
+	}
+	TRY( vtsp_tl_write(&(job.tour), tour->index[0], tour) );
+	return SUCCESS;
+}
+
+static void take_buffers(improve_job_t *job, uint32_t n_points,
+			 const vtsp_mesh_t *mesh, vtsp_opmem_t *mem)
+{
+	uint32_t n_nodes = mesh->nodes.num;
+	size_t n_cand = (size_t) n_points * MAX_CANDIDATES;
+	vtsp_tl_take(&(job->tour), n_points, mem);
+	job->cand = vtsp_opmem_take(mem, n_cand * sizeof(*(job->cand)));
+	job->n_cand = vtsp_opmem_take(mem, n_points * sizeof(*(job->n_cand)));
+	job->node_point = vtsp_opmem_take(mem, n_nodes *
+					  sizeof(*(job->node_point)));
+	/* Also the cursor of the graph build */
+	uint32_t n_ring = n_points > n_nodes ? n_points : n_nodes;
+	job->ring = vtsp_opmem_take(mem, n_ring * sizeof(*(job->ring)));
+	job->queued = vtsp_opmem_take(mem, n_points * sizeof(*(job->queued)));
+	if (!vtsp_topology_ready(mesh)) {
+		vtsp_graph_take(&(job->graph), n_nodes, mesh->adj.num, mem);
+	}
+}
+
+static void init_candidates(improve_job_t *job, const vtsp_mesh_t *mesh)
+{
+	const vtsp_graph_t *graph = &(job->graph);
+	uint32_t i;
+	for (i = 0; i < mesh->nodes.num; i++) {
+		job->node_point[i] = NONE;
+	}
+	for (i = 0; i < job->n; i++) {
+		uint32_t node = mesh->map_vtx.index[i];
+		if (job->node_point[node] == NONE) {
+			job->node_point[node] = i;
+		}
+	}
+
+	uint32_t buffer[MAX_GATHER];
+	double d[MAX_GATHER];
+	uint32_t p;
+	for (p = 0; p < job->n; p++) {
+		uint32_t n_buffer = 0;
+		uint32_t node = mesh->map_vtx.index[p];
+		/* Duplicated points share a node */
+		gather(p, job->node_point[node], buffer, &n_buffer);
+		uint32_t j;
+		for (j = graph->offset[node]; j < graph->offset[node + 1]; j++) {
+			uint32_t x = graph->index[j];
+			if (job->node_point[x] != NONE) {
+				gather(p, job->node_point[x], buffer, &n_buffer);
+				continue;
+			}
+			uint32_t k;
+			for (k = graph->offset[x]; k < graph->offset[x + 1]; k++) {
+				uint32_t q = job->node_point[graph->index[k]];
+				gather(p, q, buffer, &n_buffer);
+			}
+		}
+
+		/* Insertion sort by distance, rows are short */
+		for (j = 0; j < n_buffer; j++) {
+			uint32_t q = buffer[j];
+			double dq = dist(job, p, q);
+			uint32_t k = j;
+			while (k > 0 && d[k - 1] > dq) {
+				buffer[k] = buffer[k - 1];
+				d[k] = d[k - 1];
+				k --;
+			}
+			buffer[k] = q;
+			d[k] = dq;
+		}
+		if (n_buffer > MAX_CANDIDATES) {
+			n_buffer = MAX_CANDIDATES;
+		}
+		uint32_t *cand = &(job->cand[(size_t) p * MAX_CANDIDATES]);
+		for (j = 0; j < n_buffer; j++) {
+			cand[j] = buffer[j];
+		}
+		job->n_cand[p] = (uint8_t) n_buffer;
+	}
+}
+
+static void gather(uint32_t p, uint32_t q, uint32_t *buffer,
+		   uint32_t *n_buffer)
+{
+	if (q == NONE || q == p || *n_buffer == MAX_GATHER) {
+		return;
+	}
+	uint32_t i;
+	for (i = 0; i < *n_buffer; i++) {
+		if (buffer[i] == q) {
+			return;
+		}
+	}
+	buffer[(*n_buffer)++] = q;
+}
+
+static double dist(const improve_job_t *job, uint32_t a, uint32_t b)
+{
+	double dx = (double) job->pts[a].x - (double) job->pts[b].x;
+	double dy = (double) job->pts[a].y - (double) job->pts[b].y;
+	return sqrt(dx * dx + dy * dy);
+}
+
+static uint32_t next(const improve_job_t *job, uint32_t p)
+{
+	return vtsp_tl_next(&(job->tour), p);
+}
+
+static uint32_t prev(const improve_job_t *job, uint32_t p)
+{
+	return vtsp_tl_prev(&(job->tour), p);
+}
+
+static uint32_t step(const improve_job_t *job, uint32_t p, bool forward)
+{
+	return forward ? next(job, p) : prev(job, p);
+}
+
+static void push(improve_job_t *job, uint32_t p)
+{
+	if (job->queued[p]) {
+		return;
+	}
+	uint32_t tail = job->head + job->n_queued;
+	job->ring[tail >= job->n ? tail - job->n : tail] = p;
+	job->n_queued += 1;
+	job->queued[p] = 1;
+}
+
+static uint32_t pop(improve_job_t *job)
+{
+	uint32_t p = job->ring[job->head];
+	job->head = job->head + 1 == job->n ? 0 : job->head + 1;
+	job->n_queued -= 1;
+	job->queued[p] = 0;
+	return p;
+}
+
+static bool between(const improve_job_t *job, uint32_t a, uint32_t b,
+		    uint32_t c, bool forward)
+{
+	/* b on the path from a to c in the given direction */
+	if (forward) {
+		return vtsp_tl_between(&(job->tour), a, b, c);
+	}
+	return vtsp_tl_between(&(job->tour), c, b, a);
+}
+
+static void move_2opt(improve_job_t *job, uint32_t x1, uint32_t x2,
+		      uint32_t y1)
+{
+	/*
+	 * Replace edges (x1, x2) and (y1, y2) by (x1, y1) and (x2, y2),
+	 * where x2 follows x1 and y2 follows y1 in the same direction,
+	 * which may be either one of the list. y2 is implied by it.
+	 */
+	if (next(job, x1) == x2) {
+		vtsp_tl_reverse(&(job->tour), x2, y1);
+	} else {
+		vtsp_tl_reverse(&(job->tour), y1, x2);
+	}
+}
+
+static bool try_3opt(improve_job_t *job, uint32_t t1)
+{
+	/*
+	 * Lin-Kernighan style search up to depth 3: remove (t1, t2), add
+	 * (t2, t3), remove (t3, t4), then close with (t4, t1), a 2-opt
+	 * move when t4 precedes t3, or go on with try_depth3. Partial
+	 * gains must stay positive.
+	 */
+	int dir;
+	for (dir = 0; dir < 2; dir++) {
+		bool forward = dir == 0;
+		uint32_t t2 = step(job, t1, forward);
+		const uint32_t *cand = &(job->cand[(size_t) t2 * MAX_CANDIDATES]);
+		double g0 = dist(job, t1, t2);
+		uint32_t i;
+		for (i = 0; i < job->n_cand[t2]; i++) {
+			uint32_t t3 = cand[i];
+			double g1 = g0 - dist(job, t2, t3);
+			if (g1 <= MIN_GAIN) {
+				break;
+			}
+			if (t3 == t1 || t3 == step(job, t2, forward)) {
+				continue;
+			}
+			/* t4 is the successor of t3, then its predecessor */
+			int x4;
+			for (x4 = 0; x4 < 2; x4++) {
+				bool succ = x4 == 0;
+				uint32_t t4 = step(job, t3, succ == forward);
+				if (t4 == t1) {
+					continue;
+				}
+				double g2 = g1 + dist(job, t3, t4);
+				if (!succ && g2 - dist(job, t4, t1) > MIN_GAIN) {
+					move_2opt(job, t1, t2, t4);
+					push(job, t2);
+					push(job, t3);
+					push(job, t4);
+					return true;
+				}
+				if (try_depth3(job, t1, t2, t3, t4, g2, succ,
+					       forward)) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+static bool try_depth3(improve_job_t *job, uint32_t t1, uint32_t t2,
+		       uint32_t t3, uint32_t t4, double gain, bool succ,
+		       bool forward)
+{
+	/*
+	 * Add (t4, t5), remove (t5, t6) and close with (t6, t1). Which t6
+	 * gives a tour depends on where t5 lies, each valid case is done
+	 * as a sequence of 2-opt moves.
+	 */
+	const uint32_t *cand = &(job->cand[(size_t) t4 * MAX_CANDIDATES]);
+	uint32_t i;
+	for (i = 0; i < job->n_cand[t4]; i++) {
+		uint32_t t5 = cand[i];
+		double g3 = gain - dist(job, t4, t5);
+		if (g3 <= MIN_GAIN) {
+			break;
+		}
+		if (t5 == next(job, t4) || t5 == prev(job, t4) || t5 == t1) {
+			continue;
+		}
+		uint32_t t6;
+		if (succ) {
+			/* t5 must lie on t2..t3 */
+			if (!between(job, t2, t5, t3, forward)) {
+				continue;
+			}
+			t6 = step(job, t5, forward);
+			double g_next = g3 + dist(job, t5, t6) - dist(job, t6, t1);
+			uint32_t t6_prev = step(job, t5, !forward);
+			double g_prev = -DBL_MAX;
+			if (t5 != t2 && t6_prev != t2) {
+				g_prev = g3 + dist(job, t5, t6_prev) -
+					dist(job, t6_prev, t1);
+			}
+			if (g_next >= g_prev && g_next > MIN_GAIN) {
+				/* Segments swap: t2..t5 t4..t1 t6..t3 */
+				move_2opt(job, t1, t2, t5);
+				move_2opt(job, t1, t5, t3);
+				move_2opt(job, t1, t3, t6);
+			} else if (g_prev > MIN_GAIN) {
+				/* t2..t6 t1..t4 t5..t3 */
+				t6 = t6_prev;
+				move_2opt(job, t6, t5, t1);
+				move_2opt(job, t4, t3, t5);
+			} else {
+				continue;
+			}
+		} else if (between(job, t3, t5, t1, forward)) {
+			/* t2..t4 t5..t1 t6..t3 */
+			t6 = step(job, t5, !forward);
+			if (g3 + dist(job, t5, t6) - dist(job, t6, t1) <= MIN_GAIN) {
+				continue;
+			}
+			move_2opt(job, t1, t2, t6);
+			move_2opt(job, t3, t4, t2);
+		} else {
+			/* t2..t5 t4..t6 t1..t3 */
+			t6 = step(job, t5, forward);
+			if (g3 + dist(job, t5, t6) - dist(job, t6, t1) <= MIN_GAIN) {
+				continue;
+			}
+			move_2opt(job, t1, t2, t4);
+			move_2opt(job, t1, t4, t6);
+		}
+		push(job, t2);
+		push(job, t3);
+		push(job, t4);
+		push(job, t5);
+		push(job, t6);
+		return true;
+	}
+	return false;
+}
+
+static bool try_oropt(improve_job_t *job, uint32_t a)
+{
+	/* Move the segment starting at a next to one of its candidates */
+	const uint32_t *cand = &(job->cand[(size_t) a * MAX_CANDIDATES]);
+	int dir;
+	for (dir = 0; dir < 2; dir++) {
+		bool forward = dir == 0;
+		uint32_t p = step(job, a, !forward);
+		uint32_t s2 = a;
+		uint32_t len;
+		for (len = 1; len <= MAX_SEGMENT; len++) {
+			if (len > 1) {
+				s2 = step(job, s2, forward);
+			}
+			uint32_t nx = step(job, s2, forward);
+			if (nx == p || step(job, nx, forward) == p) {
+				break;
+			}
+			double removed = dist(job, p, a) + dist(job, s2, nx) -
+				dist(job, p, nx);
+			uint32_t i;
+			for (i = 0; i < job->n_cand[a]; i++) {
+				uint32_t c = cand[i];
+				if (dist(job, c, a) >= removed) {
+					break;
+				}
+				if (in_segment(job, a, s2, c, forward)) {
+					continue;
+				}
+				/* Edges (c, c+) and (c-, c) */
+				uint32_t c_next = step(job, c, forward);
+				uint32_t c_prev = step(job, c, !forward);
+				if (c_next != a &&
+				    apply_oropt(job, p, a, s2, nx, c, c_next,
+						removed)) {
+					return true;
+				}
+				if (c != nx &&
+				    apply_oropt(job, p, a, s2, nx, c_prev, c,
+						removed)) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+static bool apply_oropt(improve_job_t *job, uint32_t p, uint32_t s1,
+			uint32_t s2, uint32_t nx, uint32_t u, uint32_t v,
+			double gain)
+{
+	/*
+	 * Tour p s1..s2 nx .. u v, with v = u+ in the given direction.
+	 * Check u s1..s2 v and u s2..s1 v, apply the best one if it gains.
+	 */
+	double d_uv = dist(job, u, v);
+	double keep = dist(job, u, s1) + dist(job, s2, v) - d_uv;
+	double flip = dist(job, u, s2) + dist(job, s1, v) - d_uv;
+	bool keep_orient = keep <= flip;
+	if (gain - (keep_orient ? keep : flip) <= MIN_GAIN) {
+		return false;
+	}
+
+	/* p u .. nx s2..s1 v, then p nx .. u s2..s1 v */
+	move_2opt(job, p, s1, u);
+	if (u != nx) {
+		move_2opt(job, p, u, nx);
+	}
+	if (keep_orient && s1 != s2) {
+		move_2opt(job, u, s2, s1);
+	}
+	push(job, p);
+	push(job, nx);
+	push(job, s2);
+	push(job, u);
+	push(job, v);
+	return true;
+}
+
+static bool in_segment(const improve_job_t *job, uint32_t s1, uint32_t s2,
+		       uint32_t x, bool forward)
+{
+	uint32_t p = s1;
+	while (true) {
+		if (p == x) {
+			return true;
+		}
+		if (p == s2) {
+			return false;
+		}
+		p = step(job, p, forward);
+	}
+}
+
+static double elapsed_millis(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) (now.tv_sec - start->tv_sec) * 1e3 +
+		(double) (now.tv_nsec - start->tv_nsec) * 1e-6;
+}
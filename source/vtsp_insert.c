@@ -0,0 +1,491 @@
+#include <float.h>
+#include <stdint.h>
+
+#include "vtsp_insert.h"
+#include "try_macros.h"
+#include "vtsp_topology.h"
+
+#define NONE UINT32_MAX
+#define BATCH_EDGES 128      /* Edges scored per call to the integral */
+
+typedef struct {
+	const vtsp_points_t *points;
+	const vtsp_mesh_t *mesh;
+	vtsp_field_t *field;
+	const vtsp_depend_t *depend;
+	vtsp_insert_mem_t *mem;
+	uint32_t n_in_path;
+	uint32_t first;      /* A point that is always in path */
+	uint32_t scan;       /* Next point to check for leftovers */
+} insert_ctx_t;
+
+typedef struct {
+	uint32_t a, b;
+	double cost;
+} candidate_t;
+
+static int init_path(insert_ctx_t *ctx, const vtsp_perm_t *path);
+static void init_nodes(insert_ctx_t *ctx);
+static int integrate(insert_ctx_t *ctx, const uint32_t *p1,
+		     const uint32_t *p2, uint32_t n, double *output);
+static int measure_edges(insert_ctx_t *ctx, const uint32_t *a, uint32_t n);
+static int score_edge(insert_ctx_t *ctx, uint32_t u, uint32_t a,
+		      candidate_t *best);
+static int score_batch(insert_ctx_t *ctx, candidate_t *best);
+static int consider_point(insert_ctx_t *ctx, uint32_t u, uint32_t q,
+			  candidate_t *best);
+static void offer(insert_ctx_t *ctx, uint32_t u, uint32_t a, double cost);
+static int sweep(insert_ctx_t *ctx, uint32_t p);
+static int rescore(insert_ctx_t *ctx, uint32_t u);
+static int queue_leftovers(insert_ctx_t *ctx);
+static int insert(insert_ctx_t *ctx, uint32_t u);
+static void touch_changed(insert_ctx_t *ctx);
+static void touch_node(insert_ctx_t *ctx, uint32_t x);
+static void touch(vtsp_insert_mem_t *mem, uint32_t p);
+static int refresh(insert_ctx_t *ctx);
+static int report_progress(insert_ctx_t *ctx);
+static int write_path(insert_ctx_t *ctx, vtsp_perm_t *path);
+
+void vtsp_insert_take(vtsp_insert_mem_t *mem, uint32_t n_points,
+		      uint32_t n_nodes, vtsp_opmem_t *opmem)
+{
+	mem->next = vtsp_opmem_take(opmem, n_points * sizeof(*(mem->next)));
+	mem->prev = vtsp_opmem_take(opmem, n_points * sizeof(*(mem->prev)));
+	mem->best_a = vtsp_opmem_take(opmem, n_points * sizeof(*(mem->best_a)));
+	mem->best_b = vtsp_opmem_take(opmem, n_points * sizeof(*(mem->best_b)));
+	mem->edge_cost = vtsp_opmem_take(opmem, n_points * sizeof(*(mem->edge_cost)));
+	mem->in_path = vtsp_opmem_take(opmem, n_points * sizeof(*(mem->in_path)));
+	mem->node_point = vtsp_opmem_take(opmem, n_nodes * sizeof(*(mem->node_point)));
+	mem->swept = vtsp_opmem_take(opmem, n_nodes * sizeof(*(mem->swept)));
+	mem->stack = vtsp_opmem_take(opmem, n_nodes * sizeof(*(mem->stack)));
+	vtsp_queue_take(&(mem->queue), n_points, opmem);
+	mem->heat_mem = NULL;
+	mem->changed.num = 0;
+	mem->changed.n_alloc = n_nodes;
+	mem->changed.index = vtsp_opmem_take(opmem, n_nodes *
+					     sizeof(*(mem->changed.index)));
+	mem->n_touched = 0;
+	mem->touched = vtsp_opmem_take(opmem, n_points * sizeof(*(mem->touched)));
+	mem->marked = vtsp_opmem_take(opmem, n_points * sizeof(*(mem->marked)));
+	mem->n_batch = 0;
+	mem->batch_u = vtsp_opmem_take(opmem, BATCH_EDGES * sizeof(*(mem->batch_u)));
+	mem->batch_a = vtsp_opmem_take(opmem, BATCH_EDGES * sizeof(*(mem->batch_a)));
+	mem->batch_p1 = vtsp_opmem_take(opmem, 2 * BATCH_EDGES *
+					sizeof(*(mem->batch_p1)));
+	mem->batch_p2 = vtsp_opmem_take(opmem, 2 * BATCH_EDGES *
+					sizeof(*(mem->batch_p2)));
+	mem->batch_cost = vtsp_opmem_take(opmem, 2 * BATCH_EDGES *
+					  sizeof(*(mem->batch_cost)));
+}
+
+int vtsp_insert_points(const vtsp_points_t *points, const vtsp_mesh_t *mesh,
+		       vtsp_field_t *field, const vtsp_depend_t *depend,
+		       vtsp_insert_mem_t *mem, vtsp_perm_t *path)
+{
+	insert_ctx_t ctx;
+	ctx.points = points;
+	ctx.mesh = mesh;
+	ctx.field = field;
+	ctx.depend = depend;
+	ctx.mem = mem;
+	ctx.scan = 0;
+
+	THROW( mesh->map_vtx.num != points->num, ERROR );
+	THROW( !vtsp_topology_ready(mesh), ERROR );
+	init_nodes(&ctx);
+	vtsp_queue_clear(&(mem->queue));
+	TRY( init_path(&ctx, path) );
+
+	uint32_t i;
+	for (i = 0; i < path->num; i++) {
+		TRY( sweep(&ctx, path->index[i]) );
+	}
+
+	vtsp_queue_t *queue = &(mem->queue);
+	while (ctx.n_in_path < points->num) {
+		if (queue->num == 0) {
+			TRY( queue_leftovers(&ctx) );
+			continue;
+		}
+		uint32_t u = vtsp_queue_top(queue);
+		if (mem->next[mem->best_a[u]] != mem->best_b[u]) {
+			/* Its best edge was split, re-score lazily */
+			TRY( rescore(&ctx, u) );
+			continue;
+		}
+		vtsp_queue_pop(queue);
+		TRY( insert(&ctx, u) );
+		TRY( sweep(&ctx, u) );
+		TRY( report_progress(&ctx) );
+	}
+
+	TRY( write_path(&ctx, path) );
+	return SUCCESS;
+}
+
+static int init_path(insert_ctx_t *ctx, const vtsp_perm_t *path)
+{
+	vtsp_insert_mem_t *mem = ctx->mem;
+	uint32_t n = ctx->points->num;
+	THROW( path->num < 3 || path->num > n, ERROR );
+
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		mem->in_path[i] = 0;
+		mem->marked[i] = 0;
+	}
+	for (i = 0; i < path->num; i++) {
+		uint32_t a = path->index[i];
+		uint32_t b = path->index[(i + 1) % path->num];
+		THROW( a >= n || mem->in_path[a], ERROR );
+		mem->in_path[a] = 1;
+		mem->next[a] = b;
+		mem->prev[b] = a;
+	}
+	TRY( measure_edges(ctx, path->index, path->num) );
+	ctx->n_in_path = path->num;
+	ctx->first = path->index[0];
+	return SUCCESS;
+}
+
+static void init_nodes(insert_ctx_t *ctx)
+{
+	vtsp_insert_mem_t *mem = ctx->mem;
+	uint32_t i;
+	for (i = 0; i < ctx->mesh->nodes.num; i++) {
+		mem->node_point[i] = NONE;
+		mem->swept[i] = 0;
+	}
+	/* Duplicated points share a node, only the first one is linked */
+	for (i = 0; i < ctx->points->num; i++) {
+		uint32_t node = ctx->mesh->map_vtx.index[i];
+		if (mem->node_point[node] == NONE) {
+			mem->node_point[node] = i;
+		}
+	}
+}
+
+static int integrate(insert_ctx_t *ctx, const uint32_t *p1,
+		     const uint32_t *p2, uint32_t n, double *output)
+{
+	const vtsp_binding_integral_t *integral = &(ctx->depend->integral);
+	if (integral->integrate_paths != NULL) {
+		TRY( integral->integrate_paths(integral->ctx, ctx->field,
+					       ctx->mesh, p1, p2, n, output) );
+		return SUCCESS;
+	}
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		TRY( integral->integrate_path(integral->ctx, ctx->field,
+					      ctx->mesh, p1[i], p2[i],
+					      &(output[i])) );
+	}
+	return SUCCESS;
+}
+
+static int measure_edges(insert_ctx_t *ctx, const uint32_t *a, uint32_t n)
+{
+	/* edge_cost of the path edges (a[i], next[a[i]]) */
+	vtsp_insert_mem_t *mem = ctx->mem;
+	uint32_t i;
+	for (i = 0; i < n; i += 2 * BATCH_EDGES) {
+		uint32_t n_edges = n - i;
+		if (n_edges > 2 * BATCH_EDGES) {
+			n_edges = 2 * BATCH_EDGES;
+		}
+		uint32_t k;
+		for (k = 0; k < n_edges; k++) {
+			mem->batch_p1[k] = a[i + k];
+			mem->batch_p2[k] = mem->next[a[i + k]];
+		}
+		TRY( integrate(ctx, mem->batch_p1, mem->batch_p2, n_edges,
+			       mem->batch_cost) );
+		for (k = 0; k < n_edges; k++) {
+			mem->edge_cost[a[i + k]] = mem->batch_cost[k];
+		}
+	}
+	return SUCCESS;
+}
+
+static int score_edge(insert_ctx_t *ctx, uint32_t u, uint32_t a,
+		      candidate_t *best)
+{
+	/*
+	 * Queue inserting u into edge (a, next[a]), the costs come with
+	 * the batch. Offered to u if best is NULL, else kept if lower.
+	 */
+	vtsp_insert_mem_t *mem = ctx->mem;
+	uint32_t k = mem->n_batch++;
+	mem->batch_u[k] = u;
+	mem->batch_a[k] = a;
+	mem->batch_p1[2 * k] = a;
+	mem->batch_p2[2 * k] = u;
+	mem->batch_p1[2 * k + 1] = u;
+	mem->batch_p2[2 * k + 1] = mem->next[a];
+	if (mem->n_batch == BATCH_EDGES) {
+		TRY( score_batch(ctx, best) );
+	}
+	return SUCCESS;
+}
+
+static int score_batch(insert_ctx_t *ctx, candidate_t *best)
+{
+	/* In queuing order, the path does not change meanwhile */
+	vtsp_insert_mem_t *mem = ctx->mem;
+	uint32_t n = mem->n_batch;
+	mem->n_batch = 0;
+	TRY( integrate(ctx, mem->batch_p1, mem->batch_p2, 2 * n,
+		       mem->batch_cost) );
+	uint32_t k;
+	for (k = 0; k < n; k++) {
+		uint32_t a = mem->batch_a[k];
+		double cost = mem->batch_cost[2 * k] +
+			mem->batch_cost[2 * k + 1] - mem->edge_cost[a];
+		if (best == NULL) {
+			offer(ctx, mem->batch_u[k], a, cost);
+		} else if (cost < best->cost) {
+			best->a = a;
+			best->b = mem->next[a];
+			best->cost = cost;
+		}
+	}
+	return SUCCESS;
+}
+
+static int consider_point(insert_ctx_t *ctx, uint32_t u, uint32_t q,
+			  candidate_t *best)
+{
+	/* Both path edges incident to q */
+	if (q != NONE && q != u && ctx->mem->in_path[q]) {
+		TRY( score_edge(ctx, u, ctx->mem->prev[q], best) );
+		TRY( score_edge(ctx, u, q, best) );
+	}
+	return SUCCESS;
+}
+
+static void offer(insert_ctx_t *ctx, uint32_t u, uint32_t a, double cost)
+{
+	vtsp_insert_mem_t *mem = ctx->mem;
+	if (!vtsp_queue_contains(&(mem->queue), u) ||
+	    cost < mem->queue.key[u]) {
+		mem->best_a[u] = a;
+		mem->best_b[u] = mem->next[a];
+		vtsp_queue_set(&(mem->queue), u, cost);
+	}
+}
+
+static int sweep(insert_ctx_t *ctx, uint32_t p)
+{
+	/*
+	 * Offer the two path edges incident to p to every free point
+	 * around it. Steiner nodes are crossed, each one only once.
+	 */
+	vtsp_insert_mem_t *mem = ctx->mem;
+	const vtsp_graph_t *graph = &(ctx->mesh->node_nodes);
+	uint32_t a = mem->prev[p];
+	uint32_t n_stack = 0;
+	mem->stack[n_stack++] = ctx->mesh->map_vtx.index[p];
+	while (n_stack > 0) {
+		uint32_t w = mem->stack[--n_stack];
+		uint32_t j;
+		for (j = graph->offset[w]; j < graph->offset[w + 1]; j++) {
+			uint32_t x = graph->index[j];
+			uint32_t v = mem->node_point[x];
+			if (v == NONE) {
+				if (!mem->swept[x]) {
+					mem->swept[x] = 1;
+					mem->stack[n_stack++] = x;
+				}
+			} else if (!mem->in_path[v]) {
+				TRY( score_edge(ctx, v, a, NULL) );
+				TRY( score_edge(ctx, v, p, NULL) );
+			}
+		}
+	}
+	TRY( score_batch(ctx, NULL) );
+	return SUCCESS;
+}
+
+static int rescore(insert_ctx_t *ctx, uint32_t u)
+{
+	vtsp_insert_mem_t *mem = ctx->mem;
+	const vtsp_graph_t *graph = &(ctx->mesh->node_nodes);
+	candidate_t best;
+	best.cost = DBL_MAX;
+
+	/* Endpoints of the split edge remain in the path */
+	if (vtsp_queue_contains(&(mem->queue), u)) {
+		TRY( consider_point(ctx, u, mem->best_a[u], &best) );
+		TRY( consider_point(ctx, u, mem->best_b[u], &best) );
+	}
+
+	uint32_t node = ctx->mesh->map_vtx.index[u];
+	TRY( consider_point(ctx, u, mem->node_point[node], &best) );
+	uint32_t j;
+	for (j = graph->offset[node]; j < graph->offset[node + 1]; j++) {
+		uint32_t x = graph->index[j];
+		if (mem->node_point[x] != NONE) {
+			TRY( consider_point(ctx, u, mem->node_point[x], &best) );
+			continue;
+		}
+		uint32_t k;
+		for (k = graph->offset[x]; k < graph->offset[x + 1]; k++) {
+			uint32_t q = mem->node_point[graph->index[k]];
+			TRY( consider_point(ctx, u, q, &best) );
+		}
+	}
+
+	TRY( score_batch(ctx, &best) );
+	if (best.cost == DBL_MAX) {
+		/* Isolated point, any path edge is valid */
+		TRY( score_edge(ctx, u, ctx->first, &best) );
+		TRY( score_batch(ctx, &best) );
+	}
+	mem->best_a[u] = best.a;
+	mem->best_b[u] = best.b;
+	vtsp_queue_set(&(mem->queue), u, best.cost);
+	return SUCCESS;
+}
+
+static int queue_leftovers(insert_ctx_t *ctx)
+{
+	/* Points not reached through the mesh, e.g. duplicated points */
+	vtsp_insert_mem_t *mem = ctx->mem;
+	for (; ctx->scan < ctx->points->num; ctx->scan++) {
+		uint32_t u = ctx->scan;
+		if (!mem->in_path[u] && !vtsp_queue_contains(&(mem->queue), u)) {
+			TRY( rescore(ctx, u) );
+		}
+	}
+	THROW( mem->queue.num == 0, ERROR );
+	return SUCCESS;
+}
+
+static int insert(insert_ctx_t *ctx, uint32_t u)
+{
+	vtsp_insert_mem_t *mem = ctx->mem;
+	uint32_t a = mem->best_a[u];
+	uint32_t b = mem->best_b[u];
+	mem->next[a] = u;
+	mem->prev[u] = a;
+	mem->next[u] = b;
+	mem->prev[b] = u;
+	mem->in_path[u] = 1;
+	ctx->n_in_path += 1;
+	mem->n_touched = 0;
+	touch(mem, a);
+	touch(mem, u);
+
+	const vtsp_binding_heat_t *heat = &(ctx->depend->heat);
+	const vtsp_binding_integral_t *integral = &(ctx->depend->integral);
+	if (heat->update_heat != NULL) {
+		/* New edges are measured on the field with u fixed */
+		TRY( heat->update_heat(heat->ctx, ctx->mesh,
+				       ctx->mesh->map_vtx.index[u],
+				       ctx->field, &(mem->changed),
+				       mem->heat_mem) );
+		if (integral->invalidate != NULL) {
+			TRY( integral->invalidate(integral->ctx) );
+		}
+		touch_changed(ctx);
+	}
+	TRY( refresh(ctx) );
+	return SUCCESS;
+}
+
+static void touch_changed(insert_ctx_t *ctx)
+{
+	/*
+	 * Costs measured on the old field, around the nodes the update
+	 * moved and their neighbors. Queued points there have their best
+	 * edge nearby, rescore searches it around them.
+	 */
+	const vtsp_graph_t *graph = &(ctx->mesh->node_nodes);
+	const vtsp_perm_t *changed = &(ctx->mem->changed);
+	uint32_t i;
+	for (i = 0; i < changed->num; i++) {
+		uint32_t x = changed->index[i];
+		touch_node(ctx, x);
+		uint32_t j;
+		for (j = graph->offset[x]; j < graph->offset[x + 1]; j++) {
+			touch_node(ctx, graph->index[j]);
+		}
+	}
+}
+
+static void touch_node(insert_ctx_t *ctx, uint32_t x)
+{
+	/* Both path edges of its point, or its queued cost */
+	vtsp_insert_mem_t *mem = ctx->mem;
+	uint32_t v = mem->node_point[x];
+	if (v == NONE) {
+		return;
+	}
+	if (mem->in_path[v]) {
+		touch(mem, mem->prev[v]);
+		touch(mem, v);
+	} else if (vtsp_queue_contains(&(mem->queue), v)) {
+		touch(mem, v);
+	}
+}
+
+static void touch(vtsp_insert_mem_t *mem, uint32_t p)
+{
+	if (!mem->marked[p]) {
+		mem->marked[p] = 1;
+		mem->touched[mem->n_touched++] = p;
+	}
+}
+
+static int refresh(insert_ctx_t *ctx)
+{
+	/*
+	 * Touched points of the path stand for their edge to next, they
+	 * are measured first so queued points score against new costs.
+	 */
+	vtsp_insert_mem_t *mem = ctx->mem;
+	uint32_t n_edges = 0;
+	uint32_t k;
+	for (k = 0; k < mem->n_touched; k++) {
+		uint32_t p = mem->touched[k];
+		mem->marked[p] = 0;
+		if (mem->in_path[p]) {
+			mem->touched[k] = mem->touched[n_edges];
+			mem->touched[n_edges++] = p;
+		}
+	}
+	TRY( measure_edges(ctx, mem->touched, n_edges) );
+	for (k = n_edges; k < mem->n_touched; k++) {
+		TRY( rescore(ctx, mem->touched[k]) );
+	}
+	mem->n_touched = 0;
+	return SUCCESS;
+}
+
+static int report_progress(insert_ctx_t *ctx)
+{
+	const vtsp_binding_reporter_t *reporter = &(ctx->depend->reporter);
+	uint32_t n = ctx->points->num;
+	uint32_t step = n / 100 + 1;
+	if (reporter->report_progress == NULL || ctx->n_in_path % step != 0) {
+		return SUCCESS;
+	}
+	float percent = 100.0f * (float) ctx->n_in_path / (float) n;
+	TRY( reporter->report_progress(reporter->ctx, percent) );
+	return SUCCESS;
+}
+
+static int write_path(insert_ctx_t *ctx, vtsp_perm_t *path)
+{
+	uint32_t first = ctx->first;
+	uint32_t p = first;
+	uint32_t i = 0;
+	do {
+		THROW( i >= path->n_alloc, ERROR );
+		path->index[i++] = p;
+		p = ctx->mem->next[p];
+	} while (p != first);
+	THROW( i != ctx->points->num, ERROR );
+	path->num = i;
+	return SUCCESS;
+}
@@ -0,0 +1,49 @@
+#ifndef __VTSP_INSERT_H__
+#define __VTSP_INSERT_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_depend.h"
+#include "vtsp_opmem.h"
+#include "vtsp_queue.h"
+
+/* Scratch of the heat-guided insertion loop */
+typedef struct {
+	uint32_t *next, *prev;  /* Path as a circular list over points */
+	uint32_t *best_a;       /* Best edge (best_a, best_b) of queued points */
+	uint32_t *best_b;
+	double *edge_cost;      /* Cost of edge (a, next[a]) */
+	uint8_t *in_path;
+	uint32_t *node_point;   /* Mesh node to input point, NONE if Steiner */
+	uint8_t *swept;         /* Steiner nodes already crossed by a sweep */
+	uint32_t *stack;
+	vtsp_queue_t queue;
+	void *heat_mem;         /* op_mem of an incremental heat binding */
+	vtsp_perm_t changed;    /* Nodes the last heat update moved */
+	uint32_t n_touched;     /* Points whose edge or queued cost is stale */
+	uint32_t *touched;
+	uint8_t *marked;
+	/* Edges (a, next[a]) waiting to be scored for u, two paths each */
+	uint32_t n_batch;
+	uint32_t *batch_u, *batch_a;
+	uint32_t *batch_p1, *batch_p2;
+	double *batch_cost;
+} vtsp_insert_mem_t;
+
+void vtsp_insert_take(vtsp_insert_mem_t *mem, uint32_t n_points,
+		      uint32_t n_nodes, vtsp_opmem_t *opmem);
+
+/*
+ * Grow the closed path (initially the convex envelope) until it
+ * visits every point, always inserting the point whose cheapest
+ * insertion, measured with the integral binding, is the lowest.
+ * With an incremental heat binding the field follows the path, and
+ * costs measured around the nodes it moved are measured again.
+ * The topology of the mesh must be built.
+ */
+int vtsp_insert_points(const vtsp_points_t *points, const vtsp_mesh_t *mesh,
+		       vtsp_field_t *field, const vtsp_depend_t *depend,
+		       vtsp_insert_mem_t *mem, vtsp_perm_t *path);
+
+#endif
@@ -0,0 +1,519 @@
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vtsp_integral.h"
+#include "try_macros.h"
+#include "vtsp_locate.h"
+#include "vtsp_opmem.h"
+#include "vtsp_parallel.h"
+#include "vtsp_topology.h"
+
+#define NONE VTSP_LOCATE_NONE
+#define MIN_PAIRS_PER_THREAD 4096
+#define END_EPS 1e-6   /* Rounding left on lambda when the end is reached */
+
+/*
+ * Lives at the start of the op_mem of prepare. The adjacency comes
+ * from the topology of the mesh, or from a copy of the mesh whose
+ * topology and locator are built in that op_mem.
+ */
+typedef struct {
+	const vtsp_mesh_t *mesh;
+	const vtsp_locator_t *locator;
+	const uint32_t *trg_offset;   /* Node to triangles, CSR */
+	const uint32_t *trg_index;
+	const uint32_t *nbr;          /* 3 per triangle, across the edge
+					 opposite each corner */
+	vtsp_mesh_t own_mesh;
+	vtsp_locator_t own;
+} walk_t;
+
+/* Segment from p, the last point reached and the integral so far */
+typedef struct {
+	const walk_t *walk;
+	const float *values;
+	double px, py, dx, dy, len2;
+	double lambda, value;
+	double sum;
+} walker_t;
+
+/* Node on one side of the segment, classified once */
+typedef struct {
+	uint32_t node;
+	double side;
+	double lambda;
+} mark_t;
+
+typedef struct {
+	const walk_t *walk;
+	const vtsp_field_t *field;
+	const vtsp_mesh_t *mesh;
+	const uint32_t *p1, *p2;
+	uint32_t n;
+	double *output;
+} batch_t;
+
+static int integrate_batch(void *ctx, uint32_t id, uint32_t n_threads);
+static int integrate_nodes(const walk_t *walk, const float *values,
+			   uint32_t from_node, uint32_t to_node,
+			   double *output);
+static void start(walker_t *w, const walk_t *walk, const float *values,
+		  const vtsp_point_t *p, const vtsp_point_t *q);
+static int walk_from(walker_t *w, uint32_t node, uint32_t t);
+static uint32_t trg_node(const vtsp_trg_t *trg, uint32_t k);
+static uint32_t trg_corner(const vtsp_trg_t *trg, uint32_t node);
+static bool shares_trg(const walk_t *walk, uint32_t a, uint32_t b);
+static double side(const walker_t *w, uint32_t node);
+static double ahead(const walker_t *w, uint32_t node);
+static void reach(walker_t *w, double lambda, double value);
+static void reach_node(walker_t *w, uint32_t node);
+static int reach_end(walker_t *w);
+static void mark(const walker_t *w, uint32_t node, mark_t *output);
+static double edge_lambda(const mark_t *l, const mark_t *r, double *s);
+static void reach_edge(walker_t *w, const mark_t *l, const mark_t *r);
+static int leave_node(const walker_t *w, uint32_t node, uint32_t *next,
+		      uint32_t *trg, mark_t *l, mark_t *r);
+static void leave_trg(const walker_t *w, uint32_t t, uint32_t *next,
+		      mark_t *l, mark_t *r);
+static int cross_trgs(walker_t *w, uint32_t t, mark_t l, mark_t r,
+		      uint32_t *steps, uint32_t *output);
+
+int vtsp_bind_integral(vtsp_binding_integral_t *integral,
+		       vtsp_integral_ctx_t *ctx)
+{
+	ctx->walk = NULL;
+	integral->ctx = ctx;
+	integral->prepare_sizeof_opmem = &vtsp_integral_prepare_sizeof_opmem;
+	integral->prepare = &vtsp_integral_prepare;
+	integral->integrate_path = &vtsp_integrate_path;
+	integral->integrate_paths = &vtsp_integrate_paths;
+	integral->invalidate = NULL;
+	return SUCCESS;
+}
+
+int vtsp_integral_prepare_sizeof_opmem(void *ctx, const vtsp_mesh_t *mesh,
+				       size_t *output)
+{
+	size_t topology_size = 0;
+	size_t locator_size = 0;
+	if (mesh->locator == NULL) {
+		if (!vtsp_topology_ready(mesh)) {
+			vtsp_mesh_t own_mesh = *mesh;
+			vtsp_topology_clear(&own_mesh);
+			TRY( vtsp_topology_sizeof_opmem(&own_mesh,
+							&topology_size) );
+		}
+		TRY( vtsp_locator_sizeof_opmem(mesh, &locator_size) );
+	}
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, NULL);
+	vtsp_opmem_take(&mem, sizeof(walk_t));
+	vtsp_opmem_take(&mem, topology_size);
+	vtsp_opmem_take(&mem, locator_size);
+
+	*output = vtsp_opmem_sizeof(&mem);
+	return SUCCESS;
+}
+
+int vtsp_integral_prepare(void *ctx, const vtsp_mesh_t *mesh, void *op_mem)
+{
+	vtsp_integral_ctx_t *ictx = (vtsp_integral_ctx_t*) ctx;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, op_mem);
+	walk_t *walk = vtsp_opmem_take(&mem, sizeof(*walk));
+	walk->mesh = mesh;
+	walk->locator = mesh->locator;
+	const vtsp_mesh_t *topology = mesh;
+	if (walk->locator == NULL) {
+		if (!vtsp_topology_ready(mesh)) {
+			walk->own_mesh = *mesh;
+			vtsp_topology_clear(&(walk->own_mesh));
+			size_t topology_size;
+			TRY( vtsp_topology_sizeof_opmem(&(walk->own_mesh),
+							&topology_size) );
+			TRY( vtsp_topology_build(&(walk->own_mesh),
+						 ictx->n_threads,
+						 vtsp_opmem_take(&mem,
+								 topology_size)) );
+			topology = &(walk->own_mesh);
+		}
+		size_t locator_size;
+		TRY( vtsp_locator_sizeof_opmem(mesh, &locator_size) );
+		TRY( vtsp_locator_build(&(walk->own), topology,
+					vtsp_opmem_take(&mem, locator_size)) );
+		walk->locator = &(walk->own);
+	}
+	topology = walk->locator->mesh;
+	THROW( topology->adj.trgs != mesh->adj.trgs, ERROR );
+	walk->trg_offset = topology->node_trgs.offset;
+	walk->trg_index = topology->node_trgs.index;
+	walk->nbr = topology->nbr.index;
+	ictx->walk = walk;
+	return SUCCESS;
+}
+
+int vtsp_integrate_path(void *ctx, const vtsp_field_t *field,
+			const vtsp_mesh_t *mesh, uint32_t p1, uint32_t p2,
+			double *output)
+{
+	const vtsp_integral_ctx_t *ictx = (const vtsp_integral_ctx_t*) ctx;
+	const walk_t *walk = ictx->walk;
+	THROW( walk == NULL || walk->mesh != mesh, ERROR );
+	TRY( integrate_nodes(walk, field->values, mesh->map_vtx.index[p1],
+			     mesh->map_vtx.index[p2], output) );
+	return SUCCESS;
+}
+
+int vtsp_integrate_paths(void *ctx, const vtsp_field_t *field,
+			 const vtsp_mesh_t *mesh, const uint32_t *p1,
+			 const uint32_t *p2, uint32_t n, double *output)
+{
+	const vtsp_integral_ctx_t *ictx = (const vtsp_integral_ctx_t*) ctx;
+	batch_t batch;
+	batch.walk = ictx->walk;
+	batch.field = field;
+	batch.mesh = mesh;
+	batch.p1 = p1;
+	batch.p2 = p2;
+	batch.n = n;
+	batch.output = output;
+	THROW( batch.walk == NULL || batch.walk->mesh != mesh, ERROR );
+
+	/* Short batches stay on the caller, threads cost more than walks */
+	uint32_t n_threads = vtsp_parallel_threads(ictx->n_threads, n,
+						   MIN_PAIRS_PER_THREAD);
+	if (n_threads == 1) {
+		return integrate_batch(&batch, 0, 1);
+	}
+	TRY( vtsp_parallel_run(n_threads, &integrate_batch, &batch) );
+	return SUCCESS;
+}
+
+int vtsp_integrate_segment(void *ctx, const vtsp_field_t *field,
+			   const vtsp_mesh_t *mesh, const vtsp_point_t *a,
+			   const vtsp_point_t *b, double *output)
+{
+	const vtsp_integral_ctx_t *ictx = (const vtsp_integral_ctx_t*) ctx;
+	const walk_t *walk = ictx->walk;
+	THROW( walk == NULL || walk->mesh != mesh, ERROR );
+	uint32_t t;
+	double weight[3];
+	TRY( vtsp_locate_point(walk->locator, a, &t, weight) );
+	THROW( t == NONE, MALFORMED_INPUT );
+	const vtsp_trg_t *trg = &(mesh->adj.trgs[t]);
+	walker_t w;
+	start(&w, walk, field->values, a, b);
+	w.value = weight[0] * w.values[trg->n1] +
+		weight[1] * w.values[trg->n2] + weight[2] * w.values[trg->n3];
+	TRY( walk_from(&w, NONE, t) );
+	*output = w.sum * sqrt(w.len2);
+	return SUCCESS;
+}
+
+static int integrate_batch(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	const batch_t *batch = (const batch_t*) ctx;
+	const uint32_t *map = batch->mesh->map_vtx.index;
+	const float *values = batch->field->values;
+	uint32_t begin, end, i;
+	vtsp_parallel_range(batch->n, id, n_threads, &begin, &end);
+	for (i = begin; i < end; i++) {
+		TRY( integrate_nodes(batch->walk, values, map[batch->p1[i]],
+				     map[batch->p2[i]], &(batch->output[i])) );
+	}
+	return SUCCESS;
+}
+
+static int integrate_nodes(const walk_t *walk, const float *values,
+			   uint32_t from_node, uint32_t to_node,
+			   double *output)
+{
+	const vtsp_mesh_t *mesh = walk->mesh;
+	if (walk->trg_offset[from_node] == walk->trg_offset[from_node + 1]) {
+		/* Out of every triangle, walk the other way */
+		uint32_t swap = from_node;
+		from_node = to_node;
+		to_node = swap;
+	}
+	walker_t w;
+	start(&w, walk, values, &(mesh->nodes.pts[from_node]),
+	      &(mesh->nodes.pts[to_node]));
+	w.value = w.values[from_node];
+	if (shares_trg(walk, from_node, to_node)) {
+		/* Mesh edge, the most frequent query during insertion */
+		reach(&w, 1.0, w.values[to_node]);
+		*output = w.sum * sqrt(w.len2);
+		return SUCCESS;
+	}
+	TRY( walk_from(&w, from_node, NONE) );
+	*output = w.sum * sqrt(w.len2);
+	return SUCCESS;
+}
+
+static void start(walker_t *w, const walk_t *walk, const float *values,
+		  const vtsp_point_t *p, const vtsp_point_t *q)
+{
+	w->walk = walk;
+	w->values = values;
+	w->px = p->x;
+	w->py = p->y;
+	w->dx = (double) q->x - (double) p->x;
+	w->dy = (double) q->y - (double) p->y;
+	w->len2 = w->dx * w->dx + w->dy * w->dy;
+	w->lambda = 0.0;
+	w->sum = 0.0;
+}
+
+static int walk_from(walker_t *w, uint32_t node, uint32_t t)
+{
+	/*
+	 * The field is linear inside each triangle, so every piece of the
+	 * segment integrates exactly by the trapezoid rule. The walk goes
+	 * from node to node, crossing the triangles in between, and each
+	 * node and edge is classified once by its side of the line. It
+	 * starts at node, or inside t when node is NONE, and ends at the
+	 * end of the segment, even if a duplicated point left the node
+	 * there out of every triangle.
+	 */
+	const vtsp_mesh_t *mesh = w->walk->mesh;
+	uint32_t steps = 0;
+	uint32_t max_steps = mesh->nodes.num + mesh->adj.num;
+	uint32_t next;
+	mark_t l, r;
+	if (node == NONE && w->len2 > 0.0) {
+		leave_trg(w, t, &next, &l, &r);
+		if (next != NONE) {
+			reach_node(w, next);
+			node = next;
+		} else {
+			TRY( cross_trgs(w, t, l, r, &steps, &node) );
+		}
+	}
+	while (w->lambda < 1.0 && w->len2 > 0.0) {
+		THROW( ++steps > max_steps, ERROR );
+		TRY( leave_node(w, node, &next, &t, &l, &r) );
+		if (next == NONE && t == NONE) {
+			TRY( reach_end(w) );
+			break;
+		}
+		if (next != NONE) {
+			/* Along an edge */
+			reach_node(w, next);
+			node = next;
+			continue;
+		}
+		TRY( cross_trgs(w, t, l, r, &steps, &node) );
+	}
+	return SUCCESS;
+}
+
+static uint32_t trg_node(const vtsp_trg_t *trg, uint32_t k)
+{
+	return k == 0 ? trg->n1 : (k == 1 ? trg->n2 : trg->n3);
+}
+
+static uint32_t trg_corner(const vtsp_trg_t *trg, uint32_t node)
+{
+	return trg->n1 == node ? 0 : (trg->n2 == node ? 1 : 2);
+}
+
+static bool shares_trg(const walk_t *walk, uint32_t a, uint32_t b)
+{
+	const vtsp_trg_t *trgs = walk->mesh->adj.trgs;
+	uint32_t j;
+	for (j = walk->trg_offset[a]; j < walk->trg_offset[a + 1]; j++) {
+		const vtsp_trg_t *trg = &(trgs[walk->trg_index[j]]);
+		if (trg->n1 == b || trg->n2 == b || trg->n3 == b) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static double side(const walker_t *w, uint32_t node)
+{
+	/* Positive on the left of the segment */
+	vtsp_point_t v = w->walk->mesh->nodes.pts[node];
+	return w->dx * ((double) v.y - w->py) - w->dy * ((double) v.x - w->px);
+}
+
+static double ahead(const walker_t *w, uint32_t node)
+{
+	/* Position of the projection, 0 at from_node and 1 at to_node */
+	vtsp_point_t v = w->walk->mesh->nodes.pts[node];
+	return (w->dx * ((double) v.x - w->px) +
+		w->dy * ((double) v.y - w->py)) / w->len2;
+}
+
+static void reach(walker_t *w, double lambda, double value)
+{
+	if (lambda > 1.0) {
+		/* Passed to_node, the field is linear in between */
+		value = w->value + (value - w->value) *
+			(1.0 - w->lambda) / (lambda - w->lambda);
+		lambda = 1.0;
+	}
+	w->sum += (lambda - w->lambda) * 0.5 * (w->value + value);
+	w->lambda = lambda;
+	w->value = value;
+}
+
+static void reach_node(walker_t *w, uint32_t node)
+{
+	reach(w, ahead(w, node), w->values[node]);
+}
+
+static int reach_end(walker_t *w)
+{
+	/*
+	 * The end lies on the boundary and rounding stopped the walk short
+	 * of it, the field is kept over the rest of the segment.
+	 */
+	THROW( w->lambda < 1.0 - END_EPS, ERROR ); /* Segment leaves the mesh */
+	reach(w, 1.0, w->value);
+	return SUCCESS;
+}
+
+static void mark(const walker_t *w, uint32_t node, mark_t *output)
+{
+	output->node = node;
+	output->side = side(w, node);
+	output->lambda = ahead(w, node);
+}
+
+static double edge_lambda(const mark_t *l, const mark_t *r, double *s)
+{
+	/* Edge with l on the left and r on the right of the segment */
+	*s = l->side / (l->side - r->side);
+	return l->lambda + *s * (r->lambda - l->lambda);
+}
+
+static void reach_edge(walker_t *w, const mark_t *l, const mark_t *r)
+{
+	double s;
+	double lambda = edge_lambda(l, r, &s);
+	double fl = w->values[l->node];
+	reach(w, lambda, fl + s * ((double) w->values[r->node] - fl));
+}
+
+static int leave_node(const walker_t *w, uint32_t node, uint32_t *next,
+		      uint32_t *trg, mark_t *l, mark_t *r)
+{
+	/*
+	 * The triangle whose opposite edge the segment crosses ahead,
+	 * or the next node when the segment runs along one of its edges.
+	 * Either winding works, the crossing tells forward from backward.
+	 * Both are NONE when nothing is ahead, the end is on the boundary.
+	 */
+	const walk_t *walk = w->walk;
+	uint32_t j;
+	for (j = walk->trg_offset[node]; j < walk->trg_offset[node + 1]; j++) {
+		uint32_t t = walk->trg_index[j];
+		const vtsp_trg_t *tr = &(walk->mesh->adj.trgs[t]);
+		uint32_t k = trg_corner(tr, node);
+		mark_t b, c;
+		mark(w, trg_node(tr, (k + 1) % 3), &b);
+		mark(w, trg_node(tr, (k + 2) % 3), &c);
+		if (b.side == 0.0 && b.lambda > w->lambda) {
+			*next = b.node;
+			return SUCCESS;
+		}
+		if (c.side == 0.0 && c.lambda > w->lambda) {
+			*next = c.node;
+			return SUCCESS;
+		}
+		if ((b.side < 0.0 && c.side > 0.0) ||
+		    (b.side > 0.0 && c.side < 0.0)) {
+			*l = b.side > 0.0 ? b : c;
+			*r = b.side > 0.0 ? c : b;
+			double s;
+			if (edge_lambda(l, r, &s) > w->lambda) {
+				*next = NONE;
+				*trg = t;
+				return SUCCESS;
+			}
+		}
+	}
+	*next = NONE;
+	*trg = NONE;
+	return SUCCESS;
+}
+
+static void leave_trg(const walker_t *w, uint32_t t, uint32_t *next,
+		      mark_t *l, mark_t *r)
+{
+	/*
+	 * From inside t the segment leaves at the crossing furthest
+	 * ahead, through a corner when it passes on one.
+	 */
+	const vtsp_trg_t *tr = &(w->walk->mesh->adj.trgs[t]);
+	mark_t m[3];
+	uint32_t k;
+	for (k = 0; k < 3; k++) {
+		mark(w, trg_node(tr, k), &(m[k]));
+	}
+	double best = -DBL_MAX;
+	*next = NONE;
+	for (k = 0; k < 3; k++) {
+		const mark_t *b = &(m[(k + 1) % 3]);
+		const mark_t *c = &(m[(k + 2) % 3]);
+		if (m[k].side == 0.0 && m[k].lambda > best) {
+			best = m[k].lambda;
+			*next = m[k].node;
+		}
+		if ((b->side < 0.0 && c->side > 0.0) ||
+		    (b->side > 0.0 && c->side < 0.0)) {
+			const mark_t *bl = b->side > 0.0 ? b : c;
+			const mark_t *br = b->side > 0.0 ? c : b;
+			double s;
+			double lambda = edge_lambda(bl, br, &s);
+			if (lambda > best) {
+				best = lambda;
+				*next = NONE;
+				*l = *bl;
+				*r = *br;
+			}
+		}
+	}
+}
+
+static int cross_trgs(walker_t *w, uint32_t t, mark_t l, mark_t r,
+		      uint32_t *steps, uint32_t *output)
+{
+	/*
+	 * Leave t through edge (l, r) until the segment hits a node.
+	 * Each step classifies only the node across the edge.
+	 */
+	const walk_t *walk = w->walk;
+	uint32_t max_steps = walk->mesh->nodes.num + walk->mesh->adj.num;
+	for (;;) {
+		THROW( ++(*steps) > max_steps, ERROR );
+		reach_edge(w, &l, &r);
+		if (w->lambda >= 1.0) {
+			return SUCCESS;
+		}
+		const vtsp_trg_t *tr = &(walk->mesh->adj.trgs[t]);
+		uint32_t u = walk->nbr[3 * t + 3 - trg_corner(tr, l.node) -
+				       trg_corner(tr, r.node)];
+		if (u == NONE) {
+			return reach_end(w);
+		}
+		tr = &(walk->mesh->adj.trgs[u]);
+		mark_t v;
+		mark(w, trg_node(tr, 3 - trg_corner(tr, l.node) -
+				 trg_corner(tr, r.node)), &v);
+		if (v.side == 0.0) {
+			reach(w, v.lambda, w->values[v.node]);
+			*output = v.node;
+			return SUCCESS;
+		}
+		if (v.side > 0.0) {
+			l = v;
+		} else {
+			r = v;
+		}
+		t = u;
+	}
+}
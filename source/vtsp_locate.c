@@ -0,0 +1,206 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "vtsp_locate.h"
+#include "try_macros.h"
+#include "vtsp_opmem.h"
+
+#define NONE VTSP_LOCATE_NONE
+#define WALK_EPS 1e-9
+
+static void take_buffers(vtsp_locator_t *loc, uint32_t n_nodes,
+			 vtsp_opmem_t *mem);
+static void build_grid(vtsp_locator_t *loc);
+static void fill_seeds(vtsp_locator_t *loc);
+static uint32_t cell_of(const vtsp_locator_t *loc, double x, double y);
+static int barycentric(const vtsp_mesh_t *mesh, uint32_t t,
+		       const vtsp_point_t *p, double *output);
+
+int vtsp_locator_sizeof_opmem(const vtsp_mesh_t *mesh, size_t *output)
+{
+	vtsp_locator_t loc;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, NULL);
+	take_buffers(&loc, mesh->nodes.num, &mem);
+
+	*output = vtsp_opmem_sizeof(&mem);
+	return SUCCESS;
+}
+
+int vtsp_locator_build(vtsp_locator_t *locator, const vtsp_mesh_t *mesh,
+		       void *op_mem)
+{
+	THROW( mesh->nodes.num == 0 || mesh->adj.num == 0, ERROR );
+	THROW( !vtsp_topology_ready(mesh), ERROR );
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, op_mem);
+	take_buffers(locator, mesh->nodes.num, &mem);
+	locator->mesh = mesh;
+	build_grid(locator);
+	return SUCCESS;
+}
+
+int vtsp_locate_point(const vtsp_locator_t *locator, const vtsp_point_t *p,
+		      uint32_t *trg, double *weight)
+{
+	/*
+	 * Visibility walk, always across the edge the point is furthest
+	 * beyond. It ends in the triangle of p on meshes of convex
+	 * domains, the boundary stops it when p is outside.
+	 */
+	const vtsp_mesh_t *mesh = locator->mesh;
+	uint32_t t = locator->seed[cell_of(locator, p->x, p->y)];
+	uint32_t step;
+	for (step = 0; step <= mesh->adj.num; step++) {
+		TRY( barycentric(mesh, t, p, weight) );
+		uint32_t k = 0;
+		if (weight[1] < weight[k]) {
+			k = 1;
+		}
+		if (weight[2] < weight[k]) {
+			k = 2;
+		}
+		if (weight[k] >= -WALK_EPS) {
+			*trg = t;
+			return SUCCESS;
+		}
+		t = mesh->nbr.index[3 * t + k];
+		if (t == NONE) {
+			*trg = NONE;
+			return SUCCESS;
+		}
+	}
+	return ERROR; /* The walk cycles, the mesh is tangled */
+}
+
+int vtsp_field_at(const vtsp_locator_t *locator, const vtsp_field_t *field,
+		  const vtsp_point_t *p, double *output)
+{
+	uint32_t t;
+	double weight[3];
+	TRY( vtsp_locate_point(locator, p, &t, weight) );
+	THROW( t == NONE, MALFORMED_INPUT );
+	const vtsp_trg_t *trg = &(locator->mesh->adj.trgs[t]);
+	*output = weight[0] * field->values[trg->n1] +
+		weight[1] * field->values[trg->n2] +
+		weight[2] * field->values[trg->n3];
+	return SUCCESS;
+}
+
+static void take_buffers(vtsp_locator_t *loc, uint32_t n_nodes,
+			 vtsp_opmem_t *mem)
+{
+	/* As many cells as nodes at most, whatever the aspect ratio */
+	uint32_t n_cells = n_nodes > 0 ? n_nodes : 1;
+	loc->seed = vtsp_opmem_take(mem, n_cells * sizeof(*(loc->seed)));
+}
+
+static void build_grid(vtsp_locator_t *loc)
+{
+	/* Cells follow the aspect of the bounding box, nx * ny <= nodes */
+	const vtsp_mesh_t *mesh = loc->mesh;
+	const vtsp_point_t *pts = mesh->nodes.pts;
+	uint32_t n = mesh->nodes.num;
+	double x0 = pts[0].x, x1 = x0;
+	double y0 = pts[0].y, y1 = y0;
+	uint32_t i;
+	for (i = 1; i < n; i++) {
+		x0 = pts[i].x < x0 ? pts[i].x : x0;
+		x1 = pts[i].x > x1 ? pts[i].x : x1;
+		y0 = pts[i].y < y0 ? pts[i].y : y0;
+		y1 = pts[i].y > y1 ? pts[i].y : y1;
+	}
+	double w = x1 - x0;
+	double h = y1 - y0;
+	uint32_t nx = 1;
+	if (w > 0.0 && h > 0.0) {
+		double fx = sqrt((double) n * w / h);
+		nx = fx < 1.0 ? 1 : (fx > (double) n ? n : (uint32_t) fx);
+	} else if (w > 0.0) {
+		nx = n;
+	}
+	loc->nx = nx;
+	loc->ny = n / nx;
+	loc->x0 = x0;
+	loc->y0 = y0;
+	loc->inv_cw = w > 0.0 ? loc->nx / w : 0.0;
+	loc->inv_ch = h > 0.0 ? loc->ny / h : 0.0;
+	fill_seeds(loc);
+}
+
+static void fill_seeds(vtsp_locator_t *loc)
+{
+	/*
+	 * Each triangle seeds the cell of its centroid, empty cells take
+	 * the nearest seed of their row, empty rows the nearest row.
+	 */
+	const vtsp_mesh_t *mesh = loc->mesh;
+	const vtsp_point_t *pts = mesh->nodes.pts;
+	uint32_t nx = loc->nx, ny = loc->ny;
+	uint32_t i, x, y;
+	for (i = 0; i < nx * ny; i++) {
+		loc->seed[i] = NONE;
+	}
+	for (i = 0; i < mesh->adj.num; i++) {
+		const vtsp_trg_t *trg = &(mesh->adj.trgs[i]);
+		double cx = ((double) pts[trg->n1].x + pts[trg->n2].x +
+			     pts[trg->n3].x) / 3.0;
+		double cy = ((double) pts[trg->n1].y + pts[trg->n2].y +
+			     pts[trg->n3].y) / 3.0;
+		loc->seed[cell_of(loc, cx, cy)] = i;
+	}
+	for (y = 0; y < ny; y++) {
+		uint32_t *row = &(loc->seed[y * nx]);
+		for (x = 1; x < nx; x++) {
+			if (row[x] == NONE) {
+				row[x] = row[x - 1];
+			}
+		}
+		for (x = nx - 1; x > 0; x--) {
+			if (row[x - 1] == NONE) {
+				row[x - 1] = row[x];
+			}
+		}
+	}
+	for (y = 1; y < ny; y++) {
+		if (loc->seed[y * nx] == NONE) {
+			for (x = 0; x < nx; x++) {
+				loc->seed[y * nx + x] = loc->seed[(y - 1) * nx + x];
+			}
+		}
+	}
+	for (y = ny - 1; y > 0; y--) {
+		if (loc->seed[(y - 1) * nx] == NONE) {
+			for (x = 0; x < nx; x++) {
+				loc->seed[(y - 1) * nx + x] = loc->seed[y * nx + x];
+			}
+		}
+	}
+}
+
+static uint32_t cell_of(const vtsp_locator_t *loc, double x, double y)
+{
+	/* Points off the grid take the nearest cell */
+	double fx = (x - loc->x0) * loc->inv_cw;
+	double fy = (y - loc->y0) * loc->inv_ch;
+	uint32_t ix = fx > 0.0 ? (fx < loc->nx ? (uint32_t) fx : loc->nx - 1) : 0;
+	uint32_t iy = fy > 0.0 ? (fy < loc->ny ? (uint32_t) fy : loc->ny - 1) : 0;
+	return iy * loc->nx + ix;
+}
+
+static int barycentric(const vtsp_mesh_t *mesh, uint32_t t,
+		       const vtsp_point_t *p, double *output)
+{
+	const vtsp_point_t *pts = mesh->nodes.pts;
+	const vtsp_trg_t *trg = &(mesh->adj.trgs[t]);
+	double x0 = pts[trg->n1].x, y0 = pts[trg->n1].y;
+	double x1 = pts[trg->n2].x - x0, y1 = pts[trg->n2].y - y0;
+	double x2 = pts[trg->n3].x - x0, y2 = pts[trg->n3].y - y0;
+	double px = p->x - x0, py = p->y - y0;
+	double det = x1 * y2 - x2 * y1;
+	THROW( det == 0.0, ERROR );
+	output[1] = (px * y2 - x2 * py) / det;
+	output[2] = (x1 * py - px * y1) / det;
+	output[0] = 1.0 - output[1] - output[2];
+	return SUCCESS;
+}
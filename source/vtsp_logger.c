@@ -0,0 +1,234 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vtsp_logger.h"
+#include "try_macros.h"
+
+#define DEFAULT_CAPACITY (1 << 20)
+#define ARRAY_CHUNK 4096       /* Bytes formatted per push in log_array */
+#define ARRAY_PER_LINE 16
+
+struct vtsp_logger_sync {
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;   /* Also signals the end of a record */
+	pthread_t drainer;
+};
+
+static void *drain(void *ctx);
+static int write_all(int fd, const char *data, uint32_t size);
+static void begin_record(vtsp_logger_t *logger);
+static int end_record(vtsp_logger_t *logger);
+static void push(vtsp_logger_t *logger, const char *data, uint32_t size);
+
+int vtsp_logger_init(vtsp_logger_t *logger, int fd, uint32_t capacity)
+{
+	logger->fd = fd;
+	logger->capacity = capacity > 0 ? capacity : DEFAULT_CAPACITY;
+	logger->head = 0;
+	logger->tail = 0;
+	logger->stop = false;
+	logger->busy = false;
+	logger->status = SUCCESS;
+	TRY_PTR( malloc(logger->capacity), logger->ring, ERROR_MALLOC );
+	TRY_PTR( malloc(sizeof(*(logger->sync))), logger->sync, ERROR_SYNC );
+
+	vtsp_logger_sync_t *sync = logger->sync;
+	TRY_GOTO( pthread_mutex_init(&(sync->lock), NULL), ERROR_LOCK );
+	TRY_GOTO( pthread_cond_init(&(sync->not_empty), NULL), ERROR_EMPTY );
+	TRY_GOTO( pthread_cond_init(&(sync->not_full), NULL), ERROR_FULL );
+	TRY_GOTO( pthread_create(&(sync->drainer), NULL, drain, logger),
+		  ERROR_THREAD );
+	return SUCCESS;
+ERROR_THREAD:
+	pthread_cond_destroy(&(sync->not_full));
+ERROR_FULL:
+	pthread_cond_destroy(&(sync->not_empty));
+ERROR_EMPTY:
+	pthread_mutex_destroy(&(sync->lock));
+ERROR_LOCK:
+	free(logger->sync);
+ERROR_SYNC:
+	free(logger->ring);
+ERROR_MALLOC:
+	return ERROR;
+}
+
+int vtsp_logger_finish(vtsp_logger_t *logger)
+{
+	vtsp_logger_sync_t *sync = logger->sync;
+	pthread_mutex_lock(&(sync->lock));
+	logger->stop = true;
+	pthread_cond_signal(&(sync->not_empty));
+	pthread_mutex_unlock(&(sync->lock));
+	pthread_join(sync->drainer, NULL);
+
+	pthread_cond_destroy(&(sync->not_full));
+	pthread_cond_destroy(&(sync->not_empty));
+	pthread_mutex_destroy(&(sync->lock));
+	free(logger->sync);
+	free(logger->ring);
+	return logger->status;
+}
+
+int vtsp_bind_logger(vtsp_binding_logger_t *binding, vtsp_logger_t *logger,
+		     int level)
+{
+	binding->ctx = logger;
+	binding->level = level;
+	binding->log = vtsp_logger_log;
+	binding->log_array = vtsp_logger_log_array;
+	return SUCCESS;
+}
+
+int vtsp_logger_log(void *ctx, const char *msg)
+{
+	/* The line and its newline go in under one lock */
+	vtsp_logger_t *logger = ctx;
+	pthread_mutex_lock(&(logger->sync->lock));
+	begin_record(logger);
+	push(logger, msg, strlen(msg));
+	push(logger, "\n", 1);
+	int status = end_record(logger);
+	pthread_mutex_unlock(&(logger->sync->lock));
+	return status;
+}
+
+int vtsp_logger_log_array(void *ctx, const char *prefix,
+			  const uint32_t *array, uint32_t num)
+{
+	/*
+	 * Format locally and push in large chunks, one lock per chunk.
+	 * The record stays busy between chunks, no other line gets in.
+	 */
+	vtsp_logger_t *logger = ctx;
+	pthread_mutex_t *lock = &(logger->sync->lock);
+	char chunk[ARRAY_CHUNK];
+	int len = snprintf(chunk, ARRAY_CHUNK, "%s (%u):\n", prefix, num);
+	THROW( len < 0, ERROR );
+	len = len < ARRAY_CHUNK ? len : ARRAY_CHUNK - 1;
+
+	pthread_mutex_lock(lock);
+	begin_record(logger);
+	pthread_mutex_unlock(lock);
+	uint32_t i;
+	for (i = 0; i < num; i++) {
+		if (len > ARRAY_CHUNK - 16) {
+			pthread_mutex_lock(lock);
+			push(logger, chunk, len);
+			pthread_mutex_unlock(lock);
+			len = 0;
+		}
+		bool last = (i % ARRAY_PER_LINE == ARRAY_PER_LINE - 1) ||
+			(i == num - 1);
+		len += sprintf(chunk + len, " %u%s", array[i], last ? "\n" : "");
+	}
+	pthread_mutex_lock(lock);
+	push(logger, chunk, len);
+	int status = end_record(logger);
+	pthread_mutex_unlock(lock);
+	return status;
+}
+
+static void begin_record(vtsp_logger_t *logger)
+{
+	/* Lock held, waits for the record of another caller to end */
+	vtsp_logger_sync_t *sync = logger->sync;
+	while (logger->busy) {
+		pthread_cond_wait(&(sync->not_full), &(sync->lock));
+	}
+	logger->busy = true;
+}
+
+static int end_record(vtsp_logger_t *logger)
+{
+	logger->busy = false;
+	pthread_cond_broadcast(&(logger->sync->not_full));
+	return logger->status;
+}
+
+static void push(vtsp_logger_t *logger, const char *data, uint32_t size)
+{
+	/* Lock held inside a record, waits on room when the ring is full */
+	vtsp_logger_sync_t *sync = logger->sync;
+	while (size > 0) {
+		uint64_t used = logger->head - logger->tail;
+		while (used == logger->capacity && logger->status == SUCCESS) {
+			pthread_cond_wait(&(sync->not_full), &(sync->lock));
+			used = logger->head - logger->tail;
+		}
+		if (logger->status != SUCCESS) {
+			break; /* The drainer failed, messages would pile up */
+		}
+
+		/* Copy up to the free space or the end of the ring */
+		uint32_t begin = logger->head % logger->capacity;
+		uint32_t len = logger->capacity - used;
+		if (len > logger->capacity - begin) {
+			len = logger->capacity - begin;
+		}
+		if (len > size) {
+			len = size;
+		}
+		memcpy(logger->ring + begin, data, len);
+		logger->head += len;
+		data += len;
+		size -= len;
+		pthread_cond_signal(&(sync->not_empty));
+	}
+}
+
+static void *drain(void *ctx)
+{
+	vtsp_logger_t *logger = ctx;
+	vtsp_logger_sync_t *sync = logger->sync;
+	pthread_mutex_lock(&(sync->lock));
+	while (1) {
+		while (logger->head == logger->tail && !logger->stop) {
+			pthread_cond_wait(&(sync->not_empty), &(sync->lock));
+		}
+		if (logger->head == logger->tail) {
+			break; /* Stopped and drained */
+		}
+
+		/* Write the contiguous part without holding the lock */
+		uint32_t begin = logger->tail % logger->capacity;
+		uint64_t used = logger->head - logger->tail;
+		uint32_t len = logger->capacity - begin;
+		if (len > used) {
+			len = used;
+		}
+		pthread_mutex_unlock(&(sync->lock));
+		int status = write_all(logger->fd, logger->ring + begin, len);
+		pthread_mutex_lock(&(sync->lock));
+
+		logger->tail += len;
+		if (status != SUCCESS) {
+			logger->status = status;
+			logger->tail = logger->head;
+		}
+		pthread_cond_broadcast(&(sync->not_full));
+	}
+	pthread_mutex_unlock(&(sync->lock));
+	return NULL;
+}
+
+static int write_all(int fd, const char *data, uint32_t size)
+{
+	while (size > 0) {
+		ssize_t n = write(fd, data, size);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		THROW( n <= 0, ERROR );
+		data += n;
+		size -= n;
+	}
+	return SUCCESS;
+}
@@ -0,0 +1,700 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vtsp_multigrid.h"
+#include "try_macros.h"
+#include "vtsp_envelope.h"
+#include "vtsp_parallel.h"
+#include "vtsp_topology.h"
+
+#define NONE UINT32_MAX
+#define MIN_NODES_PER_THREAD 16384
+#define MAX_DIRECT 512         /* Coarsest level solved by dense Cholesky */
+#define COARSEN_DIV 3          /* A coarse level keeps at most a third */
+#define STEINER_DIV 2          /* Room for the mesher to add half as many */
+#define SMOOTH_SWEEPS 2        /* Before and after the coarse correction */
+#define COARSEST_SWEEPS 30     /* If coarsening stalled above MAX_DIRECT */
+#define OMEGA 0.6              /* Jacobi damping */
+#define WALK_EPS 1e-9
+
+enum {
+	STATE_FREE = 0,
+	STATE_COARSE,
+	STATE_FINE
+};
+
+typedef struct {
+	vtsp_multigrid_t *mg;
+	vtsp_mg_level_t *lvl;
+	vtsp_mg_level_t *next;
+	const double *x_in;
+	double *x_out;
+} mg_task_t;
+
+static void take_mesh(vtsp_mesh_t *mesh, uint32_t n_points, uint32_t n_nodes,
+		      uint32_t n_trgs, vtsp_opmem_t *mem);
+static uint32_t select_coarse(vtsp_multigrid_t *mg, const vtsp_stiffness_t *a,
+			      uint32_t *n_free);
+static void take_coarse(const vtsp_stiffness_t *a, uint8_t *state, uint32_t i);
+static int is_boundary(const vtsp_stiffness_t *a, uint32_t i);
+static int has_free_neighbor(const vtsp_stiffness_t *a, uint32_t i);
+static uint32_t count_free(const vtsp_stiffness_t *a);
+static int has_free_neighbor(const vtsp_stiffness_t *a, uint32_t i)
+{
+	const vtsp_graph_t *graph = &(a->graph);
+	uint32_t e;
+	for (e = graph->offset[i]; e < graph->offset[i + 1]; e++) {
+		if (!a->fixed[graph->index[e]]) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static uint32_t count_free(const vtsp_stiffness_t *a)
+{
+	uint32_t n_free = 0;
+	uint32_t i;
+	for (i = 0; i < a->n; i++) {
+		n_free += !a->fixed[i];
+	}
+	return n_free;
+}
+
+static int mesh_level(vtsp_multigrid_t *mg, const vtsp_stiffness_t *fine,
+		      vtsp_mg_level_t *lvl, uint32_t n_points,
+		      const vtsp_binding_mesher_t *mesher);
+static int assemble(void *ctx, uint32_t id, uint32_t n_threads);
+static int interpolation(void *ctx, uint32_t id, uint32_t n_threads);
+static int locate(const vtsp_stiffness_t *coarse, uint32_t start,
+		  const vtsp_point_t *p, uint32_t *index, float *weight);
+static uint32_t other_trg(const vtsp_stiffness_t *a, uint32_t t,
+			  uint32_t u, uint32_t v);
+static void transpose(vtsp_mg_level_t *fine, uint32_t n_coarse);
+static int factor_dense(vtsp_multigrid_t *mg, const vtsp_stiffness_t *a);
+static void solve_dense(const vtsp_multigrid_t *mg, vtsp_mg_level_t *lvl);
+static int cycle(vtsp_multigrid_t *mg, uint32_t l);
+static int smooth(vtsp_multigrid_t *mg, vtsp_mg_level_t *lvl, double **x,
+		  double **t, uint32_t n_sweeps, int from_zero);
+static int smooth_rows(void *ctx, uint32_t id, uint32_t n_threads);
+static int residual_rows(void *ctx, uint32_t id, uint32_t n_threads);
+static int restrict_rows(void *ctx, uint32_t id, uint32_t n_threads);
+static int prolong_rows(void *ctx, uint32_t id, uint32_t n_threads);
+
+int vtsp_mg_take(vtsp_multigrid_t *mg, uint32_t n_nodes,
+		 const vtsp_binding_mesher_t *mesher, vtsp_opmem_t *mem)
+{
+	/* Every level is sized for the bounds of the previous one */
+	size_t op_size = 0;
+	uint32_t max_points = 0;
+	vtsp_mg_level_t *fine = &(mg->level[0]);
+	fine->t = vtsp_opmem_take(mem, n_nodes * sizeof(*(fine->t)));
+	uint32_t n_fine = n_nodes;
+	mg->max_levels = 1;
+	while (n_fine > MAX_DIRECT && mg->max_levels < VTSP_MG_MAX_LEVELS) {
+		uint32_t n_points = n_fine / COARSEN_DIV;
+		uint32_t n_coarse = n_points + n_points / STEINER_DIV;
+		uint32_t n_ctrgs = 2 * n_coarse;
+		vtsp_mg_level_t *lvl = &(mg->level[mg->max_levels]);
+		take_mesh(&(lvl->mesh), n_points, n_coarse, n_ctrgs, mem);
+		vtsp_stiffness_take(&(lvl->own), n_coarse, n_ctrgs, false, mem);
+		lvl->x = vtsp_opmem_take(mem, n_coarse * sizeof(*(lvl->x)));
+		lvl->b = vtsp_opmem_take(mem, n_coarse * sizeof(*(lvl->b)));
+		lvl->t = vtsp_opmem_take(mem, n_coarse * sizeof(*(lvl->t)));
+
+		size_t n_entries = 3 * (size_t) n_fine;
+		fine->p_index = vtsp_opmem_take(mem, n_entries *
+						sizeof(*(fine->p_index)));
+		fine->p_weight = vtsp_opmem_take(mem, n_entries *
+						 sizeof(*(fine->p_weight)));
+		fine->r_offset = vtsp_opmem_take(mem, (n_coarse + 1) *
+						 sizeof(*(fine->r_offset)));
+		fine->r_index = vtsp_opmem_take(mem, n_entries *
+						sizeof(*(fine->r_index)));
+		fine->r_weight = vtsp_opmem_take(mem, n_entries *
+						 sizeof(*(fine->r_weight)));
+
+		/* Envelope and mesher of this level share one scratch */
+		vtsp_points_t points = {n_points, n_points, NULL};
+		vtsp_perm_t envelope = {n_points, n_points, NULL};
+		size_t size = 0;
+		TRY( vtsp_get_convex_envelope_sizeof_opmem(NULL, &points, &size) );
+		op_size = size > op_size ? size : op_size;
+		if (mesher->get_mesh_sizeof_opmem != NULL) {
+			TRY( mesher->get_mesh_sizeof_opmem(mesher->ctx, &points,
+							   &envelope,
+							   &(lvl->mesh), &size) );
+			op_size = size > op_size ? size : op_size;
+		}
+		max_points = n_points > max_points ? n_points : max_points;
+
+		fine = lvl;
+		n_fine = n_coarse;
+		mg->max_levels ++;
+	}
+
+	/* Coarsening may stop early on any level at most MAX_DIRECT free */
+	uint32_t n_dense = n_nodes < MAX_DIRECT ? n_nodes : MAX_DIRECT;
+	mg->dense = vtsp_opmem_take(mem, (size_t) n_dense * n_dense *
+				    sizeof(*(mg->dense)));
+	mg->dense_node = vtsp_opmem_take(mem, n_dense *
+					 sizeof(*(mg->dense_node)));
+	mg->state = vtsp_opmem_take(mem, n_nodes * sizeof(*(mg->state)));
+	mg->coarse_of = vtsp_opmem_take(mem, n_nodes * sizeof(*(mg->coarse_of)));
+	mg->points.num = 0;
+	mg->points.n_alloc = max_points;
+	mg->points.pts = vtsp_opmem_take(mem, max_points *
+					 sizeof(*(mg->points.pts)));
+	mg->envelope.num = 0;
+	mg->envelope.n_alloc = max_points;
+	mg->envelope.index = vtsp_opmem_take(mem, max_points *
+					     sizeof(*(mg->envelope.index)));
+	mg->op_mem = vtsp_opmem_take(mem, op_size);
+	return SUCCESS;
+}
+
+int vtsp_mg_build(vtsp_multigrid_t *mg, vtsp_stiffness_t *a,
+		  const vtsp_binding_mesher_t *mesher, uint32_t n_threads)
+{
+	mg->level[0].a = a;
+	mg->level[0].n_threads = vtsp_parallel_threads(n_threads, a->n,
+						       MIN_NODES_PER_THREAD);
+	mg->n_levels = 1;
+	uint32_t n_free = count_free(a);
+	while (mg->n_levels < mg->max_levels) {
+		vtsp_mg_level_t *fine = &(mg->level[mg->n_levels - 1]);
+		vtsp_mg_level_t *lvl = &(mg->level[mg->n_levels]);
+		if (n_free <= MAX_DIRECT) {
+			break;
+		}
+		/* Kept fixed nodes count against the room, not the rate */
+		uint32_t n_kept_free;
+		uint32_t n_points = select_coarse(mg, fine->a, &n_kept_free);
+		if (n_points < 3 || n_points > lvl->mesh.map_vtx.n_alloc ||
+		    COARSEN_DIV * n_kept_free > n_free) {
+			break; /* Coarsening stalls */
+		}
+		TRY( mesh_level(mg, fine->a, lvl, n_points, mesher) );
+
+		lvl->a = &(lvl->own);
+		lvl->n_threads = vtsp_parallel_threads(n_threads,
+						       lvl->mesh.nodes.num,
+						       MIN_NODES_PER_THREAD);
+		mg_task_t task = {mg, lvl, NULL, NULL, NULL};
+		TRY( vtsp_parallel_run(lvl->n_threads, &assemble, &task) );
+		task.lvl = fine;
+		task.next = lvl;
+		TRY( vtsp_parallel_run(fine->n_threads, &interpolation, &task) );
+		transpose(fine, lvl->a->n);
+		n_free = count_free(lvl->a);
+		mg->n_levels ++;
+	}
+
+	const vtsp_stiffness_t *coarsest = mg->level[mg->n_levels - 1].a;
+	mg->direct = 0;
+	if (n_free <= MAX_DIRECT) {
+		TRY( factor_dense(mg, coarsest) );
+	}
+	return SUCCESS;
+}
+
+int vtsp_mg_vcycle(vtsp_multigrid_t *mg, const double *b, double *x)
+{
+	/* Level 0 only reads b */
+	mg->level[0].b = (double*) b;
+	mg->level[0].x = x;
+	return cycle(mg, 0);
+}
+
+static void take_mesh(vtsp_mesh_t *mesh, uint32_t n_points, uint32_t n_nodes,
+		      uint32_t n_trgs, vtsp_opmem_t *mem)
+{
+	mesh->nodes.num = 0;
+	mesh->nodes.n_alloc = n_nodes;
+	mesh->nodes.pts = vtsp_opmem_take(mem, n_nodes *
+					  sizeof(*(mesh->nodes.pts)));
+	mesh->adj.num = 0;
+	mesh->adj.n_alloc = n_trgs;
+	mesh->adj.trgs = vtsp_opmem_take(mem, n_trgs * sizeof(*(mesh->adj.trgs)));
+	mesh->map_vtx.num = 0;
+	mesh->map_vtx.n_alloc = n_points;
+	mesh->map_vtx.index = vtsp_opmem_take(mem, n_points *
+					      sizeof(*(mesh->map_vtx.index)));
+	vtsp_topology_clear(mesh);
+	mesh->locator = NULL;
+}
+
+static uint32_t select_coarse(vtsp_multigrid_t *mg, const vtsp_stiffness_t *a,
+			      uint32_t *n_free)
+{
+	/*
+	 * Every fixed node next to a free one is kept, so coarse levels
+	 * hold the same constraints, fixed nodes with only fixed neighbors
+	 * constrain nothing and are dropped. The free nodes keep a maximal
+	 * independent set of their own, boundary nodes pick first.
+	 */
+	uint8_t *state = mg->state;
+	uint32_t i;
+	for (i = 0; i < a->n; i++) {
+		state[i] = STATE_FREE;
+	}
+	for (i = 0; i < a->n; i++) {
+		if (a->fixed[i] && has_free_neighbor(a, i)) {
+			state[i] = STATE_COARSE;
+		}
+	}
+	for (i = 0; i < a->n; i++) {
+		if (state[i] == STATE_FREE && !a->fixed[i] && is_boundary(a, i)) {
+			take_coarse(a, state, i);
+		}
+	}
+	for (i = 0; i < a->n; i++) {
+		if (state[i] == STATE_FREE && !a->fixed[i]) {
+			take_coarse(a, state, i);
+		}
+	}
+
+	uint32_t n_points = 0;
+	*n_free = 0;
+	for (i = 0; i < a->n; i++) {
+		if (state[i] != STATE_COARSE) {
+			mg->coarse_of[i] = NONE;
+			continue;
+		}
+		if (n_points < mg->points.n_alloc) {
+			mg->points.pts[n_points] = a->mesh->nodes.pts[i];
+		}
+		mg->coarse_of[i] = n_points++;
+		*n_free += !a->fixed[i];
+	}
+	return n_points;
+}
+
+static void take_coarse(const vtsp_stiffness_t *a, uint8_t *state, uint32_t i)
+{
+	const vtsp_graph_t *graph = &(a->graph);
+	state[i] = STATE_COARSE;
+	uint32_t e;
+	for (e = graph->offset[i]; e < graph->offset[i + 1]; e++) {
+		if (state[graph->index[e]] == STATE_FREE) {
+			state[graph->index[e]] = STATE_FINE;
+		}
+	}
+}
+
+static int is_boundary(const vtsp_stiffness_t *a, uint32_t i)
+{
+	/* An edge with a single triangle */
+	const vtsp_graph_t *graph = &(a->graph);
+	uint32_t e;
+	for (e = graph->offset[i]; e < graph->offset[i + 1]; e++) {
+		uint32_t j = graph->index[e];
+		uint32_t count = 0;
+		uint32_t k;
+		for (k = a->trg_offset[i]; k < a->trg_offset[i + 1]; k++) {
+			const vtsp_trg_t *trg = &(a->mesh->adj.trgs[a->trg_index[k]]);
+			if (trg->n1 == j || trg->n2 == j || trg->n3 == j) {
+				count ++;
+			}
+		}
+		if (count == 1) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int mesh_level(vtsp_multigrid_t *mg, const vtsp_stiffness_t *fine,
+		      vtsp_mg_level_t *lvl, uint32_t n_points,
+		      const vtsp_binding_mesher_t *mesher)
+{
+	THROW( n_points > lvl->mesh.map_vtx.n_alloc, ERROR );
+	mg->points.num = n_points;
+	TRY( vtsp_get_convex_envelope(NULL, &(mg->points), &(mg->envelope),
+				      mg->op_mem) );
+	lvl->mesh.nodes.num = 0;
+	lvl->mesh.adj.num = 0;
+	lvl->mesh.map_vtx.num = 0;
+	TRY( mesher->get_mesh(mesher->ctx, &(mg->points), &(mg->envelope),
+			      &(lvl->mesh), mg->op_mem) );
+	THROW( lvl->mesh.map_vtx.num != n_points, ERROR );
+
+	/* Kept nodes stay fixed if they were, Steiner nodes are free */
+	vtsp_stiffness_t *a = &(lvl->own);
+	TRY( vtsp_stiffness_pattern(a, &(lvl->mesh)) );
+	uint32_t i;
+	for (i = 0; i < a->n; i++) {
+		a->fixed[i] = 0;
+	}
+	for (i = 0; i < fine->n; i++) {
+		uint32_t k = mg->coarse_of[i];
+		if (k != NONE) {
+			THROW( lvl->mesh.map_vtx.index[k] >= a->n, ERROR );
+			a->fixed[lvl->mesh.map_vtx.index[k]] = fine->fixed[i];
+		}
+	}
+	return SUCCESS;
+}
+
+static int assemble(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	mg_task_t *task = (mg_task_t*) ctx;
+	uint32_t begin, end;
+	vtsp_parallel_range(task->lvl->a->n, id, n_threads, &begin, &end);
+	return vtsp_stiffness_assemble(task->lvl->a, begin, end);
+}
+
+static int interpolation(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	/* Rows of the fine level, fixed nodes take no correction */
+	mg_task_t *task = (mg_task_t*) ctx;
+	const vtsp_stiffness_t *fine = task->lvl->a;
+	const vtsp_stiffness_t *coarse = task->next->a;
+	const uint32_t *map = task->next->mesh.map_vtx.index;
+	const uint32_t *coarse_of = task->mg->coarse_of;
+	uint32_t begin, end;
+	vtsp_parallel_range(fine->n, id, n_threads, &begin, &end);
+
+	uint32_t i;
+	for (i = begin; i < end; i++) {
+		uint32_t *index = &(task->lvl->p_index[3 * i]);
+		float *weight = &(task->lvl->p_weight[3 * i]);
+		uint32_t c = coarse_of[i] != NONE ? map[coarse_of[i]] : NONE;
+		index[0] = index[1] = index[2] = c != NONE ? c : 0;
+		weight[0] = weight[1] = weight[2] = 0.0f;
+		if (fine->fixed[i]) {
+			continue;
+		}
+		if (c != NONE) {
+			weight[0] = 1.0f;
+			continue;
+		}
+
+		/* Walk from a triangle of a kept neighbor */
+		uint32_t e;
+		for (e = fine->graph.offset[i]; e < fine->graph.offset[i + 1]; e++) {
+			uint32_t k = coarse_of[fine->graph.index[e]];
+			if (k != NONE) {
+				c = map[k];
+				break;
+			}
+		}
+		THROW( c == NONE || coarse->trg_offset[c] ==
+		       coarse->trg_offset[c + 1], ERROR );
+		TRY( locate(coarse, coarse->trg_index[coarse->trg_offset[c]],
+			    &(fine->mesh->nodes.pts[i]), index, weight) );
+	}
+	return SUCCESS;
+}
+
+static int locate(const vtsp_stiffness_t *coarse, uint32_t start,
+		  const vtsp_point_t *p, uint32_t *index, float *weight)
+{
+	/* Visibility walk, points off the mesh take the clamped weights */
+	const vtsp_point_t *pts = coarse->mesh->nodes.pts;
+	uint32_t t = start;
+	double l[3];
+	uint32_t v[3];
+	uint32_t step;
+	for (step = 0; step <= coarse->n; step++) {
+		const vtsp_trg_t *trg = &(coarse->mesh->adj.trgs[t]);
+		v[0] = trg->n1;
+		v[1] = trg->n2;
+		v[2] = trg->n3;
+		double x0 = pts[v[0]].x, y0 = pts[v[0]].y;
+		double x1 = pts[v[1]].x - x0, y1 = pts[v[1]].y - y0;
+		double x2 = pts[v[2]].x - x0, y2 = pts[v[2]].y - y0;
+		double px = p->x - x0, py = p->y - y0;
+		double det = x1 * y2 - x2 * y1;
+		THROW( det == 0.0, ERROR );
+		l[1] = (px * y2 - x2 * py) / det;
+		l[2] = (x1 * py - px * y1) / det;
+		l[0] = 1.0 - l[1] - l[2];
+
+		uint32_t k = 0;
+		if (l[1] < l[k]) {
+			k = 1;
+		}
+		if (l[2] < l[k]) {
+			k = 2;
+		}
+		if (l[k] >= -WALK_EPS) {
+			break;
+		}
+		uint32_t next = other_trg(coarse, t, v[(k + 1) % 3],
+					  v[(k + 2) % 3]);
+		if (next == NONE) {
+			break;
+		}
+		t = next;
+	}
+
+	double sum = 0.0;
+	uint32_t k;
+	for (k = 0; k < 3; k++) {
+		l[k] = l[k] > 0.0 ? l[k] : 0.0;
+		sum += l[k];
+	}
+	THROW( !(sum > 0.0), ERROR );
+	for (k = 0; k < 3; k++) {
+		index[k] = v[k];
+		weight[k] = (float) (l[k] / sum);
+	}
+	return SUCCESS;
+}
+
+static uint32_t other_trg(const vtsp_stiffness_t *a, uint32_t t,
+			  uint32_t u, uint32_t v)
+{
+	uint32_t k;
+	for (k = a->trg_offset[u]; k < a->trg_offset[u + 1]; k++) {
+		uint32_t s = a->trg_index[k];
+		const vtsp_trg_t *trg = &(a->mesh->adj.trgs[s]);
+		if (s != t && (trg->n1 == v || trg->n2 == v || trg->n3 == v)) {
+			return s;
+		}
+	}
+	return NONE;
+}
+
+static void transpose(vtsp_mg_level_t *fine, uint32_t n_coarse)
+{
+	/* Restriction gathers by coarse rows, so threads never collide */
+	uint32_t n_entries = 3 * fine->a->n;
+	uint32_t *offset = fine->r_offset;
+	uint32_t i;
+	for (i = 0; i <= n_coarse; i++) {
+		offset[i] = 0;
+	}
+	for (i = 0; i < n_entries; i++) {
+		if (fine->p_weight[i] != 0.0f) {
+			offset[fine->p_index[i] + 1] ++;
+		}
+	}
+	for (i = 0; i < n_coarse; i++) {
+		offset[i + 1] += offset[i];
+	}
+	for (i = 0; i < n_entries; i++) {
+		if (fine->p_weight[i] != 0.0f) {
+			uint32_t c = fine->p_index[i];
+			fine->r_index[offset[c]] = i / 3;
+			fine->r_weight[offset[c]] = fine->p_weight[i];
+			offset[c] ++;
+		}
+	}
+	for (i = n_coarse; i > 0; i--) {
+		offset[i] = offset[i - 1];
+	}
+	offset[0] = 0;
+}
+
+static int factor_dense(vtsp_multigrid_t *mg, const vtsp_stiffness_t *a)
+{
+	/* Free rows only, coarse_of numbers them once the levels are built */
+	uint32_t *dense_of = mg->coarse_of;
+	uint32_t n = 0;
+	uint32_t i, j, k;
+	for (i = 0; i < a->n; i++) {
+		dense_of[i] = a->fixed[i] ? NONE : n;
+		if (!a->fixed[i]) {
+			THROW( n == MAX_DIRECT, ERROR );
+			mg->dense_node[n++] = i;
+		}
+	}
+	double *m = mg->dense;
+	for (i = 0; i < n * n; i++) {
+		m[i] = 0.0;
+	}
+	for (i = 0; i < n; i++) {
+		uint32_t row = mg->dense_node[i];
+		m[i * n + i] = a->diag[row];
+		uint32_t e;
+		for (e = a->graph.offset[row]; e < a->graph.offset[row + 1]; e++) {
+			uint32_t col = dense_of[a->graph.index[e]];
+			if (col != NONE) {
+				m[i * n + col] = a->val[e];
+			}
+		}
+	}
+	/* Lower Cholesky factor, in place */
+	for (j = 0; j < n; j++) {
+		double d = m[j * n + j];
+		for (k = 0; k < j; k++) {
+			d -= m[j * n + k] * m[j * n + k];
+		}
+		THROW( !(d > 0.0), ERROR );
+		d = sqrt(d);
+		m[j * n + j] = d;
+		for (i = j + 1; i < n; i++) {
+			double s = m[i * n + j];
+			for (k = 0; k < j; k++) {
+				s -= m[i * n + k] * m[j * n + k];
+			}
+			m[i * n + j] = s / d;
+		}
+	}
+	mg->n_dense = n;
+	mg->direct = 1;
+	return SUCCESS;
+}
+
+static void solve_dense(const vtsp_multigrid_t *mg, vtsp_mg_level_t *lvl)
+{
+	/* Solved in t over the free rows, fixed nodes take no correction */
+	uint32_t n = mg->n_dense;
+	const double *m = mg->dense;
+	const uint32_t *node = mg->dense_node;
+	double *y = lvl->t;
+	uint32_t i, k;
+	for (i = 0; i < n; i++) {
+		double s = lvl->b[node[i]];
+		for (k = 0; k < i; k++) {
+			s -= m[i * n + k] * y[k];
+		}
+		y[i] = s / m[i * n + i];
+	}
+	for (i = n; i > 0; i--) {
+		double s = y[i - 1];
+		for (k = i; k < n; k++) {
+			s -= m[k * n + i - 1] * y[k];
+		}
+		y[i - 1] = s / m[(i - 1) * n + i - 1];
+	}
+	for (i = 0; i < lvl->a->n; i++) {
+		lvl->x[i] = 0.0;
+	}
+	for (i = 0; i < n; i++) {
+		lvl->x[node[i]] = y[i];
+	}
+}
+
+static int cycle(vtsp_multigrid_t *mg, uint32_t l)
+{
+	vtsp_mg_level_t *lvl = &(mg->level[l]);
+	double *x = lvl->x;
+	double *t = lvl->t;
+	if (l + 1 == mg->n_levels) {
+		if (mg->direct) {
+			solve_dense(mg, lvl);
+			return SUCCESS;
+		}
+		TRY( smooth(mg, lvl, &x, &t, COARSEST_SWEEPS, 1) );
+	} else {
+		vtsp_mg_level_t *next = &(mg->level[l + 1]);
+		TRY( smooth(mg, lvl, &x, &t, SMOOTH_SWEEPS, 1) );
+
+		mg_task_t task = {mg, lvl, next, x, t};
+		TRY( vtsp_parallel_run(lvl->n_threads, &residual_rows, &task) );
+		TRY( vtsp_parallel_run(next->n_threads, &restrict_rows, &task) );
+		TRY( cycle(mg, l + 1) );
+		task.x_out = x;
+		TRY( vtsp_parallel_run(lvl->n_threads, &prolong_rows, &task) );
+
+		TRY( smooth(mg, lvl, &x, &t, SMOOTH_SWEEPS, 0) );
+	}
+	if (x != lvl->x) {
+		memcpy(lvl->x, x, lvl->a->n * sizeof(*x));
+	}
+	return SUCCESS;
+}
+
+static int smooth(vtsp_multigrid_t *mg, vtsp_mg_level_t *lvl, double **x,
+		  double **t, uint32_t n_sweeps, int from_zero)
+{
+	/* Jacobi reads the old iterate, x and t swap after every sweep */
+	mg_task_t task = {mg, lvl, NULL, NULL, NULL};
+	uint32_t k;
+	for (k = 0; k < n_sweeps; k++) {
+		task.x_in = from_zero && k == 0 ? NULL : *x;
+		task.x_out = *t;
+		TRY( vtsp_parallel_run(lvl->n_threads, &smooth_rows, &task) );
+		double *swap = *x;
+		*x = *t;
+		*t = swap;
+	}
+	return SUCCESS;
+}
+
+static int smooth_rows(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	mg_task_t *task = (mg_task_t*) ctx;
+	const vtsp_stiffness_t *a = task->lvl->a;
+	const double *b = task->lvl->b;
+	const double *x = task->x_in;
+	double *y = task->x_out;
+	uint32_t begin, end;
+	vtsp_parallel_range(a->n, id, n_threads, &begin, &end);
+
+	uint32_t i;
+	if (x == NULL) {
+		for (i = begin; i < end; i++) {
+			y[i] = OMEGA * b[i] / a->diag[i];
+		}
+		return SUCCESS;
+	}
+	for (i = begin; i < end; i++) {
+		double s = b[i] - a->diag[i] * x[i];
+		uint32_t e;
+		for (e = a->graph.offset[i]; e < a->graph.offset[i + 1]; e++) {
+			s -= a->val[e] * x[a->graph.index[e]];
+		}
+		y[i] = x[i] + OMEGA * s / a->diag[i];
+	}
+	return SUCCESS;
+}
+
+static int residual_rows(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	/* x_out = b - A x_in */
+	mg_task_t *task = (mg_task_t*) ctx;
+	const vtsp_stiffness_t *a = task->lvl->a;
+	uint32_t begin, end;
+	vtsp_parallel_range(a->n, id, n_threads, &begin, &end);
+
+	vtsp_stiffness_multiply(a, task->x_in, task->x_out, begin, end);
+	uint32_t i;
+	for (i = begin; i < end; i++) {
+		task->x_out[i] = task->lvl->b[i] - task->x_out[i];
+	}
+	return SUCCESS;
+}
+
+static int restrict_rows(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	/* Coarse right hand side from the fine residual in x_out */
+	mg_task_t *task = (mg_task_t*) ctx;
+	const vtsp_mg_level_t *fine = task->lvl;
+	vtsp_mg_level_t *next = task->next;
+	uint32_t begin, end;
+	vtsp_parallel_range(next->a->n, id, n_threads, &begin, &end);
+
+	uint32_t c;
+	for (c = begin; c < end; c++) {
+		double s = 0.0;
+		uint32_t e;
+		for (e = fine->r_offset[c]; e < fine->r_offset[c + 1]; e++) {
+			s += fine->r_weight[e] * task->x_out[fine->r_index[e]];
+		}
+		next->b[c] = next->a->fixed[c] ? 0.0 : s;
+	}
+	return SUCCESS;
+}
+
+static int prolong_rows(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	mg_task_t *task = (mg_task_t*) ctx;
+	const vtsp_mg_level_t *fine = task->lvl;
+	const double *xc = task->next->x;
+	uint32_t begin, end;
+	vtsp_parallel_range(fine->a->n, id, n_threads, &begin, &end);
+
+	uint32_t i;
+	for (i = begin; i < end; i++) {
+		const uint32_t *index = &(fine->p_index[3 * i]);
+		const float *weight = &(fine->p_weight[3 * i]);
+		task->x_out[i] += weight[0] * xc[index[0]] +
+			weight[1] * xc[index[1]] + weight[2] * xc[index[2]];
+	}
+	return SUCCESS;
+}
@@ -0,0 +1,62 @@
+#ifndef __VTSP_MULTIGRID_H__
+#define __VTSP_MULTIGRID_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_depend.h"
+#include "vtsp_opmem.h"
+#include "vtsp_stiffness.h"
+
+#define VTSP_MG_MAX_LEVELS 16
+
+/*
+ * Geometric multigrid over a hierarchy of meshes.
+ * Each coarse level keeps the fixed nodes of the finer one that touch a
+ * free node, so it carries the same constraints, and an independent set
+ * of its free nodes, then is triangulated by the mesher binding.
+ * Interpolation is barycentric in the coarse triangle holding each node,
+ * restriction is its transpose, smoothing is damped Jacobi. The
+ * coarsest level is solved by dense Cholesky over its free nodes.
+ */
+typedef struct {
+	vtsp_stiffness_t *a;      /* Level 0 borrows the caller's matrix */
+	vtsp_stiffness_t own;
+	vtsp_mesh_t mesh;
+	uint32_t n_threads;
+	/* Interpolation from the next level, 3 entries per node */
+	uint32_t *p_index;
+	float *p_weight;
+	/* Its transpose, one row per node of the next level */
+	uint32_t *r_offset;
+	uint32_t *r_index;
+	float *r_weight;
+	double *x, *b, *t;
+} vtsp_mg_level_t;
+
+typedef struct {
+	uint32_t n_levels;
+	uint32_t max_levels;      /* Levels with memory */
+	vtsp_mg_level_t level[VTSP_MG_MAX_LEVELS];
+	double *dense;            /* Cholesky factor of the coarsest level */
+	uint32_t *dense_node;     /* Its free nodes, rows of dense */
+	uint32_t n_dense;
+	int direct;               /* Coarsest level solved by dense */
+	/* Scratch used while building a level */
+	uint8_t *state;
+	uint32_t *coarse_of;
+	vtsp_points_t points;
+	vtsp_perm_t envelope;
+	void *op_mem;             /* Envelope and mesher */
+} vtsp_multigrid_t;
+
+/* Memory for a fine mesh with up to n_nodes */
+int vtsp_mg_take(vtsp_multigrid_t *mg, uint32_t n_nodes,
+		 const vtsp_binding_mesher_t *mesher, vtsp_opmem_t *mem);
+/* a must be assembled, it stays the matrix of level 0 */
+int vtsp_mg_build(vtsp_multigrid_t *mg, vtsp_stiffness_t *a,
+		  const vtsp_binding_mesher_t *mesher, uint32_t n_threads);
+/* One V-cycle from a zero guess, x approximates A^-1 b */
+int vtsp_mg_vcycle(vtsp_multigrid_t *mg, const double *b, double *x);
+
+#endif
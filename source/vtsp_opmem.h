@@ -0,0 +1,57 @@
+#ifndef __VTSP_OPMEM_H__
+#define __VTSP_OPMEM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OPMEM_ALIGN 64
+
+/*
+ * Bump allocator over the caller's op_mem.
+ * With a NULL base it only counts bytes, so the same sequence of
+ * takes and releases sizes op_mem first and carves it later.
+ */
+typedef struct {
+	char *base;
+	size_t used;
+	size_t peak;
+} vtsp_opmem_t;
+
+static inline void vtsp_opmem_init(vtsp_opmem_t *mem, void *base)
+{
+	/* Align the base, the caller reserved OPMEM_ALIGN extra bytes */
+	uintptr_t addr = (uintptr_t) base;
+	addr = (addr + OPMEM_ALIGN - 1) & ~((uintptr_t) OPMEM_ALIGN - 1);
+	mem->base = base ? (char*) addr : NULL;
+	mem->used = 0;
+	mem->peak = 0;
+}
+
+static inline void *vtsp_opmem_take(vtsp_opmem_t *mem, size_t size)
+{
+	void *ptr = mem->base ? mem->base + mem->used : NULL;
+	mem->used += (size + OPMEM_ALIGN - 1) & ~((size_t) OPMEM_ALIGN - 1);
+	if (mem->used > mem->peak) {
+		mem->peak = mem->used;
+	}
+	return ptr;
+}
+
+static inline size_t vtsp_opmem_mark(const vtsp_opmem_t *mem)
+{
+	return mem->used;
+}
+
+/* Give back everything taken after mark */
+static inline void vtsp_opmem_release(vtsp_opmem_t *mem, size_t mark)
+{
+	mem->used = mark;
+}
+
+/* Bytes the caller must provide to replay the same sequence */
+static inline size_t vtsp_opmem_sizeof(const vtsp_opmem_t *mem)
+{
+	return mem->peak + OPMEM_ALIGN;
+}
+
+#endif
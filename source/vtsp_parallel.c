@@ -0,0 +1,79 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "vtsp_parallel.h"
+#include "vtsp_types.h"
+#include "try_macros.h"
+
+typedef struct {
+	vtsp_parallel_task_f task;
+	void *ctx;
+	uint32_t id;
+	uint32_t n_threads;
+	int status;
+} worker_t;
+
+static void *run_worker(void *arg);
+
+uint32_t vtsp_parallel_threads(uint32_t requested, uint32_t n_items,
+			       uint32_t min_items_per_thread)
+{
+	uint32_t n = requested;
+	if (n == 0) {
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		n = cores > 0 ? (uint32_t) cores : 1;
+	}
+	uint32_t max_useful = n_items / (min_items_per_thread + 1) + 1;
+	if (n > max_useful) {
+		n = max_useful;
+	}
+	if (n > PARALLEL_MAX_THREADS) {
+		n = PARALLEL_MAX_THREADS;
+	}
+	return n;
+}
+
+int vtsp_parallel_run(uint32_t n_threads, vtsp_parallel_task_f task, void *ctx)
+{
+	THROW( n_threads == 0 || n_threads > PARALLEL_MAX_THREADS, ERROR );
+
+	pthread_t threads[PARALLEL_MAX_THREADS];
+	worker_t workers[PARALLEL_MAX_THREADS];
+	uint32_t i;
+	for (i = 0; i < n_threads; i++) {
+		workers[i].task = task;
+		workers[i].ctx = ctx;
+		workers[i].id = i;
+		workers[i].n_threads = n_threads;
+		workers[i].status = ERROR;
+	}
+
+	uint32_t n_started = 1;
+	for (i = 1; i < n_threads; i++) {
+		if (0 != pthread_create(&(threads[i]), NULL, &run_worker,
+					&(workers[i]))) {
+			break;
+		}
+		n_started ++;
+	}
+	run_worker(&(workers[0]));
+	for (i = 1; i < n_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	for (i = 0; i < n_threads; i++) {
+		TRY( workers[i].status );
+	}
+	return SUCCESS;
+}
+
+static void *run_worker(void *arg)
+{
+	worker_t *worker = (worker_t*) arg;
+	worker->status = worker->task(worker->ctx, worker->id,
+				      worker->n_threads);
+	return NULL;
+}
@@ -0,0 +1,27 @@
+#ifndef __VTSP_PARALLEL_H__
+#define __VTSP_PARALLEL_H__
+
+#include <stdint.h>
+
+#define PARALLEL_MAX_THREADS 64
+
+/* Task run by every thread, id goes from 0 to n_threads - 1 */
+typedef int (*vtsp_parallel_task_f)(void *ctx, uint32_t id, uint32_t n_threads);
+
+/* Threads to use for n items, 'requested' 0 means every online core */
+uint32_t vtsp_parallel_threads(uint32_t requested, uint32_t n_items,
+			       uint32_t min_items_per_thread);
+
+/* The caller runs as thread 0, returns the first failing status */
+int vtsp_parallel_run(uint32_t n_threads, vtsp_parallel_task_f task, void *ctx);
+
+/* Contiguous share of n items for thread id */
+static inline void vtsp_parallel_range(uint32_t n, uint32_t id,
+				       uint32_t n_threads,
+				       uint32_t *begin, uint32_t *end)
+{
+	*begin = (uint32_t) (((uint64_t) n * id) / n_threads);
+	*end = (uint32_t) (((uint64_t) n * (id + 1)) / n_threads);
+}
+
+#endif
@@ -0,0 +1,63 @@
+#include <stdint.h>
+
+#include "vtsp_points.h"
+#include "try_macros.h"
+#include "vtsp_opmem.h"
+
+static void take_arrays(vtsp_points_soa_t *points, uint32_t n_alloc,
+			vtsp_opmem_t *mem);
+
+int vtsp_points_soa_sizeof(uint32_t n_alloc, size_t *output)
+{
+	vtsp_points_soa_t points;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, NULL);
+	take_arrays(&points, n_alloc, &mem);
+
+	*output = vtsp_opmem_sizeof(&mem);
+	return SUCCESS;
+}
+
+int vtsp_points_soa_init(vtsp_points_soa_t *points, uint32_t n_alloc,
+			 void *mem)
+{
+	THROW( mem == NULL, ERROR );
+	vtsp_opmem_t opmem;
+	vtsp_opmem_init(&opmem, mem);
+	take_arrays(points, n_alloc, &opmem);
+	points->num = 0;
+	points->n_alloc = n_alloc;
+	return SUCCESS;
+}
+
+int vtsp_points_to_soa(const vtsp_points_t *input, vtsp_points_soa_t *output)
+{
+	THROW( output->n_alloc < input->num, ERROR );
+	uint32_t i;
+	for (i = 0; i < input->num; i++) {
+		output->x[i] = input->pts[i].x;
+		output->y[i] = input->pts[i].y;
+	}
+	output->num = input->num;
+	return SUCCESS;
+}
+
+int vtsp_points_from_soa(const vtsp_points_soa_t *input,
+			 vtsp_points_t *output)
+{
+	THROW( output->n_alloc < input->num, ERROR );
+	uint32_t i;
+	for (i = 0; i < input->num; i++) {
+		output->pts[i].x = input->x[i];
+		output->pts[i].y = input->y[i];
+	}
+	output->num = input->num;
+	return SUCCESS;
+}
+
+static void take_arrays(vtsp_points_soa_t *points, uint32_t n_alloc,
+			vtsp_opmem_t *mem)
+{
+	points->x = vtsp_opmem_take(mem, n_alloc * sizeof(*(points->x)));
+	points->y = vtsp_opmem_take(mem, n_alloc * sizeof(*(points->y)));
+}
@@ -0,0 +1,102 @@
+#include <stdint.h>
+
+#include "vtsp_queue.h"
+
+static void sift_up(vtsp_queue_t *queue, uint32_t i);
+static void sift_down(vtsp_queue_t *queue, uint32_t i);
+static void place(vtsp_queue_t *queue, uint32_t i, uint32_t item);
+
+void vtsp_queue_take(vtsp_queue_t *queue, uint32_t n_alloc, vtsp_opmem_t *mem)
+{
+	queue->num = 0;
+	queue->n_alloc = n_alloc;
+	queue->heap = vtsp_opmem_take(mem, n_alloc * sizeof(*(queue->heap)));
+	queue->pos = vtsp_opmem_take(mem, n_alloc * sizeof(*(queue->pos)));
+	queue->key = vtsp_opmem_take(mem, n_alloc * sizeof(*(queue->key)));
+}
+
+void vtsp_queue_clear(vtsp_queue_t *queue)
+{
+	uint32_t i;
+	for (i = 0; i < queue->n_alloc; i++) {
+		queue->pos[i] = QUEUE_NONE;
+	}
+	queue->num = 0;
+}
+
+int vtsp_queue_contains(const vtsp_queue_t *queue, uint32_t item)
+{
+	return queue->pos[item] != QUEUE_NONE;
+}
+
+void vtsp_queue_set(vtsp_queue_t *queue, uint32_t item, double key)
+{
+	uint32_t i = queue->pos[item];
+	if (i == QUEUE_NONE) {
+		queue->key[item] = key;
+		place(queue, queue->num, item);
+		queue->num += 1;
+		sift_up(queue, queue->num - 1);
+	} else if (key < queue->key[item]) {
+		queue->key[item] = key;
+		sift_up(queue, i);
+	} else {
+		queue->key[item] = key;
+		sift_down(queue, i);
+	}
+}
+
+uint32_t vtsp_queue_pop(vtsp_queue_t *queue)
+{
+	uint32_t item = queue->heap[0];
+	queue->num -= 1;
+	if (queue->num > 0) {
+		place(queue, 0, queue->heap[queue->num]);
+		sift_down(queue, 0);
+	}
+	queue->pos[item] = QUEUE_NONE;
+	return item;
+}
+
+static void sift_up(vtsp_queue_t *queue, uint32_t i)
+{
+	uint32_t item = queue->heap[i];
+	double key = queue->key[item];
+	while (i > 0) {
+		uint32_t parent = (i - 1) / 2;
+		if (queue->key[queue->heap[parent]] <= key) {
+			break;
+		}
+		place(queue, i, queue->heap[parent]);
+		i = parent;
+	}
+	place(queue, i, item);
+}
+
+static void sift_down(vtsp_queue_t *queue, uint32_t i)
+{
+	uint32_t item = queue->heap[i];
+	double key = queue->key[item];
+	while (1) {
+		uint32_t child = 2 * i + 1;
+		if (child >= queue->num) {
+			break;
+		}
+		if (child + 1 < queue->num &&
+		    queue->key[queue->heap[child + 1]] < queue->key[queue->heap[child]]) {
+			child += 1;
+		}
+		if (key <= queue->key[queue->heap[child]]) {
+			break;
+		}
+		place(queue, i, queue->heap[child]);
+		i = child;
+	}
+	place(queue, i, item);
+}
+
+static void place(vtsp_queue_t *queue, uint32_t i, uint32_t item)
+{
+	queue->heap[i] = item;
+	queue->pos[item] = i;
+}
@@ -0,0 +1,34 @@
+#ifndef __VTSP_QUEUE_H__
+#define __VTSP_QUEUE_H__
+
+#include <stdint.h>
+
+#include "vtsp_opmem.h"
+
+#define QUEUE_NONE UINT32_MAX
+
+/*
+ * Indexed binary min-heap over items 0..n_alloc-1.
+ * Each item is at most once in the queue, its key can be updated.
+ */
+typedef struct {
+	uint32_t num;
+	uint32_t n_alloc;
+	uint32_t *heap;  /* Items in heap order */
+	uint32_t *pos;   /* Position of each item in heap, QUEUE_NONE if out */
+	double *key;     /* Key of each item */
+} vtsp_queue_t;
+
+void vtsp_queue_take(vtsp_queue_t *queue, uint32_t n_alloc, vtsp_opmem_t *mem);
+void vtsp_queue_clear(vtsp_queue_t *queue);
+int vtsp_queue_contains(const vtsp_queue_t *queue, uint32_t item);
+/* Insert item or change its key if it is already queued */
+void vtsp_queue_set(vtsp_queue_t *queue, uint32_t item, double key);
+uint32_t vtsp_queue_pop(vtsp_queue_t *queue);
+
+static inline uint32_t vtsp_queue_top(const vtsp_queue_t *queue)
+{
+	return queue->heap[0];
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "vtsp_renumber.h"
+#include "try_macros.h"
+#include "vtsp_topology.h"
+
+static uint32_t lowest(const vtsp_trg_t *trg);
+
+void vtsp_renumber_take(vtsp_renumber_mem_t *mem, uint32_t n_nodes,
+			uint32_t n_trgs, vtsp_opmem_t *opmem)
+{
+	mem->order.num = 0;
+	mem->order.n_alloc = n_nodes;
+	mem->order.index = vtsp_opmem_take(opmem, n_nodes *
+					   sizeof(*(mem->order.index)));
+	mem->inverse = vtsp_opmem_take(opmem, n_nodes * sizeof(*(mem->inverse)));
+	mem->pts = vtsp_opmem_take(opmem, n_nodes * sizeof(*(mem->pts)));
+	mem->trgs = vtsp_opmem_take(opmem, n_trgs * sizeof(*(mem->trgs)));
+	mem->offset = vtsp_opmem_take(opmem, (n_nodes + 1) *
+				      sizeof(*(mem->offset)));
+	mem->trg_inverse = vtsp_opmem_take(opmem, n_trgs *
+					   sizeof(*(mem->trg_inverse)));
+	mem->nbr = vtsp_opmem_take(opmem, 3 * (size_t) n_trgs *
+				   sizeof(*(mem->nbr)));
+}
+
+void vtsp_renumber_points(const vtsp_points_t *input, const vtsp_perm_t *order,
+			  vtsp_points_t *output)
+{
+	uint32_t i;
+	for (i = 0; i < order->num; i++) {
+		output->pts[i] = input->pts[order->index[i]];
+	}
+	output->num = order->num;
+}
+
+int vtsp_renumber_mesh(vtsp_mesh_t *mesh, vtsp_renumber_mem_t *mem)
+{
+	uint32_t n_nodes = mesh->nodes.num;
+	uint32_t n_trgs = mesh->adj.num;
+	THROW( mem->order.num != n_nodes, ERROR );
+
+	uint32_t i;
+	for (i = 0; i < n_nodes; i++) {
+		mem->inverse[mem->order.index[i]] = i;
+	}
+	for (i = 0; i < n_nodes; i++) {
+		mem->pts[i] = mesh->nodes.pts[mem->order.index[i]];
+	}
+	memcpy(mesh->nodes.pts, mem->pts, n_nodes * sizeof(*(mem->pts)));
+	for (i = 0; i < mesh->map_vtx.num; i++) {
+		mesh->map_vtx.index[i] = mem->inverse[mesh->map_vtx.index[i]];
+	}
+
+	/* Stable counting sort by lowest node, corners keep their turn */
+	memset(mem->offset, 0, (n_nodes + 1) * sizeof(*(mem->offset)));
+	vtsp_trg_t *trgs = mesh->adj.trgs;
+	for (i = 0; i < n_trgs; i++) {
+		trgs[i].n1 = mem->inverse[trgs[i].n1];
+		trgs[i].n2 = mem->inverse[trgs[i].n2];
+		trgs[i].n3 = mem->inverse[trgs[i].n3];
+		mem->offset[lowest(&(trgs[i])) + 1] ++;
+	}
+	for (i = 0; i < n_nodes; i++) {
+		mem->offset[i + 1] += mem->offset[i];
+	}
+	for (i = 0; i < n_trgs; i++) {
+		uint32_t t = mem->offset[lowest(&(trgs[i]))] ++;
+		mem->trgs[t] = trgs[i];
+		mem->trg_inverse[i] = t;
+	}
+	memcpy(trgs, mem->trgs, n_trgs * sizeof(*trgs));
+
+	if (mesh->nbr.num == 3 * n_trgs) {
+		uint32_t *nbr = mesh->nbr.index;
+		for (i = 0; i < 3 * n_trgs; i++) {
+			uint32_t u = nbr[i];
+			THROW( u != VTSP_NO_TRG && u >= n_trgs, ERROR );
+			mem->nbr[3 * mem->trg_inverse[i / 3] + i % 3] =
+				u == VTSP_NO_TRG ? u : mem->trg_inverse[u];
+		}
+		memcpy(nbr, mem->nbr, 3 * (size_t) n_trgs * sizeof(*nbr));
+	}
+	return SUCCESS;
+}
+
+void vtsp_renumber_tour(vtsp_perm_t *tour, const vtsp_perm_t *order)
+{
+	uint32_t i;
+	for (i = 0; i < tour->num; i++) {
+		tour->index[i] = order->index[tour->index[i]];
+	}
+}
+
+static uint32_t lowest(const vtsp_trg_t *trg)
+{
+	uint32_t n = trg->n1 < trg->n2 ? trg->n1 : trg->n2;
+	return n < trg->n3 ? n : trg->n3;
+}
@@ -0,0 +1,37 @@
+#ifndef __VTSP_RENUMBER_H__
+#define __VTSP_RENUMBER_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_opmem.h"
+
+/* Scratch of the mesh renumbering */
+typedef struct {
+	vtsp_perm_t order;      /* New node to old node, from the orderer */
+	uint32_t *inverse;      /* Old node to new node */
+	vtsp_point_t *pts;
+	vtsp_trg_t *trgs;
+	uint32_t *offset;       /* Triangles per lowest node, then offsets */
+	uint32_t *trg_inverse;  /* Old triangle to new triangle */
+	uint32_t *nbr;
+} vtsp_renumber_mem_t;
+
+void vtsp_renumber_take(vtsp_renumber_mem_t *mem, uint32_t n_nodes,
+			uint32_t n_trgs, vtsp_opmem_t *opmem);
+
+/* output[i] = input[order[i]] */
+void vtsp_renumber_points(const vtsp_points_t *input, const vtsp_perm_t *order,
+			  vtsp_points_t *output);
+
+/*
+ * Move the nodes to the order in mem->order, then sort the triangles
+ * by their lowest node so they follow the nodes. map_vtx and the
+ * neighbors filled by the mesher follow.
+ */
+int vtsp_renumber_mesh(vtsp_mesh_t *mesh, vtsp_renumber_mem_t *mem);
+
+/* Tour over ordered points back to the points they came from */
+void vtsp_renumber_tour(vtsp_perm_t *tour, const vtsp_perm_t *order);
+
+#endif
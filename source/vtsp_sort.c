@@ -0,0 +1,82 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "vtsp_sort.h"
+
+#define INSERTION_RUN 16
+
+static int is_less(const vtsp_point_t *pts, uint32_t i, uint32_t j);
+static void sort_run(const vtsp_point_t *pts, uint32_t *index, uint32_t n);
+static void merge(const vtsp_point_t *pts, const uint32_t *src,
+		  uint32_t begin, uint32_t mid, uint32_t end, uint32_t *dst);
+
+void vtsp_sort_by_xy(const vtsp_point_t *pts, uint32_t *index, uint32_t n,
+		     uint32_t *scratch)
+{
+	uint32_t i;
+	for (i = 0; i < n; i += INSERTION_RUN) {
+		uint32_t len = n - i < INSERTION_RUN ? n - i : INSERTION_RUN;
+		sort_run(pts, &(index[i]), len);
+	}
+
+	/* Bottom-up merges, ping-pong between index and scratch */
+	uint32_t *src = index;
+	uint32_t *dst = scratch;
+	uint32_t width;
+	for (width = INSERTION_RUN; width < n; width *= 2) {
+		for (i = 0; i < n; i += 2 * width) {
+			uint32_t mid = i + width < n ? i + width : n;
+			uint32_t end = i + 2 * width < n ? i + 2 * width : n;
+			merge(pts, src, i, mid, end, dst);
+		}
+		uint32_t *tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+	if (src != index) {
+		memcpy(index, src, n * sizeof(*index));
+	}
+}
+
+static int is_less(const vtsp_point_t *pts, uint32_t i, uint32_t j)
+{
+	if (pts[i].x != pts[j].x) {
+		return pts[i].x < pts[j].x;
+	}
+	return pts[i].y < pts[j].y;
+}
+
+static void sort_run(const vtsp_point_t *pts, uint32_t *index, uint32_t n)
+{
+	uint32_t i;
+	for (i = 1; i < n; i++) {
+		uint32_t val = index[i];
+		uint32_t j = i;
+		while (j > 0 && is_less(pts, val, index[j - 1])) {
+			index[j] = index[j - 1];
+			j --;
+		}
+		index[j] = val;
+	}
+}
+
+static void merge(const vtsp_point_t *pts, const uint32_t *src,
+		  uint32_t begin, uint32_t mid, uint32_t end, uint32_t *dst)
+{
+	uint32_t i = begin;
+	uint32_t j = mid;
+	uint32_t k = begin;
+	while (i < mid && j < end) {
+		if (is_less(pts, src[j], src[i])) {
+			dst[k++] = src[j++];
+		} else {
+			dst[k++] = src[i++];
+		}
+	}
+	while (i < mid) {
+		dst[k++] = src[i++];
+	}
+	while (j < end) {
+		dst[k++] = src[j++];
+	}
+}
@@ -0,0 +1,15 @@
+#ifndef __VTSP_SORT_H__
+#define __VTSP_SORT_H__
+
+#include <stdint.h>
+
+#include "vtsp_types.h"
+
+/*
+ * Sort point indices by x, then y (stable merge sort).
+ * scratch must hold n entries.
+ */
+void vtsp_sort_by_xy(const vtsp_point_t *pts, uint32_t *index, uint32_t n,
+		     uint32_t *scratch);
+
+#endif
@@ -0,0 +1,151 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "vtsp_stiffness.h"
+#include "try_macros.h"
+#include "vtsp_topology.h"
+
+static void build_incidence(vtsp_stiffness_t *a);
+static int add_trg(vtsp_stiffness_t *a, uint32_t i, const vtsp_trg_t *trg);
+static double *find_entry(vtsp_stiffness_t *a, uint32_t i, uint32_t j);
+
+void vtsp_stiffness_take(vtsp_stiffness_t *a, uint32_t n_nodes,
+			 uint32_t n_trgs, bool shared, vtsp_opmem_t *mem)
+{
+	a->shared = shared;
+	if (!shared) {
+		vtsp_graph_take(&(a->graph), n_nodes, n_trgs, mem);
+		a->trg_offset = vtsp_opmem_take(mem, (n_nodes + 1) *
+						sizeof(*(a->trg_offset)));
+		a->trg_index = vtsp_opmem_take(mem, 3 * (size_t) n_trgs *
+					       sizeof(*(a->trg_index)));
+		a->cursor = vtsp_opmem_take(mem, n_nodes *
+					    sizeof(*(a->cursor)));
+	}
+	a->fixed = vtsp_opmem_take(mem, n_nodes * sizeof(*(a->fixed)));
+	a->diag = vtsp_opmem_take(mem, n_nodes * sizeof(*(a->diag)));
+	a->val = vtsp_opmem_take(mem, 6 * (size_t) n_trgs * sizeof(*(a->val)));
+	a->load = vtsp_opmem_take(mem, n_nodes * sizeof(*(a->load)));
+}
+
+int vtsp_stiffness_pattern(vtsp_stiffness_t *a, const vtsp_mesh_t *mesh)
+{
+	a->mesh = mesh;
+	a->n = mesh->nodes.num;
+	if (a->shared) {
+		THROW( !vtsp_topology_ready(mesh), ERROR );
+		a->graph = mesh->node_nodes;
+		a->trg_offset = mesh->node_trgs.offset;
+		a->trg_index = mesh->node_trgs.index;
+		return SUCCESS;
+	}
+	TRY( vtsp_graph_build(mesh, &(a->graph), a->cursor) );
+	build_incidence(a);
+	return SUCCESS;
+}
+
+int vtsp_stiffness_assemble(vtsp_stiffness_t *a, uint32_t begin, uint32_t end)
+{
+	const vtsp_graph_t *graph = &(a->graph);
+	uint32_t i;
+	for (i = begin; i < end; i++) {
+		uint32_t e;
+		a->diag[i] = 0.0;
+		a->load[i] = 0.0;
+		for (e = graph->offset[i]; e < graph->offset[i + 1]; e++) {
+			a->val[e] = 0.0;
+		}
+		uint32_t k;
+		for (k = a->trg_offset[i]; k < a->trg_offset[i + 1]; k++) {
+			const vtsp_trg_t *trg =
+				&(a->mesh->adj.trgs[a->trg_index[k]]);
+			TRY( add_trg(a, i, trg) );
+		}
+
+		/*
+		 * Dirichlet rows become identity and their columns are
+		 * dropped, so do the rows of nodes out of every triangle.
+		 */
+		if (a->fixed[i] || a->trg_offset[i] == a->trg_offset[i + 1]) {
+			a->diag[i] = 1.0;
+			for (e = graph->offset[i]; e < graph->offset[i + 1]; e++) {
+				a->val[e] = 0.0;
+			}
+			continue;
+		}
+		for (e = graph->offset[i]; e < graph->offset[i + 1]; e++) {
+			if (a->fixed[graph->index[e]]) {
+				a->val[e] = 0.0;
+			}
+		}
+	}
+	return SUCCESS;
+}
+
+static void build_incidence(vtsp_stiffness_t *a)
+{
+	/* Rows are assembled in parallel from the triangles around them */
+	const vtsp_trgs_t *adj = &(a->mesh->adj);
+	uint32_t i;
+	for (i = 0; i <= a->n; i++) {
+		a->trg_offset[i] = 0;
+	}
+	for (i = 0; i < adj->num; i++) {
+		a->trg_offset[adj->trgs[i].n1 + 1] ++;
+		a->trg_offset[adj->trgs[i].n2 + 1] ++;
+		a->trg_offset[adj->trgs[i].n3 + 1] ++;
+	}
+	for (i = 0; i < a->n; i++) {
+		a->trg_offset[i + 1] += a->trg_offset[i];
+		a->cursor[i] = a->trg_offset[i];
+	}
+	for (i = 0; i < adj->num; i++) {
+		a->trg_index[a->cursor[adj->trgs[i].n1]++] = i;
+		a->trg_index[a->cursor[adj->trgs[i].n2]++] = i;
+		a->trg_index[a->cursor[adj->trgs[i].n3]++] = i;
+	}
+}
+
+static int add_trg(vtsp_stiffness_t *a, uint32_t i, const vtsp_trg_t *trg)
+{
+	/* Row i of the P1 element matrix, (b_i b_j + c_i c_j) / 4A */
+	const vtsp_point_t *pts = a->mesh->nodes.pts;
+	uint32_t v[3] = {trg->n1, trg->n2, trg->n3};
+	double b[3], c[3];
+	uint32_t k;
+	for (k = 0; k < 3; k++) {
+		const vtsp_point_t *p1 = &(pts[v[(k + 1) % 3]]);
+		const vtsp_point_t *p2 = &(pts[v[(k + 2) % 3]]);
+		b[k] = (double) p1->y - (double) p2->y;
+		c[k] = (double) p2->x - (double) p1->x;
+	}
+	double area = 0.5 * fabs(b[0] * c[1] - b[1] * c[0]);
+	THROW( !(area > 0.0), ERROR ); /* Degenerate triangle */
+
+	uint32_t li = v[0] == i ? 0 : (v[1] == i ? 1 : 2);
+	for (k = 0; k < 3; k++) {
+		double kij = (b[li] * b[k] + c[li] * c[k]) / (4.0 * area);
+		if (k == li) {
+			a->diag[i] += kij;
+		} else {
+			double *entry = find_entry(a, i, v[k]);
+			THROW( entry == NULL, ERROR );
+			*entry += kij;
+		}
+	}
+	a->load[i] += area / 3.0;
+	return SUCCESS;
+}
+
+static double *find_entry(vtsp_stiffness_t *a, uint32_t i, uint32_t j)
+{
+	/* Rows are sorted and short */
+	const vtsp_graph_t *graph = &(a->graph);
+	uint32_t e;
+	for (e = graph->offset[i]; e < graph->offset[i + 1]; e++) {
+		if (graph->index[e] == j) {
+			return &(a->val[e]);
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef __VTSP_STIFFNESS_H__
+#define __VTSP_STIFFNESS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_graph.h"
+#include "vtsp_opmem.h"
+
+/*
+ * P1 stiffness matrix of a mesh in CSR form.
+ * Rows of fixed nodes are identity and their columns are dropped,
+ * so the matrix stays symmetric positive definite.
+ */
+typedef struct {
+	const vtsp_mesh_t *mesh;
+	uint32_t n;
+	bool shared;             /* Pattern and incidence from the mesh */
+	vtsp_graph_t graph;      /* Pattern of the off-diagonal entries */
+	uint32_t *trg_offset;    /* Triangles around each node, CSR */
+	uint32_t *trg_index;
+	uint32_t *cursor;
+	uint8_t *fixed;          /* Filled by the caller before assembling */
+	double *diag;
+	double *val;             /* Along graph.index */
+	double *load;            /* Integral of the hat function of each node */
+} vtsp_stiffness_t;
+
+/* shared takes the pattern from the topology of the mesh, see vtsp_topology.h */
+void vtsp_stiffness_take(vtsp_stiffness_t *a, uint32_t n_nodes,
+			 uint32_t n_trgs, bool shared, vtsp_opmem_t *mem);
+/* Pattern and node to triangle incidence */
+int vtsp_stiffness_pattern(vtsp_stiffness_t *a, const vtsp_mesh_t *mesh);
+/* Rows begin..end, threads assemble disjoint ranges */
+int vtsp_stiffness_assemble(vtsp_stiffness_t *a, uint32_t begin, uint32_t end);
+
+/* y = A x over the rows begin..end, returns the dot of x and y there */
+static inline double vtsp_stiffness_multiply(const vtsp_stiffness_t *a,
+					     const double *x, double *y,
+					     uint32_t begin, uint32_t end)
+{
+	const uint32_t *offset = a->graph.offset;
+	const uint32_t *index = a->graph.index;
+	double dot = 0.0;
+	uint32_t i;
+	for (i = begin; i < end; i++) {
+		double s = a->diag[i] * x[i];
+		uint32_t e;
+		for (e = offset[i]; e < offset[i + 1]; e++) {
+			s += a->val[e] * x[index[e]];
+		}
+		y[i] = s;
+		dot += x[i] * s;
+	}
+	return dot;
+}
+
+#endif
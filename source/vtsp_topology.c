@@ -0,0 +1,157 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vtsp_topology.h"
+#include "try_macros.h"
+#include "vtsp_graph.h"
+#include "vtsp_opmem.h"
+#include "vtsp_parallel.h"
+
+#define MIN_TRGS_PER_THREAD 65536
+
+static void take_buffers(vtsp_mesh_t *mesh, uint32_t n_nodes, uint32_t n_trgs,
+			 vtsp_opmem_t *mem, uint32_t **cursor);
+static int build_incidence(vtsp_mesh_t *mesh, uint32_t *cursor);
+static int find_nbrs(void *ctx, uint32_t id, uint32_t n_threads);
+static uint32_t find_nbr(const vtsp_mesh_t *mesh, uint32_t t,
+			 uint32_t a, uint32_t b);
+static uint32_t trg_node(const vtsp_trg_t *trg, uint32_t k);
+
+bool vtsp_topology_ready(const vtsp_mesh_t *mesh)
+{
+	return mesh->nbr.num == 3 * mesh->adj.num &&
+		mesh->node_trgs.num == mesh->nodes.num &&
+		mesh->node_nodes.num == mesh->nodes.num;
+}
+
+void vtsp_topology_clear(vtsp_mesh_t *mesh)
+{
+	mesh->nbr.num = 0;
+	mesh->nbr.n_alloc = 0;
+	mesh->nbr.index = NULL;
+	mesh->node_trgs.num = 0;
+	mesh->node_trgs.n_alloc = 0;
+	mesh->node_trgs.offset = NULL;
+	mesh->node_trgs.index = NULL;
+	mesh->node_nodes = mesh->node_trgs;
+}
+
+int vtsp_topology_sizeof_opmem(const vtsp_mesh_t *mesh, size_t *output)
+{
+	vtsp_mesh_t bound = *mesh;
+	uint32_t *cursor;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, NULL);
+	take_buffers(&bound, mesh->nodes.num, mesh->adj.num, &mem, &cursor);
+
+	*output = vtsp_opmem_sizeof(&mem);
+	return SUCCESS;
+}
+
+int vtsp_topology_build(vtsp_mesh_t *mesh, uint32_t n_threads, void *op_mem)
+{
+	uint32_t n_trgs = mesh->adj.num;
+	uint32_t *cursor;
+	vtsp_opmem_t mem;
+	vtsp_opmem_init(&mem, op_mem);
+	bool has_nbr = mesh->nbr.num == 3 * n_trgs;
+	take_buffers(mesh, mesh->nodes.num, n_trgs, &mem, &cursor);
+
+	TRY( build_incidence(mesh, cursor) );
+	TRY( vtsp_graph_build(mesh, &(mesh->node_nodes), cursor) );
+	if (!has_nbr) {
+		/* Neighbors share the edge, looked up around one of its nodes */
+		n_threads = vtsp_parallel_threads(n_threads, n_trgs,
+						  MIN_TRGS_PER_THREAD);
+		TRY( vtsp_parallel_run(n_threads, &find_nbrs, mesh) );
+		mesh->nbr.num = 3 * n_trgs;
+	}
+	return SUCCESS;
+}
+
+static void take_buffers(vtsp_mesh_t *mesh, uint32_t n_nodes, uint32_t n_trgs,
+			 vtsp_opmem_t *mem, uint32_t **cursor)
+{
+	vtsp_graph_t *node_trgs = &(mesh->node_trgs);
+	node_trgs->num = 0;
+	node_trgs->n_alloc = n_nodes;
+	node_trgs->offset = vtsp_opmem_take(mem, (n_nodes + (size_t) 1) *
+					    sizeof(*(node_trgs->offset)));
+	node_trgs->index = vtsp_opmem_take(mem, 3 * (size_t) n_trgs *
+					   sizeof(*(node_trgs->index)));
+	vtsp_graph_take(&(mesh->node_nodes), n_nodes, n_trgs, mem);
+	*cursor = vtsp_opmem_take(mem, n_nodes * sizeof(**cursor));
+	if (mesh->nbr.n_alloc < 3 * (size_t) n_trgs) {
+		mesh->nbr.num = 0;
+		mesh->nbr.n_alloc = 3 * n_trgs;
+		mesh->nbr.index = vtsp_opmem_take(mem, 3 * (size_t) n_trgs *
+						  sizeof(*(mesh->nbr.index)));
+	}
+}
+
+static int build_incidence(vtsp_mesh_t *mesh, uint32_t *cursor)
+{
+	const vtsp_trgs_t *adj = &(mesh->adj);
+	vtsp_graph_t *node_trgs = &(mesh->node_trgs);
+	uint32_t n = mesh->nodes.num;
+	uint32_t i, k;
+	for (i = 0; i <= n; i++) {
+		node_trgs->offset[i] = 0;
+	}
+	for (i = 0; i < adj->num; i++) {
+		for (k = 0; k < 3; k++) {
+			uint32_t v = trg_node(&(adj->trgs[i]), k);
+			THROW( v >= n, ERROR );
+			node_trgs->offset[v + 1] ++;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		node_trgs->offset[i + 1] += node_trgs->offset[i];
+		cursor[i] = node_trgs->offset[i];
+	}
+	for (i = 0; i < adj->num; i++) {
+		for (k = 0; k < 3; k++) {
+			uint32_t v = trg_node(&(adj->trgs[i]), k);
+			node_trgs->index[cursor[v]++] = i;
+		}
+	}
+	node_trgs->num = n;
+	return SUCCESS;
+}
+
+static int find_nbrs(void *ctx, uint32_t id, uint32_t n_threads)
+{
+	vtsp_mesh_t *mesh = (vtsp_mesh_t*) ctx;
+	const vtsp_trgs_t *adj = &(mesh->adj);
+	uint32_t begin, end, i, k;
+	vtsp_parallel_range(adj->num, id, n_threads, &begin, &end);
+	for (i = begin; i < end; i++) {
+		for (k = 0; k < 3; k++) {
+			uint32_t a = trg_node(&(adj->trgs[i]), (k + 1) % 3);
+			uint32_t b = trg_node(&(adj->trgs[i]), (k + 2) % 3);
+			mesh->nbr.index[3 * i + k] = find_nbr(mesh, i, a, b);
+		}
+	}
+	return SUCCESS;
+}
+
+static uint32_t find_nbr(const vtsp_mesh_t *mesh, uint32_t t,
+			 uint32_t a, uint32_t b)
+{
+	const vtsp_graph_t *node_trgs = &(mesh->node_trgs);
+	const vtsp_trg_t *trgs = mesh->adj.trgs;
+	uint32_t j;
+	for (j = node_trgs->offset[a]; j < node_trgs->offset[a + 1]; j++) {
+		uint32_t u = node_trgs->index[j];
+		const vtsp_trg_t *trg = &(trgs[u]);
+		if (u != t && (trg->n1 == b || trg->n2 == b || trg->n3 == b)) {
+			return u;
+		}
+	}
+	return VTSP_NO_TRG;
+}
+
+static uint32_t trg_node(const vtsp_trg_t *trg, uint32_t k)
+{
+	return k == 0 ? trg->n1 : (k == 1 ? trg->n2 : trg->n3);
+}
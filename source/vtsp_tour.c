@@ -0,0 +1,247 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vtsp_tour.h"
+#include "try_macros.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#endif
+
+static double edge_length(const vtsp_point_t *pts, uint32_t a, uint32_t b);
+static double path_length_scalar(const vtsp_point_t *pts, const uint32_t *index,
+				 uint32_t n_edges);
+static double edge_length_soa(const float *x, const float *y, uint32_t a,
+			      uint32_t b);
+static double path_length_soa_scalar(const float *x, const float *y,
+				     const uint32_t *index, uint32_t n_edges);
+#ifdef HAVE_AVX2_KERNEL
+static double path_length_avx2(const vtsp_point_t *pts, const uint32_t *index,
+			       uint32_t n_edges);
+static double path_length_soa_avx2(const float *x, const float *y,
+				   const uint32_t *index, uint32_t n_edges);
+#endif
+
+int vtsp_tour_length(const vtsp_points_t *points, const vtsp_perm_t *tour,
+		     double *output)
+{
+	uint32_t n = tour->num;
+	if (n < 2) {
+		*output = 0;
+		return SUCCESS;
+	}
+
+	/* Open path index[0] ... index[n-1], then the closing edge */
+	double length;
+#ifdef HAVE_AVX2_KERNEL
+	if (__builtin_cpu_supports("avx2")) {
+		length = path_length_avx2(points->pts, tour->index, n - 1);
+	} else {
+		length = path_length_scalar(points->pts, tour->index, n - 1);
+	}
+#else
+	length = path_length_scalar(points->pts, tour->index, n - 1);
+#endif
+	length += edge_length(points->pts, tour->index[n - 1], tour->index[0]);
+	*output = length;
+	return SUCCESS;
+}
+
+int vtsp_tour_length_soa(const vtsp_points_soa_t *points,
+			 const vtsp_perm_t *tour, double *output)
+{
+	uint32_t n = tour->num;
+	if (n < 2) {
+		*output = 0;
+		return SUCCESS;
+	}
+
+	double length;
+#ifdef HAVE_AVX2_KERNEL
+	if (__builtin_cpu_supports("avx2")) {
+		length = path_length_soa_avx2(points->x, points->y, tour->index,
+					      n - 1);
+	} else {
+		length = path_length_soa_scalar(points->x, points->y,
+						tour->index, n - 1);
+	}
+#else
+	length = path_length_soa_scalar(points->x, points->y, tour->index,
+					n - 1);
+#endif
+	length += edge_length_soa(points->x, points->y, tour->index[n - 1],
+				  tour->index[0]);
+	*output = length;
+	return SUCCESS;
+}
+
+int vtsp_tour_validate_sizeof_opmem(uint32_t n_points, size_t *output)
+{
+	*output = (n_points / 64 + 1) * sizeof(uint64_t);
+	return SUCCESS;
+}
+
+int vtsp_tour_validate(const vtsp_perm_t *tour, uint32_t n_points,
+		       void *op_mem)
+{
+	THROW( tour->num != n_points, ERROR );
+
+	uint64_t *bitmap = op_mem;
+	memset(bitmap, 0, (n_points / 64 + 1) * sizeof(*bitmap));
+	uint32_t i;
+	for (i = 0; i < n_points; i++) {
+		uint32_t p = tour->index[i];
+		THROW( p >= n_points, ERROR );
+		uint64_t mask = (uint64_t) 1 << (p % 64);
+		THROW( bitmap[p / 64] & mask, ERROR ); /* Visited twice */
+		bitmap[p / 64] |= mask;
+	}
+	/* n_points distinct indices below n_points, none is missing */
+	return SUCCESS;
+}
+
+int vtsp_tour_gap(const vtsp_points_t *points, const vtsp_perm_t *tour,
+		  const vtsp_perm_t *reference, double *output)
+{
+	double length, reference_length;
+	TRY( vtsp_tour_length(points, tour, &length) );
+	TRY( vtsp_tour_length(points, reference, &reference_length) );
+	THROW( reference_length <= 0, ERROR );
+	*output = 100.0 * (length - reference_length) / reference_length;
+	return SUCCESS;
+}
+
+static double edge_length(const vtsp_point_t *pts, uint32_t a, uint32_t b)
+{
+	/* Same operations as the vector kernel, sums are exact integers */
+	double dx = (double) pts[a].x - (double) pts[b].x;
+	double dy = (double) pts[a].y - (double) pts[b].y;
+	return floor(sqrt(dx * dx + dy * dy) + 0.5);
+}
+
+static double path_length_scalar(const vtsp_point_t *pts, const uint32_t *index,
+				 uint32_t n_edges)
+{
+	double sum0 = 0;
+	double sum1 = 0;
+	uint32_t i;
+	for (i = 0; i + 1 < n_edges; i += 2) {
+		sum0 += edge_length(pts, index[i], index[i + 1]);
+		sum1 += edge_length(pts, index[i + 1], index[i + 2]);
+	}
+	if (i < n_edges) {
+		sum0 += edge_length(pts, index[i], index[i + 1]);
+	}
+	return sum0 + sum1;
+}
+
+static double edge_length_soa(const float *x, const float *y, uint32_t a,
+			      uint32_t b)
+{
+	double dx = (double) x[a] - (double) x[b];
+	double dy = (double) y[a] - (double) y[b];
+	return floor(sqrt(dx * dx + dy * dy) + 0.5);
+}
+
+static double path_length_soa_scalar(const float *x, const float *y,
+				     const uint32_t *index, uint32_t n_edges)
+{
+	double sum0 = 0;
+	double sum1 = 0;
+	uint32_t i;
+	for (i = 0; i + 1 < n_edges; i += 2) {
+		sum0 += edge_length_soa(x, y, index[i], index[i + 1]);
+		sum1 += edge_length_soa(x, y, index[i + 1], index[i + 2]);
+	}
+	if (i < n_edges) {
+		sum0 += edge_length_soa(x, y, index[i], index[i + 1]);
+	}
+	return sum0 + sum1;
+}
+
+#ifdef HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+static double path_length_avx2(const vtsp_point_t *pts, const uint32_t *index,
+			       uint32_t n_edges)
+{
+	/* Four edges per step, x and y gathered through the indices of
+	 * both endpoints (scale 8 skips the other coordinate) */
+	const float *x = &(pts[0].x);
+	const float *y = &(pts[0].y);
+	const __m256d half = _mm256_set1_pd(0.5);
+	__m256d sum = _mm256_setzero_pd();
+	uint32_t i;
+	for (i = 0; i + 4 <= n_edges; i += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i*) &(index[i]));
+		__m128i b = _mm_loadu_si128((const __m128i*) &(index[i + 1]));
+		__m256d ax = _mm256_cvtps_pd(_mm_i32gather_ps(x, a, 8));
+		__m256d ay = _mm256_cvtps_pd(_mm_i32gather_ps(y, a, 8));
+		__m256d bx = _mm256_cvtps_pd(_mm_i32gather_ps(x, b, 8));
+		__m256d by = _mm256_cvtps_pd(_mm_i32gather_ps(y, b, 8));
+		__m256d dx = _mm256_sub_pd(ax, bx);
+		__m256d dy = _mm256_sub_pd(ay, by);
+		__m256d d2 = _mm256_add_pd(_mm256_mul_pd(dx, dx),
+					   _mm256_mul_pd(dy, dy));
+		__m256d d = _mm256_floor_pd(_mm256_add_pd(_mm256_sqrt_pd(d2),
+							  half));
+		sum = _mm256_add_pd(sum, d);
+	}
+
+	double lanes[4];
+	_mm256_storeu_pd(lanes, sum);
+	double length = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	for (; i < n_edges; i++) {
+		length += edge_length(pts, index[i], index[i + 1]);
+	}
+	return length;
+}
+
+__attribute__((target("avx2")))
+static double path_length_soa_avx2(const float *x, const float *y,
+				   const uint32_t *index, uint32_t n_edges)
+{
+	/* Eight edges per step, one gather per coordinate and endpoint,
+	 * the distances are taken in double four lanes at a time */
+	const __m256d half = _mm256_set1_pd(0.5);
+	__m256d sum = _mm256_setzero_pd();
+	uint32_t i;
+	for (i = 0; i + 8 <= n_edges; i += 8) {
+		__m256i a = _mm256_loadu_si256((const __m256i*) &(index[i]));
+		__m256i b = _mm256_loadu_si256((const __m256i*) &(index[i + 1]));
+		__m256 ax8 = _mm256_i32gather_ps(x, a, 4);
+		__m256 ay8 = _mm256_i32gather_ps(y, a, 4);
+		__m256 bx8 = _mm256_i32gather_ps(x, b, 4);
+		__m256 by8 = _mm256_i32gather_ps(y, b, 4);
+		int h;
+		for (h = 0; h < 2; h++) {
+			__m128 ax4 = h ? _mm256_extractf128_ps(ax8, 1) :
+				_mm256_castps256_ps128(ax8);
+			__m128 ay4 = h ? _mm256_extractf128_ps(ay8, 1) :
+				_mm256_castps256_ps128(ay8);
+			__m128 bx4 = h ? _mm256_extractf128_ps(bx8, 1) :
+				_mm256_castps256_ps128(bx8);
+			__m128 by4 = h ? _mm256_extractf128_ps(by8, 1) :
+				_mm256_castps256_ps128(by8);
+			__m256d dx = _mm256_sub_pd(_mm256_cvtps_pd(ax4),
+						   _mm256_cvtps_pd(bx4));
+			__m256d dy = _mm256_sub_pd(_mm256_cvtps_pd(ay4),
+						   _mm256_cvtps_pd(by4));
+			__m256d d2 = _mm256_add_pd(_mm256_mul_pd(dx, dx),
+						   _mm256_mul_pd(dy, dy));
+			__m256d d = _mm256_floor_pd(
+				_mm256_add_pd(_mm256_sqrt_pd(d2), half));
+			sum = _mm256_add_pd(sum, d);
+		}
+	}
+
+	double lanes[4];
+	_mm256_storeu_pd(lanes, sum);
+	double length = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	for (; i < n_edges; i++) {
+		length += edge_length_soa(x, y, index[i], index[i + 1]);
+	}
+	return length;
+}
+#endif
@@ -0,0 +1,84 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "vtsp_tracer.h"
+#include "try_macros.h"
+
+static double now_us(void);
+static int write_separator(vtsp_tracer_t *tracer);
+
+int vtsp_tracer_init(vtsp_tracer_t *tracer, FILE *fp)
+{
+	tracer->fp = fp;
+	tracer->origin_us = now_us();
+	tracer->first = true;
+	TRY_NONEG( fprintf(fp, "[\n"), ERROR );
+	return SUCCESS;
+ERROR:
+	return ERROR;
+}
+
+int vtsp_tracer_finish(vtsp_tracer_t *tracer)
+{
+	TRY_NONEG( fprintf(tracer->fp, "\n]\n"), ERROR );
+	TRY_GOTO( fflush(tracer->fp), ERROR );
+	return SUCCESS;
+ERROR:
+	return ERROR;
+}
+
+int vtsp_bind_tracer(vtsp_binding_tracer_t *binding, vtsp_tracer_t *tracer)
+{
+	binding->ctx = tracer;
+	binding->begin = vtsp_tracer_begin;
+	binding->end = vtsp_tracer_end;
+	return SUCCESS;
+}
+
+int vtsp_tracer_begin(void *ctx, const char *span)
+{
+	/* Span names are plain identifiers, no JSON escaping needed */
+	vtsp_tracer_t *tracer = ctx;
+	TRY( write_separator(tracer) );
+	TRY_NONEG( fprintf(tracer->fp, "{\"name\":\"%s\",\"cat\":\"vtsp\","
+			   "\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":1}",
+			   span, now_us() - tracer->origin_us), ERROR );
+	return SUCCESS;
+ERROR:
+	return ERROR;
+}
+
+int vtsp_tracer_end(void *ctx, const char *span, uint32_t n_items)
+{
+	vtsp_tracer_t *tracer = ctx;
+	double ts = now_us() - tracer->origin_us;
+	TRY( write_separator(tracer) );
+	TRY_NONEG( fprintf(tracer->fp, "{\"name\":\"%s\",\"cat\":\"vtsp\","
+			   "\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":1,"
+			   "\"args\":{\"items\":%u}}",
+			   span, ts, n_items), ERROR );
+	return SUCCESS;
+ERROR:
+	return ERROR;
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+static int write_separator(vtsp_tracer_t *tracer)
+{
+	if (!tracer->first) {
+		TRY_NONEG( fprintf(tracer->fp, ",\n"), ERROR );
+	}
+	tracer->first = false;
+	return SUCCESS;
+ERROR:
+	return ERROR;
+}
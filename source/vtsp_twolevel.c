@@ -0,0 +1,468 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "vtsp_twolevel.h"
+#include "try_macros.h"
+
+#define NONE UINT32_MAX
+#define MIN_GROUP 8
+#define MAX_GROUP_FACTOR 2     /* Split segments larger than this */
+#define MIN_GROUP_DIVISOR 4    /* Merge segments smaller than this */
+#define SEGS_FACTOR 4          /* Room for segments after splits */
+#define MAX_ID (1 << 30)
+
+static uint32_t group_size(uint32_t n);
+static uint32_t offset_in_seg(const vtsp_twolevel_t *tl, uint32_t a);
+static void reverse_inside(vtsp_twolevel_t *tl, uint32_t a, uint32_t b);
+static void reverse_segs(vtsp_twolevel_t *tl, uint32_t first, uint32_t last,
+			 uint32_t n_run);
+static void split_before(vtsp_twolevel_t *tl, uint32_t a);
+static void split_after(vtsp_twolevel_t *tl, uint32_t a, uint32_t avoid);
+static void move_head_to_prev(vtsp_twolevel_t *tl, uint32_t s, uint32_t count);
+static void move_tail_to_next(vtsp_twolevel_t *tl, uint32_t s, uint32_t count);
+static uint32_t pop_head(vtsp_twolevel_t *tl, uint32_t s);
+static uint32_t pop_tail(vtsp_twolevel_t *tl, uint32_t s);
+static void push_head(vtsp_twolevel_t *tl, uint32_t s, uint32_t x);
+static void push_tail(vtsp_twolevel_t *tl, uint32_t s, uint32_t x);
+static void touch(vtsp_twolevel_t *tl, uint32_t s);
+static void rebalance(vtsp_twolevel_t *tl);
+static void split_seg(vtsp_twolevel_t *tl, uint32_t s);
+static void merge_seg(vtsp_twolevel_t *tl, uint32_t s);
+static void check_ids(vtsp_twolevel_t *tl, uint32_t s);
+static void renumber(vtsp_twolevel_t *tl, uint32_t s);
+static void rank_from(vtsp_twolevel_t *tl, uint32_t s);
+
+void vtsp_tl_take(vtsp_twolevel_t *tl, uint32_t n, vtsp_opmem_t *mem)
+{
+	uint32_t group = group_size(n);
+	tl->n = n;
+	tl->group = group;
+	tl->n_segs = (n + group - 1) / group;
+	tl->cap_segs = SEGS_FACTOR * tl->n_segs + 1;
+	uint32_t n_scratch = n > tl->cap_segs ? n : tl->cap_segs;
+	tl->nodes = vtsp_opmem_take(mem, n * sizeof(*(tl->nodes)));
+	tl->segs = vtsp_opmem_take(mem, tl->cap_segs * sizeof(*(tl->segs)));
+	tl->free_segs = vtsp_opmem_take(mem, tl->cap_segs *
+					sizeof(*(tl->free_segs)));
+	tl->scratch = vtsp_opmem_take(mem, n_scratch * sizeof(*(tl->scratch)));
+}
+
+void vtsp_tl_init(vtsp_twolevel_t *tl, const uint32_t *order)
+{
+	uint32_t s;
+	tl->n_segs = (tl->n + tl->group - 1) / tl->group;
+	for (s = 0; s < tl->n_segs; s++) {
+		vtsp_tl_seg_t *seg = &(tl->segs[s]);
+		uint32_t begin = s * tl->group;
+		uint32_t end = begin + tl->group < tl->n ? begin + tl->group : tl->n;
+		seg->first = order[begin];
+		seg->last = order[end - 1];
+		seg->next = s + 1 == tl->n_segs ? 0 : s + 1;
+		seg->prev = s == 0 ? tl->n_segs - 1 : s - 1;
+		seg->rank = s;
+		seg->size = end - begin;
+		seg->reversed = 0;
+
+		uint32_t i;
+		for (i = begin; i < end; i++) {
+			vtsp_tl_node_t *node = &(tl->nodes[order[i]]);
+			node->next = i + 1 < end ? order[i + 1] : NONE;
+			node->prev = i > begin ? order[i - 1] : NONE;
+			node->id = (int32_t) (i - begin);
+			node->seg = s;
+		}
+	}
+	tl->n_free = 0;
+	for (s = tl->cap_segs; s > tl->n_segs; s--) {
+		tl->segs[s - 1].size = 0;
+		tl->free_segs[tl->n_free++] = s - 1;
+	}
+	tl->n_touched = 0;
+}
+
+int vtsp_tl_write(const vtsp_twolevel_t *tl, uint32_t first,
+		  vtsp_perm_t *perm)
+{
+	THROW( perm->n_alloc < tl->n, ERROR );
+	uint32_t p = first;
+	uint32_t i;
+	for (i = 0; i < tl->n; i++) {
+		perm->index[i] = p;
+		p = vtsp_tl_next(tl, p);
+	}
+	THROW( p != first, ERROR );
+	perm->num = tl->n;
+	return SUCCESS;
+}
+
+void vtsp_tl_reverse(vtsp_twolevel_t *tl, uint32_t a, uint32_t b)
+{
+	if (a == b) {
+		return;
+	}
+	if (tl->nodes[a].seg == tl->nodes[b].seg) {
+		if (vtsp_tl_key(tl, a) <= vtsp_tl_key(tl, b)) {
+			reverse_inside(tl, a, b);
+			return;
+		}
+		/* The path goes around the tour, reverse the rest */
+		uint32_t c = vtsp_tl_next(tl, b);
+		if (c != a) {
+			reverse_inside(tl, c, vtsp_tl_prev(tl, a));
+		}
+		return;
+	}
+
+	/* Make the path a run of whole segments */
+	tl->n_touched = 0;
+	split_before(tl, a);
+	if (tl->nodes[a].seg == tl->nodes[b].seg) {
+		reverse_inside(tl, a, b);
+	} else {
+		split_after(tl, b, tl->nodes[a].seg);
+		uint32_t first = tl->nodes[a].seg;
+		uint32_t last = tl->nodes[b].seg;
+		/* Ranks are positions, modulo n_segs */
+		uint32_t n_run = tl->segs[last].rank + tl->n_segs -
+			tl->segs[first].rank;
+		n_run = n_run % tl->n_segs + 1;
+		if (2 * n_run <= tl->n_segs) {
+			reverse_segs(tl, first, last, n_run);
+		} else if (n_run < tl->n_segs) {
+			reverse_segs(tl, tl->segs[last].next, tl->segs[first].prev,
+				     tl->n_segs - n_run);
+		}
+	}
+	rebalance(tl);
+}
+
+static uint32_t group_size(uint32_t n)
+{
+	uint32_t group = (uint32_t) ceil(sqrt((double) n));
+	return group < MIN_GROUP ? MIN_GROUP : group;
+}
+
+static uint32_t offset_in_seg(const vtsp_twolevel_t *tl, uint32_t a)
+{
+	/* Position of a from the head of its segment */
+	const vtsp_tl_seg_t *seg = &(tl->segs[tl->nodes[a].seg]);
+	if (seg->reversed) {
+		return (uint32_t) (tl->nodes[seg->last].id - tl->nodes[a].id);
+	}
+	return (uint32_t) (tl->nodes[a].id - tl->nodes[seg->first].id);
+}
+
+static void reverse_inside(vtsp_twolevel_t *tl, uint32_t a, uint32_t b)
+{
+	/* a comes before b inside one segment, x..y in stored order */
+	vtsp_tl_seg_t *seg = &(tl->segs[tl->nodes[a].seg]);
+	uint32_t x = seg->reversed ? b : a;
+	uint32_t y = seg->reversed ? a : b;
+	uint32_t before = x == seg->first ? NONE : tl->nodes[x].prev;
+	uint32_t after = y == seg->last ? NONE : tl->nodes[y].next;
+	int32_t id = tl->nodes[x].id;
+
+	uint32_t *list = tl->scratch;
+	uint32_t len = 0;
+	uint32_t p;
+	for (p = x; p != after; p = tl->nodes[p].next) {
+		list[len++] = p;
+	}
+	uint32_t i;
+	for (i = 0; i < len; i++) {
+		vtsp_tl_node_t *node = &(tl->nodes[list[len - 1 - i]]);
+		node->id = id + (int32_t) i;
+		node->prev = i == 0 ? before : list[len - i];
+		node->next = i + 1 == len ? after : list[len - 2 - i];
+	}
+	if (before == NONE) {
+		seg->first = list[len - 1];
+	} else {
+		tl->nodes[before].next = list[len - 1];
+	}
+	if (after == NONE) {
+		seg->last = list[0];
+	} else {
+		tl->nodes[after].prev = list[0];
+	}
+}
+
+static void reverse_segs(vtsp_twolevel_t *tl, uint32_t first, uint32_t last,
+			 uint32_t n_run)
+{
+	/* Segments take the ranks of the positions they move to */
+	uint32_t *run = tl->scratch;
+	uint32_t *rank = &(tl->scratch[n_run]);
+	uint32_t i;
+	uint32_t s = first;
+	for (i = 0; i < n_run; i++) {
+		run[i] = s;
+		rank[i] = tl->segs[s].rank;
+		s = tl->segs[s].next;
+	}
+	uint32_t before = tl->segs[first].prev;
+	uint32_t after = tl->segs[last].next;
+	for (i = 0; i < n_run; i++) {
+		vtsp_tl_seg_t *seg = &(tl->segs[run[n_run - 1 - i]]);
+		seg->rank = rank[i];
+		seg->reversed ^= 1;
+		seg->prev = i == 0 ? before : run[n_run - i];
+		seg->next = i + 1 == n_run ? after : run[n_run - 2 - i];
+	}
+	tl->segs[before].next = last;
+	tl->segs[after].prev = first;
+}
+
+static void split_before(vtsp_twolevel_t *tl, uint32_t a)
+{
+	/* Make a the head of a segment, moving the shorter part */
+	uint32_t s = tl->nodes[a].seg;
+	uint32_t offset = offset_in_seg(tl, a);
+	if (offset == 0) {
+		return;
+	}
+	if (offset <= tl->segs[s].size - offset) {
+		move_head_to_prev(tl, s, offset);
+	} else {
+		move_tail_to_next(tl, s, tl->segs[s].size - offset);
+	}
+}
+
+static void split_after(vtsp_twolevel_t *tl, uint32_t a, uint32_t avoid)
+{
+	/* Make a the tail of a segment, the head of avoid stays */
+	uint32_t s = tl->nodes[a].seg;
+	uint32_t n_upto = offset_in_seg(tl, a) + 1;
+	uint32_t n_after = tl->segs[s].size - n_upto;
+	if (n_after == 0) {
+		return;
+	}
+	if (n_after <= n_upto && tl->segs[s].next != avoid) {
+		move_tail_to_next(tl, s, n_after);
+	} else {
+		move_head_to_prev(tl, s, n_upto);
+	}
+}
+
+static void move_head_to_prev(vtsp_twolevel_t *tl, uint32_t s, uint32_t count)
+{
+	uint32_t t = tl->segs[s].prev;
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		push_tail(tl, t, pop_head(tl, s));
+	}
+	check_ids(tl, t);
+	touch(tl, s);
+	touch(tl, t);
+}
+
+static void move_tail_to_next(vtsp_twolevel_t *tl, uint32_t s, uint32_t count)
+{
+	uint32_t t = tl->segs[s].next;
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		push_head(tl, t, pop_tail(tl, s));
+	}
+	check_ids(tl, t);
+	touch(tl, s);
+	touch(tl, t);
+}
+
+static uint32_t pop_head(vtsp_twolevel_t *tl, uint32_t s)
+{
+	vtsp_tl_seg_t *seg = &(tl->segs[s]);
+	uint32_t x = vtsp_tl_head(seg);
+	seg->size -= 1;
+	if (seg->size == 0) {
+		seg->first = NONE;
+		seg->last = NONE;
+	} else if (seg->reversed) {
+		seg->last = tl->nodes[x].prev;
+		tl->nodes[seg->last].next = NONE;
+	} else {
+		seg->first = tl->nodes[x].next;
+		tl->nodes[seg->first].prev = NONE;
+	}
+	return x;
+}
+
+static uint32_t pop_tail(vtsp_twolevel_t *tl, uint32_t s)
+{
+	vtsp_tl_seg_t *seg = &(tl->segs[s]);
+	uint32_t x = vtsp_tl_tail(seg);
+	seg->size -= 1;
+	if (seg->size == 0) {
+		seg->first = NONE;
+		seg->last = NONE;
+	} else if (seg->reversed) {
+		seg->first = tl->nodes[x].next;
+		tl->nodes[seg->first].prev = NONE;
+	} else {
+		seg->last = tl->nodes[x].prev;
+		tl->nodes[seg->last].next = NONE;
+	}
+	return x;
+}
+
+static void push_head(vtsp_twolevel_t *tl, uint32_t s, uint32_t x)
+{
+	/* Before the head in tour order */
+	vtsp_tl_seg_t *seg = &(tl->segs[s]);
+	vtsp_tl_node_t *node = &(tl->nodes[x]);
+	node->seg = s;
+	if (seg->size == 0) {
+		node->next = NONE;
+		node->prev = NONE;
+		node->id = 0;
+		seg->first = x;
+		seg->last = x;
+	} else if (seg->reversed) {
+		tl->nodes[seg->last].next = x;
+		node->prev = seg->last;
+		node->next = NONE;
+		node->id = tl->nodes[seg->last].id + 1;
+		seg->last = x;
+	} else {
+		tl->nodes[seg->first].prev = x;
+		node->next = seg->first;
+		node->prev = NONE;
+		node->id = tl->nodes[seg->first].id - 1;
+		seg->first = x;
+	}
+	seg->size += 1;
+}
+
+static void push_tail(vtsp_twolevel_t *tl, uint32_t s, uint32_t x)
+{
+	/* After the tail in tour order */
+	vtsp_tl_seg_t *seg = &(tl->segs[s]);
+	vtsp_tl_node_t *node = &(tl->nodes[x]);
+	node->seg = s;
+	if (seg->size == 0) {
+		node->next = NONE;
+		node->prev = NONE;
+		node->id = 0;
+		seg->first = x;
+		seg->last = x;
+	} else if (seg->reversed) {
+		tl->nodes[seg->first].prev = x;
+		node->next = seg->first;
+		node->prev = NONE;
+		node->id = tl->nodes[seg->first].id - 1;
+		seg->first = x;
+	} else {
+		tl->nodes[seg->last].next = x;
+		node->prev = seg->last;
+		node->next = NONE;
+		node->id = tl->nodes[seg->last].id + 1;
+		seg->last = x;
+	}
+	seg->size += 1;
+}
+
+static void touch(vtsp_twolevel_t *tl, uint32_t s)
+{
+	if (tl->n_touched < VTSP_TL_MAX_TOUCHED) {
+		tl->touched[tl->n_touched++] = s;
+	}
+}
+
+static void rebalance(vtsp_twolevel_t *tl)
+{
+	/* Only segments resized by the last reversal, once it is done */
+	uint32_t i;
+	for (i = 0; i < tl->n_touched; i++) {
+		uint32_t s = tl->touched[i];
+		uint32_t size = tl->segs[s].size;
+		if (size > MAX_GROUP_FACTOR * tl->group) {
+			split_seg(tl, s);
+		} else if (size > 0 && size < tl->group / MIN_GROUP_DIVISOR) {
+			merge_seg(tl, s);
+		}
+	}
+	tl->n_touched = 0;
+}
+
+static void split_seg(vtsp_twolevel_t *tl, uint32_t s)
+{
+	/* The tail half goes to a free segment after s */
+	if (tl->n_free == 0) {
+		return;
+	}
+	uint32_t t = tl->free_segs[--(tl->n_free)];
+	vtsp_tl_seg_t *seg = &(tl->segs[s]);
+	vtsp_tl_seg_t *dst = &(tl->segs[t]);
+	dst->size = 0;
+	dst->reversed = 0;
+	dst->prev = s;
+	dst->next = seg->next;
+	tl->segs[seg->next].prev = t;
+	seg->next = t;
+	tl->n_segs += 1;
+
+	uint32_t count = seg->size / 2;
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		push_head(tl, t, pop_tail(tl, s));
+	}
+	rank_from(tl, s);
+}
+
+static void merge_seg(vtsp_twolevel_t *tl, uint32_t s)
+{
+	/* Every point goes to the smaller neighbor, s is freed */
+	if (tl->n_segs == 1) {
+		return;
+	}
+	vtsp_tl_seg_t *seg = &(tl->segs[s]);
+	uint32_t prev = seg->prev;
+	uint32_t next = seg->next;
+	uint32_t t;
+	if (tl->segs[prev].size <= tl->segs[next].size) {
+		t = prev;
+		while (seg->size > 0) {
+			push_tail(tl, t, pop_head(tl, s));
+		}
+	} else {
+		t = next;
+		while (seg->size > 0) {
+			push_head(tl, t, pop_tail(tl, s));
+		}
+	}
+	check_ids(tl, t);
+	tl->segs[prev].next = next;
+	tl->segs[next].prev = prev;
+	tl->free_segs[tl->n_free++] = s;
+	tl->n_segs -= 1;
+	rank_from(tl, prev);
+	if (tl->segs[t].size > MAX_GROUP_FACTOR * tl->group) {
+		split_seg(tl, t);
+	}
+}
+
+static void check_ids(vtsp_twolevel_t *tl, uint32_t s)
+{
+	const vtsp_tl_seg_t *seg = &(tl->segs[s]);
+	if (tl->nodes[seg->first].id < -MAX_ID ||
+	    tl->nodes[seg->last].id > MAX_ID) {
+		renumber(tl, s);
+	}
+}
+
+static void renumber(vtsp_twolevel_t *tl, uint32_t s)
+{
+	int32_t id = 0;
+	uint32_t p;
+	for (p = tl->segs[s].first; p != NONE; p = tl->nodes[p].next) {
+		tl->nodes[p].id = id++;
+	}
+}
+
+static void rank_from(vtsp_twolevel_t *tl, uint32_t s)
+{
+	uint32_t i;
+	for (i = 0; i < tl->n_segs; i++) {
+		tl->segs[s].rank = i;
+		s = tl->segs[s].next;
+	}
+}
@@ -0,0 +1,108 @@
+#ifndef __VTSP_TWOLEVEL_H__
+#define __VTSP_TWOLEVEL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vtsp_types.h"
+#include "vtsp_opmem.h"
+
+/*
+ * Tour as a two-level doubly-linked list.
+ * Points are grouped in about sqrt(n) segments of consecutive points,
+ * each one with a reversed bit. next, prev and between are O(1),
+ * reversing a path costs O(sqrt(n)). Segments that grow or shrink
+ * too much are split or merged after each reversal.
+ */
+typedef struct {
+	uint32_t next, prev;   /* Inside the segment, in stored order */
+	int32_t id;            /* Consecutive, increases along next */
+	uint32_t seg;
+} vtsp_tl_node_t;
+
+typedef struct {
+	uint32_t first, last;  /* Stored order */
+	uint32_t next, prev;   /* Neighbor segments in tour order */
+	uint32_t rank;         /* Position, from some segment along next */
+	uint32_t size;         /* Zero if the segment is free */
+	uint32_t reversed;
+} vtsp_tl_seg_t;
+
+#define VTSP_TL_MAX_TOUCHED 4
+
+typedef struct {
+	uint32_t n;
+	uint32_t group;        /* Initial segment size */
+	uint32_t n_segs;
+	uint32_t cap_segs;
+	vtsp_tl_node_t *nodes;
+	vtsp_tl_seg_t *segs;
+	uint32_t *free_segs;
+	uint32_t n_free;
+	uint32_t touched[VTSP_TL_MAX_TOUCHED];  /* Resized by a reversal */
+	uint32_t n_touched;
+	uint32_t *scratch;
+} vtsp_twolevel_t;
+
+void vtsp_tl_take(vtsp_twolevel_t *tl, uint32_t n, vtsp_opmem_t *mem);
+/* order holds the n points in tour order */
+void vtsp_tl_init(vtsp_twolevel_t *tl, const uint32_t *order);
+/* Tour starting at first, perm must allocate n indices */
+int vtsp_tl_write(const vtsp_twolevel_t *tl, uint32_t first,
+		  vtsp_perm_t *perm);
+/* Reverse the path from a to b in tour order */
+void vtsp_tl_reverse(vtsp_twolevel_t *tl, uint32_t a, uint32_t b);
+
+static inline uint32_t vtsp_tl_head(const vtsp_tl_seg_t *seg)
+{
+	return seg->reversed ? seg->last : seg->first;
+}
+
+static inline uint32_t vtsp_tl_tail(const vtsp_tl_seg_t *seg)
+{
+	return seg->reversed ? seg->first : seg->last;
+}
+
+static inline uint32_t vtsp_tl_next(const vtsp_twolevel_t *tl, uint32_t a)
+{
+	const vtsp_tl_node_t *node = &(tl->nodes[a]);
+	const vtsp_tl_seg_t *seg = &(tl->segs[node->seg]);
+	if (a == vtsp_tl_tail(seg)) {
+		return vtsp_tl_head(&(tl->segs[seg->next]));
+	}
+	return seg->reversed ? node->prev : node->next;
+}
+
+static inline uint32_t vtsp_tl_prev(const vtsp_twolevel_t *tl, uint32_t a)
+{
+	const vtsp_tl_node_t *node = &(tl->nodes[a]);
+	const vtsp_tl_seg_t *seg = &(tl->segs[node->seg]);
+	if (a == vtsp_tl_head(seg)) {
+		return vtsp_tl_tail(&(tl->segs[seg->prev]));
+	}
+	return seg->reversed ? node->next : node->prev;
+}
+
+/* Position of a along the tour, starting at some segment head */
+static inline int64_t vtsp_tl_key(const vtsp_twolevel_t *tl, uint32_t a)
+{
+	const vtsp_tl_node_t *node = &(tl->nodes[a]);
+	const vtsp_tl_seg_t *seg = &(tl->segs[node->seg]);
+	int64_t offset = seg->reversed ? -(int64_t) node->id : node->id;
+	return ((int64_t) seg->rank << 32) + offset;
+}
+
+/* True if b is on the path from a to c in tour order */
+static inline bool vtsp_tl_between(const vtsp_twolevel_t *tl, uint32_t a,
+				   uint32_t b, uint32_t c)
+{
+	int64_t ka = vtsp_tl_key(tl, a);
+	int64_t kb = vtsp_tl_key(tl, b);
+	int64_t kc = vtsp_tl_key(tl, c);
+	if (ka <= kc) {
+		return ka <= kb && kb <= kc;
+	}
+	return kb >= ka || kb <= kc;
+}
+
+#endif
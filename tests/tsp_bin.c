@@ -0,0 +1,194 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "try_macros.h"
+#include "tsp_bin.h"
+#include "tsp_io.h"
+
+#define VTSP_BIN_MAGIC "VTSPBIN"
+#define VTSP_BIN_BYTE_ORDER 0x01020304u
+
+static int map_file(const char *input_filename, uint32_t kind,
+		    uint32_t elem_size, vtsp_bin_map_t *map,
+		    const vtsp_bin_header_t **header);
+static int validate_header(const vtsp_bin_header_t *header, size_t file_size,
+			   uint32_t kind, uint32_t elem_size);
+static int write_file(const char *output_filename, uint32_t kind,
+		      uint32_t num, const void *data, uint32_t elem_size);
+static int log_flush(FILE* fp, const char *msg);
+
+int vtsp_bin_map_problem(const char *input_filename, vtsp_points_t *output,
+			 vtsp_bin_map_t *map)
+{
+	const vtsp_bin_header_t *header;
+	TRY( map_file(input_filename, VTSP_BIN_PROBLEM,
+		      sizeof(*(output->pts)), map, &header) );
+	output->num = header->num;
+	output->n_alloc = header->num;
+	output->pts = (vtsp_point_t*) ((char*) map->data + header->data_offset);
+	return SUCCESS;
+}
+
+int vtsp_bin_map_tour(const char *input_filename, vtsp_perm_t *output,
+		      vtsp_bin_map_t *map)
+{
+	const vtsp_bin_header_t *header;
+	TRY( map_file(input_filename, VTSP_BIN_TOUR,
+		      sizeof(*(output->index)), map, &header) );
+	output->num = header->num;
+	output->n_alloc = header->num;
+	output->index = (uint32_t*) ((char*) map->data + header->data_offset);
+	return SUCCESS;
+}
+
+int vtsp_bin_unmap(vtsp_bin_map_t *map)
+{
+	TRY( munmap(map->data, map->size) );
+	map->data = NULL;
+	map->size = 0;
+	return SUCCESS;
+}
+
+int vtsp_bin_write_problem(const vtsp_points_t *input,
+			   const char *output_filename)
+{
+	return write_file(output_filename, VTSP_BIN_PROBLEM, input->num,
+			  input->pts, sizeof(*(input->pts)));
+}
+
+int vtsp_bin_write_tour(const vtsp_perm_t *input, const char *output_filename)
+{
+	return write_file(output_filename, VTSP_BIN_TOUR, input->num,
+			  input->index, sizeof(*(input->index)));
+}
+
+int vtsp_bin_convert_problem(const char *input_filename,
+			     const char *output_filename)
+{
+	vtsp_points_t input;
+	TRY( vtsp_load_problem(input_filename, &input) );
+
+	int status = vtsp_bin_write_problem(&input, output_filename);
+
+	free(input.pts);
+	return status;
+}
+
+int vtsp_bin_convert_tour(const char *input_filename,
+			  const char *output_filename)
+{
+	/* DIMENSION is optional in tours, but every node takes at
+	 * least a digit and a separator */
+	struct stat st;
+	THROW( stat(input_filename, &st) != 0, ERROR );
+
+	vtsp_perm_t input;
+	input.n_alloc = st.st_size / 2 + 1;
+	TRY_PTR( malloc(input.n_alloc * sizeof(*(input.index))), input.index,
+		 ERROR_MALLOC );
+	TRY_GOTO( vtsp_read_tour(input_filename, &input), ERROR );
+	TRY_GOTO( vtsp_bin_write_tour(&input, output_filename), ERROR );
+
+	free(input.index);
+	return SUCCESS;
+ERROR:
+	free(input.index);
+ERROR_MALLOC:
+	return ERROR;
+}
+
+static int map_file(const char *input_filename, uint32_t kind,
+		    uint32_t elem_size, vtsp_bin_map_t *map,
+		    const vtsp_bin_header_t **header)
+{
+	int fd = open(input_filename, O_RDONLY);
+	THROW( fd < 0, ERROR );
+
+	struct stat st;
+	TRY_GOTO( fstat(fd, &st), ERROR_MAP );
+	if (st.st_size < sizeof(vtsp_bin_header_t)) {
+		goto ERROR_MAP;
+	}
+	map->size = st.st_size;
+	map->data = mmap(NULL, map->size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+			 fd, 0);
+	if (map->data == MAP_FAILED) {
+		goto ERROR_MAP;
+	}
+	close(fd);
+
+	*header = map->data;
+	TRY_GOTO( validate_header(*header, map->size, kind, elem_size),
+		  ERROR_HEADER );
+	return SUCCESS;
+ERROR_HEADER:
+	munmap(map->data, map->size);
+	TRY( log_flush(stderr, "Error in binary header") );
+	return ERROR;
+ERROR_MAP:
+	close(fd);
+	TRY( log_flush(stderr, "Error mapping file") );
+	return ERROR;
+}
+
+static int validate_header(const vtsp_bin_header_t *header, size_t file_size,
+			   uint32_t kind, uint32_t elem_size)
+{
+	THROW( memcmp(header->magic, VTSP_BIN_MAGIC, sizeof(header->magic)),
+	       ERROR );
+	THROW( header->byte_order != VTSP_BIN_BYTE_ORDER, ERROR );
+	THROW( header->version != VTSP_BIN_VERSION, ERROR );
+	THROW( header->kind != kind, ERROR );
+	THROW( header->data_offset % VTSP_BIN_ALIGN != 0, ERROR );
+	THROW( header->data_size != (uint64_t) header->num * elem_size, ERROR );
+	THROW( header->data_offset > file_size, ERROR );
+	THROW( header->data_size > file_size - header->data_offset, ERROR );
+	return SUCCESS;
+}
+
+static int write_file(const char *output_filename, uint32_t kind,
+		      uint32_t num, const void *data, uint32_t elem_size)
+{
+	vtsp_bin_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, VTSP_BIN_MAGIC, sizeof(header.magic));
+	header.version = VTSP_BIN_VERSION;
+	header.kind = kind;
+	header.byte_order = VTSP_BIN_BYTE_ORDER;
+	header.num = num;
+	header.data_offset = sizeof(header); /* Exactly VTSP_BIN_ALIGN */
+	header.data_size = (uint64_t) num * elem_size;
+
+	FILE *fp;
+	TRY_PTR( fopen(output_filename, "wb"), fp, ERROR_OPEN );
+	TRY_GOTO( fwrite(&header, sizeof(header), 1, fp) != 1, ERROR_WRITE );
+	if (num > 0) {
+		TRY_GOTO( fwrite(data, elem_size, num, fp) != num, ERROR_WRITE );
+	}
+	TRY_GOTO( fclose(fp), ERROR_CLOSE );
+	return SUCCESS;
+ERROR_WRITE:
+	fclose(fp);
+ERROR_CLOSE:
+	TRY( log_flush(stderr, "Error writing binary file") );
+	return ERROR;
+ERROR_OPEN:
+	TRY( log_flush(stderr, "Error opening file") );
+	return ERROR;
+}
+
+static int log_flush(FILE* fp, const char *msg)
+{
+	TRY_NONEG( fprintf(fp, "%s\n", msg), ERROR );
+	TRY_GOTO( fflush(fp), ERROR );
+	return SUCCESS;
+ERROR:
+	return ERROR;
+}
@@ -0,0 +1,62 @@
+#ifndef __TSP_BIN_H__
+#define __TSP_BIN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vtsp.h"
+
+#define VTSP_BIN_EXT ".vbin"
+#define VTSP_BIN_VERSION 1
+#define VTSP_BIN_ALIGN 64
+
+enum {
+	VTSP_BIN_PROBLEM = 1,  /* Data is vtsp_point_t[num] */
+	VTSP_BIN_TOUR = 2      /* Data is uint32_t[num], 0-based */
+};
+
+/*
+ * Binary container for problems and tours.
+ * The header takes the first VTSP_BIN_ALIGN bytes and the data
+ * section has the in-memory layout of vtsp_points_t.pts or
+ * vtsp_perm_t.index, so the reader maps it without copying.
+ * Files are host-endian, byte_order tells when they are not.
+ */
+typedef struct {
+	char magic[8];          /* "VTSPBIN" */
+	uint32_t version;
+	uint32_t kind;
+	uint32_t byte_order;    /* VTSP_BIN_BYTE_ORDER as written */
+	uint32_t num;
+	uint64_t data_offset;   /* Multiple of VTSP_BIN_ALIGN */
+	uint64_t data_size;
+	char reserved[24];
+} vtsp_bin_header_t;
+
+typedef struct {
+	void *data;
+	size_t size;
+} vtsp_bin_map_t;
+
+/*
+ * Map a binary file, output points into the mapping until
+ * vtsp_bin_unmap(). Pages are copy-on-write, writes through
+ * output stay private.
+ */
+int vtsp_bin_map_problem(const char *input_filename, vtsp_points_t *output,
+			 vtsp_bin_map_t *map);
+int vtsp_bin_map_tour(const char *input_filename, vtsp_perm_t *output,
+		      vtsp_bin_map_t *map);
+int vtsp_bin_unmap(vtsp_bin_map_t *map);
+
+int vtsp_bin_write_problem(const vtsp_points_t *input,
+			   const char *output_filename);
+int vtsp_bin_write_tour(const vtsp_perm_t *input, const char *output_filename);
+
+/* Migrate TSPLIB text files, validated by the text readers */
+int vtsp_bin_convert_problem(const char *input_filename,
+			     const char *output_filename);
+int vtsp_bin_convert_tour(const char *input_filename,
+			  const char *output_filename);
+
+#endif
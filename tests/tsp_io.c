@@ -1,8 +1,15 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "try_macros.h"
 #include "tsp_io.h"
@@ -27,21 +34,68 @@ typedef struct {
 
 line_t LINE_TYPES[] = {
 	{LINE_NAME, "NAME"},
-	{LINE_NAME, "TYPE"},
-	{LINE_NAME, "COMMENT"},
-	{LINE_NAME, "DIMENSION"},
-	{LINE_NAME, "EDGE_WEIGHT"},
-	{LINE_NAME, "NODE_COORD_SECTION"},
-	{LINE_NAME, "TOUR_SECTION"},
-	{LINE_NAME, "EOF"}
+	{LINE_TYPE, "TYPE"},
+	{LINE_COMMENT, "COMMENT"},
+	{LINE_DIMENSION, "DIMENSION"},
+	{LINE_EDGE_WEIGHT_TYPE, "EDGE_WEIGHT_TYPE"},
+	{LINE_NODE_COORD_SECTION, "NODE_COORD_SECTION"},
+	{LINE_TOUR_SECTION, "TOUR_SECTION"},
+	{LINE_EOF, "EOF"}
 };
 
+#define MAX_THREADS 64
+#define MIN_BYTES_PER_THREAD (1 << 20)
+
+typedef struct {
+	const char *data;
+	size_t size;
+} mapped_file_t;
+
+typedef struct {
+	const char *type;      /* Expected TYPE */
+	int section;           /* Line type opening the data section */
+	uint32_t dimension;    /* Zero if not given */
+	size_t data_offset;    /* First byte after the section line */
+} file_header_t;
 
-static int read_problem_npts(FILE *fp, uint32_t *output);
-static int read_problem(FILE *fp, vtsp_points_t *output);
-static int read_tour(FILE *fp, vtsp_perm_t *output);
+typedef struct {
+	const char *begin;      /* Lines starting in [begin, end) */
+	const char *end;
+	const char *file_end;   /* Last line may cross end */
+	vtsp_points_t *output;
+	uint64_t *bitmap;       /* Shared by all chunks */
+	uint32_t n_read;
+	bool stopped;           /* Found a line that is not a coordinate */
+	int status;
+} coords_chunk_t;
+
+
+static int map_file(const char *input_filename, mapped_file_t *output);
+static int unmap_file(mapped_file_t *input);
+static int read_mapped_problem(const mapped_file_t *file, bool allocate,
+			       uint32_t n_threads, vtsp_points_t *output);
+static int read_mapped_tour(const mapped_file_t *file, vtsp_perm_t *output);
+static int scan_header(const mapped_file_t *file, const char *type,
+		       int section, file_header_t *output);
+static int read_header_line(const char *line, uint32_t len,
+			    file_header_t *output, bool *section_start);
+static int scan_coords(const char *begin, const char *end,
+		       uint32_t n_threads, vtsp_points_t *output,
+		       uint64_t *bitmap);
+static uint32_t get_n_threads(uint32_t n_threads, size_t size);
+static const char *line_start(const char *p, const char *begin,
+			      const char *end);
+static void *scan_chunk_task(void *chunk);
+static int scan_chunk(coords_chunk_t *chunk);
+static int scan_tour(const char *begin, const char *end, uint32_t bound,
+		     vtsp_perm_t *output, uint64_t *bitmap);
+static const char *skip_spaces(const char *p, const char *end);
+static const char *skip_blanks(const char *p, const char *end);
+static const char *skip_line(const char *p, const char *end);
+static int scan_uint(const char **p, const char *end, uint32_t *output);
+static int scan_float(const char **p, const char *end, float *output);
+static int bitmap_test_and_set(uint64_t *bitmap, uint32_t i);
 static int write_tour(FILE *fp, const char *name, const vtsp_perm_t *input);
-static int get_line(FILE *fp, uint32_t max_len, char *line, uint32_t *len);
 static int get_line_type(const char* line, uint32_t len, int *type);
 static int get_string_of_line_type(int type, char *output, int max_len);
 static int split_str(char *line, uint32_t len, char sep,
@@ -50,77 +104,67 @@ static int split_str(char *line, uint32_t len, char sep,
 static int trim_ref(char *line, uint32_t len, char** ref, uint32_t *ref_len);
 static int is_blank(char c);
 static int parse_int(const char* input, int *output);
-static int parse_float(const char* input, float *output);
-static int read_coordinates(const char *line, uint32_t len, vtsp_points_t *output,
-			    int *pos);
-static int read_tour_point(const char *line, uint32_t len, vtsp_perm_t *output,
-			   int i, int *pos);
 static int copy_str(const char* input, int input_len, char *output, int max_len);
-static int read_problem_metadata(const char *line, uint32_t len,
-				 bool *reading_coords, vtsp_points_t *output);
-static int read_tour_metadata(const char *line, uint32_t len,
-			      bool *reading_tour, vtsp_perm_t *output);
 static int log_name(const char *name);
 static int validate_type(const char* type, const char *expected_type);
 static int log_comment(const char *comment);
-static int get_problem_dimension(const char *dim, vtsp_points_t *output);
-static int get_tour_dimension(const char *dim, vtsp_perm_t *output);
 static int log_ignored_line(const char *line);
 static int log_flush(FILE* fp, const char *msg);
 
 int vtsp_read_problem_npts(const char *input_filename, uint32_t *output)
 {
-	FILE *fp;
-	TRY_PTR( fopen(input_filename, "r"), fp, ERROR_OPEN );
+	mapped_file_t file;
+	TRY( map_file(input_filename, &file) );
 
-	int status = read_problem_npts(fp, output);
+	file_header_t header;
+	int status = scan_header(&file, "TSP", LINE_NODE_COORD_SECTION,
+				 &header);
 	
-	TRY_GOTO( fclose(fp), ERROR_CLOSE );
+	TRY( unmap_file(&file) );
+	THROW( status != SUCCESS, status );
+	THROW( header.dimension == 0, ERROR );
 
-	return status;
-ERROR_OPEN:
-	TRY( log_flush(stderr, "Error opening file") );
-	return ERROR;
-ERROR_CLOSE:
-	TRY( log_flush(stderr, "Error closing file") );
-	return ERROR;
+	*output = header.dimension;
+	return SUCCESS;
 }
 
 int vtsp_read_problem(const char *input_filename, vtsp_points_t *output)
 {
-	FILE *fp;
-	TRY_PTR( fopen(input_filename, "r"), fp, ERROR_OPEN );
+	mapped_file_t file;
+	TRY( map_file(input_filename, &file) );
 
-	int status = read_problem(fp, output);
+	int status = read_mapped_problem(&file, false, 0, output);
 	
-	TRY_GOTO( fclose(fp), ERROR_CLOSE );
-
+	TRY( unmap_file(&file) );
 	return status;
-ERROR_OPEN:
-	TRY( log_flush(stderr, "Error opening file") );
-	return ERROR;
-ERROR_CLOSE:
-	TRY( log_flush(stderr, "Error closing file") );
-	return ERROR;
 }
 
+int vtsp_load_problem(const char *input_filename, vtsp_points_t *output)
+{
+	return vtsp_load_problem_threads(input_filename, 0, output);
+}
 
-int vtsp_read_tour(const char *input_filename, vtsp_perm_t *output)
+int vtsp_load_problem_threads(const char *input_filename, uint32_t n_threads,
+			      vtsp_points_t *output)
 {
-	FILE *fp;
-	TRY_PTR( fopen(input_filename, "r"), fp, ERROR_OPEN );
+	mapped_file_t file;
+	TRY( map_file(input_filename, &file) );
 
-	int status = read_tour(fp, output);
+	int status = read_mapped_problem(&file, true, n_threads, output);
 	
-	TRY_GOTO( fclose(fp), ERROR_CLOSE );
+	TRY( unmap_file(&file) );
+	return status;
+}
+
+int vtsp_read_tour(const char *input_filename, vtsp_perm_t *output)
+{
+	mapped_file_t file;
+	TRY( map_file(input_filename, &file) );
 
+	int status = read_mapped_tour(&file, output);
+	
+	TRY( unmap_file(&file) );
 	return status;
-ERROR_OPEN:
-	TRY( log_flush(stderr, "Error opening file") );
-	return ERROR;
-ERROR_CLOSE:
-	TRY( log_flush(stderr, "Error closing file") );
-	return ERROR;
 }
 
 int vtsp_write_tour(const vtsp_perm_t *input, const char *output_filename)
@@ -141,93 +185,428 @@ ERROR_CLOSE:
 	return ERROR;
 }
 
-static int read_problem_npts(FILE *fp, uint32_t *output)
+
+static int map_file(const char *input_filename, mapped_file_t *output)
 {
-	char line[255];
-	uint32_t len;
-	int status;
+	int fd = open(input_filename, O_RDONLY);
+	THROW( fd < 0, ERROR );
+
+	struct stat st;
+	TRY_GOTO( fstat(fd, &st), ERROR_MAP );
+	output->size = st.st_size;
+	output->data = NULL;
+	if (output->size > 0) {
+		void *data = mmap(NULL, output->size, PROT_READ, MAP_PRIVATE,
+				  fd, 0);
+		if (data == MAP_FAILED) {
+			goto ERROR_MAP;
+		}
+		posix_madvise(data, output->size, POSIX_MADV_SEQUENTIAL);
+		output->data = data;
+	}
+
+	close(fd);
+	return SUCCESS;
+ERROR_MAP:
+	close(fd);
+	TRY( log_flush(stderr, "Error opening file") );
+	return ERROR;
+}
+
+static int unmap_file(mapped_file_t *input)
+{
+	if (input->size > 0) {
+		TRY( munmap((void*) input->data, input->size) );
+	}
+	return SUCCESS;
+}
+
+static int read_mapped_problem(const mapped_file_t *file, bool allocate,
+			       uint32_t n_threads, vtsp_points_t *output)
+{
+	file_header_t header;
+	TRY( scan_header(file, "TSP", LINE_NODE_COORD_SECTION, &header) );
+	uint32_t n = header.dimension;
+	THROW( n == 0, ERROR );
+
+	if (allocate) {
+		TRY_PTR( malloc(n * sizeof(*(output->pts))), output->pts,
+			 ERROR_MALLOC );
+		output->n_alloc = n;
+	}
+	THROW( output->n_alloc < n, ERROR );
+	output->num = n;
+
+	uint64_t *bitmap;
+	TRY_PTR( calloc(n / 64 + 1, sizeof(*bitmap)), bitmap, ERROR_BITMAP );
+	int status = scan_coords(file->data + header.data_offset,
+				 file->data + file->size, n_threads,
+				 output, bitmap);
+	free(bitmap);
+	if (status == SUCCESS) {
+		return SUCCESS;
+	}
+
+ERROR_BITMAP:
+	if (allocate) {
+		free(output->pts);
+	}
+ERROR_MALLOC:
+	TRY( log_flush(stderr, "Error reading coordinates") );
+	return ERROR;
+}
+
+static int read_mapped_tour(const mapped_file_t *file, vtsp_perm_t *output)
+{
+	file_header_t header;
+	TRY( scan_header(file, "TOUR", LINE_TOUR_SECTION, &header) );
+	/* Without DIMENSION the tour may use the whole allocation */
+	uint32_t bound = header.dimension ? header.dimension : output->n_alloc;
+	THROW( output->n_alloc < bound, ERROR );
+
+	uint64_t *bitmap;
+	TRY_PTR( calloc(bound / 64 + 1, sizeof(*bitmap)), bitmap, ERROR_BITMAP );
+	int status = scan_tour(file->data + header.data_offset,
+			       file->data + file->size, bound, output, bitmap);
+	free(bitmap);
+	/* With DIMENSION every node must be visited */
+	if (status == SUCCESS &&
+	    (header.dimension == 0 || output->num == header.dimension)) {
+		return SUCCESS;
+	}
+
+ERROR_BITMAP:
+	TRY( log_flush(stderr, "Error reading tour") );
+	return ERROR;
+}
+
+static int scan_header(const mapped_file_t *file, const char *type,
+		       int section, file_header_t *output)
+{
+	const char *p = file->data;
+	const char *end = file->data + file->size;
+	output->type = type;
+	output->section = section;
+	output->dimension = 0;
+	while (p < end) {
+		const char *eol = memchr(p, '\n', end - p);
+		if (eol == NULL) {
+			eol = end;
+		}
+		bool section_start = false;
+		TRY( read_header_line(p, eol - p, output, &section_start) );
+		p = eol < end ? eol + 1 : end;
+		if (section_start) {
+			output->data_offset = p - file->data;
+			return SUCCESS;
+		}
+	}
+	return ERROR; /* No data section */
+}
+
+static int read_header_line(const char *line, uint32_t len,
+			    file_header_t *output, bool *section_start)
+{
+	char buffer[255];
 	char *lpart, *rpart;
 	uint32_t llen, rlen;
 	int type;
-	int val;
-	while ((status = get_line(fp, 255, line, &len)) == 0) {
-		TRY( split_str(line, len, ':', &lpart, &llen, &rpart, &rlen) );
-		TRY( get_line_type(lpart, llen, &type) );
-		if (type == LINE_DIMENSION) {
-			TRY(  parse_int(rpart, &val) );
-			THROW ( val <= 0, 10 ); /* Error: Invalid dimension */
-			*output = val;
-			return SUCCESS;
+	if (len > 0 && line[len - 1] == '\r') {
+		len --;
+	}
+	if (len > 254) {
+		len = 254; /* Only keywords matter, comments are cut */
+	}
+	TRY( copy_str(line, len, buffer, 254) );
+	TRY( split_str(buffer, len, ':', &lpart, &llen, &rpart, &rlen) );
+	if (llen == 0) {
+		return SUCCESS; /* Blank line */
+	}
+	TRY( get_line_type(lpart, llen, &type) );
+	rpart[rlen] = 0;
+	switch (type) {
+	case LINE_NAME:
+		TRY( log_name(rpart) );
+		break;
+	case LINE_TYPE:
+		TRY( validate_type(rpart, output->type) );
+		break;
+	case LINE_COMMENT:
+		TRY( log_comment(rpart) );
+		break;
+	case LINE_DIMENSION: {
+		int val;
+		TRY( parse_int(rpart, &val) );
+		THROW( val <= 0, ERROR );
+		output->dimension = val;
+		break;
+	}
+	case LINE_EDGE_WEIGHT_TYPE:
+		TRY( validate_type(rpart, "EUC_2D") );
+		break;
+	case LINE_NODE_COORD_SECTION:
+	case LINE_TOUR_SECTION:
+		*section_start = (type == output->section);
+		break;
+	default:
+		TRY( log_ignored_line(buffer) );
+		break;
+	}
+	return SUCCESS;
+}
+
+static int scan_coords(const char *begin, const char *end,
+		       uint32_t n_threads, vtsp_points_t *output,
+		       uint64_t *bitmap)
+{
+	/* Split the section at line starts, one chunk per thread */
+	uint32_t n = get_n_threads(n_threads, end - begin);
+	size_t step = (end - begin) / n;
+	coords_chunk_t chunks[MAX_THREADS];
+	pthread_t threads[MAX_THREADS];
+	bool spawned[MAX_THREADS];
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		chunks[i].begin = line_start(begin + i * step, begin, end);
+		chunks[i].end = end;
+		chunks[i].file_end = end;
+		chunks[i].output = output;
+		chunks[i].bitmap = bitmap;
+		if (i > 0) {
+			chunks[i - 1].end = chunks[i].begin;
 		}
 	}
-	THROW ( status > 0, status );
 
-	return ERROR;
+	for (i = 1; i < n; i++) {
+		spawned[i] = (pthread_create(&(threads[i]), NULL,
+					     scan_chunk_task, &(chunks[i])) == 0);
+		if (!spawned[i]) {
+			scan_chunk_task(&(chunks[i]));
+		}
+	}
+	scan_chunk_task(&(chunks[0]));
+	for (i = 1; i < n; i++) {
+		if (spawned[i]) {
+			pthread_join(threads[i], NULL);
+		}
+	}
+
+	/* The section ends at the first line that is not a coordinate,
+	 * later chunks only hold the trailing keywords */
+	uint32_t n_read = 0;
+	bool stopped = false;
+	for (i = 0; i < n; i++) {
+		TRY( chunks[i].status );
+		THROW( stopped && chunks[i].n_read > 0, ERROR );
+		n_read += chunks[i].n_read;
+		stopped = stopped || chunks[i].stopped;
+	}
+	/* No repeated index, so every node was read */
+	THROW( n_read != output->num, ERROR );
+	return SUCCESS;
 }
 
-static int read_problem(FILE *fp, vtsp_points_t *output)
+static uint32_t get_n_threads(uint32_t n_threads, size_t size)
 {
-	char line[255];
-	uint32_t len;
-	int status;
-	int sum_check = 0;
-	int n_read = 0;
-	bool reading_coords = false;
-	while ((status = get_line(fp, 255, line, &len)) == 0) {
-		if (reading_coords) {
-			int i;
-			TRY( read_coordinates(line, len, output, &i) );
-
-			n_read ++;
-			sum_check += (i + 1);
-			
-			if (n_read >= output->num) {
-				reading_coords = false;
-			}
-		} else {
-			TRY( read_problem_metadata(line, len, &reading_coords,
-						   output) );
-		}
+	if (n_threads == 0) {
+		long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+		n_threads = n_cores > 0 ? n_cores : 1;
+	}
+	size_t max_threads = size / MIN_BYTES_PER_THREAD + 1;
+	if (n_threads > max_threads) {
+		n_threads = max_threads;
+	}
+	return n_threads < MAX_THREADS ? n_threads : MAX_THREADS;
+}
+
+static const char *line_start(const char *p, const char *begin,
+			      const char *end)
+{
+	if (p == begin || p[-1] == '\n') {
+		return p;
 	}
-	THROW( reading_coords, ERROR );
-	THROW( status > 0, status );
+	return skip_line(p, end);
+}
 
-	int expected_sum_check = (1 + output->num) * (output->num) / 2;
-	THROW( sum_check != expected_sum_check, ERROR );
+static void *scan_chunk_task(void *chunk)
+{
+	coords_chunk_t *ctx = chunk;
+	ctx->n_read = 0;
+	ctx->stopped = false;
+	ctx->status = scan_chunk(ctx);
+	return NULL;
+}
 
+static int scan_chunk(coords_chunk_t *chunk)
+{
+	/* Lines "index x y" until a keyword (EOF) or the end of chunk */
+	const char *p = chunk->begin;
+	const char *end = chunk->file_end;
+	vtsp_points_t *output = chunk->output;
+	while (1) {
+		p = skip_spaces(p, end);
+		if (p >= chunk->end) {
+			break;
+		}
+		if (*p < '0' || *p > '9') {
+			chunk->stopped = true;
+			break;
+		}
+		uint32_t i;
+		float x, y;
+		TRY( scan_uint(&p, end, &i) );
+		TRY( scan_float(&p, end, &x) );
+		TRY( scan_float(&p, end, &y) );
+		THROW( i == 0 || i > output->num, ERROR );
+		TRY( bitmap_test_and_set(chunk->bitmap, i - 1) );
+
+		output->pts[i - 1].x = x;
+		output->pts[i - 1].y = y;
+		chunk->n_read ++;
+		p = skip_line(p, end);
+	}
 	return SUCCESS;
 }
 
+static int scan_tour(const char *begin, const char *end, uint32_t bound,
+		     vtsp_perm_t *output, uint64_t *bitmap)
+{
+	/* Node numbers in any layout, ended by -1, EOF or the end of file */
+	const char *p = skip_spaces(begin, end);
+	uint32_t n_read = 0;
+	uint32_t max = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		uint32_t j;
+		TRY( scan_uint(&p, end, &j) );
+		THROW( j == 0 || j > bound, ERROR );
+		TRY( bitmap_test_and_set(bitmap, j - 1) );
+
+		output->index[n_read++] = j - 1;
+		if (j > max) {
+			max = j;
+		}
+		p = skip_spaces(p, end);
+	}
+	/* No repeated node, so the tour is a permutation */
+	THROW( max != n_read, ERROR );
+	output->num = n_read;
+	return SUCCESS;
+}
 
-static int read_tour(FILE *fp, vtsp_perm_t *output)
+static const char *skip_blanks(const char *p, const char *end)
 {
-	char line[255];
-	uint32_t len;
-	int status;
-	int sum_check = 0;
-	int i = 0;
-	bool reading_tour = false;
-	while ((status = get_line(fp, 255, line, &len)) == 0) {
-		if (reading_tour) {
-			int j = 0;
-			TRY( read_tour_point(line, len, output, i, &j) );
-
-			i ++;
-			sum_check += (j + 1);
-			if (i >= output-> num || j < 0) {
-				reading_tour = false;
-			}
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		p ++;
+	}
+	return p;
+}
+
+static const char *skip_spaces(const char *p, const char *end)
+{
+	while (p < end && isspace((unsigned char) *p)) {
+		p ++;
+	}
+	return p;
+}
+
+static const char *skip_line(const char *p, const char *end)
+{
+	const char *eol = memchr(p, '\n', end - p);
+	return eol ? eol + 1 : end;
+}
+
+static int scan_uint(const char **p, const char *end, uint32_t *output)
+{
+	const char *c = skip_blanks(*p, end);
+	uint64_t val = 0;
+	const char *first = c;
+	while (c < end && *c >= '0' && *c <= '9') {
+		val = val * 10 + (*c - '0');
+		THROW( val > UINT32_MAX, ERROR );
+		c ++;
+	}
+	THROW( c == first, ERROR );
+	*output = (uint32_t) val;
+	*p = c;
+	return SUCCESS;
+}
+
+static int scan_float(const char **p, const char *end, float *output)
+{
+	/* [sign] digits [. digits] [e|E [sign] digits] */
+	static const double POW10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+		1e21, 1e22
+	};
+	const char *c = skip_blanks(*p, end);
+	bool negative = false;
+	if (c < end && (*c == '-' || *c == '+')) {
+		negative = (*c == '-');
+		c ++;
+	}
+
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	int n_digits = 0;
+	for (; c < end && *c >= '0' && *c <= '9'; c++, n_digits++) {
+		if (mantissa < 100000000000000000ULL) {
+			mantissa = mantissa * 10 + (*c - '0');
 		} else {
-			TRY( read_tour_metadata(line, len, &reading_tour,
-						output) );
+			exponent ++; /* Beyond double precision */
 		}
 	}
-	THROW( reading_tour, ERROR );
-	THROW( status > 0, status );
+	if (c < end && *c == '.') {
+		for (c++; c < end && *c >= '0' && *c <= '9'; c++, n_digits++) {
+			if (mantissa < 100000000000000000ULL) {
+				mantissa = mantissa * 10 + (*c - '0');
+				exponent --;
+			}
+		}
+	}
+	THROW( n_digits == 0, ERROR );
+
+	if (c < end && (*c == 'e' || *c == 'E')) {
+		c ++;
+		bool negative_exp = false;
+		if (c < end && (*c == '-' || *c == '+')) {
+			negative_exp = (*c == '-');
+			c ++;
+		}
+		int exp = 0;
+		const char *first = c;
+		for (; c < end && *c >= '0' && *c <= '9'; c++) {
+			if (exp < 1000) {
+				exp = exp * 10 + (*c - '0');
+			}
+		}
+		THROW( c == first, ERROR );
+		exponent += negative_exp ? -exp : exp;
+	}
 
-	int expected_sum_check = (1 + output->num) * (output->num) / 2;
-	THROW( sum_check != expected_sum_check, ERROR );
+	double val = (double) mantissa;
+	while (exponent > 22) {
+		val *= 1e22;
+		exponent -= 22;
+	}
+	while (exponent < -22) {
+		val /= 1e22;
+		exponent += 22;
+	}
+	val = exponent >= 0 ? val * POW10[exponent] : val / POW10[-exponent];
 
+	*output = (float) (negative ? -val : val);
+	*p = c;
+	return SUCCESS;
+}
+
+static int bitmap_test_and_set(uint64_t *bitmap, uint32_t i)
+{
+	/* Atomic, coordinate chunks share the bitmap */
+	uint64_t mask = (uint64_t) 1 << (i % 64);
+	uint64_t old = __atomic_fetch_or(&(bitmap[i / 64]), mask,
+					 __ATOMIC_RELAXED);
+	THROW( old & mask, ERROR ); /* Repeated index */
 	return SUCCESS;
 }
 
@@ -259,7 +638,8 @@ static int write_tour(FILE *fp, const char *name, const vtsp_perm_t *input)
 
 	int i;
 	for (i = 0; i < input->num; i++) {
-		TRY_NONEG( fprintf(fp, "%u\n", input->index[i]), ERROR );
+		/* TSPLIB numbers nodes from 1 */
+		TRY_NONEG( fprintf(fp, "%u\n", input->index[i] + 1), ERROR );
 	}
 	TRY_NONEG( fprintf(fp, "%i\n", -1), ERROR );
 	
@@ -272,37 +652,14 @@ ERROR:
 	return ERROR;
 }
 
-static int get_line(FILE *fp, uint32_t max_len, char *line, uint32_t *len)
-{
-	/* Max size must be 2 chars longer than max line,
-	 * to handle 'new line' and null character.
-	 */
-	memset(line, 0, max_len);
-	char *out = fgets(line, max_len, fp);
-
-	if (out == 0) {
-		if(feof(fp)) {
-			return -1; /* End of file */
-		} else {
-			return 1; /* Error: while reading */
-		}
-	}
-
-	*len = strlen(line) - 1;
-
-	THROW( line[*len] != '\n', 2 ); /* Error: Line longer than max_size*/
-	
-	line[*len] = 0; /* Remove 'new line ' */
-	return SUCCESS;
-}
-
 static int get_line_type(const char* line, uint32_t len, int *type)
 {
 	int types_len = sizeof(LINE_TYPES) / sizeof(line_t);
 	int i = 0;
 
 	for (i = 0; i < types_len; i++) {
-		if (strncmp(LINE_TYPES[i].name, line, len) == 0) {
+		if (strlen(LINE_TYPES[i].name) == len &&
+		    strncmp(LINE_TYPES[i].name, line, len) == 0) {
 			*type = LINE_TYPES[i].type;
 			return SUCCESS;
 		}
@@ -321,6 +678,7 @@ static int get_string_of_line_type(int type, char *output, int max_len)
 		if (type == LINE_TYPES[i].type) {
 			strncpy(output, LINE_TYPES[i].name, max_len);
 			output[max_len] = 0; /* Null terminate */
+			return SUCCESS;
 		}
 	}
 	output[0] = 0; /* Not found */
@@ -382,63 +740,6 @@ static int parse_int(const char* input, int *output)
 	return SUCCESS;
 }
 
-static int parse_float(const char* input, float *output)
-{
-	*output = strtof(input, 0);
-	return SUCCESS;
-}
-
-static int read_coordinates(const char *line, uint32_t len, vtsp_points_t *output,
-			    int *pos)
-{
-	char *lpart, *rpart;
-	uint32_t llen, rlen;
-	char tmp_str[20];
-
-	/* Split "position coordinates" */
-	TRY( split_str((char*)line, len, ' ', &lpart, &llen, &rpart, &rlen) );
-
-	TRY( copy_str(lpart, llen, tmp_str, 19) );
-	TRY( parse_int(tmp_str, pos) );
-	*pos = (*pos) - 1;
-
-	THROW( *pos >= output->num, ERROR );
-	
-	/* Split coordinates */
-	char *xs, *ys;
-	uint32_t lxs, lys;
-	TRY( split_str(rpart, rlen, ' ', &xs, &lxs, &ys, &lys) );
-
-	float x, y;
-	TRY( copy_str(xs, lxs, tmp_str, 19) );
-	TRY( parse_float(tmp_str, &x) );
-	
-	TRY( copy_str(ys, lys, tmp_str, 19) );
-	TRY( parse_float(tmp_str, &y) );
-
-	output->pts[*pos].x = x;
-	output->pts[*pos].y = y;
-	
-	return SUCCESS;
-}
-
-static int read_tour_point(const char *line, uint32_t len, vtsp_perm_t *output,
-			   int i, int *pos)
-{
-	char tmp_str[20];
-	TRY( copy_str(line, len, tmp_str, 19) );
-	TRY( parse_int(tmp_str, pos) );
-	*pos = (*pos) - 1;
-
-	THROW( *pos >= output->num, ERROR );
-
-	if (*pos >= 0) {
-		output->index[i] = *pos;
-	}
-	
-	return SUCCESS;
-}
-
 static int copy_str(const char* input, int input_len, char *output, int max_len)
 {
 	THROW( input_len > max_len, ERROR );
@@ -449,84 +750,12 @@ static int copy_str(const char* input, int input_len, char *output, int max_len)
 	return SUCCESS;
 }
 
-static int read_problem_metadata(const char *line, uint32_t len,
-				 bool *reading_coords, vtsp_points_t *output)
-{
-	char *lpart, *rpart;
-	uint32_t llen, rlen;
-	int type;
-	TRY( split_str((char*)line, len, ':', &lpart, &llen, &rpart, &rlen) );
-	TRY( get_line_type(lpart, llen, &type) );
-	switch (type) {
-	case LINE_NAME:
-		TRY( log_name(rpart) );
-		break;
-	case LINE_TYPE:
-		TRY( validate_type(rpart, "TSP") );
-		break;
-	case LINE_COMMENT:
-		TRY( log_comment(rpart) );
-		break;
-	case LINE_DIMENSION:
-		TRY( get_problem_dimension(rpart, output) );
-		break;
-	case LINE_EDGE_WEIGHT_TYPE:
-		TRY( validate_type(rpart, "EUC_2D") );
-		break;
-	case LINE_NODE_COORD_SECTION:
-		*reading_coords = true;
-		break;
-	case LINE_EOF:
-		*reading_coords = false;
-		break;
-	case LINE_UNKNOWN:
-	default:
-		TRY( log_ignored_line(line) );
-		break;
-	}
-	return SUCCESS;
-}
-
-
-static int read_tour_metadata(const char *line, uint32_t len,
-			      bool *reading_tour, vtsp_perm_t *output)
-{
-	char *lpart, *rpart;
-	uint32_t llen, rlen;
-	int type;
-	TRY( split_str((char*)line, len, ':', &lpart, &llen, &rpart, &rlen) );
-	TRY( get_line_type(lpart, llen, &type) );
-	switch (type) {
-	case LINE_NAME:
-		TRY( log_name(rpart) );
-		break;
-	case LINE_TYPE:
-		TRY( validate_type(rpart, "TOUR") );
-		break;
-	case LINE_COMMENT:
-		TRY( log_comment(rpart) );
-		break;
-	case LINE_DIMENSION:
-		TRY( get_tour_dimension(rpart, output) );
-		break;
-	case LINE_TOUR_SECTION:
-		*reading_tour = true;
-		break;
-	case LINE_EOF:
-		*reading_tour = false;
-		break;
-	case LINE_UNKNOWN:
-	default:
-		TRY( log_ignored_line(line) );
-		break;
-	}
-	return SUCCESS;
-}
 
 static int log_name(const char *name)
 {
 	char message[255];
-	TRY_NONEG( sprintf(message, "Reading TSP file: \"%s\"", name), ERROR);
+	TRY_NONEG( snprintf(message, sizeof(message), "Reading TSP file: \"%s\"",
+			    name), ERROR );
 	TRY( log_flush(stdout, message) );
 	return SUCCESS;
 ERROR:
@@ -543,7 +772,8 @@ static int validate_type(const char* type, const char *expected_type)
 static int log_comment(const char *comment)
 {
 	char message[255];
-	TRY_NONEG( sprintf(message, "Reading comment: \"%s\"", comment), ERROR);
+	TRY_NONEG( snprintf(message, sizeof(message), "Reading comment: \"%s\"",
+			    comment), ERROR );
 	TRY( log_flush(stdout, message) );
 	return SUCCESS;
 ERROR:
@@ -551,29 +781,11 @@ ERROR:
 	return ERROR;
 }
 
-static int get_problem_dimension(const char *dim, vtsp_points_t *output)
-{
-	int val;
-	TRY( parse_int(dim, &val) );
-	THROW( output->n_alloc < val, ERROR );
-	output->num = val;
-	return SUCCESS;
-}
-
-static int get_tour_dimension(const char *dim, vtsp_perm_t *output)
-{
-	int val;
-	TRY( parse_int(dim, &val) );
-	THROW( output->n_alloc < val, ERROR );
-	output->num = val;
-	return SUCCESS;
-}
-
-
 static int log_ignored_line(const char *line)
 {
 	char message[255];
-	TRY_NONEG( sprintf(message, "Ignored line \"%s\"", line), ERROR);
+	TRY_NONEG( snprintf(message, sizeof(message), "Ignored line \"%s\"",
+			    line), ERROR );
 	TRY( log_flush(stdout, message) );
 	return SUCCESS;
 ERROR:
@@ -7,6 +7,11 @@
 
 int vtsp_read_problem_npts(const char *input_filename, uint32_t *output);
 int vtsp_read_problem(const char *input_filename, vtsp_points_t *output);
+/* Read the problem in one pass, output->pts is allocated, free() it */
+int vtsp_load_problem(const char *input_filename, vtsp_points_t *output);
+/* Same, coordinates are parsed by n_threads (0 for all cores) */
+int vtsp_load_problem_threads(const char *input_filename, uint32_t n_threads,
+			      vtsp_points_t *output);
 int vtsp_read_tour(const char *input_filename, vtsp_perm_t *output);
 int vtsp_write_tour(const vtsp_perm_t *input, const char *output_filename);
 
@@ -0,0 +1,635 @@
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "delaunay_trg.h"
+#include "fem_heat.h"
+#include "triangular_mesh.h"
+
+#include "try_macros.h"
+#include "vtsp.h"
+#include "vtsp_bindings.h"
+
+
+#define OPMEM_ALIGN 64
+#define SPACING_CELL_PTS 2   /* Input points per cell of the spacing grid */
+#define NO_POINT UINT32_MAX
+
+/*
+ * Input points bucketed in a uniform grid, with the squared distance
+ * of each one to its nearest other input point.
+ */
+typedef struct {
+	const vtsp_points_t *pts;
+	uint32_t nx, ny;
+	float x0, y0;
+	float inv_cw, inv_ch;   /* Cells per unit of length */
+	float min_cell;         /* Smaller side of a cell */
+	uint32_t *cell_start;   /* nx * ny + 1, points of a cell in cell_pts */
+	uint32_t *cell_pts;
+	float *nn2;
+} spacing_t;
+
+/* What splits are decided from, for one mesh */
+typedef struct {
+	uint32_t max_nodes;
+	bool refine;
+	float ratio2;        /* Longest edge over local spacing, squared */
+	spacing_t spacing;
+} refine_job_t;
+
+static int bind_get_mesh_sizeof_opmem(void *ctx, const vtsp_points_t *input_pts,
+				      const vtsp_perm_t *input_envelope,
+				      const vtsp_mesh_t *output_ref,
+				      size_t *output);
+static int bind_get_mesh_sizeof_output(void *ctx,
+				       const vtsp_points_t *input_pts,
+				       const vtsp_perm_t *input_envelope,
+				       const vtsp_mesh_t *output_ref,
+				       size_t *output);
+static int bind_get_mesh(void* ctx, const vtsp_points_t *input_pts,
+			 const vtsp_perm_t *input_envelope,
+			 vtsp_mesh_t *output, void *op_mem);
+static int bind_solve_heat_sizeof_opmem(void *ctx, const vtsp_mesh_t *input,
+					size_t *output);
+static int bind_solve_heat(void* ctx, const vtsp_mesh_t *input,
+			   float input_temperature_vtx,
+			   vtsp_field_t *output, void *op_mem);
+static void cast_input_to_dms_solid(const vtsp_points_t *input_pts,
+				    const vtsp_perm_t *input_envelope,
+				    dms_sgm_t *sgm_mem, dms_solid_t *output);
+static void cast_input_to_dms_refiner(const vtsp_dms_ctx_t *ctx,
+				      const vtsp_points_t *input_pts,
+				      const vtsp_mesh_t *output_ref,
+				      refine_job_t *job,
+				      dms_extra_refine_t *output);
+static size_t spacing_sizeof(const vtsp_dms_ctx_t *ctx,
+			     const vtsp_points_t *input_pts);
+static void spacing_build(spacing_t *sp, const vtsp_points_t *input_pts,
+			  char **cursor);
+static uint32_t spacing_cell(const spacing_t *sp, float x, float y);
+static uint32_t spacing_nearest(const spacing_t *sp, float x, float y,
+				bool other, float *output);
+static float spacing_at(const spacing_t *sp, const float v[2]);
+static void cast_input_to_fem(const vtsp_mesh_t *input, float *node_values,
+			      fem_input_t *output);
+static size_t opmem_align(size_t size);
+static void *opmem_take(char **cursor, size_t size);
+
+static int opmem_dms_verify_solid(const dms_solid_t *input, void *op_mem);
+static int opmem_dms_get_mesh(const dms_solid_t *input,
+			      const dms_extra_refine_t *refine,
+			      void *output, void *op_mem);
+
+static int bind_should_split_trg(void *ctx, const dms_trg_ctx_t *in,
+				 bool* out);
+static int copy_mesh(const dms_xmesh_t *input, vtsp_mesh_t *output);
+static int hand_over_mesh(dms_xmesh_t *input, vtsp_mesh_t *output);
+static void copy_nbrs(const dms_trgs_t *trgs, uint32_t t, uint32_t *output);
+static bool trg_has_edge(const dms_trg_t *trg, uint32_t n1, uint32_t n2);
+static float dist2(const float a[2], const float b[2]);
+static int log_flush(FILE* fp, const char *msg);
+
+int vtsp_bind_dms_mesher(vtsp_binding_mesher_t *mesher, vtsp_dms_ctx_t *ctx)
+{
+	THROW( !(ctx->accuracy >= 0), ERROR ); /* NaN included */
+	mesher->ctx = ctx;
+	mesher->get_mesh_sizeof_opmem = &bind_get_mesh_sizeof_opmem;
+	mesher->get_mesh_sizeof_output = &bind_get_mesh_sizeof_output;
+	mesher->get_mesh = &bind_get_mesh;
+	return SUCCESS;
+}
+
+int vtsp_bind_fem_heat(vtsp_binding_heat_t *heat)
+{
+	heat->ctx = 0;
+	heat->solve_heat_sizeof_opmem = &bind_solve_heat_sizeof_opmem;
+	heat->solve_heat = &bind_solve_heat;
+	heat->update_heat = NULL;
+	return SUCCESS;
+}
+
+static int bind_get_mesh_sizeof_opmem(void *ctx, const vtsp_points_t *input_pts,
+				      const vtsp_perm_t *input_envelope,
+				      const vtsp_mesh_t *output_ref,
+				      size_t *output)
+{
+	/* Layout: dms output | segments | spacing | verify or mesh scratch */
+	dms_solid_t dms_solid;
+	cast_input_to_dms_solid(input_pts, input_envelope, NULL, &dms_solid);
+	refine_job_t job;
+	dms_extra_refine_t dms_refiner;
+	cast_input_to_dms_refiner(ctx, input_pts, output_ref, &job,
+				  &dms_refiner);
+
+	size_t sgm_size = input_envelope->num * sizeof(*(dms_solid.sgm.data));
+	uint32_t output_size, verify_size, mesh_size;
+	TRY( dms_get_mesh_sizeof_output(&dms_solid, &dms_refiner, &output_size) );
+	TRY( dms_verify_solid_sizeof_opmem(&dms_solid, &verify_size) );
+	TRY( dms_get_mesh_sizeof_opmem(&dms_solid, &dms_refiner, &mesh_size) );
+
+	*output = opmem_align(output_size) + opmem_align(sgm_size) +
+		spacing_sizeof(ctx, input_pts) +
+		opmem_align(verify_size > mesh_size ? verify_size : mesh_size);
+	return SUCCESS;
+}
+
+static int bind_get_mesh_sizeof_output(void *ctx,
+				       const vtsp_points_t *input_pts,
+				       const vtsp_perm_t *input_envelope,
+				       const vtsp_mesh_t *output_ref,
+				       size_t *output)
+{
+	/* The dms output heads op_mem, the mesh is handed over from there */
+	dms_solid_t dms_solid;
+	cast_input_to_dms_solid(input_pts, input_envelope, NULL, &dms_solid);
+	refine_job_t job;
+	dms_extra_refine_t dms_refiner;
+	cast_input_to_dms_refiner(ctx, input_pts, output_ref, &job,
+				  &dms_refiner);
+
+	uint32_t output_size;
+	TRY( dms_get_mesh_sizeof_output(&dms_solid, &dms_refiner, &output_size) );
+	*output = opmem_align(output_size);
+	return SUCCESS;
+}
+
+static int bind_get_mesh(void* ctx, const vtsp_points_t *input_pts,
+			 const vtsp_perm_t *input_envelope,
+			 vtsp_mesh_t *output, void *op_mem)
+{	
+	dms_solid_t dms_solid;
+	cast_input_to_dms_solid(input_pts, input_envelope, NULL, &dms_solid);
+	refine_job_t job;
+	dms_extra_refine_t dms_refiner;
+	cast_input_to_dms_refiner(ctx, input_pts, output, &job, &dms_refiner);
+	
+	uint32_t memsize;
+	TRY( dms_get_mesh_sizeof_output(&dms_solid, &dms_refiner, &memsize) );
+	char *cursor = op_mem;
+	void *dms_output = opmem_take(&cursor, memsize);
+	dms_sgm_t *sgm_mem = opmem_take(&cursor, input_envelope->num *
+					sizeof(*sgm_mem));
+	cast_input_to_dms_solid(input_pts, input_envelope, sgm_mem, &dms_solid);
+	if (job.refine) {
+		/* Read by should_split_trg while dms meshes */
+		spacing_build(&(job.spacing), input_pts, &cursor);
+	}
+	
+	TRY( log_flush(stdout, "GetMesh / Verify solid... ") );
+	TRY( opmem_dms_verify_solid(&dms_solid, cursor) );
+	
+	TRY( log_flush(stdout, "GetMesh / Calculate mesh... ") );
+	TRY( opmem_dms_get_mesh(&dms_solid, &dms_refiner, dms_output, cursor) );
+	
+	dms_xmesh_t *dms_xmesh;
+	TRY( dms_get_mesh_ref_output(dms_output, &dms_xmesh) );
+	
+	/* Without arrays of the caller the mesh stays in dms_output */
+	if (output->nodes.pts == NULL) {
+		TRY( log_flush(stdout, "GetMesh / Hand over output... ") );
+		TRY( hand_over_mesh(dms_xmesh, output) );
+		return SUCCESS;
+	}
+	TRY( log_flush(stdout, "GetMesh / Copy to output... ") );
+	TRY( copy_mesh(dms_xmesh, output) );
+	
+	return SUCCESS;
+}
+
+static int bind_solve_heat_sizeof_opmem(void *ctx, const vtsp_mesh_t *input,
+					size_t *output)
+{
+	/* Layout: node values | fem scratch */
+	fem_input_t fem_input;
+	cast_input_to_fem(input, NULL, &fem_input);
+
+	size_t values_size = input->nodes.num * sizeof(float);
+	uint32_t fem_size = 0;
+	TRY( fem_solve_heat_sizeof_opmem(&fem_input, &fem_size) );
+
+	*output = opmem_align(values_size) + opmem_align(fem_size);
+	return SUCCESS;
+}
+
+static int bind_solve_heat(void* ctx, const vtsp_mesh_t *input,
+			   float input_temperature_vtx,
+			   vtsp_field_t *output, void *op_mem)
+{
+	char *cursor = op_mem;
+	float *node_values = opmem_take(&cursor, input->nodes.num *
+					sizeof(*node_values));
+	uint32_t i;
+	for (i = 0; i < input->nodes.num; i++) {
+		node_values[i] = input_temperature_vtx;
+	}
+	
+	fem_input_t fem_input;
+	cast_input_to_fem(input, node_values, &fem_input);
+
+	TRY( log_flush(stdout, "SolveHeat / Solving... ") );
+	TRY( fem_solve_heat(&fem_input, output->values, cursor) );
+
+	return SUCCESS;
+}
+
+static void cast_input_to_dms_solid(const vtsp_points_t *input_pts,
+				    const vtsp_perm_t *input_envelope,
+				    dms_sgm_t *sgm_mem, dms_solid_t *output)
+{
+	output->vtx.num = input_pts->num;
+	output->vtx.data = (dms_point_t*) input_pts->pts;
+	output->holes.num = 0;
+	output->holes.data = NULL;
+
+	uint32_t nsgm = input_envelope->num;
+	output->sgm.num = nsgm;
+	output->sgm.n_alloc = nsgm;
+	output->sgm.data = sgm_mem;
+	if (sgm_mem == NULL) {
+		return; /* Only sizes are needed */
+	}
+
+	uint32_t i;
+	for (i = 0; i < nsgm; i++) {
+		output->sgm.data[i].p1 = input_envelope->index[i];
+		output->sgm.data[i].p2 = input_envelope->index[(i+1) % nsgm];
+	}
+}
+
+static void cast_input_to_dms_refiner(const vtsp_dms_ctx_t *ctx,
+				      const vtsp_points_t *input_pts,
+				      const vtsp_mesh_t *output_ref,
+				      refine_job_t *job,
+				      dms_extra_refine_t *output)
+{
+	/* Max nodes allocated for output, without refinement */
+	job->max_nodes = output_ref->nodes.n_alloc;
+	job->refine = ctx->accuracy > 0;
+	job->ratio2 = 0;
+	if (job->refine) {
+		/* Node budget, sizes follow it so they only need the counts */
+		double budget = input_pts->num * (1.0 + ctx->accuracy);
+		if (budget < job->max_nodes) {
+			job->max_nodes = (uint32_t) budget;
+		}
+		job->ratio2 = 4.0f / (ctx->accuracy * ctx->accuracy);
+	}
+	output->ctx = job;
+	output->max_nodes = job->max_nodes;
+	output->should_split_trg = &bind_should_split_trg;
+}
+
+static size_t spacing_sizeof(const vtsp_dms_ctx_t *ctx,
+			     const vtsp_points_t *input_pts)
+{
+	if (!(ctx->accuracy > 0)) {
+		return 0;
+	}
+	uint32_t max_cells = input_pts->num / SPACING_CELL_PTS + 1;
+	return opmem_align((max_cells + 1) * sizeof(uint32_t)) +
+		opmem_align(input_pts->num * sizeof(uint32_t)) +
+		opmem_align(input_pts->num * sizeof(float));
+}
+
+static void spacing_build(spacing_t *sp, const vtsp_points_t *input_pts,
+			  char **cursor)
+{
+	uint32_t n = input_pts->num;
+	float min_x = FLT_MAX, min_y = FLT_MAX;
+	float max_x = -FLT_MAX, max_y = -FLT_MAX;
+	uint32_t i, c;
+	for (i = 0; i < n; i++) {
+		const vtsp_point_t *p = &(input_pts->pts[i]);
+		min_x = p->x < min_x ? p->x : min_x;
+		min_y = p->y < min_y ? p->y : min_y;
+		max_x = p->x > max_x ? p->x : max_x;
+		max_y = p->y > max_y ? p->y : max_y;
+	}
+	float w = max_x > min_x ? max_x - min_x : 1.0f;
+	float h = max_y > min_y ? max_y - min_y : 1.0f;
+
+	/* About square cells, no more of them than spacing_sizeof counts */
+	uint32_t max_cells = n / SPACING_CELL_PTS + 1;
+	double nx = sqrt(max_cells * (double) w / h);
+	sp->nx = nx < 1.0 ? 1 : (nx > max_cells ? max_cells : (uint32_t) nx);
+	sp->ny = max_cells / sp->nx;
+	sp->pts = input_pts;
+	sp->x0 = min_x;
+	sp->y0 = min_y;
+	sp->inv_cw = sp->nx / w;
+	sp->inv_ch = sp->ny / h;
+	sp->min_cell = w / sp->nx < h / sp->ny ? w / sp->nx : h / sp->ny;
+	uint32_t n_cells = sp->nx * sp->ny;
+	sp->cell_start = opmem_take(cursor, (n_cells + 1) * sizeof(uint32_t));
+	sp->cell_pts = opmem_take(cursor, n * sizeof(uint32_t));
+	sp->nn2 = opmem_take(cursor, n * sizeof(float));
+
+	/* Counting sort of the points by cell */
+	for (c = 0; c <= n_cells; c++) {
+		sp->cell_start[c] = 0;
+	}
+	for (i = 0; i < n; i++) {
+		const vtsp_point_t *p = &(input_pts->pts[i]);
+		sp->cell_start[spacing_cell(sp, p->x, p->y) + 1] ++;
+	}
+	for (c = 0; c < n_cells; c++) {
+		sp->cell_start[c + 1] += sp->cell_start[c];
+	}
+	for (i = 0; i < n; i++) {
+		const vtsp_point_t *p = &(input_pts->pts[i]);
+		sp->cell_pts[sp->cell_start[spacing_cell(sp, p->x, p->y)]++] = i;
+	}
+	for (c = n_cells; c > 0; c--) {
+		sp->cell_start[c] = sp->cell_start[c - 1];
+	}
+	sp->cell_start[0] = 0;
+
+	for (i = 0; i < n; i++) {
+		const vtsp_point_t *p = &(input_pts->pts[i]);
+		spacing_nearest(sp, p->x, p->y, true, &(sp->nn2[i]));
+	}
+}
+
+static uint32_t spacing_cell(const spacing_t *sp, float x, float y)
+{
+	float fx = (x - sp->x0) * sp->inv_cw;
+	float fy = (y - sp->y0) * sp->inv_ch;
+	uint32_t i = fx <= 0.0f ? 0 : (fx >= sp->nx ? sp->nx - 1 : (uint32_t) fx);
+	uint32_t j = fy <= 0.0f ? 0 : (fy >= sp->ny ? sp->ny - 1 : (uint32_t) fy);
+	return j * sp->nx + i;
+}
+
+static uint32_t spacing_nearest(const spacing_t *sp, float x, float y,
+				bool other, float *output)
+{
+	/*
+	 * Ring after ring of cells around the one of (x, y), a point in
+	 * ring r is at least r - 1 cells away. other skips the points at
+	 * (x, y) itself, so duplicates do not count as neighbors.
+	 */
+	uint32_t c = spacing_cell(sp, x, y);
+	int64_t cx = c % sp->nx, cy = c / sp->nx;
+	int64_t r_max = sp->nx > sp->ny ? sp->nx : sp->ny;
+	uint32_t best = NO_POINT;
+	float best_d2 = FLT_MAX;
+	int64_t r, i, j;
+	for (r = 0; r <= r_max; r++) {
+		float reach = (r - 1) * sp->min_cell;
+		if (r > 1 && best != NO_POINT && reach * reach >= best_d2) {
+			break;
+		}
+		for (j = cy - r; j <= cy + r; j++) {
+			if (j < 0 || j >= sp->ny) {
+				continue;
+			}
+			bool edge_row = j == cy - r || j == cy + r;
+			int64_t step = edge_row || r == 0 ? 1 : 2 * r;
+			for (i = cx - r; i <= cx + r; i += step) {
+				if (i < 0 || i >= sp->nx) {
+					continue;
+				}
+				uint32_t cell = (uint32_t) (j * sp->nx + i);
+				uint32_t k;
+				for (k = sp->cell_start[cell];
+				     k < sp->cell_start[cell + 1]; k++) {
+					uint32_t q = sp->cell_pts[k];
+					const vtsp_point_t *p = &(sp->pts->pts[q]);
+					float dx = p->x - x;
+					float dy = p->y - y;
+					float d2 = dx * dx + dy * dy;
+					if ((d2 > 0.0f || !other) && d2 < best_d2) {
+						best = q;
+						best_d2 = d2;
+					}
+				}
+			}
+		}
+	}
+	*output = best_d2;
+	return best;
+}
+
+static float spacing_at(const spacing_t *sp, const float v[2])
+{
+	/*
+	 * Squared spacing of the input around v: the distance from its
+	 * nearest input point to the next one, or to v when v is further.
+	 */
+	float d2;
+	uint32_t p = spacing_nearest(sp, v[0], v[1], false, &d2);
+	if (p == NO_POINT) {
+		return FLT_MAX;
+	}
+	return d2 > sp->nn2[p] ? d2 : sp->nn2[p];
+}
+
+static void cast_input_to_fem(const vtsp_mesh_t *input, float *node_values,
+			      fem_input_t *output)
+{
+	fem_cond_t fem_cond;
+	fem_cond.temp.on_nodes.n = input->map_vtx.num;
+	fem_cond.temp.on_nodes.index = input->map_vtx.index;
+	fem_cond.temp.on_nodes.values = node_values;
+	fem_cond.temp.on_edges.n = 0;
+	fem_cond.temp.on_edges.edges = 0;
+	fem_cond.temp.on_edges.values = 0;
+	fem_cond.flux.on_nodes.n = 0;
+	fem_cond.flux.on_nodes.index = 0;
+	fem_cond.flux.on_nodes.values = 0;
+	fem_cond.flux.on_edges.n = 0;
+	fem_cond.flux.on_edges.edges = 0;
+	fem_cond.flux.on_edges.values = 0;
+	
+	fem_mesh_t fem_mesh;
+	fem_mesh.n_nodes = input->nodes.num;
+	fem_mesh.nodes = (fem_node_t*) input->nodes.pts;
+	fem_mesh.n_elems = input->adj.num;
+	fem_mesh.elems = (fem_elem_t*) input->adj.trgs;
+	
+	output->diffusion = 1.0f;
+	output->mesh = fem_mesh;
+	output->cond = fem_cond;
+}
+
+static size_t opmem_align(size_t size)
+{
+	return (size + OPMEM_ALIGN - 1) & ~((size_t) OPMEM_ALIGN - 1);
+}
+
+static void *opmem_take(char **cursor, size_t size)
+{
+	void *ptr = *cursor;
+	*cursor += opmem_align(size);
+	return ptr;
+}
+
+static int opmem_dms_verify_solid(const dms_solid_t *input, void *op_mem)
+{
+	TRY( log_flush(stdout, "Verifying solid...") );
+	char error_msg[100];
+	TRY( dms_verify_solid(input, error_msg, op_mem) );
+	TRY( log_flush(stdout, error_msg) );
+	return SUCCESS;
+}
+
+static int opmem_dms_get_mesh(const dms_solid_t *input,
+			      const dms_extra_refine_t *refine,
+			      void *output, void *op_mem)
+{
+	TRY( log_flush(stdout, "Meshing solid with DMS...") );
+	TRY( dms_get_mesh(input, refine, output, op_mem) );
+	return SUCCESS;
+}
+
+static int bind_should_split_trg(void *ctx, const dms_trg_ctx_t *in, bool* out)
+{
+	/*
+	 * The heat is fixed at the input points, it varies most across
+	 * triangles large against the spacing of the points around them.
+	 * The spacing is the one of the coarsest corner, dense clusters
+	 * are refined as well as the empty space between them.
+	 */
+	const refine_job_t *job = (const refine_job_t*) ctx;
+	*out = false;
+	if (!job->refine || in->nnod >= job->max_nodes) {
+		return SUCCESS; /* Budget spent */
+	}
+	float e1 = dist2(in->n1, in->n2);
+	float e2 = dist2(in->n2, in->n3);
+	float e3 = dist2(in->n3, in->n1);
+	float longest = e1 > e2 ? e1 : e2;
+	longest = longest > e3 ? longest : e3;
+	float h1 = spacing_at(&(job->spacing), in->n1);
+	float h2 = spacing_at(&(job->spacing), in->n2);
+	float h3 = spacing_at(&(job->spacing), in->n3);
+	float spacing = h1 > h2 ? h1 : h2;
+	spacing = spacing > h3 ? spacing : h3;
+	*out = longest > job->ratio2 * spacing;
+	return SUCCESS;
+}
+
+static int copy_mesh(const dms_xmesh_t *input, vtsp_mesh_t *output)
+{
+	/* Copy nodes */
+	THROW( input->mesh.nodes.num > output->nodes.n_alloc, ERROR );
+	output->nodes.num = input->mesh.nodes.num;
+
+	uint32_t i = 0;
+	for (i = 0; i < output->nodes.num; i++) {
+		output->nodes.pts[i].x = input->mesh.nodes.data[i].x;
+		output->nodes.pts[i].y = input->mesh.nodes.data[i].y;
+	}
+
+	/* Copy triangles */
+	THROW( input->mesh.trgs.num > output->adj.n_alloc, ERROR );
+	output->adj.num = input->mesh.trgs.num;
+	for (i = 0; i < output->adj.num; i++ ) {
+		output->adj.trgs[i].n1 = input->mesh.trgs.data[i].n1;
+		output->adj.trgs[i].n2 = input->mesh.trgs.data[i].n2;
+		output->adj.trgs[i].n3 = input->mesh.trgs.data[i].n3;
+	}
+
+	/* Copy neighbors when there is room, vtsp_solve looks them up otherwise */
+	if (output->nbr.n_alloc >= 3 * output->adj.num) {
+		for (i = 0; i < output->adj.num; i++) {
+			copy_nbrs(&(input->mesh.trgs), i,
+				  &(output->nbr.index[3 * i]));
+		}
+		output->nbr.num = 3 * output->adj.num;
+	}
+
+	/* Copy vtx map */
+	THROW( input->map_vtx.num > output->map_vtx.n_alloc, ERROR );
+	output->map_vtx.num = input->map_vtx.num;
+	for (i = 0; i < output->map_vtx.num; i++) {
+		output->map_vtx.index[i] = input->map_vtx.index[i];
+	}
+	
+	return SUCCESS;
+}
+
+static int hand_over_mesh(dms_xmesh_t *input, vtsp_mesh_t *output)
+{
+	/* Nodes and vtx map share their layout, they are used in place */
+	THROW( sizeof(dms_point_t) != sizeof(vtsp_point_t), ERROR );
+	THROW( input->mesh.nodes.num > output->nodes.n_alloc, ERROR );
+	THROW( input->mesh.trgs.num > output->adj.n_alloc, ERROR );
+	THROW( input->map_vtx.num > output->map_vtx.n_alloc, ERROR );
+	output->nodes.num = input->mesh.nodes.num;
+	output->nodes.n_alloc = input->mesh.nodes.n_alloc;
+	output->nodes.pts = (vtsp_point_t*) input->mesh.nodes.data;
+	output->map_vtx.num = input->map_vtx.num;
+	output->map_vtx.n_alloc = input->map_vtx.n_alloc;
+	output->map_vtx.index = input->map_vtx.index;
+
+	/* Neighbors first, the triangles are compacted over themselves */
+	uint32_t n_trgs = input->mesh.trgs.num;
+	uint32_t i;
+	if (output->nbr.n_alloc >= 3 * n_trgs) {
+		for (i = 0; i < n_trgs; i++) {
+			copy_nbrs(&(input->mesh.trgs), i,
+				  &(output->nbr.index[3 * i]));
+		}
+		output->nbr.num = 3 * n_trgs;
+	}
+	vtsp_trg_t *trgs = (vtsp_trg_t*) input->mesh.trgs.data;
+	for (i = 0; i < n_trgs; i++) {
+		/* Triangle i only overwrites the ones before it */
+		vtsp_trg_t trg;
+		trg.n1 = input->mesh.trgs.data[i].n1;
+		trg.n2 = input->mesh.trgs.data[i].n2;
+		trg.n3 = input->mesh.trgs.data[i].n3;
+		trgs[i] = trg;
+	}
+	output->adj.num = n_trgs;
+	output->adj.n_alloc = input->mesh.trgs.n_alloc;
+	output->adj.trgs = trgs;
+	return SUCCESS;
+}
+
+static void copy_nbrs(const dms_trgs_t *trgs, uint32_t t, uint32_t *output)
+{
+	/* vtsp wants the neighbor across the edge opposite each corner */
+	const dms_trg_t *trg = &(trgs->data[t]);
+	uint32_t corner[3] = { trg->n1, trg->n2, trg->n3 };
+	uint32_t adj[3] = { trg->t1, trg->t2, trg->t3 };
+	uint32_t k, j;
+	for (k = 0; k < 3; k++) {
+		uint32_t a = corner[(k + 1) % 3];
+		uint32_t b = corner[(k + 2) % 3];
+		output[k] = VTSP_NO_TRG;
+		for (j = 0; j < 3; j++) {
+			if (adj[j] != (uint32_t) DMS_NO_ADJ && adj[j] < trgs->num &&
+			    trg_has_edge(&(trgs->data[adj[j]]), a, b)) {
+				output[k] = adj[j];
+			}
+		}
+	}
+}
+
+static bool trg_has_edge(const dms_trg_t *trg, uint32_t n1, uint32_t n2)
+{
+	bool has_n1 = trg->n1 == n1 || trg->n2 == n1 || trg->n3 == n1;
+	bool has_n2 = trg->n1 == n2 || trg->n2 == n2 || trg->n3 == n2;
+	return has_n1 && has_n2;
+}
+
+static float dist2(const float a[2], const float b[2])
+{
+	float dx = a[0] - b[0];
+	float dy = a[1] - b[1];
+	return dx * dx + dy * dy;
+}
+
+static int log_flush(FILE* fp, const char *msg)
+{
+	TRY_NONEG( fprintf(fp, "%s\n", msg), ERROR );
+	TRY_GOTO( fflush(fp), ERROR );
+	return SUCCESS;
+ERROR:
+	return ERROR;
+}
@@ -0,0 +1,23 @@
+#ifndef __VTSP_BINDINGS__
+#define __VTSP_BINDINGS__
+
+#include "vtsp.h"
+
+/*
+ * Refinement of the dms mesh, trading heat accuracy for mesh size.
+ * A triangle is split while its longest edge is over twice the local
+ * spacing divided by accuracy. The spacing at a corner is the distance
+ * from its nearest input point to the next one, or to the corner when
+ * further, and the coarsest corner counts. The split adds at most
+ * accuracy nodes per input point, within the room of the mesh.
+ * 0 keeps the bare triangulation of the points.
+ */
+typedef struct {
+	float accuracy;
+} vtsp_dms_ctx_t;
+
+/* Mesher and heat bindings shared by tests and benchmarks */
+int vtsp_bind_dms_mesher(vtsp_binding_mesher_t *mesher, vtsp_dms_ctx_t *ctx);
+int vtsp_bind_fem_heat(vtsp_binding_heat_t *heat);
+
+#endif
@@ -49,7 +49,36 @@ int vtsp_fill_background(vtsp_graphics_t *ctx) {
 }
 
 int vtsp_draw_field(vtsp_graphics_t *ctx, const vtsp_mesh_t *mesh, const vtsp_field_t *field) {
-	// PENDING
+	if (mesh->locator == NULL || field->num == 0) {
+		return SUCCESS;
+	}
+
+	float lo = field->values[0];
+	float hi = lo;
+	uint32_t i;
+	for (i = 1; i < field->num; i++) {
+		lo = field->values[i] < lo ? field->values[i] : lo;
+		hi = field->values[i] > hi ? field->values[i] : hi;
+	}
+	double range = hi > lo ? hi - lo : 1.0;
+
+	/* A sample per pixel, pixels off the mesh keep the background */
+	uint32_t x, y;
+	for (y = 0; y < ctx->h; y++) {
+		for (x = 0; x < ctx->w; x++) {
+			vtsp_point_t p;
+			p.x = x + 0.5f;
+			p.y = y + 0.5f;
+			double value;
+			if (vtsp_field_at(mesh->locator, field, &p, &value) != SUCCESS) {
+				continue;
+			}
+			double t = (value - lo) / range;
+			cairo_set_source_rgb(ctx->cr, t, 0.0, 1.0 - t);
+			cairo_rectangle(ctx->cr, x, y, 1, 1);
+			cairo_fill(ctx->cr);
+		}
+	}
 	return SUCCESS;
 }
 
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "try_macros.h"
+#include "tsp_bin.h"
+#include "tsp_io.h"
+
+#define MAX_FILENAME 4096
+
+static int convert(const char *input_filename);
+static int ends_with(const char *str, const char *suffix);
+
+/*
+ * Migrate TSPLIB files to the binary container in bulk:
+ *   vtsp_convert a280.tsp a280.opt.tour ...
+ * Every FILE is written next to it as FILE.vbin
+ */
+int main(int argc, const char* argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s FILE...\n", argv[0]);
+		return ERROR;
+	}
+
+	int n_failed = 0;
+	int i;
+	for (i = 1; i < argc; i++) {
+		if (convert(argv[i]) != SUCCESS) {
+			fprintf(stderr, "Error converting %s\n", argv[i]);
+			n_failed ++;
+		}
+	}
+	printf("Converted %i of %i files\n", argc - 1 - n_failed, argc - 1);
+	return n_failed > 0 ? ERROR : SUCCESS;
+}
+
+static int convert(const char *input_filename)
+{
+	char output_filename[MAX_FILENAME];
+	int len = snprintf(output_filename, MAX_FILENAME, "%s%s",
+			   input_filename, VTSP_BIN_EXT);
+	THROW( len < 0 || len >= MAX_FILENAME, ERROR );
+
+	if (ends_with(input_filename, ".tour")) {
+		TRY( vtsp_bin_convert_tour(input_filename, output_filename) );
+	} else {
+		TRY( vtsp_bin_convert_problem(input_filename, output_filename) );
+	}
+	return SUCCESS;
+}
+
+static int ends_with(const char *str, const char *suffix)
+{
+	size_t len = strlen(str);
+	size_t suffix_len = strlen(suffix);
+	return len >= suffix_len &&
+		strcmp(str + len - suffix_len, suffix) == 0;
+}